@@ -30,6 +30,7 @@
 #include "ev-document-links.h"
 #include "ev-selection.h"
 #include "ev-file-helpers.h"
+#include "ev-surface-pool.h"
 
 #include <glib.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -352,8 +353,9 @@ djvu_document_render (EvDocument      *document,
 			rotation = DDJVU_ROTATE_0;
 	}
 
-	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
-					      page_width, page_height);
+	/* DjVuLibre writes every pixel of the rectangle when it succeeds */
+	surface = ev_surface_pool_create_surface (CAIRO_FORMAT_RGB24,
+						  page_width, page_height, FALSE);
 	rowstride = cairo_image_surface_get_stride (surface);
 	pixels = (gchar *)cairo_image_surface_get_data (surface);
 
@@ -365,12 +367,15 @@ djvu_document_render (EvDocument      *document,
 
 	ddjvu_page_set_rotation (d_page, rotation);
 	
-	ddjvu_page_render (d_page, DDJVU_RENDER_COLOR,
-			   &prect,
-			   &rrect,
-			   djvu_document->d_format,
-			   rowstride,
-			   pixels);
+	if (!ddjvu_page_render (d_page, DDJVU_RENDER_COLOR,
+				&prect,
+				&rrect,
+				djvu_document->d_format,
+				rowstride,
+				pixels)) {
+		/* The buffer might come from any page rendered before */
+		memset (pixels, 0, rowstride * cairo_image_surface_get_height (surface));
+	}
 
 	cairo_surface_mark_dirty (surface);
 
@@ -25,6 +25,7 @@
 #endif
 
 #include "cairo-device.h"
+#include "ev-surface-pool.h"
 
 typedef struct {
 	cairo_t *cr;
@@ -32,6 +33,10 @@ typedef struct {
 	gint xmargin;
 	gint ymargin;
 
+	/* Size of the surface, or 0 for the size of the page */
+	gint width;
+	gint height;
+
 	gdouble scale;
 	
 	Ulong fg;
@@ -332,11 +337,19 @@ mdvi_cairo_device_render (DviContext* dvi)
 	if (cairo_device->cr)
 		cairo_destroy (cairo_device->cr);
 
-	page_width = dvi->dvi_page_w * dvi->params.conv + 2 * cairo_device->xmargin;
-	page_height = dvi->dvi_page_h * dvi->params.vconv + 2 * cairo_device->ymargin;
+	if (cairo_device->width > 0 && cairo_device->height > 0) {
+		page_width = cairo_device->width;
+		page_height = cairo_device->height;
+	} else {
+		page_width = dvi->dvi_page_w * dvi->params.conv + 2 * cairo_device->xmargin;
+		page_height = dvi->dvi_page_h * dvi->params.vconv + 2 * cairo_device->ymargin;
+	}
 
-	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
-                                              page_width, page_height);
+	/* The background is painted below, so the surface needs
+	 * neither alpha nor to be cleared
+	 */
+	surface = ev_surface_pool_create_surface (CAIRO_FORMAT_RGB24,
+						  page_width, page_height, FALSE);
 
 	cairo_device->cr = cairo_create (surface);
         cairo_surface_destroy (surface);
@@ -370,3 +383,16 @@ mdvi_cairo_device_set_scale (DviDevice *device,
 
 	cairo_device->scale = scale;
 }
+
+void
+mdvi_cairo_device_set_size (DviDevice *device,
+			    gint       width,
+			    gint       height)
+{
+	DviCairoDevice *cairo_device;
+
+	cairo_device = (DviCairoDevice *) device->device_data;
+
+	cairo_device->width = width;
+	cairo_device->height = height;
+}
@@ -35,6 +35,9 @@ void             mdvi_cairo_device_set_margins (DviDevice *device,
 						gint       ymargin);
 void             mdvi_cairo_device_set_scale   (DviDevice *device,
 						gdouble    scale);
+void             mdvi_cairo_device_set_size    (DviDevice *device,
+						gint       width,
+						gint       height);
 
 G_END_DECLS
 
@@ -189,6 +189,15 @@ dvi_document_render (EvDocument      *document,
 	    xmargin = (required_width - proposed_width) / 2;
 	if (required_height >= proposed_height)
 	    ymargin = (required_height - proposed_height) / 2;
+
+	/* When the page fits, render it at the final size, so that it
+	 * doesn't have to be scaled afterwards
+	 */
+	if (required_width >= proposed_width && required_height >= proposed_height)
+		mdvi_cairo_device_set_size (&dvi_document->context->device,
+					    required_width, required_height);
+	else
+		mdvi_cairo_device_set_size (&dvi_document->context->device, 0, 0);
 	    
 	mdvi_cairo_device_set_margins (&dvi_document->context->device, xmargin, ymargin);
 	mdvi_cairo_device_set_scale (&dvi_document->context->device, rc->scale);
@@ -54,6 +54,7 @@
 #include "ev-transition-effect.h"
 #include "ev-attachment.h"
 #include "ev-image.h"
+#include "ev-surface-pool.h"
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
@@ -99,7 +100,10 @@ struct _PdfDocument
 	EvDocument parent_instance;
 
 	PopplerDocument *document;
+	GMappedFile *mapped_file;
 	gchar *password;
+	gchar *permanent_id;
+	gchar *update_id;
 	gboolean forms_modified;
 	gboolean annots_modified;
 
@@ -189,10 +193,21 @@ pdf_document_dispose (GObject *object)
 		g_object_unref (pdf_document->document);
 	}
 
+	/* Must be released after the document reading from it */
+	if (pdf_document->mapped_file) {
+		g_mapped_file_unref (pdf_document->mapped_file);
+		pdf_document->mapped_file = NULL;
+	}
+
 	if (pdf_document->font_info) { 
 		poppler_font_info_free (pdf_document->font_info);
 	}
 
+	g_free (pdf_document->permanent_id);
+	pdf_document->permanent_id = NULL;
+	g_free (pdf_document->update_id);
+	pdf_document->update_id = NULL;
+
 	if (pdf_document->fonts_iter) {
 		poppler_fonts_iter_free (pdf_document->fonts_iter);
 	}
@@ -261,6 +276,29 @@ pdf_document_save (EvDocument  *document,
 	return retval;
 }
 
+/* Length of the IDs returned by poppler_document_get_id() */
+#define PDF_DOCUMENT_ID_LENGTH 32
+
+/* Keeps the IDs of the loaded document, so that search contexts opening
+ * the file again can tell whether it still is the same document without
+ * using the document from another thread
+ */
+static void
+pdf_document_store_id (PdfDocument *pdf_document)
+{
+	g_free (pdf_document->permanent_id);
+	pdf_document->permanent_id = NULL;
+	g_free (pdf_document->update_id);
+	pdf_document->update_id = NULL;
+
+	if (!poppler_document_get_id (pdf_document->document,
+				      &pdf_document->permanent_id,
+				      &pdf_document->update_id)) {
+		pdf_document->permanent_id = NULL;
+		pdf_document->update_id = NULL;
+	}
+}
+
 static gboolean
 pdf_document_load (EvDocument   *document,
 		   const char   *uri,
@@ -277,6 +315,45 @@ pdf_document_load (EvDocument   *document,
 		return FALSE;
 	}
 
+	pdf_document_store_id (pdf_document);
+
+	return TRUE;
+}
+
+static gboolean
+pdf_document_load_mapped (EvDocument   *document,
+			  GMappedFile  *mapped_file,
+			  GError      **error)
+{
+	GError *poppler_error = NULL;
+	PdfDocument *pdf_document = PDF_DOCUMENT (document);
+	gsize length;
+
+	length = g_mapped_file_get_length (mapped_file);
+	if (length > G_MAXINT) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "Document too large to be loaded from memory");
+		return FALSE;
+	}
+
+	/* Poppler reads the data in place, without copying it */
+	pdf_document->document =
+		poppler_document_new_from_data (g_mapped_file_get_contents (mapped_file),
+						(int) length,
+						pdf_document->password,
+						&poppler_error);
+
+	if (pdf_document->document == NULL) {
+		convert_error (poppler_error, error);
+		return FALSE;
+	}
+
+	if (pdf_document->mapped_file)
+		g_mapped_file_unref (pdf_document->mapped_file);
+	pdf_document->mapped_file = g_mapped_file_ref (mapped_file);
+
+	pdf_document_store_id (pdf_document);
+
 	return TRUE;
 }
 
@@ -302,6 +379,8 @@ pdf_document_load_stream (EvDocument          *document,
                 return FALSE;
         }
 
+        pdf_document_store_id (pdf_document);
+
         return TRUE;
 }
 #endif
@@ -328,6 +407,8 @@ pdf_document_load_gfile (EvDocument          *document,
                 return FALSE;
         }
 
+        pdf_document_store_id (pdf_document);
+
         return TRUE;
 }
 #endif
@@ -389,10 +470,17 @@ pdf_page_render (PopplerPage     *page,
 	cairo_surface_t *surface;
 	cairo_t *cr;
 
-	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
-					      width, height);
+	/* Pages are opaque, so poppler draws over the white background
+	 * like pdftocairo does, instead of over a cleared surface that
+	 * needs the background painted below afterwards
+	 */
+	surface = ev_surface_pool_create_surface (CAIRO_FORMAT_RGB24,
+						  width, height, FALSE);
 	cr = cairo_create (surface);
 
+	cairo_set_source_rgb (cr, 1., 1., 1.);
+	cairo_paint (cr);
+
 	switch (rc->rotation) {
 	        case 90:
 			cairo_translate (cr, width, 0);
@@ -410,10 +498,6 @@ pdf_page_render (PopplerPage     *page,
 	cairo_rotate (cr, rc->rotation * G_PI / 180.0);
 	poppler_page_render (page, cr);
 
-	cairo_set_operator (cr, CAIRO_OPERATOR_DEST_OVER);
-	cairo_set_source_rgb (cr, 1., 1., 1.);
-	cairo_paint (cr);
-
 	cairo_destroy (cr);
 
 	return surface;
@@ -939,6 +1023,7 @@ pdf_document_class_init (PdfDocumentClass *klass)
 
 	ev_document_class->save = pdf_document_save;
 	ev_document_class->load = pdf_document_load;
+	ev_document_class->load_mapped = pdf_document_load_mapped;
 #ifdef HAVE_POPPLER_DOCUMENT_NEW_FROM_STREAM
         ev_document_class->load_stream = pdf_document_load_stream;
 #endif
@@ -1556,24 +1641,17 @@ pdf_document_document_images_iface_init (EvDocumentImagesInterface *iface)
 }
 
 static GList *
-pdf_document_find_find_text_with_options (EvDocumentFind *document_find,
-					  EvPage         *page,
-					  const gchar    *text,
-					  EvFindOptions   options)
+pdf_document_find_poppler_page (PopplerPage   *poppler_page,
+				const gchar   *text,
+				EvFindOptions  options)
 {
 	GList *matches, *l;
-	PopplerPage *poppler_page;
 	gdouble height;
 	GList *retval = NULL;
 #ifdef HAVE_POPPLER_PAGE_FIND_TEXT_WITH_OPTIONS
 	guint find_flags = 0;
 #endif
 
-	g_return_val_if_fail (POPPLER_IS_PAGE (page->backend_page), NULL);
-	g_return_val_if_fail (text != NULL, NULL);
-
-	poppler_page = POPPLER_PAGE (page->backend_page);
-
 #ifdef HAVE_POPPLER_PAGE_FIND_TEXT_WITH_OPTIONS
 	if (options & EV_FIND_CASE_SENSITIVE)
 		find_flags |= POPPLER_FIND_CASE_SENSITIVE;
@@ -1607,6 +1685,19 @@ pdf_document_find_find_text_with_options (EvDocumentFind *document_find,
 	return g_list_reverse (retval);
 }
 
+static GList *
+pdf_document_find_find_text_with_options (EvDocumentFind *document_find,
+					  EvPage         *page,
+					  const gchar    *text,
+					  EvFindOptions   options)
+{
+	g_return_val_if_fail (POPPLER_IS_PAGE (page->backend_page), NULL);
+	g_return_val_if_fail (text != NULL, NULL);
+
+	return pdf_document_find_poppler_page (POPPLER_PAGE (page->backend_page),
+					       text, options);
+}
+
 static GList *
 pdf_document_find_find_text (EvDocumentFind *document_find,
 			     EvPage         *page,
@@ -1631,6 +1722,83 @@ pdf_document_find_get_supported_options (EvDocumentFind *document_find)
 #endif
 }
 
+/* Search contexts are private poppler documents, reading from the
+ * same mapped data when possible, so that they don't share any state
+ * with the document used for rendering.
+ */
+static gpointer
+pdf_document_find_create_context (EvDocumentFind *document_find)
+{
+	PdfDocument     *pdf_document = PDF_DOCUMENT (document_find);
+	PopplerDocument *context;
+	const gchar     *uri;
+	gchar           *permanent_id;
+	gchar           *update_id;
+
+	if (pdf_document->mapped_file) {
+		return poppler_document_new_from_data (g_mapped_file_get_contents (pdf_document->mapped_file),
+						       (int) g_mapped_file_get_length (pdf_document->mapped_file),
+						       pdf_document->password,
+						       NULL);
+	}
+
+	/* Without IDs there's no way to know whether the file on disk
+	 * is still the document that was loaded
+	 */
+	if (!pdf_document->permanent_id || !pdf_document->update_id)
+		return NULL;
+
+	uri = ev_document_get_uri (EV_DOCUMENT (document_find));
+	if (!uri || !g_str_has_prefix (uri, "file:"))
+		return NULL;
+
+	context = poppler_document_new_from_file (uri, pdf_document->password, NULL);
+	if (!context)
+		return NULL;
+
+	if (!poppler_document_get_id (context, &permanent_id, &update_id)) {
+		g_object_unref (context);
+		return NULL;
+	}
+
+	if (memcmp (permanent_id, pdf_document->permanent_id, PDF_DOCUMENT_ID_LENGTH) != 0 ||
+	    memcmp (update_id, pdf_document->update_id, PDF_DOCUMENT_ID_LENGTH) != 0) {
+		g_object_unref (context);
+		context = NULL;
+	}
+	g_free (permanent_id);
+	g_free (update_id);
+
+	return context;
+}
+
+static GList *
+pdf_document_find_find_text_in_context (EvDocumentFind *document_find,
+					gpointer        context,
+					gint            page,
+					const gchar    *text,
+					EvFindOptions   options)
+{
+	PopplerPage *poppler_page;
+	GList       *retval;
+
+	poppler_page = poppler_document_get_page (POPPLER_DOCUMENT (context), page);
+	if (!poppler_page)
+		return NULL;
+
+	retval = pdf_document_find_poppler_page (poppler_page, text, options);
+	g_object_unref (poppler_page);
+
+	return retval;
+}
+
+static void
+pdf_document_find_free_context (EvDocumentFind *document_find,
+				gpointer        context)
+{
+	g_object_unref (context);
+}
+
 static void
 pdf_document_find_iface_init (EvDocumentFindInterface *iface)
 {
@@ -1639,6 +1807,9 @@ pdf_document_find_iface_init (EvDocumentFindInterface *iface)
 	iface->find_text_with_options = pdf_document_find_find_text_with_options;
 #endif
 	iface->get_supported_options = pdf_document_find_get_supported_options;
+	iface->create_context = pdf_document_find_create_context;
+	iface->find_text_in_context = pdf_document_find_find_text_in_context;
+	iface->free_context = pdf_document_find_free_context;
 }
 
 static void
@@ -31,6 +31,8 @@
 #include "tiff2ps.h"
 #include "tiff-document.h"
 #include "ev-document-misc.h"
+#include "ev-imaging.h"
+#include "ev-surface-pool.h"
 #include "ev-file-exporter.h"
 #include "ev-file-helpers.h"
 
@@ -228,11 +230,9 @@ tiff_document_render (EvDocument      *document,
 	float x_res, y_res;
 	gint rowstride, bytes;
 	guchar *pixels = NULL;
-	guchar *p;
 	int orientation;
 	cairo_surface_t *surface;
 	cairo_surface_t *rotated_surface;
-	static const cairo_user_data_key_t key;
 	
 	g_return_val_if_fail (TIFF_IS_DOCUMENT (document), NULL);
 	g_return_val_if_fail (tiff_document->tiff != NULL, NULL);
@@ -288,18 +288,15 @@ tiff_document_render (EvDocument      *document,
 		return NULL;
 	}
 	
-	pixels = g_try_malloc (bytes);
-	if (!pixels) {
+	/* libtiff writes every pixel of the image */
+	surface = ev_surface_pool_create_surface (CAIRO_FORMAT_RGB24,
+						  width, height, FALSE);
+	if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
 		g_warning("Failed to allocate memory for rendering.");
+		cairo_surface_destroy (surface);
 		return NULL;
 	}
-	
-	surface = cairo_image_surface_create_for_data (pixels,
-						       CAIRO_FORMAT_RGB24,
-						       width, height,
-						       rowstride);
-	cairo_surface_set_user_data (surface, &key,
-				     pixels, (cairo_destroy_func_t)g_free);
+	pixels = cairo_image_surface_get_data (surface);
 
 	TIFFReadRGBAImageOriented (tiff_document->tiff,
 				   width, height,
@@ -307,27 +304,25 @@ tiff_document_render (EvDocument      *document,
 				   orientation, 0);
 	pop_handlers ();
 
-	/* Convert the format returned by libtiff to
-	* what cairo expects
-	*/
-	p = pixels;
-	while (p < pixels + bytes) {
-		guint32 *pixel = (guint32*)p;
-		guint8 r = TIFFGetR(*pixel);
-		guint8 g = TIFFGetG(*pixel);
-		guint8 b = TIFFGetB(*pixel);
-		guint8 a = TIFFGetA(*pixel);
-
-		*pixel = (a << 24) | (r << 16) | (g << 8) | b;
-
-		p += 4;
-	}
-
+	/* Scaling and rotating treat every channel the same, so the
+	 * format returned by libtiff is converted to what cairo expects
+	 * afterwards, on the final surface only. At scale 1 without
+	 * rotation that's the same surface.
+	 */
 	rotated_surface = ev_document_misc_surface_rotate_and_scale (surface,
 								     (width * rc->scale) + 0.5,
 								     (height * rc->scale * (x_res / y_res)) + 0.5,
 								     rc->rotation);
 	cairo_surface_destroy (surface);
+
+	if (cairo_surface_status (rotated_surface) == CAIRO_STATUS_SUCCESS) {
+		cairo_surface_flush (rotated_surface);
+		ev_imaging_swap_red_blue (cairo_image_surface_get_data (rotated_surface),
+					  cairo_image_surface_get_width (rotated_surface),
+					  cairo_image_surface_get_height (rotated_surface),
+					  cairo_image_surface_get_stride (rotated_surface));
+		cairo_surface_mark_dirty (rotated_surface);
+	}
 	
 	return rotated_surface;
 }
@@ -336,72 +331,18 @@ static GdkPixbuf *
 tiff_document_get_thumbnail (EvDocument      *document,
 			     EvRenderContext *rc)
 {
-	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
-	int width, height;
-	float x_res, y_res;
-	gint rowstride, bytes;
-	guchar *pixels = NULL;
-	GdkPixbuf *pixbuf;
-	GdkPixbuf *scaled_pixbuf;
-	GdkPixbuf *rotated_pixbuf;
-	
-	push_handlers ();
-	if (TIFFSetDirectory (tiff_document->tiff, rc->page->index) != 1) {
-		pop_handlers ();
-		return NULL;
-	}
-
-	if (!TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGEWIDTH, &width)) {
-		pop_handlers ();
-		return NULL;
-	}
+	cairo_surface_t *surface;
+	GdkPixbuf       *pixbuf;
 
-	if (! TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGELENGTH, &height)) {
-		pop_handlers ();
+	/* Rendering already downscales and rotates without any filtering */
+	surface = tiff_document_render (document, rc);
+	if (!surface)
 		return NULL;
-	}
 
-	tiff_document_get_resolution (tiff_document, &x_res, &y_res);
-	
-	pop_handlers ();
-  
-	/* Sanity check the doc */
-	if (width <= 0 || height <= 0)
-		return NULL;                
-
-	rowstride = width * 4;
-	if (rowstride / 4 != width)
-		/* overflow */
-		return NULL;                
-        
-	bytes = height * rowstride;
-	if (bytes / rowstride != height)
-		/* overflow */
-		return NULL;                
-	
-	pixels = g_try_malloc (bytes);
-	if (!pixels)
-		return NULL;
-	
-	pixbuf = gdk_pixbuf_new_from_data (pixels, GDK_COLORSPACE_RGB, TRUE, 8, 
-					   width, height, rowstride,
-					   (GdkPixbufDestroyNotify) g_free, NULL);
-	TIFFReadRGBAImageOriented (tiff_document->tiff,
-				   width, height,
-				   (uint32 *)pixels,
-				   ORIENTATION_TOPLEFT, 0);
-	pop_handlers ();
+	pixbuf = ev_document_misc_pixbuf_from_surface (surface);
+	cairo_surface_destroy (surface);
 
-	scaled_pixbuf = gdk_pixbuf_scale_simple (pixbuf,
-						 width * rc->scale,
-						 height * rc->scale * (x_res / y_res),
-						 GDK_INTERP_BILINEAR);
-	g_object_unref (pixbuf);
-	
-	rotated_pixbuf = gdk_pixbuf_rotate_simple (scaled_pixbuf, 360 - rc->rotation);
-	g_object_unref (scaled_pixbuf);
-	
-	return rotated_pixbuf;
+	return pixbuf;
 }
 
 static gchar *
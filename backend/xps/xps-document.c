@@ -26,6 +26,7 @@
 #include "ev-document-links.h"
 #include "ev-document-print.h"
 #include "ev-document-misc.h"
+#include "ev-surface-pool.h"
 
 struct _XPSDocument {
 	EvDocument    object;
@@ -216,8 +217,11 @@ xps_document_render (EvDocument      *document,
 		height = (guint) ((page_height * rc->scale) + 0.5);
 	}
 
-	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
-					      width, height);
+	/* Pages are opaque and the background is painted first, so the
+	 * surface needs neither alpha nor to be cleared
+	 */
+	surface = ev_surface_pool_create_surface (CAIRO_FORMAT_RGB24,
+						  width, height, FALSE);
 	cr = cairo_create (surface);
 
 	cairo_set_source_rgb (cr, 1., 1., 1.);
@@ -25,6 +25,7 @@
 #include <libdocument/ev-async-renderer.h>
 #include <libdocument/ev-attachment.h>
 #include <libdocument/ev-backends-manager.h>
+#include <libdocument/ev-cached-input-stream.h>
 #include <libdocument/ev-document-attachments.h>
 #include <libdocument/ev-document-factory.h>
 #include <libdocument/ev-document-find.h>
@@ -53,6 +54,7 @@
 #include <libdocument/ev-page.h>
 #include <libdocument/ev-render-context.h>
 #include <libdocument/ev-selection.h>
+#include <libdocument/ev-text-index.h>
 #include <libdocument/ev-transition-effect.h>
 #include <libdocument/ev-version.h>
 #include <libdocument/ev-macros.h>
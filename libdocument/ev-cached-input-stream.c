@@ -0,0 +1,609 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "ev-cached-input-stream.h"
+
+/* EvCachedInputStream reads a remote file with random access, keeping
+ * what has been read in a local sparse cache file. Blocks are fetched
+ * on demand for the reader, while a prefetch thread downloads the rest
+ * of the file in the background, starting where the reader last
+ * missed the cache.
+ */
+
+#define BLOCK_SIZE (64 * 1024)
+
+enum {
+	COMPLETE,
+	N_SIGNALS
+};
+
+struct _EvCachedInputStreamPrivate {
+	GFile            *source;
+	GFile            *cache;
+	gint              fd;
+	goffset           size;
+	goffset           position;
+	gboolean          initialized;
+
+	/* Reader side, used only by the thread reading the stream */
+	GFileInputStream *remote;
+
+	/* Shared with the prefetch thread, protected by mutex */
+	GMutex            mutex;
+	guint8           *cached;
+	guint             n_blocks;
+	guint             n_cached;
+	guint             prefetch_hint;
+	guint             complete_idle_id;
+
+	/* The prefetch thread holds a reference to the stream and writes
+	 * through a file descriptor of its own, so that it can be stopped
+	 * without waiting for it
+	 */
+	GCancellable     *prefetch_cancellable;
+	gint              prefetch_fd;
+};
+
+static guint signals[N_SIGNALS];
+
+#define EV_CACHED_INPUT_STREAM_GET_PRIVATE(object) \
+                (G_TYPE_INSTANCE_GET_PRIVATE ((object), EV_TYPE_CACHED_INPUT_STREAM, EvCachedInputStreamPrivate))
+
+G_DEFINE_TYPE (EvCachedInputStream, ev_cached_input_stream, G_TYPE_FILE_INPUT_STREAM)
+
+static gboolean
+emit_complete (EvCachedInputStream *stream)
+{
+	EvCachedInputStreamPrivate *priv = stream->priv;
+
+	g_mutex_lock (&priv->mutex);
+	priv->complete_idle_id = 0;
+	g_mutex_unlock (&priv->mutex);
+
+	g_signal_emit (stream, signals[COMPLETE], 0);
+
+	return FALSE;
+}
+
+static gboolean
+ev_cached_input_stream_fetch_block (EvCachedInputStream *stream,
+				    GInputStream        *remote,
+				    gint                 fd,
+				    guint                block,
+				    GCancellable        *cancellable,
+				    GError             **error)
+{
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	goffset  offset;
+	gsize    len, bytes_read;
+	gsize    written = 0;
+	guint8  *buffer;
+
+	offset = (goffset) block * BLOCK_SIZE;
+	len = MIN (BLOCK_SIZE, priv->size - offset);
+
+	if (g_seekable_tell (G_SEEKABLE (remote)) != offset &&
+	    !g_seekable_seek (G_SEEKABLE (remote), offset, G_SEEK_SET,
+			      cancellable, error))
+		return FALSE;
+
+	buffer = g_malloc (len);
+	if (!g_input_stream_read_all (remote, buffer, len, &bytes_read,
+				      cancellable, error)) {
+		g_free (buffer);
+		return FALSE;
+	}
+
+	if (bytes_read != len) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				     "Unexpected end of remote file");
+		g_free (buffer);
+		return FALSE;
+	}
+
+	while (written < len) {
+		gssize n;
+
+		n = pwrite (fd, buffer + written, len - written, offset + written);
+		if (n == -1) {
+			int errsv = errno;
+
+			if (errsv == EINTR)
+				continue;
+
+			g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+				     "Failed to write cache file: %s",
+				     g_strerror (errsv));
+			g_free (buffer);
+			return FALSE;
+		}
+		written += n;
+	}
+	g_free (buffer);
+
+	g_mutex_lock (&priv->mutex);
+	if (!priv->cached[block]) {
+		priv->cached[block] = TRUE;
+		priv->n_cached++;
+
+		if (priv->n_cached == priv->n_blocks) {
+			g_object_ref (stream);
+			priv->complete_idle_id =
+				g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+						 (GSourceFunc) emit_complete,
+						 stream,
+						 (GDestroyNotify) g_object_unref);
+		}
+	}
+	g_mutex_unlock (&priv->mutex);
+
+	return TRUE;
+}
+
+static gpointer
+ev_cached_input_stream_prefetch (EvCachedInputStream *stream)
+{
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	GFileInputStream           *remote;
+	gint                        fd = priv->prefetch_fd;
+
+	remote = g_file_read (priv->source, priv->prefetch_cancellable, NULL);
+	if (!remote) {
+		close (fd);
+		g_object_unref (stream);
+		return NULL;
+	}
+
+	while (!g_cancellable_is_cancelled (priv->prefetch_cancellable)) {
+		guint block = priv->n_blocks;
+		guint i;
+
+		g_mutex_lock (&priv->mutex);
+		for (i = 0; i < priv->n_blocks; i++) {
+			guint b = (priv->prefetch_hint + i) % priv->n_blocks;
+
+			if (!priv->cached[b]) {
+				block = b;
+				break;
+			}
+		}
+		priv->prefetch_hint = block + 1;
+		g_mutex_unlock (&priv->mutex);
+
+		if (block == priv->n_blocks)
+			break;
+
+		if (!ev_cached_input_stream_fetch_block (stream, G_INPUT_STREAM (remote),
+							 fd, block,
+							 priv->prefetch_cancellable,
+							 NULL))
+			break;
+	}
+
+	g_input_stream_close (G_INPUT_STREAM (remote), NULL, NULL);
+	g_object_unref (remote);
+	close (fd);
+	g_object_unref (stream);
+
+	return NULL;
+}
+
+static gboolean
+ev_cached_input_stream_ensure_initialized (EvCachedInputStream *stream,
+					   GCancellable        *cancellable,
+					   GError             **error)
+{
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	GFileInfo                  *info;
+	GThread                    *thread;
+	gchar                      *path;
+
+	if (priv->initialized)
+		return TRUE;
+
+	priv->remote = g_file_read (priv->source, cancellable, error);
+	if (!priv->remote)
+		return FALSE;
+
+	if (!g_seekable_can_seek (G_SEEKABLE (priv->remote))) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "Remote file does not support random access");
+		g_clear_object (&priv->remote);
+		return FALSE;
+	}
+
+	info = g_file_input_stream_query_info (priv->remote,
+					       G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					       cancellable, error);
+	if (!info) {
+		g_clear_object (&priv->remote);
+		return FALSE;
+	}
+	priv->size = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	if (priv->size <= 0) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "Remote file size is unknown");
+		g_clear_object (&priv->remote);
+		return FALSE;
+	}
+
+	path = g_file_get_path (priv->cache);
+	priv->fd = g_open (path, O_RDWR | O_CREAT, 0600);
+	g_free (path);
+	if (priv->fd == -1 || ftruncate (priv->fd, priv->size) == -1) {
+		int errsv = errno;
+
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     "Failed to create cache file: %s",
+			     g_strerror (errsv));
+		if (priv->fd != -1) {
+			close (priv->fd);
+			priv->fd = -1;
+		}
+		g_clear_object (&priv->remote);
+		return FALSE;
+	}
+
+	priv->n_blocks = (priv->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	priv->cached = g_new0 (guint8, priv->n_blocks);
+	priv->initialized = TRUE;
+
+	/* Without a prefetch thread blocks are still fetched on demand */
+	priv->prefetch_fd = dup (priv->fd);
+	if (priv->prefetch_fd == -1)
+		return TRUE;
+
+	priv->prefetch_cancellable = g_cancellable_new ();
+	thread = g_thread_try_new ("EvCachedInputStream prefetch",
+				   (GThreadFunc) ev_cached_input_stream_prefetch,
+				   g_object_ref (stream), NULL);
+	if (thread) {
+		g_thread_unref (thread);
+	} else {
+		close (priv->prefetch_fd);
+		g_object_unref (stream);
+	}
+
+	return TRUE;
+}
+
+/* Doesn't wait for the prefetch thread, it finishes the block it's
+ * fetching and exits on its own
+ */
+static void
+ev_cached_input_stream_stop_prefetch (EvCachedInputStream *stream)
+{
+	EvCachedInputStreamPrivate *priv = stream->priv;
+
+	if (priv->prefetch_cancellable)
+		g_cancellable_cancel (priv->prefetch_cancellable);
+}
+
+static gssize
+ev_cached_input_stream_read (GInputStream *input_stream,
+			     void         *buffer,
+			     gsize         count,
+			     GCancellable *cancellable,
+			     GError      **error)
+{
+	EvCachedInputStream        *stream = EV_CACHED_INPUT_STREAM (input_stream);
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	guint                       first, last, block;
+	gssize                      n;
+
+	if (!ev_cached_input_stream_ensure_initialized (stream, cancellable, error))
+		return -1;
+
+	if (count == 0 || priv->position >= priv->size)
+		return 0;
+
+	count = MIN (count, priv->size - priv->position);
+	first = priv->position / BLOCK_SIZE;
+	last = (priv->position + count - 1) / BLOCK_SIZE;
+
+	for (block = first; block <= last; block++) {
+		gboolean cached;
+
+		g_mutex_lock (&priv->mutex);
+		cached = priv->cached[block];
+		if (!cached)
+			priv->prefetch_hint = block + 1;
+		g_mutex_unlock (&priv->mutex);
+
+		if (cached)
+			continue;
+
+		if (!ev_cached_input_stream_fetch_block (stream, G_INPUT_STREAM (priv->remote),
+							 priv->fd, block,
+							 cancellable, error))
+			return -1;
+	}
+
+	do {
+		n = pread (priv->fd, buffer, count, priv->position);
+	} while (n == -1 && errno == EINTR);
+
+	if (n == -1) {
+		int errsv = errno;
+
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     "Failed to read cache file: %s",
+			     g_strerror (errsv));
+		return -1;
+	}
+
+	priv->position += n;
+
+	return n;
+}
+
+static gboolean
+ev_cached_input_stream_close (GInputStream *input_stream,
+			      GCancellable *cancellable,
+			      GError      **error)
+{
+	EvCachedInputStream        *stream = EV_CACHED_INPUT_STREAM (input_stream);
+	EvCachedInputStreamPrivate *priv = stream->priv;
+
+	ev_cached_input_stream_stop_prefetch (stream);
+
+	g_mutex_lock (&priv->mutex);
+	if (priv->complete_idle_id > 0) {
+		g_source_remove (priv->complete_idle_id);
+		priv->complete_idle_id = 0;
+	}
+	g_mutex_unlock (&priv->mutex);
+
+	if (priv->remote) {
+		g_input_stream_close (G_INPUT_STREAM (priv->remote), cancellable, NULL);
+		g_clear_object (&priv->remote);
+	}
+
+	if (priv->fd != -1) {
+		close (priv->fd);
+		priv->fd = -1;
+	}
+
+	return TRUE;
+}
+
+static goffset
+ev_cached_input_stream_tell (GFileInputStream *file_stream)
+{
+	return EV_CACHED_INPUT_STREAM (file_stream)->priv->position;
+}
+
+static gboolean
+ev_cached_input_stream_can_seek (GFileInputStream *file_stream)
+{
+	return TRUE;
+}
+
+static gboolean
+ev_cached_input_stream_seek (GFileInputStream *file_stream,
+			     goffset           offset,
+			     GSeekType         type,
+			     GCancellable     *cancellable,
+			     GError          **error)
+{
+	EvCachedInputStream        *stream = EV_CACHED_INPUT_STREAM (file_stream);
+	EvCachedInputStreamPrivate *priv = stream->priv;
+	goffset                     position;
+
+	switch (type) {
+	case G_SEEK_SET:
+		position = offset;
+		break;
+	case G_SEEK_CUR:
+		position = priv->position + offset;
+		break;
+	case G_SEEK_END:
+		if (!ev_cached_input_stream_ensure_initialized (stream, cancellable, error))
+			return FALSE;
+		position = priv->size + offset;
+		break;
+	default:
+		g_assert_not_reached ();
+		return FALSE;
+	}
+
+	if (position < 0) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+				     "Invalid seek request");
+		return FALSE;
+	}
+
+	priv->position = position;
+
+	return TRUE;
+}
+
+static GFileInfo *
+ev_cached_input_stream_query_info (GFileInputStream *file_stream,
+				   const char       *attributes,
+				   GCancellable     *cancellable,
+				   GError          **error)
+{
+	EvCachedInputStream *stream = EV_CACHED_INPUT_STREAM (file_stream);
+
+	return g_file_query_info (stream->priv->source, attributes,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable, error);
+}
+
+static void
+ev_cached_input_stream_finalize (GObject *object)
+{
+	EvCachedInputStream        *stream = EV_CACHED_INPUT_STREAM (object);
+	EvCachedInputStreamPrivate *priv = stream->priv;
+
+	ev_cached_input_stream_stop_prefetch (stream);
+
+	g_clear_object (&priv->prefetch_cancellable);
+	g_clear_object (&priv->source);
+	g_clear_object (&priv->cache);
+	g_free (priv->cached);
+	g_mutex_clear (&priv->mutex);
+
+	G_OBJECT_CLASS (ev_cached_input_stream_parent_class)->finalize (object);
+}
+
+static void
+ev_cached_input_stream_init (EvCachedInputStream *stream)
+{
+	stream->priv = EV_CACHED_INPUT_STREAM_GET_PRIVATE (stream);
+	stream->priv->fd = -1;
+	g_mutex_init (&stream->priv->mutex);
+}
+
+static void
+ev_cached_input_stream_class_init (EvCachedInputStreamClass *klass)
+{
+	GObjectClass          *g_object_class = G_OBJECT_CLASS (klass);
+	GInputStreamClass     *input_stream_class = G_INPUT_STREAM_CLASS (klass);
+	GFileInputStreamClass *file_stream_class = G_FILE_INPUT_STREAM_CLASS (klass);
+
+	g_object_class->finalize = ev_cached_input_stream_finalize;
+
+	input_stream_class->read_fn = ev_cached_input_stream_read;
+	input_stream_class->close_fn = ev_cached_input_stream_close;
+
+	file_stream_class->tell = ev_cached_input_stream_tell;
+	file_stream_class->can_seek = ev_cached_input_stream_can_seek;
+	file_stream_class->seek = ev_cached_input_stream_seek;
+	file_stream_class->query_info = ev_cached_input_stream_query_info;
+
+	/**
+	 * EvCachedInputStream::complete:
+	 * @stream: the object which received the signal
+	 *
+	 * Emitted in the main loop once the whole remote file has
+	 * been stored in the cache file.
+	 */
+	signals[COMPLETE] =
+		g_signal_new ("complete",
+			      EV_TYPE_CACHED_INPUT_STREAM,
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvCachedInputStreamClass, complete),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__VOID,
+			      G_TYPE_NONE, 0);
+
+	g_type_class_add_private (g_object_class, sizeof (EvCachedInputStreamPrivate));
+}
+
+/**
+ * ev_cached_input_stream_new:
+ * @source: the remote #GFile to read
+ * @cache: a local #GFile to store the data read from @source
+ *
+ * Creates a seekable stream reading @source, which only downloads the
+ * parts of the file that are actually read before the rest of it is
+ * fetched in the background. No I/O happens until the stream is first
+ * read or seeked from its end, so the stream can be created from the
+ * main loop and handed to a thread. If @source can not be accessed
+ * randomly, the first read fails with %G_IO_ERROR_NOT_SUPPORTED.
+ *
+ * Returns: (transfer full): a new #GFileInputStream
+ *
+ * Since: 3.6
+ */
+GFileInputStream *
+ev_cached_input_stream_new (GFile *source,
+			    GFile *cache)
+{
+	EvCachedInputStream *stream;
+
+	g_return_val_if_fail (G_IS_FILE (source), NULL);
+	g_return_val_if_fail (G_IS_FILE (cache) && g_file_is_native (cache), NULL);
+
+	stream = g_object_new (EV_TYPE_CACHED_INPUT_STREAM, NULL);
+	stream->priv->source = g_object_ref (source);
+	stream->priv->cache = g_object_ref (cache);
+
+	return G_FILE_INPUT_STREAM (stream);
+}
+
+/**
+ * ev_cached_input_stream_get_cache:
+ * @stream: a #EvCachedInputStream
+ *
+ * Returns: (transfer none): the local cache file of @stream. Its contents
+ *   are only complete once ev_cached_input_stream_is_complete() returns %TRUE.
+ *
+ * Since: 3.6
+ */
+GFile *
+ev_cached_input_stream_get_cache (EvCachedInputStream *stream)
+{
+	g_return_val_if_fail (EV_IS_CACHED_INPUT_STREAM (stream), NULL);
+
+	return stream->priv->cache;
+}
+
+/**
+ * ev_cached_input_stream_is_complete:
+ * @stream: a #EvCachedInputStream
+ *
+ * Returns: %TRUE if the whole remote file has been stored in the cache file
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_cached_input_stream_is_complete (EvCachedInputStream *stream)
+{
+	EvCachedInputStreamPrivate *priv;
+	gboolean                    retval;
+
+	g_return_val_if_fail (EV_IS_CACHED_INPUT_STREAM (stream), FALSE);
+
+	priv = stream->priv;
+
+	g_mutex_lock (&priv->mutex);
+	retval = priv->initialized && priv->n_cached == priv->n_blocks;
+	g_mutex_unlock (&priv->mutex);
+
+	return retval;
+}
+
+/**
+ * ev_cached_input_stream_cancel_prefetch:
+ * @stream: a #EvCachedInputStream
+ *
+ * Stops downloading the parts of the remote file that have not been
+ * read yet. Reading from @stream keeps fetching blocks on demand. This
+ * doesn't block, so it can be called from the main loop.
+ *
+ * Since: 3.6
+ */
+void
+ev_cached_input_stream_cancel_prefetch (EvCachedInputStream *stream)
+{
+	g_return_if_fail (EV_IS_CACHED_INPUT_STREAM (stream));
+
+	ev_cached_input_stream_stop_prefetch (stream);
+}
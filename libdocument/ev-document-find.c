@@ -63,3 +63,97 @@ ev_document_find_get_supported_options (EvDocumentFind *document_find)
 		return iface->get_supported_options (document_find);
 	return 0;
 }
+
+/**
+ * ev_document_find_has_contexts:
+ * @document_find: an #EvDocumentFind
+ *
+ * Returns: %TRUE if the backend implements search contexts, so that
+ * ev_document_find_create_context() might succeed
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_document_find_has_contexts (EvDocumentFind *document_find)
+{
+	EvDocumentFindInterface *iface = EV_DOCUMENT_FIND_GET_IFACE (document_find);
+
+	return iface->create_context && iface->find_text_in_context && iface->free_context;
+}
+
+/**
+ * ev_document_find_create_context:
+ * @document_find: an #EvDocumentFind
+ *
+ * Creates a search context for @document_find. Every context is
+ * independent from the document and from other contexts, so they can be
+ * used from different threads at the same time without holding the
+ * document mutex.
+ *
+ * This is called from worker threads without the document mutex held,
+ * so backends must only use data that doesn't change once the document
+ * is loaded, and must return %NULL when the context wouldn't search the
+ * same document that was loaded, for example because the file changed.
+ *
+ * Returns: a new search context, or %NULL if the backend doesn't
+ * support searching concurrently
+ *
+ * Since: 3.6
+ */
+gpointer
+ev_document_find_create_context (EvDocumentFind *document_find)
+{
+	EvDocumentFindInterface *iface = EV_DOCUMENT_FIND_GET_IFACE (document_find);
+
+	if (ev_document_find_has_contexts (document_find))
+		return iface->create_context (document_find);
+	return NULL;
+}
+
+/**
+ * ev_document_find_find_text_in_context:
+ * @document_find: an #EvDocumentFind
+ * @context: a search context created with ev_document_find_create_context()
+ * @page: the page index
+ * @text: the text to search
+ * @options: the #EvFindOptions
+ *
+ * Searches @text in @page using @context. This can be called from any
+ * thread, but a context must not be used by two threads at the same time.
+ *
+ * Returns: (transfer full) (element-type EvRectangle): the list of matches
+ *
+ * Since: 3.6
+ */
+GList *
+ev_document_find_find_text_in_context (EvDocumentFind *document_find,
+				       gpointer        context,
+				       gint            page,
+				       const gchar    *text,
+				       EvFindOptions   options)
+{
+	EvDocumentFindInterface *iface = EV_DOCUMENT_FIND_GET_IFACE (document_find);
+
+	g_return_val_if_fail (context != NULL, NULL);
+
+	return iface->find_text_in_context (document_find, context, page, text, options);
+}
+
+/**
+ * ev_document_find_free_context:
+ * @document_find: an #EvDocumentFind
+ * @context: a search context created with ev_document_find_create_context()
+ *
+ * Frees @context.
+ *
+ * Since: 3.6
+ */
+void
+ev_document_find_free_context (EvDocumentFind *document_find,
+			       gpointer        context)
+{
+	EvDocumentFindInterface *iface = EV_DOCUMENT_FIND_GET_IFACE (document_find);
+
+	if (context)
+		iface->free_context (document_find, context);
+}
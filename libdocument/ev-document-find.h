@@ -63,6 +63,14 @@ struct _EvDocumentFindInterface
 						  const gchar    *text,
 						  EvFindOptions   options);
 	EvFindOptions (*get_supported_options)   (EvDocumentFind *document_find);
+	gpointer      (* create_context)         (EvDocumentFind *document_find);
+	GList        *(* find_text_in_context)   (EvDocumentFind *document_find,
+						  gpointer        context,
+						  gint            page,
+						  const gchar    *text,
+						  EvFindOptions   options);
+	void          (* free_context)           (EvDocumentFind *document_find,
+						  gpointer        context);
 };
 
 GType         ev_document_find_get_type               (void) G_GNUC_CONST;
@@ -75,6 +83,15 @@ GList        *ev_document_find_find_text_with_options (EvDocumentFind *document_
 						       const gchar    *text,
 						       EvFindOptions   options);
 EvFindOptions ev_document_find_get_supported_options  (EvDocumentFind *document_find);
+gboolean      ev_document_find_has_contexts           (EvDocumentFind *document_find);
+gpointer      ev_document_find_create_context         (EvDocumentFind *document_find);
+GList        *ev_document_find_find_text_in_context   (EvDocumentFind *document_find,
+						       gpointer        context,
+						       gint            page,
+						       const gchar    *text,
+						       EvFindOptions   options);
+void          ev_document_find_free_context           (EvDocumentFind *document_find,
+						       gpointer        context);
 
 G_END_DECLS
 
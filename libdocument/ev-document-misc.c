@@ -26,6 +26,8 @@
 #include <gtk/gtk.h>
 
 #include "ev-document-misc.h"
+#include "ev-imaging.h"
+#include "ev-surface-pool.h"
 
 /* Returns a new GdkPixbuf that is suitable for placing in the thumbnail view.
  * It is four pixels wider and taller than the source.  If source_pixbuf is not
@@ -186,11 +188,25 @@ ev_document_misc_paint_one_page (cairo_t      *cr,
 	cairo_fill (cr);
 }
 
+/* Image surfaces in the formats the imaging kernels handle */
+static gboolean
+ev_document_misc_surface_is_rgb (cairo_surface_t *surface)
+{
+	cairo_format_t format;
+
+	if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE ||
+	    cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+		return FALSE;
+
+	format = cairo_image_surface_get_format (surface);
+
+	return format == CAIRO_FORMAT_ARGB32 || format == CAIRO_FORMAT_RGB24;
+}
+
 cairo_surface_t *
 ev_document_misc_surface_from_pixbuf (GdkPixbuf *pixbuf)
 {
 	cairo_surface_t *surface;
-	cairo_t         *cr;
 
 	g_return_val_if_fail (GDK_IS_PIXBUF (pixbuf), NULL);
 
@@ -198,23 +214,116 @@ ev_document_misc_surface_from_pixbuf (GdkPixbuf *pixbuf)
 					      CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
 					      gdk_pixbuf_get_width (pixbuf),
 					      gdk_pixbuf_get_height (pixbuf));
-	cr = cairo_create (surface);
-	gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
-	cairo_paint (cr);
-	cairo_destroy (cr);
-	
+	if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+		return surface;
+
+	cairo_surface_flush (surface);
+	ev_imaging_rgb_to_argb32 (gdk_pixbuf_get_pixels (pixbuf),
+				  gdk_pixbuf_get_rowstride (pixbuf),
+				  gdk_pixbuf_get_n_channels (pixbuf),
+				  cairo_image_surface_get_data (surface),
+				  cairo_image_surface_get_stride (surface),
+				  gdk_pixbuf_get_width (pixbuf),
+				  gdk_pixbuf_get_height (pixbuf));
+	cairo_surface_mark_dirty (surface);
+
 	return surface;
 }
 
 GdkPixbuf *
 ev_document_misc_pixbuf_from_surface (cairo_surface_t *surface)
 {
+	GdkPixbuf *pixbuf;
+	gboolean   has_alpha;
+	gint       width, height;
+
 	g_return_val_if_fail (surface, NULL);	
 
-        return gdk_pixbuf_get_from_surface (surface,
-                                            0, 0,
-                                            cairo_image_surface_get_width (surface),
-                                            cairo_image_surface_get_height (surface));
+	width = cairo_image_surface_get_width (surface);
+	height = cairo_image_surface_get_height (surface);
+
+	if (!ev_document_misc_surface_is_rgb (surface))
+		return gdk_pixbuf_get_from_surface (surface, 0, 0, width, height);
+
+	has_alpha = cairo_image_surface_get_format (surface) == CAIRO_FORMAT_ARGB32;
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+	if (!pixbuf)
+		return NULL;
+
+	cairo_surface_flush (surface);
+	ev_imaging_argb32_to_rgb (cairo_image_surface_get_data (surface),
+				  cairo_image_surface_get_stride (surface),
+				  gdk_pixbuf_get_pixels (pixbuf),
+				  gdk_pixbuf_get_rowstride (pixbuf),
+				  gdk_pixbuf_get_n_channels (pixbuf),
+				  width, height);
+
+	return pixbuf;
+}
+
+/* Downscaling averages all the source pixels and rotating moves them
+ * exactly, so there's no need to go through cairo filters
+ */
+static cairo_surface_t *
+ev_document_misc_image_rotate_and_scale (cairo_surface_t *surface,
+					 gint             dest_width,
+					 gint             dest_height,
+					 gint             dest_rotation)
+{
+	cairo_surface_t *new_surface;
+	const guchar    *src;
+	gint             src_stride;
+	guchar          *scaled = NULL;
+	gint             width, height;
+	gint             new_width = dest_width;
+	gint             new_height = dest_height;
+
+	width = cairo_image_surface_get_width (surface);
+	height = cairo_image_surface_get_height (surface);
+
+	if (dest_rotation == 90 || dest_rotation == 270) {
+		new_width = dest_height;
+		new_height = dest_width;
+	}
+
+	/* Every pixel is written by the kernels */
+	new_surface = ev_surface_pool_create_surface (cairo_image_surface_get_format (surface),
+						      new_width, new_height, FALSE);
+	if (cairo_surface_status (new_surface) != CAIRO_STATUS_SUCCESS)
+		return new_surface;
+
+	cairo_surface_flush (surface);
+	cairo_surface_flush (new_surface);
+	src = cairo_image_surface_get_data (surface);
+	src_stride = cairo_image_surface_get_stride (surface);
+
+	if (dest_width != width || dest_height != height) {
+		if (dest_rotation == 0) {
+			ev_imaging_downscale_argb32 (src, width, height, src_stride,
+						     cairo_image_surface_get_data (new_surface),
+						     dest_width, dest_height,
+						     cairo_image_surface_get_stride (new_surface));
+			cairo_surface_mark_dirty (new_surface);
+
+			return new_surface;
+		}
+
+		scaled = g_malloc ((gsize) dest_width * dest_height * 4);
+		ev_imaging_downscale_argb32 (src, width, height, src_stride,
+					     scaled, dest_width, dest_height,
+					     dest_width * 4);
+		src = scaled;
+		src_stride = dest_width * 4;
+	}
+
+	ev_imaging_rotate_argb32 (src, dest_width, dest_height, src_stride,
+				  cairo_image_surface_get_data (new_surface),
+				  cairo_image_surface_get_stride (new_surface),
+				  dest_rotation);
+	cairo_surface_mark_dirty (new_surface);
+	g_free (scaled);
+
+	return new_surface;
 }
 
 cairo_surface_t *
@@ -238,6 +347,16 @@ ev_document_misc_surface_rotate_and_scale (cairo_surface_t *surface,
 		return cairo_surface_reference (surface);
 	}
 
+	if (ev_document_misc_surface_is_rgb (surface) &&
+	    dest_width <= width && dest_height <= height &&
+	    (dest_rotation == 0 || dest_rotation == 90 ||
+	     dest_rotation == 180 || dest_rotation == 270)) {
+		return ev_document_misc_image_rotate_and_scale (surface,
+								dest_width,
+								dest_height,
+								dest_rotation);
+	}
+
 	if (dest_rotation == 90 || dest_rotation == 270) {
 		new_width = dest_height;
 		new_height = dest_width;
@@ -281,6 +400,17 @@ void
 ev_document_misc_invert_surface (cairo_surface_t *surface) {
 	cairo_t *cr;
 
+	if (ev_document_misc_surface_is_rgb (surface)) {
+		cairo_surface_flush (surface);
+		ev_imaging_invert_argb32 (cairo_image_surface_get_data (surface),
+					  cairo_image_surface_get_width (surface),
+					  cairo_image_surface_get_height (surface),
+					  cairo_image_surface_get_stride (surface));
+		cairo_surface_mark_dirty (surface);
+
+		return;
+	}
+
 	cr = cairo_create (surface);
 
 	/* white + DIFFERENCE -> invert */
@@ -293,31 +423,14 @@ ev_document_misc_invert_surface (cairo_surface_t *surface) {
 void
 ev_document_misc_invert_pixbuf (GdkPixbuf *pixbuf)
 {
-	guchar *data, *p;
-	guint   width, height, x, y, rowstride, n_channels;
-
-	n_channels = gdk_pixbuf_get_n_channels (pixbuf);
 	g_assert (gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB);
 	g_assert (gdk_pixbuf_get_bits_per_sample (pixbuf) == 8);
 
-	/* First grab a pointer to the raw pixel data. */
-	data = gdk_pixbuf_get_pixels (pixbuf);
-
-	/* Find the number of bytes per row (could be padded). */
-	rowstride = gdk_pixbuf_get_rowstride (pixbuf);
-
-	width = gdk_pixbuf_get_width (pixbuf);
-	height = gdk_pixbuf_get_height (pixbuf);
-	for (x = 0; x < width; x++) {
-		for (y = 0; y < height; y++) {
-			/* Calculate pixel's offset into the data array. */
-			p = data + x * n_channels + y * rowstride;
-			/* Change the RGB values*/
-			p[0] = 255 - p[0];
-			p[1] = 255 - p[1];
-			p[2] = 255 - p[2];
-		}
-	}
+	ev_imaging_invert_rgb (gdk_pixbuf_get_pixels (pixbuf),
+			       gdk_pixbuf_get_width (pixbuf),
+			       gdk_pixbuf_get_height (pixbuf),
+			       gdk_pixbuf_get_rowstride (pixbuf),
+			       gdk_pixbuf_get_n_channels (pixbuf));
 }
 
 gdouble
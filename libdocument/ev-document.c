@@ -21,11 +21,19 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <glib/gstdio.h>
+#ifdef G_OS_UNIX
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "ev-document.h"
 #include "ev-document-misc.h"
+#include "ev-trace.h"
 #include "synctex_parser.h"
 
 #define EV_DOCUMENT_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), EV_TYPE_DOCUMENT, EvDocumentPrivate))
@@ -36,11 +44,24 @@ typedef struct _EvPageSize
 	gdouble height;
 } EvPageSize;
 
+/* Read-only mapping of a local file, shared by all the
+ * documents loaded from the same file while it's unchanged
+ */
+typedef struct _EvMappedFile
+{
+	gchar       *filename;
+	GMappedFile *mapped_file;
+	goffset      size;
+	time_t       mtime;
+	guint        users;
+} EvMappedFile;
+
 struct _EvDocumentPrivate
 {
 	gchar          *uri;
 
 	gint            n_pages;
+	gboolean        cache_loaded;
 
 	gboolean        uniform;
 	gdouble         uniform_width;
@@ -57,6 +78,8 @@ struct _EvDocumentPrivate
 	EvDocumentInfo *info;
 
 	synctex_scanner_t synctex_scanner;
+
+	EvMappedFile   *mapped;
 };
 
 static gint            _ev_document_get_n_pages     (EvDocument *document);
@@ -72,6 +95,28 @@ static gboolean        _ev_document_support_synctex (EvDocument *document);
 static GMutex ev_doc_mutex;
 static GMutex ev_fc_mutex;
 
+#define EV_DOCUMENT_MAPPED_MIN_SIZE (8 * 1024 * 1024)
+
+static GMutex      ev_mapped_files_mutex;
+static GHashTable *ev_mapped_files = NULL;
+
+#if defined (G_OS_UNIX) && defined (SIGBUS) && defined (SA_SIGINFO) && defined (MAP_ANONYMOUS)
+#define EV_MAPPED_FILE_GUARD 1
+#define EV_MAPPED_FILE_MAX_GUARDED 64
+
+/* Address ranges of the mappings, read from the SIGBUS handler, so they
+ * are written without locking and an empty slot has an end of 0
+ */
+typedef struct {
+	volatile gsize start;
+	volatile gsize end;
+} EvMappedRange;
+
+static EvMappedRange    ev_mapped_ranges[EV_MAPPED_FILE_MAX_GUARDED];
+static struct sigaction ev_mapped_old_sigbus;
+static gsize            ev_mapped_page_size;
+#endif
+
 G_DEFINE_ABSTRACT_TYPE (EvDocument, ev_document, G_TYPE_OBJECT)
 
 GQuark
@@ -97,6 +142,182 @@ ev_document_impl_get_info (EvDocument *document)
 	return g_new0 (EvDocumentInfo, 1);
 }
 
+#ifdef EV_MAPPED_FILE_GUARD
+/* A mapped file can be truncated or rewritten in place by another
+ * process while documents read from it, e.g. by TeX, and reading the
+ * pages past its new end raises SIGBUS. The pages that fault are
+ * replaced with zeroed pages, so that the backend reads garbage instead
+ * of crashing, until the document is reloaded when the change is noticed.
+ */
+static void
+ev_mapped_file_sigbus_handler (int        sig,
+			       siginfo_t *info,
+			       void      *context)
+{
+	gsize addr = (gsize) info->si_addr;
+	guint i;
+
+	for (i = 0; i < EV_MAPPED_FILE_MAX_GUARDED; i++) {
+		gpointer page;
+
+		if (addr < ev_mapped_ranges[i].start || addr >= ev_mapped_ranges[i].end)
+			continue;
+
+		page = (gpointer) (addr & ~(ev_mapped_page_size - 1));
+		if (mmap (page, ev_mapped_page_size, PROT_READ,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED)
+			return;
+		break;
+	}
+
+	/* Not a mapped document, let the previous handler deal with it */
+	if (ev_mapped_old_sigbus.sa_flags & SA_SIGINFO) {
+		ev_mapped_old_sigbus.sa_sigaction (sig, info, context);
+	} else if (ev_mapped_old_sigbus.sa_handler != SIG_DFL &&
+		   ev_mapped_old_sigbus.sa_handler != SIG_IGN) {
+		ev_mapped_old_sigbus.sa_handler (sig);
+	} else {
+		/* The fault happens again when returning, and crashes */
+		sigaction (SIGBUS, &ev_mapped_old_sigbus, NULL);
+	}
+}
+
+/* Called with the mapped files lock held */
+static void
+ev_mapped_file_guard (EvMappedFile *mapped)
+{
+	static gboolean installed = FALSE;
+	gsize           start;
+	guint           i;
+
+	if (!installed) {
+		struct sigaction action;
+
+		ev_mapped_page_size = sysconf (_SC_PAGESIZE);
+
+		memset (&action, 0, sizeof (action));
+		action.sa_sigaction = ev_mapped_file_sigbus_handler;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset (&action.sa_mask);
+		sigaction (SIGBUS, &action, &ev_mapped_old_sigbus);
+		installed = TRUE;
+	}
+
+	start = (gsize) g_mapped_file_get_contents (mapped->mapped_file);
+	for (i = 0; i < EV_MAPPED_FILE_MAX_GUARDED; i++) {
+		if (ev_mapped_ranges[i].end != 0)
+			continue;
+
+		ev_mapped_ranges[i].start = start;
+		ev_mapped_ranges[i].end = start + g_mapped_file_get_length (mapped->mapped_file);
+		break;
+	}
+}
+
+/* Called with the mapped files lock held */
+static void
+ev_mapped_file_unguard (EvMappedFile *mapped)
+{
+	gsize start;
+	guint i;
+
+	start = (gsize) g_mapped_file_get_contents (mapped->mapped_file);
+	for (i = 0; i < EV_MAPPED_FILE_MAX_GUARDED; i++) {
+		if (ev_mapped_ranges[i].end == 0 || ev_mapped_ranges[i].start != start)
+			continue;
+
+		ev_mapped_ranges[i].end = 0;
+		ev_mapped_ranges[i].start = 0;
+		break;
+	}
+}
+#endif /* EV_MAPPED_FILE_GUARD */
+
+static EvMappedFile *
+ev_mapped_file_acquire (const gchar *filename,
+			goffset      min_size,
+			GError     **error)
+{
+	EvMappedFile *mapped;
+	GStatBuf      statbuf;
+
+	if (g_stat (filename, &statbuf) == -1) {
+		int errsv = errno;
+
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+			     "Failed to get attributes of file '%s': %s",
+			     filename, g_strerror (errsv));
+		return NULL;
+	}
+
+	if (statbuf.st_size < min_size) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "File too small to be mapped");
+		return NULL;
+	}
+
+	g_mutex_lock (&ev_mapped_files_mutex);
+
+	if (!ev_mapped_files)
+		ev_mapped_files = g_hash_table_new (g_str_hash, g_str_equal);
+
+	mapped = g_hash_table_lookup (ev_mapped_files, filename);
+	if (mapped && mapped->size == statbuf.st_size && mapped->mtime == statbuf.st_mtime) {
+		mapped->users++;
+		g_mutex_unlock (&ev_mapped_files_mutex);
+
+		return mapped;
+	}
+
+	mapped = g_slice_new0 (EvMappedFile);
+	mapped->mapped_file = g_mapped_file_new (filename, FALSE, error);
+	if (!mapped->mapped_file) {
+		g_mutex_unlock (&ev_mapped_files_mutex);
+		g_slice_free (EvMappedFile, mapped);
+
+		return NULL;
+	}
+
+	mapped->filename = g_strdup (filename);
+	mapped->size = statbuf.st_size;
+	mapped->mtime = statbuf.st_mtime;
+	mapped->users = 1;
+#ifdef EV_MAPPED_FILE_GUARD
+	ev_mapped_file_guard (mapped);
+#endif
+
+	/* A stale mapping of the same file stays alive
+	 * until the documents using it go away
+	 */
+	g_hash_table_replace (ev_mapped_files, mapped->filename, mapped);
+	g_mutex_unlock (&ev_mapped_files_mutex);
+
+	return mapped;
+}
+
+static void
+ev_mapped_file_release (EvMappedFile *mapped)
+{
+	g_mutex_lock (&ev_mapped_files_mutex);
+
+	if (--mapped->users > 0) {
+		g_mutex_unlock (&ev_mapped_files_mutex);
+		return;
+	}
+
+	if (g_hash_table_lookup (ev_mapped_files, mapped->filename) == mapped)
+		g_hash_table_remove (ev_mapped_files, mapped->filename);
+#ifdef EV_MAPPED_FILE_GUARD
+	ev_mapped_file_unguard (mapped);
+#endif
+
+	g_mutex_unlock (&ev_mapped_files_mutex);
+
+	g_mapped_file_unref (mapped->mapped_file);
+	g_free (mapped->filename);
+	g_slice_free (EvMappedFile, mapped);
+}
+
 static void
 ev_document_finalize (GObject *object)
 {
@@ -132,6 +353,12 @@ ev_document_finalize (GObject *object)
 		document->priv->synctex_scanner = NULL;
 	}
 
+	/* The backend has already released the mapped data in dispose */
+	if (document->priv->mapped) {
+		ev_mapped_file_release (document->priv->mapped);
+		document->priv->mapped = NULL;
+	}
+
 	G_OBJECT_CLASS (ev_document_parent_class)->finalize (object);
 }
 
@@ -161,7 +388,11 @@ ev_document_class_init (EvDocumentClass *klass)
 void
 ev_document_doc_mutex_lock (void)
 {
+	gint64 trace_start = ev_trace_begin ();
+
 	g_mutex_lock (&ev_doc_mutex);
+
+	ev_trace_end ("lock", "Document lock wait", trace_start);
 }
 
 void
@@ -204,6 +435,7 @@ ev_document_setup_cache (EvDocument *document)
          * going to the backends since it requires locks
          */
         priv->n_pages = _ev_document_get_n_pages (document);
+        priv->cache_loaded = TRUE;
 
         for (i = 0; i < priv->n_pages; i++) {
                 EvPage     *page = ev_document_get_page (document, i);
@@ -267,6 +499,82 @@ ev_document_setup_cache (EvDocument *document)
         }
 }
 
+static void
+ev_document_setup (EvDocument         *document,
+                   EvDocumentLoadFlags flags)
+{
+        /* Going through every page is what makes opening large
+         * documents slow, so it's skipped when only a few pages
+         * will be used
+         */
+        if (flags & EV_DOCUMENT_LOAD_FLAG_NO_CACHE)
+                document->priv->n_pages = _ev_document_get_n_pages (document);
+        else
+                ev_document_setup_cache (document);
+}
+
+static void
+ev_document_loaded (EvDocument         *document,
+		    const char         *uri,
+		    EvDocumentLoadFlags flags)
+{
+	EvDocumentPrivate *priv = document->priv;
+
+	ev_document_setup (document, flags);
+
+	priv->uri = g_strdup (uri);
+	priv->info = _ev_document_get_info (document);
+	if (!(flags & EV_DOCUMENT_LOAD_FLAG_NO_CACHE) &&
+	    _ev_document_support_synctex (document)) {
+		gchar *filename;
+
+		filename = g_filename_from_uri (uri, NULL, NULL);
+		if (filename != NULL) {
+			priv->synctex_scanner =
+				synctex_scanner_new_with_output_file (filename, NULL, 1);
+			g_free (filename);
+		}
+	}
+}
+
+static void
+ev_document_load_failed (EvDocument *document,
+			 GError     *err,
+			 GError    **error)
+{
+	if (err) {
+		g_propagate_error (error, err);
+	} else {
+		g_warning ("%s::EvDocument::load returned FALSE but did not fill in @error; fix the backend!\n",
+			   G_OBJECT_TYPE_NAME (document));
+
+		/* So upper layers don't crash */
+		g_set_error_literal (error,
+				     EV_DOCUMENT_ERROR,
+				     EV_DOCUMENT_ERROR_INVALID,
+				     "Internal error in backend");
+	}
+}
+
+static gboolean
+ev_document_load_uri (EvDocument         *document,
+		      const char         *uri,
+		      EvDocumentLoadFlags flags,
+		      GError            **error)
+{
+	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS (document);
+	gboolean retval;
+	GError *err = NULL;
+
+	retval = klass->load (document, uri, &err);
+	if (!retval)
+		ev_document_load_failed (document, err, error);
+	else
+		ev_document_loaded (document, uri, flags);
+
+	return retval;
+}
+
 /**
  * ev_document_load:
  * @document: a #EvDocument
@@ -289,44 +597,111 @@ ev_document_load (EvDocument  *document,
 		  const char  *uri,
 		  GError     **error)
 {
-	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS (document);
-	gboolean retval;
-	GError *err = NULL;
+	return ev_document_load_uri (document, uri, EV_DOCUMENT_LOAD_FLAG_NONE, error);
+}
 
-	retval = klass->load (document, uri, &err);
+/**
+ * ev_document_load_mapped:
+ * @document: a #EvDocument
+ * @uri: the document's URI
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Loads @document from @uri like ev_document_load(), but if @uri is a
+ * local file and the backend can read documents from memory, the file
+ * is mapped read-only and the backend reads it directly from the mapping,
+ * so that the document is paged in lazily by the kernel instead of being
+ * copied. The mapping is shared by all the documents loaded from the same
+ * unchanged file. Otherwise this is equivalent to ev_document_load().
+ *
+ * Files smaller than a few megabytes are not mapped: they don't benefit
+ * from it, and they are the ones usually rewritten in place (e.g. by TeX)
+ * while being viewed. When a mapped file is truncated anyway, the pages
+ * past its new end read as zeros instead of crashing the process with
+ * SIGBUS, and the document has to be loaded again.
+ *
+ * Returns: %TRUE on success, or %FALSE on failure.
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_document_load_mapped (EvDocument  *document,
+			 const char  *uri,
+			 GError     **error)
+{
+	return ev_document_load_full (document, uri, EV_DOCUMENT_LOAD_FLAG_NONE, error);
+}
+
+/**
+ * ev_document_load_full:
+ * @document: a #EvDocument
+ * @uri: the document's URI
+ * @flags: flags from #EvDocumentLoadFlags
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Loads @document from @uri like ev_document_load_mapped().
+ *
+ * With %EV_DOCUMENT_LOAD_FLAG_NO_CACHE, the size and label of every page
+ * are not read while loading, which is the slowest part of loading
+ * documents with many pages. They are then asked to the backend every
+ * time they are needed, so the document lock must be held as for
+ * rendering, and the maximum, minimum and uniform page sizes are not
+ * available. Use it when only a few pages will be rendered, like for
+ * thumbnailing a file.
+ *
+ * Returns: %TRUE on success, or %FALSE on failure.
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_document_load_full (EvDocument         *document,
+		       const char         *uri,
+		       EvDocumentLoadFlags flags,
+		       GError            **error)
+{
+	EvDocumentClass *klass;
+	EvMappedFile    *mapped;
+	gchar           *filename;
+	gboolean         retval;
+	GError          *err = NULL;
+
+	g_return_val_if_fail (EV_IS_DOCUMENT (document), FALSE);
+	g_return_val_if_fail (uri != NULL, FALSE);
+
+	klass = EV_DOCUMENT_GET_CLASS (document);
+	if (!klass->load_mapped)
+		return ev_document_load_uri (document, uri, flags, error);
+
+	filename = g_filename_from_uri (uri, NULL, NULL);
+	if (!filename)
+		return ev_document_load_uri (document, uri, flags, error);
+
+	mapped = ev_mapped_file_acquire (filename, EV_DOCUMENT_MAPPED_MIN_SIZE, NULL);
+	g_free (filename);
+	if (!mapped)
+		return ev_document_load_uri (document, uri, flags, error);
+
+	retval = klass->load_mapped (document, mapped->mapped_file, &err);
 	if (!retval) {
-		if (err) {
-			g_propagate_error (error, err);
-		} else {
-			g_warning ("%s::EvDocument::load returned FALSE but did not fill in @error; fix the backend!\n",
-				   G_OBJECT_TYPE_NAME (document));
-
-			/* So upper layers don't crash */
-			g_set_error_literal (error,
-					     EV_DOCUMENT_ERROR,
-					     EV_DOCUMENT_ERROR_INVALID,
-					     "Internal error in backend");
+		ev_mapped_file_release (mapped);
+
+		if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+			g_error_free (err);
+			return ev_document_load_uri (document, uri, flags, error);
 		}
-	} else {
-                EvDocumentPrivate *priv = document->priv;
 
-                ev_document_setup_cache (document);
+		ev_document_load_failed (document, err, error);
 
-                priv->uri = g_strdup (uri);
-                priv->info = _ev_document_get_info (document);
-                if (_ev_document_support_synctex (document)) {
-                        gchar *filename;
+		return FALSE;
+	}
 
-                        filename = g_filename_from_uri (uri, NULL, NULL);
-                        if (filename != NULL) {
-                                priv->synctex_scanner =
-                                        synctex_scanner_new_with_output_file (filename, NULL, 1);
-                                g_free (filename);
-                        }
-                }
-        }
+	/* Reloading a document replaces its previous mapping */
+	if (document->priv->mapped)
+		ev_mapped_file_release (document->priv->mapped);
+	document->priv->mapped = mapped;
 
-	return retval;
+	ev_document_loaded (document, uri, flags);
+
+	return TRUE;
 }
 
 /**
@@ -368,7 +743,7 @@ ev_document_load_stream (EvDocument         *document,
         if (!klass->load_stream (document, stream, flags, cancellable, error))
                 return FALSE;
 
-        ev_document_setup_cache (document);
+        ev_document_setup (document, flags);
 
         return TRUE;
 }
@@ -412,7 +787,7 @@ ev_document_load_gfile (EvDocument         *document,
         if (!klass->load_gfile (document, file, flags, cancellable, error))
                 return FALSE;
 
-        ev_document_setup_cache (document);
+        ev_document_setup (document, flags);
 
         return TRUE;
 }
@@ -609,6 +984,20 @@ ev_document_get_page_size (EvDocument *document,
 	g_return_if_fail (EV_IS_DOCUMENT (document));
 	g_return_if_fail (page_index >= 0 || page_index < document->priv->n_pages);
 
+	if (!document->priv->cache_loaded) {
+		EvPage *page = ev_document_get_page (document, page_index);
+		gdouble page_width = 0, page_height = 0;
+
+		_ev_document_get_page_size (document, page, &page_width, &page_height);
+		g_object_unref (page);
+
+		if (width)
+			*width = page_width;
+		if (height)
+			*height = page_height;
+		return;
+	}
+
 	if (width)
 		*width = document->priv->uniform ?
 			document->priv->uniform_width :
@@ -636,6 +1025,16 @@ ev_document_get_page_label (EvDocument *document,
 	g_return_val_if_fail (EV_IS_DOCUMENT (document), NULL);
 	g_return_val_if_fail (page_index >= 0 || page_index < document->priv->n_pages, NULL);
 
+	if (!document->priv->cache_loaded) {
+		EvPage *page = ev_document_get_page (document, page_index);
+		gchar  *page_label;
+
+		page_label = _ev_document_get_page_label (document, page);
+		g_object_unref (page);
+
+		return page_label ? page_label : g_strdup_printf ("%d", page_index + 1);
+	}
+
 	return (document->priv->page_labels && document->priv->page_labels[page_index]) ?
 		g_strdup (document->priv->page_labels[page_index]) :
 		g_strdup_printf ("%d", page_index + 1);
@@ -55,7 +55,8 @@ typedef struct _EvDocumentPrivate EvDocumentPrivate;
 #define EV_DOC_MUTEX_UNLOCK (ev_document_doc_mutex_unlock ())
 
 typedef enum /*< flags >*/ {
-        EV_DOCUMENT_LOAD_FLAG_NONE = 0
+        EV_DOCUMENT_LOAD_FLAG_NONE     = 0,
+        EV_DOCUMENT_LOAD_FLAG_NO_CACHE = 1 << 0
 } EvDocumentLoadFlags;
 
 typedef enum
@@ -127,6 +128,11 @@ struct _EvDocumentClass
                                                EvDocumentLoadFlags  flags,
                                                GCancellable        *cancellable,
                                                GError             **error);
+
+        /* Memory mapped files */
+        gboolean          (* load_mapped)     (EvDocument          *document,
+                                               GMappedFile         *mapped_file,
+                                               GError             **error);
 };
 
 GType            ev_document_get_type             (void) G_GNUC_CONST;
@@ -150,6 +156,13 @@ gboolean         ev_document_get_backend_info     (EvDocument      *document,
 gboolean         ev_document_load                 (EvDocument      *document,
 						   const char      *uri,
 						   GError         **error);
+gboolean         ev_document_load_mapped          (EvDocument      *document,
+						   const char      *uri,
+						   GError         **error);
+gboolean         ev_document_load_full            (EvDocument         *document,
+						   const char         *uri,
+						   EvDocumentLoadFlags flags,
+						   GError            **error);
 gboolean         ev_document_load_stream          (EvDocument         *document,
                                                    GInputStream       *stream,
                                                    EvDocumentLoadFlags flags,
@@ -21,6 +21,7 @@
 
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -738,3 +739,169 @@ ev_file_compress (const gchar       *uri,
 
 	return compression_run (uri, type, TRUE, error);
 }
+
+static gboolean
+compression_run_to_stream (const gchar       *filename,
+			   EvCompressionType  type,
+			   GOutputStream     *stream,
+			   GCancellable      *cancellable,
+			   GError           **error)
+{
+	gchar      *argv[N_ARGS];
+	gchar      *cmd;
+	GPid        pid;
+	gint        pout;
+	gint        status;
+	GIOChannel *in;
+	gchar       buf[BUFFER_SIZE];
+	GIOStatus   read_st;
+	gsize       bytes_read;
+	gboolean    retval = TRUE;
+
+	cmd = g_find_program_in_path (compressor_cmds[type]);
+	if (!cmd) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+			     "Failed to find the \"%s\" command in the search path.",
+                             compressor_cmds[type]);
+		return FALSE;
+	}
+
+	argv[0] = cmd;
+	argv[1] = "-c";
+	argv[2] = (gchar *) filename;
+	argv[3] = NULL;
+
+	if (!g_spawn_async_with_pipes (NULL, argv, NULL,
+				       G_SPAWN_STDERR_TO_DEV_NULL |
+				       G_SPAWN_DO_NOT_REAP_CHILD,
+				       NULL, NULL, &pid,
+				       NULL, &pout, NULL, error)) {
+		g_free (cmd);
+		return FALSE;
+	}
+
+	in = g_io_channel_unix_new (pout);
+	g_io_channel_set_encoding (in, NULL, NULL);
+	g_io_channel_set_close_on_unref (in, TRUE);
+
+	do {
+		read_st = g_io_channel_read_chars (in, buf, BUFFER_SIZE,
+						   &bytes_read, error);
+		if (read_st == G_IO_STATUS_ERROR) {
+			retval = FALSE;
+			break;
+		}
+
+		if (bytes_read > 0 &&
+		    !g_output_stream_write_all (stream, buf, bytes_read,
+						NULL, cancellable, error)) {
+			retval = FALSE;
+			break;
+		}
+	} while (read_st != G_IO_STATUS_EOF);
+
+	g_io_channel_unref (in);
+
+	/* A compressor that crashed or failed leaves a truncated output
+	 * that is still read until the end, only its status tells.
+	 * Closing the pipe above makes it exit if we stopped reading.
+	 */
+	while (waitpid (pid, &status, 0) == -1 && errno == EINTR)
+		;
+	g_spawn_close_pid (pid);
+
+	if (retval) {
+#if GLIB_CHECK_VERSION (2, 34, 0)
+		retval = g_spawn_check_exit_status (status, error);
+#else
+		if (!WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+			g_set_error (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+				     _("The command “%s” failed."), cmd);
+			retval = FALSE;
+		}
+#endif
+	}
+	g_free (cmd);
+
+	return retval;
+}
+
+/**
+ * ev_file_compress_to_stream:
+ * @uri: a file URI
+ * @type: the compression type
+ * @stream: a #GOutputStream to write the compressed data to
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Compresses the file at @uri writing the result directly to @stream,
+ * without going through a temporary file. Gzip compression is done
+ * in-process, other compression types pipe the output of the external
+ * compressor into @stream. If @type is %EV_COMPRESSION_NONE the contents
+ * of the file are copied unmodified.
+ *
+ * @stream is not closed.
+ *
+ * Returns: %TRUE on success, or %FALSE on error with @error filled in
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_file_compress_to_stream (const gchar       *uri,
+			    EvCompressionType  type,
+			    GOutputStream     *stream,
+			    GCancellable      *cancellable,
+			    GError           **error)
+{
+	GFile            *file;
+	GFileInputStream *input;
+	GOutputStream    *output;
+	gboolean          retval;
+
+	g_return_val_if_fail (uri != NULL, FALSE);
+	g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+	if (type == EV_COMPRESSION_BZIP2 || type == EV_COMPRESSION_LZMA) {
+		gchar *filename;
+
+		filename = g_filename_from_uri (uri, NULL, error);
+		if (!filename)
+			return FALSE;
+
+		retval = compression_run_to_stream (filename, type, stream,
+						    cancellable, error);
+		g_free (filename);
+
+		return retval;
+	}
+
+	file = g_file_new_for_uri (uri);
+	input = g_file_read (file, cancellable, error);
+	g_object_unref (file);
+	if (!input)
+		return FALSE;
+
+	if (type == EV_COMPRESSION_GZIP) {
+		GZlibCompressor *compressor;
+
+		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		output = g_converter_output_stream_new (stream, G_CONVERTER (compressor));
+		g_filter_output_stream_set_close_base_stream (G_FILTER_OUTPUT_STREAM (output), FALSE);
+		g_object_unref (compressor);
+	} else {
+		output = g_object_ref (stream);
+	}
+
+	/* Closing the converter stream flushes the compressor, the base
+	 * stream is left open for the caller.
+	 */
+	retval = g_output_stream_splice (output, G_INPUT_STREAM (input),
+					 G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+					 (output != stream ? G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET : 0),
+					 cancellable, error) != -1;
+
+	g_object_unref (output);
+	g_object_unref (input);
+
+	return retval;
+}
@@ -68,6 +68,11 @@ gchar       *ev_file_uncompress       (const gchar       *uri,
 gchar       *ev_file_compress         (const gchar       *uri,
 				       EvCompressionType  type,
 				       GError           **error);
+gboolean     ev_file_compress_to_stream (const gchar       *uri,
+                                         EvCompressionType  type,
+                                         GOutputStream     *stream,
+                                         GCancellable      *cancellable,
+                                         GError           **error);
 
 
 G_END_DECLS
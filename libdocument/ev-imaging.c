@@ -0,0 +1,724 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "ev-imaging.h"
+
+/* SSE2 is always there on x86-64, and NEON on arm64, so the vector
+ * paths don't need any runtime detection. Other targets, and the
+ * pixels left at the end of every row, use the scalar code.
+ */
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define EV_IMAGING_SSE2 1
+#elif (defined (__ARM_NEON) || defined (__ARM_NEON__)) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#include <arm_neon.h>
+#define EV_IMAGING_NEON 1
+#endif
+
+#define EV_IMAGING_ROTATE_TILE 32
+
+#define EV_IMAGING_ROW(data, stride, y) ((data) + (gsize) (y) * (stride))
+
+#if defined (EV_IMAGING_SSE2) || defined (EV_IMAGING_NEON)
+static const guint8 rgba_invert_mask[16] = {
+	0xff, 0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00,
+	0xff, 0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00
+};
+#endif
+
+static inline guint32
+ev_imaging_swap_rb (guint32 pixel)
+{
+	return (pixel & 0xff00ff00) | ((pixel >> 16) & 0xff) | ((pixel & 0xff) << 16);
+}
+
+#if defined (EV_IMAGING_SSE2)
+static inline __m128i
+ev_imaging_swap_rb_sse2 (__m128i v)
+{
+	const __m128i ag = _mm_set1_epi32 ((gint) 0xff00ff00);
+	const __m128i low = _mm_set1_epi32 (0xff);
+
+	return _mm_or_si128 (_mm_and_si128 (v, ag),
+			     _mm_or_si128 (_mm_and_si128 (_mm_srli_epi32 (v, 16), low),
+					   _mm_slli_epi32 (_mm_and_si128 (v, low), 16)));
+}
+
+static inline gboolean
+ev_imaging_is_opaque_sse2 (__m128i v)
+{
+	const __m128i alpha = _mm_set1_epi32 ((gint) 0xff000000);
+
+	return _mm_movemask_epi8 (_mm_cmpeq_epi32 (_mm_and_si128 (v, alpha), alpha)) == 0xffff;
+}
+#elif defined (EV_IMAGING_NEON)
+static inline uint32x4_t
+ev_imaging_swap_rb_neon (uint32x4_t v)
+{
+	const uint32x4_t low = vdupq_n_u32 (0xff);
+
+	return vorrq_u32 (vandq_u32 (v, vdupq_n_u32 (0xff00ff00)),
+			  vorrq_u32 (vandq_u32 (vshrq_n_u32 (v, 16), low),
+				     vshlq_n_u32 (vandq_u32 (v, low), 16)));
+}
+
+static inline gboolean
+ev_imaging_is_opaque_neon (uint32x4_t v)
+{
+	uint32x4_t a = vandq_u32 (v, vdupq_n_u32 (0xff000000));
+	uint32x2_t m = vand_u32 (vget_low_u32 (a), vget_high_u32 (a));
+
+	return (vget_lane_u32 (m, 0) & vget_lane_u32 (m, 1)) == 0xff000000;
+}
+#endif
+
+/* Inverting with cairo is painting white with the DIFFERENCE operator,
+ * which for premultiplied pixels gives opaque pixels with every color
+ * channel inverted.
+ */
+void
+ev_imaging_invert_argb32 (guchar *data,
+			  gint    width,
+			  gint    height,
+			  gint    stride)
+{
+	gint y;
+
+	for (y = 0; y < height; y++) {
+		guint32 *p = (guint32 *) EV_IMAGING_ROW (data, stride, y);
+		gint     x = 0;
+
+#if defined (EV_IMAGING_SSE2)
+		const __m128i ones = _mm_set1_epi32 (-1);
+		const __m128i alpha = _mm_set1_epi32 ((gint) 0xff000000);
+
+		for (; x + 4 <= width; x += 4) {
+			__m128i v = _mm_loadu_si128 ((__m128i *) (p + x));
+
+			v = _mm_or_si128 (_mm_xor_si128 (v, ones), alpha);
+			_mm_storeu_si128 ((__m128i *) (p + x), v);
+		}
+#elif defined (EV_IMAGING_NEON)
+		const uint32x4_t alpha = vdupq_n_u32 (0xff000000);
+
+		for (; x + 4 <= width; x += 4)
+			vst1q_u32 (p + x, vorrq_u32 (vmvnq_u32 (vld1q_u32 (p + x)), alpha));
+#endif
+		for (; x < width; x++)
+			p[x] = ~p[x] | 0xff000000;
+	}
+}
+
+/* Inverts the color channels and keeps the alpha channel, if any */
+void
+ev_imaging_invert_rgb (guchar *data,
+		       gint    width,
+		       gint    height,
+		       gint    stride,
+		       gint    n_channels)
+{
+	gint n_bytes = width * n_channels;
+	gint y;
+
+	g_return_if_fail (n_channels == 3 || n_channels == 4);
+
+	for (y = 0; y < height; y++) {
+		guchar *p = EV_IMAGING_ROW (data, stride, y);
+		gint    i = 0;
+
+#if defined (EV_IMAGING_SSE2)
+		const __m128i mask = n_channels == 4 ?
+			_mm_loadu_si128 ((const __m128i *) rgba_invert_mask) :
+			_mm_set1_epi8 ((gchar) 0xff);
+
+		for (; i + 16 <= n_bytes; i += 16) {
+			__m128i v = _mm_loadu_si128 ((__m128i *) (p + i));
+
+			_mm_storeu_si128 ((__m128i *) (p + i), _mm_xor_si128 (v, mask));
+		}
+#elif defined (EV_IMAGING_NEON)
+		const uint8x16_t mask = n_channels == 4 ?
+			vld1q_u8 (rgba_invert_mask) : vdupq_n_u8 (0xff);
+
+		for (; i + 16 <= n_bytes; i += 16)
+			vst1q_u8 (p + i, veorq_u8 (vld1q_u8 (p + i), mask));
+#endif
+		for (; i < n_bytes; i++) {
+			if (n_channels == 3 || i % 4 != 3)
+				p[i] = 255 - p[i];
+		}
+	}
+}
+
+/* Swaps the lowest and the third bytes of every 32 bit pixel, which
+ * turns ABGR words into ARGB ones and back.
+ */
+void
+ev_imaging_swap_red_blue (guchar *data,
+			  gint    width,
+			  gint    height,
+			  gint    stride)
+{
+	gint y;
+
+	for (y = 0; y < height; y++) {
+		guint32 *p = (guint32 *) EV_IMAGING_ROW (data, stride, y);
+		gint     x = 0;
+
+#if defined (EV_IMAGING_SSE2)
+		for (; x + 4 <= width; x += 4) {
+			__m128i v = _mm_loadu_si128 ((__m128i *) (p + x));
+
+			_mm_storeu_si128 ((__m128i *) (p + x), ev_imaging_swap_rb_sse2 (v));
+		}
+#elif defined (EV_IMAGING_NEON)
+		for (; x + 4 <= width; x += 4)
+			vst1q_u32 (p + x, ev_imaging_swap_rb_neon (vld1q_u32 (p + x)));
+#endif
+		for (; x < width; x++)
+			p[x] = ev_imaging_swap_rb (p[x]);
+	}
+}
+
+static inline void
+ev_imaging_unpremultiply (guint32  pixel,
+			  guchar  *dest)
+{
+	guint a = pixel >> 24;
+	guint r = (pixel >> 16) & 0xff;
+	guint g = (pixel >> 8) & 0xff;
+	guint b = pixel & 0xff;
+
+	if (a == 0xff) {
+		dest[0] = r;
+		dest[1] = g;
+		dest[2] = b;
+	} else if (a == 0) {
+		dest[0] = dest[1] = dest[2] = 0;
+	} else {
+		dest[0] = MIN ((r * 255 + a / 2) / a, 255);
+		dest[1] = MIN ((g * 255 + a / 2) / a, 255);
+		dest[2] = MIN ((b * 255 + a / 2) / a, 255);
+	}
+	dest[3] = a;
+}
+
+/* Same rounding as gdk_cairo_set_source_pixbuf() */
+static inline guint
+ev_imaging_multiply (guint c,
+		     guint a)
+{
+	guint t = c * a + 0x80;
+
+	return ((t >> 8) + t) >> 8;
+}
+
+static inline guint32
+ev_imaging_premultiply (const guchar *src)
+{
+	guint a = src[3];
+
+	if (a == 0xff)
+		return 0xff000000 | (src[0] << 16) | (src[1] << 8) | src[2];
+	if (a == 0)
+		return 0;
+
+	return (a << 24) |
+		(ev_imaging_multiply (src[0], a) << 16) |
+		(ev_imaging_multiply (src[1], a) << 8) |
+		ev_imaging_multiply (src[2], a);
+}
+
+/* On little endian machines, opaque pixels only need their red and blue
+ * bytes swapped to go from ARGB32 words to RGBA bytes and back.
+ */
+void
+ev_imaging_argb32_to_rgb (const guchar *src,
+			  gint          src_stride,
+			  guchar       *dest,
+			  gint          dest_stride,
+			  gint          dest_n_channels,
+			  gint          width,
+			  gint          height)
+{
+	gint y;
+
+	g_return_if_fail (dest_n_channels == 3 || dest_n_channels == 4);
+
+	for (y = 0; y < height; y++) {
+		const guint32 *s = (const guint32 *) EV_IMAGING_ROW (src, src_stride, y);
+		guchar        *d = EV_IMAGING_ROW (dest, dest_stride, y);
+		gint           x = 0;
+
+		if (dest_n_channels == 3) {
+			for (; x < width; x++) {
+				d[x * 3] = (s[x] >> 16) & 0xff;
+				d[x * 3 + 1] = (s[x] >> 8) & 0xff;
+				d[x * 3 + 2] = s[x] & 0xff;
+			}
+			continue;
+		}
+
+#if defined (EV_IMAGING_SSE2)
+		for (; x + 4 <= width; x += 4) {
+			__m128i v = _mm_loadu_si128 ((const __m128i *) (s + x));
+			gint    i;
+
+			if (ev_imaging_is_opaque_sse2 (v)) {
+				_mm_storeu_si128 ((__m128i *) (d + x * 4), ev_imaging_swap_rb_sse2 (v));
+				continue;
+			}
+
+			for (i = 0; i < 4; i++)
+				ev_imaging_unpremultiply (s[x + i], d + (x + i) * 4);
+		}
+#elif defined (EV_IMAGING_NEON)
+		for (; x + 4 <= width; x += 4) {
+			uint32x4_t v = vld1q_u32 (s + x);
+			gint       i;
+
+			if (ev_imaging_is_opaque_neon (v)) {
+				vst1q_u32 ((guint32 *) (d + x * 4), ev_imaging_swap_rb_neon (v));
+				continue;
+			}
+
+			for (i = 0; i < 4; i++)
+				ev_imaging_unpremultiply (s[x + i], d + (x + i) * 4);
+		}
+#endif
+		for (; x < width; x++)
+			ev_imaging_unpremultiply (s[x], d + x * 4);
+	}
+}
+
+void
+ev_imaging_rgb_to_argb32 (const guchar *src,
+			  gint          src_stride,
+			  gint          src_n_channels,
+			  guchar       *dest,
+			  gint          dest_stride,
+			  gint          width,
+			  gint          height)
+{
+	gint y;
+
+	g_return_if_fail (src_n_channels == 3 || src_n_channels == 4);
+
+	for (y = 0; y < height; y++) {
+		const guchar *s = EV_IMAGING_ROW (src, src_stride, y);
+		guint32      *d = (guint32 *) EV_IMAGING_ROW (dest, dest_stride, y);
+		gint          x = 0;
+
+		if (src_n_channels == 3) {
+			for (; x < width; x++) {
+				d[x] = 0xff000000 | (s[x * 3] << 16) | (s[x * 3 + 1] << 8) | s[x * 3 + 2];
+			}
+			continue;
+		}
+
+#if defined (EV_IMAGING_SSE2)
+		for (; x + 4 <= width; x += 4) {
+			__m128i v = _mm_loadu_si128 ((const __m128i *) (s + x * 4));
+			gint    i;
+
+			if (ev_imaging_is_opaque_sse2 (v)) {
+				_mm_storeu_si128 ((__m128i *) (d + x), ev_imaging_swap_rb_sse2 (v));
+				continue;
+			}
+
+			for (i = 0; i < 4; i++)
+				d[x + i] = ev_imaging_premultiply (s + (x + i) * 4);
+		}
+#elif defined (EV_IMAGING_NEON)
+		for (; x + 4 <= width; x += 4) {
+			uint32x4_t v = vld1q_u32 ((const guint32 *) (s + x * 4));
+			gint       i;
+
+			if (ev_imaging_is_opaque_neon (v)) {
+				vst1q_u32 (d + x, ev_imaging_swap_rb_neon (v));
+				continue;
+			}
+
+			for (i = 0; i < 4; i++)
+				d[x + i] = ev_imaging_premultiply (s + (x + i) * 4);
+		}
+#endif
+		for (; x < width; x++)
+			d[x] = ev_imaging_premultiply (s + x * 4);
+	}
+}
+
+/* The four channels of a pixel as floats, lowest byte first */
+#if defined (EV_IMAGING_SSE2)
+typedef __m128 EvVec4;
+
+static inline EvVec4
+ev_vec4_zero (void)
+{
+	return _mm_setzero_ps ();
+}
+
+static inline EvVec4
+ev_vec4_load (const gfloat *p)
+{
+	return _mm_loadu_ps (p);
+}
+
+static inline void
+ev_vec4_store (gfloat *p,
+	       EvVec4  v)
+{
+	_mm_storeu_ps (p, v);
+}
+
+static inline EvVec4
+ev_vec4_madd (EvVec4 acc,
+	      EvVec4 v,
+	      gfloat w)
+{
+	return _mm_add_ps (acc, _mm_mul_ps (v, _mm_set1_ps (w)));
+}
+
+static inline EvVec4
+ev_vec4_from_pixel (guint32 pixel)
+{
+	const __m128i zero = _mm_setzero_si128 ();
+	__m128i       v = _mm_cvtsi32_si128 ((gint) pixel);
+
+	v = _mm_unpacklo_epi16 (_mm_unpacklo_epi8 (v, zero), zero);
+
+	return _mm_cvtepi32_ps (v);
+}
+
+static inline guint32
+ev_vec4_to_pixel (EvVec4 v)
+{
+	__m128i i = _mm_cvtps_epi32 (v);
+
+	i = _mm_packs_epi32 (i, i);
+	i = _mm_packus_epi16 (i, i);
+
+	return (guint32) _mm_cvtsi128_si32 (i);
+}
+#elif defined (EV_IMAGING_NEON)
+typedef float32x4_t EvVec4;
+
+static inline EvVec4
+ev_vec4_zero (void)
+{
+	return vdupq_n_f32 (0);
+}
+
+static inline EvVec4
+ev_vec4_load (const gfloat *p)
+{
+	return vld1q_f32 (p);
+}
+
+static inline void
+ev_vec4_store (gfloat *p,
+	       EvVec4  v)
+{
+	vst1q_f32 (p, v);
+}
+
+static inline EvVec4
+ev_vec4_madd (EvVec4 acc,
+	      EvVec4 v,
+	      gfloat w)
+{
+	return vmlaq_n_f32 (acc, v, w);
+}
+
+static inline EvVec4
+ev_vec4_from_pixel (guint32 pixel)
+{
+	uint16x8_t v = vmovl_u8 (vreinterpret_u8_u32 (vdup_n_u32 (pixel)));
+
+	return vcvtq_f32_u32 (vmovl_u16 (vget_low_u16 (v)));
+}
+
+static inline guint32
+ev_vec4_to_pixel (EvVec4 v)
+{
+	uint32x4_t i = vcvtq_u32_f32 (vaddq_f32 (v, vdupq_n_f32 (0.5f)));
+	uint16x4_t h = vqmovn_u32 (i);
+
+	return vget_lane_u32 (vreinterpret_u32_u8 (vqmovn_u16 (vcombine_u16 (h, h))), 0);
+}
+#else
+typedef struct {
+	gfloat v[4];
+} EvVec4;
+
+static inline EvVec4
+ev_vec4_zero (void)
+{
+	EvVec4 r = { { 0, 0, 0, 0 } };
+
+	return r;
+}
+
+static inline EvVec4
+ev_vec4_load (const gfloat *p)
+{
+	EvVec4 r;
+
+	memcpy (r.v, p, sizeof (r.v));
+
+	return r;
+}
+
+static inline void
+ev_vec4_store (gfloat *p,
+	       EvVec4  v)
+{
+	memcpy (p, v.v, sizeof (v.v));
+}
+
+static inline EvVec4
+ev_vec4_madd (EvVec4 acc,
+	      EvVec4 v,
+	      gfloat w)
+{
+	gint i;
+
+	for (i = 0; i < 4; i++)
+		acc.v[i] += v.v[i] * w;
+
+	return acc;
+}
+
+static inline EvVec4
+ev_vec4_from_pixel (guint32 pixel)
+{
+	EvVec4 r;
+	gint   i;
+
+	for (i = 0; i < 4; i++)
+		r.v[i] = (pixel >> (i * 8)) & 0xff;
+
+	return r;
+}
+
+static inline guint32
+ev_vec4_to_pixel (EvVec4 v)
+{
+	guint32 pixel = 0;
+	gint    i;
+
+	for (i = 0; i < 4; i++)
+		pixel |= (guint32) CLAMP ((gint) (v.v[i] + 0.5f), 0, 255) << (i * 8);
+
+	return pixel;
+}
+#endif
+
+/* Every destination pixel is the average of the source pixels under
+ * it, weighted by how much of them it covers.
+ */
+typedef struct {
+	gint   *first;
+	gint   *n;
+	gfloat *weights;
+	gint    max_n;
+} EvBoxFilter;
+
+static void
+ev_box_filter_init (EvBoxFilter *filter,
+		    gint         src_length,
+		    gint         dest_length)
+{
+	gdouble scale = (gdouble) src_length / dest_length;
+	gint    i;
+
+	filter->max_n = (gint) scale + 2;
+	filter->first = g_new (gint, dest_length);
+	filter->n = g_new0 (gint, dest_length);
+	filter->weights = g_new0 (gfloat, dest_length * filter->max_n);
+
+	for (i = 0; i < dest_length; i++) {
+		gdouble start = i * scale;
+		gdouble end = MIN ((i + 1) * scale, src_length);
+		gint    j;
+
+		filter->first[i] = (gint) start;
+		for (j = filter->first[i]; j < end && filter->n[i] < filter->max_n; j++) {
+			gdouble coverage = MIN (end, j + 1) - MAX (start, j);
+
+			filter->weights[i * filter->max_n + filter->n[i]++] = coverage / scale;
+		}
+	}
+}
+
+static void
+ev_box_filter_clear (EvBoxFilter *filter)
+{
+	g_free (filter->first);
+	g_free (filter->n);
+	g_free (filter->weights);
+}
+
+static void
+ev_imaging_downscale_row (const guint32     *src,
+			  const EvBoxFilter *filter,
+			  gfloat            *row,
+			  gint               width)
+{
+	gint x, k;
+
+	for (x = 0; x < width; x++) {
+		const gfloat  *w = filter->weights + x * filter->max_n;
+		const guint32 *s = src + filter->first[x];
+		EvVec4         sum = ev_vec4_zero ();
+
+		for (k = 0; k < filter->n[x]; k++)
+			sum = ev_vec4_madd (sum, ev_vec4_from_pixel (s[k]), w[k]);
+		ev_vec4_store (row + x * 4, sum);
+	}
+}
+
+/* Area averaging downscale. Unlike bilinear filtering, every source
+ * pixel contributes to the result, so thin lines and small text don't
+ * vanish from thumbnails.
+ */
+void
+ev_imaging_downscale_argb32 (const guchar *src,
+			     gint          src_width,
+			     gint          src_height,
+			     gint          src_stride,
+			     guchar       *dest,
+			     gint          dest_width,
+			     gint          dest_height,
+			     gint          dest_stride)
+{
+	EvBoxFilter h_filter, v_filter;
+	gfloat     *row, *acc;
+	gint        row_y = -1;
+	gint        x, y, k;
+
+	g_return_if_fail (dest_width > 0 && dest_width <= src_width);
+	g_return_if_fail (dest_height > 0 && dest_height <= src_height);
+
+	ev_box_filter_init (&h_filter, src_width, dest_width);
+	ev_box_filter_init (&v_filter, src_height, dest_height);
+	row = g_new (gfloat, dest_width * 4);
+	acc = g_new (gfloat, dest_width * 4);
+
+	for (y = 0; y < dest_height; y++) {
+		guint32 *d = (guint32 *) EV_IMAGING_ROW (dest, dest_stride, y);
+
+		memset (acc, 0, dest_width * 4 * sizeof (gfloat));
+
+		for (k = 0; k < v_filter.n[y]; k++) {
+			gint   sy = v_filter.first[y] + k;
+			gfloat wy = v_filter.weights[y * v_filter.max_n + k];
+
+			/* The last source row of a destination row is
+			 * usually the first one of the next row too
+			 */
+			if (sy != row_y) {
+				ev_imaging_downscale_row ((const guint32 *) EV_IMAGING_ROW (src, src_stride, sy),
+							  &h_filter, row, dest_width);
+				row_y = sy;
+			}
+
+			for (x = 0; x < dest_width; x++) {
+				ev_vec4_store (acc + x * 4,
+					       ev_vec4_madd (ev_vec4_load (acc + x * 4),
+							     ev_vec4_load (row + x * 4), wy));
+			}
+		}
+
+		for (x = 0; x < dest_width; x++)
+			d[x] = ev_vec4_to_pixel (ev_vec4_load (acc + x * 4));
+	}
+
+	g_free (row);
+	g_free (acc);
+	ev_box_filter_clear (&h_filter);
+	ev_box_filter_clear (&v_filter);
+}
+
+/* Rotates clockwise, like cairo_rotate() does with a positive angle.
+ * The destination is src_height x src_width for 90 and 270 degrees.
+ */
+void
+ev_imaging_rotate_argb32 (const guchar *src,
+			  gint          src_width,
+			  gint          src_height,
+			  gint          src_stride,
+			  guchar       *dest,
+			  gint          dest_stride,
+			  gint          rotation)
+{
+	gint x, y, tx, ty;
+
+	switch (rotation) {
+	case 0:
+		for (y = 0; y < src_height; y++) {
+			memcpy (EV_IMAGING_ROW (dest, dest_stride, y),
+				EV_IMAGING_ROW (src, src_stride, y),
+				src_width * 4);
+		}
+		break;
+	case 180:
+		for (y = 0; y < src_height; y++) {
+			const guint32 *s = (const guint32 *) EV_IMAGING_ROW (src, src_stride, y);
+			guint32       *d = (guint32 *) EV_IMAGING_ROW (dest, dest_stride, src_height - 1 - y);
+
+			for (x = 0; x < src_width; x++)
+				d[src_width - 1 - x] = s[x];
+		}
+		break;
+	case 90:
+	case 270:
+		/* Source rows become destination columns, so walk the
+		 * source in tiles to keep the destination rows in cache
+		 */
+		for (ty = 0; ty < src_height; ty += EV_IMAGING_ROTATE_TILE) {
+			for (tx = 0; tx < src_width; tx += EV_IMAGING_ROTATE_TILE) {
+				gint y_end = MIN (ty + EV_IMAGING_ROTATE_TILE, src_height);
+				gint x_end = MIN (tx + EV_IMAGING_ROTATE_TILE, src_width);
+
+				for (y = ty; y < y_end; y++) {
+					const guint32 *s = (const guint32 *) EV_IMAGING_ROW (src, src_stride, y);
+					guchar        *d;
+					gssize         step;
+
+					if (rotation == 90) {
+						d = EV_IMAGING_ROW (dest, dest_stride, tx) + (src_height - 1 - y) * 4;
+						step = dest_stride;
+					} else {
+						d = EV_IMAGING_ROW (dest, dest_stride, src_width - 1 - tx) + y * 4;
+						step = -(gssize) dest_stride;
+					}
+
+					for (x = tx; x < x_end; x++, d += step)
+						*(guint32 *) d = s[x];
+				}
+			}
+		}
+		break;
+	default:
+		g_return_if_reached ();
+	}
+}
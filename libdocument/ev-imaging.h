@@ -0,0 +1,81 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (EVINCE_COMPILATION)
+#error "This is a private header."
+#endif
+
+#ifndef EV_IMAGING_H
+#define EV_IMAGING_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Pixel kernels working on raw image data. ARGB32 pixels are native
+ * endian 32 bit words with premultiplied alpha, like in cairo image
+ * surfaces. RGB and RGBA pixels are bytes in memory order with non
+ * premultiplied alpha, like in GdkPixbufs. Rows are stride bytes apart.
+ */
+
+void ev_imaging_invert_argb32    (guchar       *data,
+				  gint          width,
+				  gint          height,
+				  gint          stride);
+void ev_imaging_invert_rgb       (guchar       *data,
+				  gint          width,
+				  gint          height,
+				  gint          stride,
+				  gint          n_channels);
+void ev_imaging_swap_red_blue    (guchar       *data,
+				  gint          width,
+				  gint          height,
+				  gint          stride);
+void ev_imaging_argb32_to_rgb    (const guchar *src,
+				  gint          src_stride,
+				  guchar       *dest,
+				  gint          dest_stride,
+				  gint          dest_n_channels,
+				  gint          width,
+				  gint          height);
+void ev_imaging_rgb_to_argb32    (const guchar *src,
+				  gint          src_stride,
+				  gint          src_n_channels,
+				  guchar       *dest,
+				  gint          dest_stride,
+				  gint          width,
+				  gint          height);
+void ev_imaging_downscale_argb32 (const guchar *src,
+				  gint          src_width,
+				  gint          src_height,
+				  gint          src_stride,
+				  guchar       *dest,
+				  gint          dest_width,
+				  gint          dest_height,
+				  gint          dest_stride);
+void ev_imaging_rotate_argb32    (const guchar *src,
+				  gint          src_width,
+				  gint          src_height,
+				  gint          src_stride,
+				  guchar       *dest,
+				  gint          dest_stride,
+				  gint          rotation);
+
+G_END_DECLS
+
+#endif /* EV_IMAGING_H */
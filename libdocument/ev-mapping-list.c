@@ -20,13 +20,267 @@
 
 #include "ev-mapping-list.h"
 
+/* Lists with at least this number of mappings get a spatial index
+ * built on the first point query
+ */
+#define EV_MAPPING_LIST_INDEX_MIN_LENGTH 64
+#define EV_MAPPING_LIST_INDEX_MAX_SIDE   256
+
+/* Uniform grid over the mapping areas. The mappings overlapping each
+ * cell are stored in list order in a single packed array, so that the
+ * first match in a cell is also the first match in the list.
+ */
+typedef struct {
+	gdouble     x, y;
+	gdouble     cell_width;
+	gdouble     cell_height;
+	guint       n_columns;
+	guint       n_rows;
+
+	EvMapping **mappings;
+	guint       n_mappings;
+	guint      *cell_offsets;
+	guint      *cell_entries;
+
+	/* Mappings appended after the index was built
+	 * are looked up linearly from here
+	 */
+	GList      *tail;
+} EvMappingIndex;
+
 struct _EvMappingList {
-	guint          page;
-	GList         *list;
-	GDestroyNotify data_destroy_func;
-	volatile gint  ref_count;
+	guint           page;
+	GList          *list;
+	GDestroyNotify  data_destroy_func;
+	volatile gint   ref_count;
+
+	EvMappingIndex *index;
+	gboolean        index_built;
 };
 
+static inline gboolean
+ev_mapping_contains (EvMapping *mapping,
+		     gdouble    x,
+		     gdouble    y)
+{
+	return (x >= mapping->area.x1) &&
+		(y >= mapping->area.y1) &&
+		(x <= mapping->area.x2) &&
+		(y <= mapping->area.y2);
+}
+
+static inline gboolean
+ev_mapping_intersects (EvMapping         *mapping,
+		       const EvRectangle *area)
+{
+	return (mapping->area.x1 <= area->x2) &&
+		(mapping->area.y1 <= area->y2) &&
+		(mapping->area.x2 >= area->x1) &&
+		(mapping->area.y2 >= area->y1);
+}
+
+static inline guint
+ev_mapping_index_cell (gdouble start,
+		       gdouble cell_size,
+		       guint   n_cells,
+		       gdouble value)
+{
+	gdouble cell = (value - start) / cell_size;
+
+	/* Points can be anywhere, even outside of the page, so clamp
+	 * before converting, which is undefined out of the guint range.
+	 * NaN goes to the first cell too.
+	 */
+	if (!(cell > 0))
+		return 0;
+	if (cell >= n_cells - 1)
+		return n_cells - 1;
+
+	return (guint) cell;
+}
+
+static void
+ev_mapping_index_free (EvMappingIndex *grid)
+{
+	g_free (grid->mappings);
+	g_free (grid->cell_offsets);
+	g_free (grid->cell_entries);
+	g_slice_free (EvMappingIndex, grid);
+}
+
+static EvMappingIndex *
+ev_mapping_index_new (GList *list)
+{
+	EvMappingIndex *grid;
+	GList          *l;
+	guint           n_mappings;
+	guint           n_cells;
+	guint           side = 1;
+	guint           i;
+	gdouble         x2 = 0, y2 = 0;
+	guint          *fill;
+
+	n_mappings = g_list_length (list);
+	if (n_mappings < EV_MAPPING_LIST_INDEX_MIN_LENGTH)
+		return NULL;
+
+	grid = g_slice_new0 (EvMappingIndex);
+	grid->mappings = g_new (EvMapping *, n_mappings);
+	grid->n_mappings = n_mappings;
+
+	i = 0;
+	for (l = list; l; l = l->next) {
+		EvMapping *mapping = l->data;
+
+		if (i == 0) {
+			grid->x = mapping->area.x1;
+			grid->y = mapping->area.y1;
+			x2 = mapping->area.x2;
+			y2 = mapping->area.y2;
+		} else {
+			grid->x = MIN (grid->x, mapping->area.x1);
+			grid->y = MIN (grid->y, mapping->area.y1);
+			x2 = MAX (x2, mapping->area.x2);
+			y2 = MAX (y2, mapping->area.y2);
+		}
+		grid->mappings[i++] = mapping;
+		grid->tail = l;
+	}
+
+	while ((side + 1) * (side + 1) <= n_mappings && side < EV_MAPPING_LIST_INDEX_MAX_SIDE)
+		side++;
+
+	grid->n_columns = grid->n_rows = side;
+	grid->cell_width = (x2 > grid->x) ? (x2 - grid->x) / side : 1.;
+	grid->cell_height = (y2 > grid->y) ? (y2 - grid->y) / side : 1.;
+	n_cells = side * side;
+
+	/* Count the entries of every cell, then fill them in list order */
+	grid->cell_offsets = g_new0 (guint, n_cells + 1);
+	for (i = 0; i < n_mappings; i++) {
+		EvMapping *mapping = grid->mappings[i];
+		guint      c1, c2, r1, r2, r, c;
+
+		c1 = ev_mapping_index_cell (grid->x, grid->cell_width, side, mapping->area.x1);
+		c2 = ev_mapping_index_cell (grid->x, grid->cell_width, side, mapping->area.x2);
+		r1 = ev_mapping_index_cell (grid->y, grid->cell_height, side, mapping->area.y1);
+		r2 = ev_mapping_index_cell (grid->y, grid->cell_height, side, mapping->area.y2);
+
+		for (r = r1; r <= r2; r++)
+			for (c = c1; c <= c2; c++)
+				grid->cell_offsets[r * side + c + 1]++;
+	}
+
+	for (i = 0; i < n_cells; i++)
+		grid->cell_offsets[i + 1] += grid->cell_offsets[i];
+
+	grid->cell_entries = g_new (guint, grid->cell_offsets[n_cells]);
+	fill = g_memdup (grid->cell_offsets, n_cells * sizeof (guint));
+	for (i = 0; i < n_mappings; i++) {
+		EvMapping *mapping = grid->mappings[i];
+		guint      c1, c2, r1, r2, r, c;
+
+		c1 = ev_mapping_index_cell (grid->x, grid->cell_width, side, mapping->area.x1);
+		c2 = ev_mapping_index_cell (grid->x, grid->cell_width, side, mapping->area.x2);
+		r1 = ev_mapping_index_cell (grid->y, grid->cell_height, side, mapping->area.y1);
+		r2 = ev_mapping_index_cell (grid->y, grid->cell_height, side, mapping->area.y2);
+
+		for (r = r1; r <= r2; r++)
+			for (c = c1; c <= c2; c++)
+				grid->cell_entries[fill[r * side + c]++] = i;
+	}
+	g_free (fill);
+
+	return grid;
+}
+
+static EvMapping *
+ev_mapping_index_lookup (EvMappingIndex *grid,
+			 gdouble         x,
+			 gdouble         y)
+{
+	GList *l;
+	guint  cell, i;
+
+	cell = ev_mapping_index_cell (grid->y, grid->cell_height, grid->n_rows, y) * grid->n_columns +
+		ev_mapping_index_cell (grid->x, grid->cell_width, grid->n_columns, x);
+
+	for (i = grid->cell_offsets[cell]; i < grid->cell_offsets[cell + 1]; i++) {
+		EvMapping *mapping = grid->mappings[grid->cell_entries[i]];
+
+		if (ev_mapping_contains (mapping, x, y))
+			return mapping;
+	}
+
+	for (l = grid->tail->next; l; l = l->next) {
+		EvMapping *mapping = l->data;
+
+		if (ev_mapping_contains (mapping, x, y))
+			return mapping;
+	}
+
+	return NULL;
+}
+
+static GList *
+ev_mapping_index_lookup_area (EvMappingIndex    *grid,
+			      const EvRectangle *area)
+{
+	GList  *retval = NULL;
+	GList  *l;
+	guint8 *seen;
+	guint   c1, c2, r1, r2, r, c;
+	guint   i;
+
+	c1 = ev_mapping_index_cell (grid->x, grid->cell_width, grid->n_columns, area->x1);
+	c2 = ev_mapping_index_cell (grid->x, grid->cell_width, grid->n_columns, area->x2);
+	r1 = ev_mapping_index_cell (grid->y, grid->cell_height, grid->n_rows, area->y1);
+	r2 = ev_mapping_index_cell (grid->y, grid->cell_height, grid->n_rows, area->y2);
+
+	/* Mappings spanning several cells are found once per cell, and
+	 * the result must follow the list order, so mark the matches and
+	 * collect them afterwards
+	 */
+	seen = g_new0 (guint8, grid->n_mappings);
+	for (r = r1; r <= r2; r++) {
+		for (c = c1; c <= c2; c++) {
+			guint cell = r * grid->n_columns + c;
+
+			for (i = grid->cell_offsets[cell]; i < grid->cell_offsets[cell + 1]; i++) {
+				guint entry = grid->cell_entries[i];
+
+				if (!seen[entry] && ev_mapping_intersects (grid->mappings[entry], area))
+					seen[entry] = 1;
+			}
+		}
+	}
+
+	for (i = 0; i < grid->n_mappings; i++) {
+		if (seen[i])
+			retval = g_list_prepend (retval, grid->mappings[i]);
+	}
+	g_free (seen);
+
+	for (l = grid->tail->next; l; l = l->next) {
+		EvMapping *mapping = l->data;
+
+		if (ev_mapping_intersects (mapping, area))
+			retval = g_list_prepend (retval, mapping);
+	}
+
+	return g_list_reverse (retval);
+}
+
+static void
+ev_mapping_list_ensure_index (EvMappingList *mapping_list)
+{
+	if (mapping_list->index_built)
+		return;
+
+	mapping_list->index = ev_mapping_index_new (mapping_list->list);
+	mapping_list->index_built = TRUE;
+}
+
 EvMapping *
 ev_mapping_list_find (EvMappingList *mapping_list,
 		      gconstpointer  data)
@@ -67,20 +321,66 @@ ev_mapping_list_get_data (EvMappingList *mapping_list,
 {
 	GList *list;
 
+	ev_mapping_list_ensure_index (mapping_list);
+
+	if (mapping_list->index) {
+		EvMapping *mapping;
+
+		mapping = ev_mapping_index_lookup (mapping_list->index, x, y);
+
+		return mapping ? mapping->data : NULL;
+	}
+
 	for (list = mapping_list->list; list; list = list->next) {
 		EvMapping *mapping = list->data;
 
-		if ((x >= mapping->area.x1) &&
-		    (y >= mapping->area.y1) &&
-		    (x <= mapping->area.x2) &&
-		    (y <= mapping->area.y2)) {
+		if (ev_mapping_contains (mapping, x, y))
 			return mapping->data;
-		}
 	}
 
 	return NULL;
 }
 
+/**
+ * ev_mapping_list_get_mappings_in_area:
+ * @mapping_list: an #EvMappingList
+ * @area: the area in page coordinates
+ *
+ * Finds the mappings whose area intersects @area, or just touches it.
+ * Like ev_mapping_list_get_data(), large lists are looked up through
+ * a spatial index instead of walking the whole list.
+ *
+ * Returns: (transfer container) (element-type EvMapping): the mappings
+ *   found, in list order. Free the list with g_list_free(), the
+ *   mappings are owned by @mapping_list.
+ *
+ * Since: 3.6
+ */
+GList *
+ev_mapping_list_get_mappings_in_area (EvMappingList     *mapping_list,
+				      const EvRectangle *area)
+{
+	GList *retval = NULL;
+	GList *list;
+
+	g_return_val_if_fail (mapping_list != NULL, NULL);
+	g_return_val_if_fail (area != NULL, NULL);
+
+	ev_mapping_list_ensure_index (mapping_list);
+
+	if (mapping_list->index)
+		return ev_mapping_index_lookup_area (mapping_list->index, area);
+
+	for (list = mapping_list->list; list; list = list->next) {
+		EvMapping *mapping = list->data;
+
+		if (ev_mapping_intersects (mapping, area))
+			retval = g_list_prepend (retval, mapping);
+	}
+
+	return g_list_reverse (retval);
+}
+
 GList *
 ev_mapping_list_get_list (EvMappingList *mapping_list)
 {
@@ -107,6 +407,8 @@ ev_mapping_list_new (guint          page,
 	mapping_list->list = list;
 	mapping_list->data_destroy_func = data_destroy_func;
 	mapping_list->ref_count = 1;
+	mapping_list->index = NULL;
+	mapping_list->index_built = FALSE;
 
 	return mapping_list;
 }
@@ -141,6 +443,8 @@ ev_mapping_list_unref (EvMappingList *mapping_list)
 				(GFunc)mapping_list_free_foreach,
 				mapping_list->data_destroy_func);
 		g_list_free (mapping_list->list);
+		if (mapping_list->index)
+			ev_mapping_index_free (mapping_list->index);
 		g_slice_free (EvMappingList, mapping_list);
 	}
 }
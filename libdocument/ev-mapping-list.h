@@ -47,6 +47,8 @@ EvMapping     *ev_mapping_list_find_custom (EvMappingList *mapping_list,
 gpointer       ev_mapping_list_get_data    (EvMappingList *mapping_list,
 					    gdouble        x,
 					    gdouble        y);
+GList         *ev_mapping_list_get_mappings_in_area (EvMappingList     *mapping_list,
+						     const EvRectangle *area);
 
 G_END_DECLS
 
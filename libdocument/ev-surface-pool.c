@@ -0,0 +1,217 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "ev-surface-pool.h"
+
+/* Buffers of the image surfaces rendered for pages. Pages shown at the
+ * same zoom level have the same size, so instead of freeing the buffer
+ * of a surface when it's destroyed, it's kept to be used by the next
+ * surface of the same size class. That saves mapping and faulting in
+ * a few megabytes for every page rendered while scrolling.
+ *
+ * Buffers are kept up to EV_SURFACE_POOL_MAX_SIZE bytes, the least
+ * recently used going first, and freed when they haven't been used for
+ * EV_SURFACE_POOL_TRIM_TIMEOUT seconds.
+ */
+
+#define EV_SURFACE_POOL_CLASS_SIZE   (64 * 1024)
+#define EV_SURFACE_POOL_MAX_SIZE     (64 * 1024 * 1024)
+#define EV_SURFACE_POOL_TRIM_TIMEOUT 10
+
+typedef struct {
+	guchar *data;
+	gsize   size;
+	gint64  release_time;
+} EvSurfacePoolBuffer;
+
+static GMutex pool_mutex;
+static GQueue pool_buffers = G_QUEUE_INIT;
+static gsize  pool_size = 0;
+static guint  pool_trim_id = 0;
+
+static const cairo_user_data_key_t pool_buffer_key;
+
+static void
+ev_surface_pool_buffer_free (EvSurfacePoolBuffer *buffer)
+{
+	g_free (buffer->data);
+	g_slice_free (EvSurfacePoolBuffer, buffer);
+}
+
+/* Frees the buffers released before @time, must be called with the
+ * pool locked
+ */
+static void
+ev_surface_pool_trim_unlocked (gint64 time)
+{
+	EvSurfacePoolBuffer *buffer;
+
+	while ((buffer = g_queue_peek_tail (&pool_buffers)) &&
+	       buffer->release_time <= time) {
+		g_queue_pop_tail (&pool_buffers);
+		pool_size -= buffer->size;
+		ev_surface_pool_buffer_free (buffer);
+	}
+}
+
+static gboolean
+ev_surface_pool_trim_timeout (gpointer data)
+{
+	gboolean retval;
+
+	g_mutex_lock (&pool_mutex);
+	ev_surface_pool_trim_unlocked (g_get_monotonic_time () -
+				       EV_SURFACE_POOL_TRIM_TIMEOUT * G_USEC_PER_SEC);
+	retval = !g_queue_is_empty (&pool_buffers);
+	if (!retval)
+		pool_trim_id = 0;
+	g_mutex_unlock (&pool_mutex);
+
+	return retval;
+}
+
+/* Called when the surface using @buffer is destroyed, from any thread */
+static void
+ev_surface_pool_release (EvSurfacePoolBuffer *buffer)
+{
+	if (buffer->size > EV_SURFACE_POOL_MAX_SIZE) {
+		ev_surface_pool_buffer_free (buffer);
+		return;
+	}
+
+	g_mutex_lock (&pool_mutex);
+	buffer->release_time = g_get_monotonic_time ();
+	g_queue_push_head (&pool_buffers, buffer);
+	pool_size += buffer->size;
+
+	while (pool_size > EV_SURFACE_POOL_MAX_SIZE) {
+		buffer = g_queue_pop_tail (&pool_buffers);
+		pool_size -= buffer->size;
+		ev_surface_pool_buffer_free (buffer);
+	}
+
+	if (!pool_trim_id) {
+		pool_trim_id = g_timeout_add_seconds (EV_SURFACE_POOL_TRIM_TIMEOUT,
+						      ev_surface_pool_trim_timeout,
+						      NULL);
+	}
+	g_mutex_unlock (&pool_mutex);
+}
+
+static EvSurfacePoolBuffer *
+ev_surface_pool_take (gsize size)
+{
+	GList *l;
+
+	g_mutex_lock (&pool_mutex);
+	for (l = pool_buffers.head; l; l = g_list_next (l)) {
+		EvSurfacePoolBuffer *buffer = l->data;
+
+		if (buffer->size == size) {
+			g_queue_delete_link (&pool_buffers, l);
+			pool_size -= size;
+			g_mutex_unlock (&pool_mutex);
+
+			return buffer;
+		}
+	}
+	g_mutex_unlock (&pool_mutex);
+
+	return NULL;
+}
+
+/*
+ * ev_surface_pool_create_surface:
+ * @format: the format of the surface
+ * @width: the width of the surface
+ * @height: the height of the surface
+ * @clear: whether the surface has to be transparent, like the ones
+ *   created by cairo_image_surface_create()
+ *
+ * Creates an image surface whose buffer is given back to the pool when
+ * the surface is destroyed. Buffers are reused as they are, so callers
+ * that paint every pixel anyway should not ask to @clear them.
+ *
+ * Returns: a new image surface
+ */
+cairo_surface_t *
+ev_surface_pool_create_surface (cairo_format_t format,
+				gint           width,
+				gint           height,
+				gboolean       clear)
+{
+	EvSurfacePoolBuffer *buffer;
+	cairo_surface_t     *surface;
+	gint                 stride;
+	gsize                size;
+
+	stride = cairo_format_stride_for_width (format, width);
+	if (stride <= 0 || height <= 0 || (gsize) height > G_MAXSIZE / stride)
+		return cairo_image_surface_create (format, width, height);
+
+	size = (gsize) stride * height;
+	size = (size + EV_SURFACE_POOL_CLASS_SIZE - 1) & ~((gsize) EV_SURFACE_POOL_CLASS_SIZE - 1);
+
+	buffer = ev_surface_pool_take (size);
+	if (buffer) {
+		if (clear)
+			memset (buffer->data, 0, (gsize) stride * height);
+	} else {
+		guchar *data;
+
+		/* Fresh memory from the system is already zeroed,
+		 * so calloc() doesn't have to clear it
+		 */
+		data = clear ? g_try_malloc0 (size) : g_try_malloc (size);
+		if (!data)
+			return cairo_image_surface_create (format, width, height);
+
+		buffer = g_slice_new (EvSurfacePoolBuffer);
+		buffer->data = data;
+		buffer->size = size;
+	}
+
+	surface = cairo_image_surface_create_for_data (buffer->data, format,
+						       width, height, stride);
+	if (cairo_surface_set_user_data (surface, &pool_buffer_key, buffer,
+					 (cairo_destroy_func_t) ev_surface_pool_release)) {
+		cairo_surface_destroy (surface);
+		ev_surface_pool_buffer_free (buffer);
+
+		return cairo_image_surface_create (format, width, height);
+	}
+
+	return surface;
+}
+
+/*
+ * ev_surface_pool_trim:
+ *
+ * Frees all the buffers kept in the pool, for when memory is scarce or
+ * the pages won't be rendered again soon.
+ */
+void
+ev_surface_pool_trim (void)
+{
+	g_mutex_lock (&pool_mutex);
+	ev_surface_pool_trim_unlocked (G_MAXINT64);
+	g_mutex_unlock (&pool_mutex);
+}
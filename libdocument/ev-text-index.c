@@ -0,0 +1,950 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
+#include "ev-text-index.h"
+#include "ev-document-text.h"
+
+/* The index is a single file in the cache dir, named after the identity
+ * of the document file, and mapped read-only when loaded:
+ *
+ *  - header
+ *  - page table: one EvTextIndexPage per page
+ *  - bucket table: n_buckets + 1 offsets into the postings
+ *  - postings: for every bucket, the pages containing a trigram hashed
+ *    to the bucket, as delta encoded varints
+ *  - text: the UTF-8 text of every page
+ *  - boxes: four 16 bit coordinates per character of every page,
+ *    relative to the page size
+ *
+ * Searches intersect the postings of the trigrams of the search text to
+ * find candidate pages, and only the text of those pages is scanned.
+ */
+
+#define EV_TEXT_INDEX_MAGIC      "EVTXTIDX"
+#define EV_TEXT_INDEX_VERSION    1
+#define EV_TEXT_INDEX_BYTE_ORDER 0x01020304
+#define EV_TEXT_INDEX_N_BUCKETS  65536
+
+#define EV_TEXT_INDEX_PAGE_INDEXED (1 << 0)
+
+/* Indexes not used for this long are removed, and the least recently
+ * used are removed first when all of them take more than the max size
+ */
+#define EV_TEXT_INDEX_MAX_AGE  (30 * 24 * 60 * 60)
+#define EV_TEXT_INDEX_MAX_SIZE (256 * 1024 * 1024)
+
+typedef struct {
+	gchar   magic[8];
+	guint32 version;
+	guint32 byte_order;
+	guint32 n_pages;
+	guint32 n_buckets;
+	guint64 postings_offset;
+	guint64 text_offset;
+	guint64 boxes_offset;
+} EvTextIndexHeader;
+
+typedef struct {
+	guint32 flags;
+	guint32 n_chars;
+	guint64 text_offset;
+	guint64 text_length;
+	guint64 boxes_offset;
+	gdouble width;
+	gdouble height;
+} EvTextIndexPage;
+
+struct _EvTextIndex {
+	volatile gint            ref_count;
+
+	GMappedFile             *mapped_file;
+	const EvTextIndexHeader *header;
+	const EvTextIndexPage   *pages;
+	const guint32           *buckets;
+	const guint8            *postings;
+	const gchar             *text;
+	const guint16           *boxes;
+};
+
+static inline gunichar
+ev_text_index_fold (gunichar c)
+{
+	return g_unichar_isspace (c) ? ' ' : g_unichar_tolower (c);
+}
+
+static inline guint
+ev_text_index_bucket (gunichar c1,
+		      gunichar c2,
+		      gunichar c3)
+{
+	guint32 h;
+
+	h = (c1 * 31 + c2) * 31 + c3;
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+
+	return h % EV_TEXT_INDEX_N_BUCKETS;
+}
+
+static gchar *
+ev_text_index_get_dir (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "evince", "text-index", NULL);
+}
+
+/* Compressed and remote documents are loaded from a temp copy, with a
+ * new modification time every time, so the index is keyed on the file
+ * the document was opened from
+ */
+static gchar *
+ev_text_index_get_path (EvDocument  *document,
+			const gchar *uri,
+			GError     **error)
+{
+	GFile       *file;
+	GFileInfo   *info;
+	const gchar *id;
+	gchar       *key;
+	gchar       *checksum;
+	gchar       *dir;
+	gchar       *path;
+
+	if (!uri)
+		uri = ev_document_get_uri (document);
+	if (!uri) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "Document was not loaded from a file");
+		return NULL;
+	}
+
+	file = g_file_new_for_uri (uri);
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_ID_FILE ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL, error);
+	g_object_unref (file);
+	if (!info)
+		return NULL;
+
+	/* The same file, unmodified, gets the same index */
+	id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+	key = g_strdup_printf ("%s:%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+			       id ? id : uri,
+			       (guint64) g_file_info_get_size (info),
+			       g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+	g_object_unref (info);
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+	g_free (key);
+
+	dir = ev_text_index_get_dir ();
+	path = g_build_filename (dir, checksum, NULL);
+	g_free (dir);
+	g_free (checksum);
+
+	return path;
+}
+
+typedef struct {
+	gchar  *path;
+	goffset size;
+	time_t  mtime;
+} EvTextIndexFile;
+
+static gint
+ev_text_index_file_compare (const EvTextIndexFile *a,
+			    const EvTextIndexFile *b)
+{
+	if (a->mtime == b->mtime)
+		return 0;
+
+	return a->mtime < b->mtime ? 1 : -1;
+}
+
+/* Removes the indexes not used recently. The modification time of an
+ * index is updated every time it's loaded, so it tells when it was
+ * last used.
+ */
+static void
+ev_text_index_prune (void)
+{
+	GDir        *dir;
+	gchar       *dir_path;
+	const gchar *name;
+	GList       *files = NULL, *l;
+	goffset      total_size = 0;
+	time_t       now = time (NULL);
+
+	dir_path = ev_text_index_get_dir ();
+	dir = g_dir_open (dir_path, 0, NULL);
+	if (!dir) {
+		g_free (dir_path);
+		return;
+	}
+
+	while ((name = g_dir_read_name (dir))) {
+		EvTextIndexFile *file;
+		GStatBuf         buf;
+		gchar           *path;
+
+		path = g_build_filename (dir_path, name, NULL);
+		if (g_stat (path, &buf) != 0 || !S_ISREG (buf.st_mode)) {
+			g_free (path);
+			continue;
+		}
+
+		/* Temp files left by a crash while saving an index */
+		if (now - buf.st_mtime > EV_TEXT_INDEX_MAX_AGE ||
+		    (strchr (name, '.') && now - buf.st_mtime > 60 * 60)) {
+			g_unlink (path);
+			g_free (path);
+			continue;
+		}
+
+		file = g_slice_new (EvTextIndexFile);
+		file->path = path;
+		file->size = buf.st_size;
+		file->mtime = buf.st_mtime;
+		files = g_list_prepend (files, file);
+	}
+	g_dir_close (dir);
+	g_free (dir_path);
+
+	/* Most recently used first */
+	files = g_list_sort (files, (GCompareFunc)ev_text_index_file_compare);
+	for (l = files; l; l = g_list_next (l)) {
+		EvTextIndexFile *file = l->data;
+
+		total_size += file->size;
+		if (total_size > EV_TEXT_INDEX_MAX_SIZE)
+			g_unlink (file->path);
+
+		g_free (file->path);
+		g_slice_free (EvTextIndexFile, file);
+	}
+	g_list_free (files);
+}
+
+static void
+ev_text_index_append_varint (GByteArray *array,
+			     guint32     value)
+{
+	guint8 byte;
+
+	while (value >= 0x80) {
+		byte = (value & 0x7f) | 0x80;
+		g_byte_array_append (array, &byte, 1);
+		value >>= 7;
+	}
+	byte = value;
+	g_byte_array_append (array, &byte, 1);
+}
+
+static inline guint16
+ev_text_index_encode (gdouble value,
+		      gdouble size)
+{
+	if (size <= 0)
+		return 0;
+
+	return (guint16) (CLAMP (value / size, 0., 1.) * G_MAXUINT16 + 0.5);
+}
+
+static inline gdouble
+ev_text_index_decode (guint16 value,
+		      gdouble size)
+{
+	return value * size / G_MAXUINT16;
+}
+
+typedef struct {
+	GByteArray *postings;
+	gint        last_page;
+} EvTextIndexBucket;
+
+static void
+ev_text_index_add_page (EvTextIndexBucket *buckets,
+			EvTextIndexPage   *index_page,
+			GByteArray        *text_data,
+			GArray            *boxes_data,
+			gint               page,
+			const gchar       *text,
+			EvRectangle       *areas,
+			guint              n_areas)
+{
+	const gchar *p;
+	gunichar     t[3] = { 0, 0, 0 };
+	guint        i;
+
+	if (!text || !g_utf8_validate (text, -1, NULL) ||
+	    g_utf8_strlen (text, -1) != n_areas)
+		return;
+
+	index_page->flags = EV_TEXT_INDEX_PAGE_INDEXED;
+	index_page->n_chars = n_areas;
+	index_page->text_offset = text_data->len;
+	index_page->text_length = strlen (text);
+	index_page->boxes_offset = boxes_data->len;
+	g_byte_array_append (text_data, (const guint8 *) text, index_page->text_length);
+
+	for (p = text, i = 0; i < n_areas; p = g_utf8_next_char (p), i++) {
+		EvRectangle *area = areas + i;
+		guint16      box[4];
+
+		box[0] = ev_text_index_encode (area->x1, index_page->width);
+		box[1] = ev_text_index_encode (area->y1, index_page->height);
+		box[2] = ev_text_index_encode (area->x2, index_page->width);
+		box[3] = ev_text_index_encode (area->y2, index_page->height);
+		g_array_append_vals (boxes_data, box, 4);
+
+		t[0] = t[1];
+		t[1] = t[2];
+		t[2] = ev_text_index_fold (g_utf8_get_char (p));
+		if (i >= 2) {
+			EvTextIndexBucket *bucket;
+
+			bucket = buckets + ev_text_index_bucket (t[0], t[1], t[2]);
+			if (bucket->last_page == page)
+				continue;
+
+			if (!bucket->postings)
+				bucket->postings = g_byte_array_new ();
+			ev_text_index_append_varint (bucket->postings, page - bucket->last_page);
+			bucket->last_page = page;
+		}
+	}
+}
+
+struct _EvTextIndexBuilder {
+	EvDocument        *document;
+	gchar             *path;
+	gint               n_pages;
+	gint               page;
+
+	EvTextIndexPage   *pages;
+	EvTextIndexBucket *buckets;
+	GByteArray        *text_data;
+	GArray            *boxes_data;
+};
+
+/**
+ * ev_text_index_builder_new:
+ * @document: an #EvDocument implementing #EvDocumentText
+ * @uri: (allow-none): the URI @document was opened from, or %NULL to
+ *   use the URI of @document
+ * @error: (allow-none): a #GError location to store an error, or %NULL
+ *
+ * Creates a builder for the search index of @document. Indexes are
+ * saved in the user cache dir, keyed on the file at @uri, so that
+ * documents loaded from a temp copy, like compressed or remote ones,
+ * find their index again. Querying the file might block, so builders
+ * should be used from a thread.
+ *
+ * Returns: a new #EvTextIndexBuilder, or %NULL
+ *
+ * Since: 3.6
+ */
+EvTextIndexBuilder *
+ev_text_index_builder_new (EvDocument  *document,
+			   const gchar *uri,
+			   GError     **error)
+{
+	EvTextIndexBuilder *builder;
+	gchar              *path;
+	gint                i;
+
+	g_return_val_if_fail (EV_IS_DOCUMENT_TEXT (document), NULL);
+
+	path = ev_text_index_get_path (document, uri, error);
+	if (!path)
+		return NULL;
+
+	builder = g_slice_new0 (EvTextIndexBuilder);
+	builder->document = g_object_ref (document);
+	builder->path = path;
+	builder->n_pages = ev_document_get_n_pages (document);
+	builder->pages = g_new0 (EvTextIndexPage, builder->n_pages);
+	builder->buckets = g_new0 (EvTextIndexBucket, EV_TEXT_INDEX_N_BUCKETS);
+	for (i = 0; i < EV_TEXT_INDEX_N_BUCKETS; i++)
+		builder->buckets[i].last_page = -1;
+	builder->text_data = g_byte_array_new ();
+	builder->boxes_data = g_array_new (FALSE, FALSE, sizeof (guint16));
+
+	return builder;
+}
+
+/**
+ * ev_text_index_builder_free:
+ * @builder: an #EvTextIndexBuilder
+ *
+ * Frees @builder, discarding the pages added if the index wasn't saved.
+ *
+ * Since: 3.6
+ */
+void
+ev_text_index_builder_free (EvTextIndexBuilder *builder)
+{
+	gint i;
+
+	for (i = 0; i < EV_TEXT_INDEX_N_BUCKETS; i++) {
+		if (builder->buckets[i].postings)
+			g_byte_array_free (builder->buckets[i].postings, TRUE);
+	}
+	g_free (builder->buckets);
+	g_free (builder->pages);
+	g_byte_array_free (builder->text_data, TRUE);
+	g_array_free (builder->boxes_data, TRUE);
+	g_free (builder->path);
+	g_object_unref (builder->document);
+	g_slice_free (EvTextIndexBuilder, builder);
+}
+
+/**
+ * ev_text_index_builder_add_page:
+ * @builder: an #EvTextIndexBuilder
+ *
+ * Extracts the text and text layout of the next page of the document.
+ * The document mutex is only held while doing so, so pages can be added
+ * from a thread, one at a time, letting other jobs use the document in
+ * between.
+ *
+ * Returns: %TRUE if there are more pages to add
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_text_index_builder_add_page (EvTextIndexBuilder *builder)
+{
+	EvDocumentText *document_text = EV_DOCUMENT_TEXT (builder->document);
+	EvPage         *page;
+	gchar          *text;
+	EvRectangle    *areas = NULL;
+	guint           n_areas = 0;
+	gint            i = builder->page;
+
+	if (i >= builder->n_pages)
+		return FALSE;
+
+	ev_document_doc_mutex_lock ();
+	page = ev_document_get_page (builder->document, i);
+	ev_document_get_page_size (builder->document, i,
+				   &builder->pages[i].width,
+				   &builder->pages[i].height);
+	text = ev_document_text_get_text (document_text, page);
+	ev_document_text_get_text_layout (document_text, page, &areas, &n_areas);
+	g_object_unref (page);
+	ev_document_doc_mutex_unlock ();
+
+	ev_text_index_add_page (builder->buckets, builder->pages + i,
+				builder->text_data, builder->boxes_data,
+				i, text, areas, n_areas);
+	g_free (text);
+	g_free (areas);
+
+	return ++builder->page < builder->n_pages;
+}
+
+/**
+ * ev_text_index_builder_save:
+ * @builder: an #EvTextIndexBuilder
+ * @error: (allow-none): a #GError location to store an error, or %NULL
+ *
+ * Saves the index of the pages added to @builder, replacing atomically
+ * any previous one, and removes the indexes not used for a long time.
+ * Pages not added are not indexed. The text is saved unencrypted, so
+ * the index of documents that needed a password shouldn't be saved.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_text_index_builder_save (EvTextIndexBuilder *builder,
+			    GError            **error)
+{
+	EvTextIndexHeader  header;
+	EvTextIndexBucket *buckets = builder->buckets;
+	GByteArray        *text_data = builder->text_data;
+	GArray            *boxes_data = builder->boxes_data;
+	GByteArray        *data;
+	guint32           *bucket_offsets;
+	gchar             *dir;
+	gint               n_pages = builder->n_pages;
+	gint               i;
+	gboolean           retval = FALSE;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, EV_TEXT_INDEX_MAGIC, sizeof (header.magic));
+	header.version = EV_TEXT_INDEX_VERSION;
+	header.byte_order = EV_TEXT_INDEX_BYTE_ORDER;
+	header.n_pages = n_pages;
+	header.n_buckets = EV_TEXT_INDEX_N_BUCKETS;
+
+	/* Bucket offsets are relative to the postings */
+	bucket_offsets = g_new (guint32, EV_TEXT_INDEX_N_BUCKETS + 1);
+	bucket_offsets[0] = 0;
+	for (i = 0; i < EV_TEXT_INDEX_N_BUCKETS; i++) {
+		bucket_offsets[i + 1] = bucket_offsets[i] +
+			(buckets[i].postings ? buckets[i].postings->len : 0);
+	}
+
+	header.postings_offset = sizeof (header) +
+		n_pages * sizeof (EvTextIndexPage) +
+		(EV_TEXT_INDEX_N_BUCKETS + 1) * sizeof (guint32);
+	header.text_offset = header.postings_offset + bucket_offsets[EV_TEXT_INDEX_N_BUCKETS];
+	header.boxes_offset = (header.text_offset + text_data->len + 7) & ~(guint64) 7;
+
+	data = g_byte_array_sized_new (header.boxes_offset + boxes_data->len * sizeof (guint16));
+	g_byte_array_append (data, (const guint8 *) &header, sizeof (header));
+	g_byte_array_append (data, (const guint8 *) builder->pages, n_pages * sizeof (EvTextIndexPage));
+	g_byte_array_append (data, (const guint8 *) bucket_offsets,
+			     (EV_TEXT_INDEX_N_BUCKETS + 1) * sizeof (guint32));
+	for (i = 0; i < EV_TEXT_INDEX_N_BUCKETS; i++) {
+		if (buckets[i].postings)
+			g_byte_array_append (data, buckets[i].postings->data, buckets[i].postings->len);
+	}
+	g_byte_array_append (data, text_data->data, text_data->len);
+	g_byte_array_set_size (data, header.boxes_offset);
+	memset (data->data + header.text_offset + text_data->len, 0,
+		header.boxes_offset - header.text_offset - text_data->len);
+	g_byte_array_append (data, (const guint8 *) boxes_data->data,
+			     boxes_data->len * sizeof (guint16));
+	g_free (bucket_offsets);
+
+	/* g_file_set_contents() writes a temp file and renames it, so
+	 * windows building the same index don't see partial files
+	 */
+	dir = g_path_get_dirname (builder->path);
+	if (g_mkdir_with_parents (dir, 0700) == 0) {
+		retval = g_file_set_contents (builder->path, (const gchar *) data->data,
+					      data->len, error);
+	} else {
+		int errsv = errno;
+
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     "Failed to create directory “%s”: %s",
+			     dir, g_strerror (errsv));
+	}
+	g_free (dir);
+	g_byte_array_free (data, TRUE);
+
+	if (retval)
+		ev_text_index_prune ();
+
+	return retval;
+}
+
+static gboolean
+ev_text_index_validate (EvTextIndex *text_index,
+			gsize        length)
+{
+	const EvTextIndexHeader *header = text_index->header;
+	guint64                  postings_length;
+	guint                    i;
+
+	if (length < sizeof (EvTextIndexHeader) ||
+	    memcmp (header->magic, EV_TEXT_INDEX_MAGIC, sizeof (header->magic)) != 0 ||
+	    header->version != EV_TEXT_INDEX_VERSION ||
+	    header->byte_order != EV_TEXT_INDEX_BYTE_ORDER ||
+	    header->n_buckets != EV_TEXT_INDEX_N_BUCKETS)
+		return FALSE;
+
+	if (header->postings_offset != sizeof (EvTextIndexHeader) +
+	    (guint64) header->n_pages * sizeof (EvTextIndexPage) +
+	    (EV_TEXT_INDEX_N_BUCKETS + 1) * sizeof (guint32) ||
+	    header->postings_offset > header->text_offset ||
+	    header->text_offset > header->boxes_offset ||
+	    header->boxes_offset > length ||
+	    header->boxes_offset % 8 != 0)
+		return FALSE;
+
+	postings_length = header->text_offset - header->postings_offset;
+	for (i = 0; i < EV_TEXT_INDEX_N_BUCKETS; i++) {
+		if (text_index->buckets[i] > text_index->buckets[i + 1])
+			return FALSE;
+	}
+	if (text_index->buckets[EV_TEXT_INDEX_N_BUCKETS] != postings_length)
+		return FALSE;
+
+	for (i = 0; i < header->n_pages; i++) {
+		const EvTextIndexPage *page = text_index->pages + i;
+
+		if (!(page->flags & EV_TEXT_INDEX_PAGE_INDEXED))
+			continue;
+
+		if (page->text_offset + page->text_length > header->boxes_offset - header->text_offset ||
+		    page->boxes_offset + (guint64) page->n_chars * 4 >
+		    (length - header->boxes_offset) / sizeof (guint16))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * ev_text_index_load:
+ * @document: an #EvDocument
+ * @uri: (allow-none): the URI @document was opened from, or %NULL to
+ *   use the URI of @document
+ * @error: (allow-none): a #GError location to store an error, or %NULL
+ *
+ * Loads the search index previously built for @document with an
+ * #EvTextIndexBuilder. If there isn't any index for the current
+ * contents of the file at @uri, %G_IO_ERROR_NOT_FOUND is returned.
+ * Like building, this does file I/O, so it should be called from
+ * a thread.
+ *
+ * Returns: (transfer full): a new #EvTextIndex, or %NULL
+ *
+ * Since: 3.6
+ */
+EvTextIndex *
+ev_text_index_load (EvDocument  *document,
+		    const gchar *uri,
+		    GError     **error)
+{
+	EvTextIndex *text_index;
+	GMappedFile *mapped_file;
+	const gchar *contents;
+	gchar       *path;
+	gsize        length;
+
+	path = ev_text_index_get_path (document, uri, error);
+	if (!path)
+		return NULL;
+
+	if (!g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			     "No text index “%s”", path);
+		g_free (path);
+
+		return NULL;
+	}
+
+	mapped_file = g_mapped_file_new (path, FALSE, error);
+	if (!mapped_file) {
+		g_free (path);
+
+		return NULL;
+	}
+
+	contents = g_mapped_file_get_contents (mapped_file);
+	length = g_mapped_file_get_length (mapped_file);
+
+	text_index = g_slice_new0 (EvTextIndex);
+	text_index->ref_count = 1;
+	text_index->mapped_file = mapped_file;
+	text_index->header = (const EvTextIndexHeader *) contents;
+
+	if (length >= sizeof (EvTextIndexHeader) &&
+	    length >= sizeof (EvTextIndexHeader) +
+	    (guint64) text_index->header->n_pages * sizeof (EvTextIndexPage) +
+	    (EV_TEXT_INDEX_N_BUCKETS + 1) * sizeof (guint32)) {
+		text_index->pages = (const EvTextIndexPage *) (contents + sizeof (EvTextIndexHeader));
+		text_index->buckets = (const guint32 *) (text_index->pages + text_index->header->n_pages);
+	}
+
+	if (!text_index->pages ||
+	    !ev_text_index_validate (text_index, length) ||
+	    text_index->header->n_pages != ev_document_get_n_pages (document)) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "Invalid text index “%s”", path);
+		ev_text_index_unref (text_index);
+		/* It will be built again */
+		g_unlink (path);
+		g_free (path);
+
+		return NULL;
+	}
+
+	/* Mark the index as recently used, so it's not pruned */
+	g_utime (path, NULL);
+	g_free (path);
+
+	text_index->postings = (const guint8 *) contents + text_index->header->postings_offset;
+	text_index->text = contents + text_index->header->text_offset;
+	text_index->boxes = (const guint16 *) (contents + text_index->header->boxes_offset);
+
+	return text_index;
+}
+
+EvTextIndex *
+ev_text_index_ref (EvTextIndex *text_index)
+{
+	g_return_val_if_fail (text_index != NULL, NULL);
+	g_return_val_if_fail (text_index->ref_count > 0, text_index);
+
+	g_atomic_int_inc (&text_index->ref_count);
+
+	return text_index;
+}
+
+void
+ev_text_index_unref (EvTextIndex *text_index)
+{
+	g_return_if_fail (text_index != NULL);
+	g_return_if_fail (text_index->ref_count > 0);
+
+	if (g_atomic_int_dec_and_test (&text_index->ref_count)) {
+		g_mapped_file_unref (text_index->mapped_file);
+		g_slice_free (EvTextIndex, text_index);
+	}
+}
+
+gint
+ev_text_index_get_n_pages (EvTextIndex *text_index)
+{
+	g_return_val_if_fail (text_index != NULL, 0);
+
+	return text_index->header->n_pages;
+}
+
+/**
+ * ev_text_index_has_page:
+ * @text_index: an #EvTextIndex
+ * @page: the page index
+ *
+ * Returns: whether @text_index can answer searches in @page. Pages whose
+ * text layout doesn't match their text are not indexed.
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_text_index_has_page (EvTextIndex *text_index,
+			gint         page)
+{
+	g_return_val_if_fail (text_index != NULL, FALSE);
+
+	if (page < 0 || page >= (gint) text_index->header->n_pages)
+		return FALSE;
+
+	return text_index->pages[page].flags & EV_TEXT_INDEX_PAGE_INDEXED;
+}
+
+static void
+ev_text_index_mark_bucket (EvTextIndex *text_index,
+			   guint        bucket,
+			   guint8      *pages)
+{
+	const guint8 *p = text_index->postings + text_index->buckets[bucket];
+	const guint8 *end = text_index->postings + text_index->buckets[bucket + 1];
+	gint          page = -1;
+
+	while (p < end) {
+		guint32 delta = 0;
+		guint   shift = 0;
+
+		while (p < end && shift < 32) {
+			delta |= (guint32) (*p & 0x7f) << shift;
+			shift += 7;
+			if (!(*p++ & 0x80))
+				break;
+		}
+
+		page += delta;
+		if (page >= 0 && page < (gint) text_index->header->n_pages)
+			pages[page] = 1;
+	}
+}
+
+static void
+ev_text_index_get_box (EvTextIndex           *text_index,
+		       const EvTextIndexPage *index_page,
+		       guint                  i,
+		       EvRectangle           *box)
+{
+	const guint16 *b = text_index->boxes + index_page->boxes_offset + i * 4;
+
+	box->x1 = ev_text_index_decode (b[0], index_page->width);
+	box->y1 = ev_text_index_decode (b[1], index_page->height);
+	box->x2 = ev_text_index_decode (b[2], index_page->width);
+	box->y2 = ev_text_index_decode (b[3], index_page->height);
+}
+
+/* Matches never span line breaks, like the ones found by the backends,
+ * but a line can still be made of several runs of text
+ */
+static GList *
+ev_text_index_add_match (EvTextIndex           *text_index,
+			 const EvTextIndexPage *index_page,
+			 const gunichar        *chars,
+			 guint                  start,
+			 guint                  end,
+			 GList                 *matches)
+{
+	EvRectangle *line = NULL;
+	guint        i;
+
+	for (i = start; i < end; i++) {
+		EvRectangle box;
+
+		if (chars[i] == '\n')
+			continue;
+
+		ev_text_index_get_box (text_index, index_page, i, &box);
+		if (line && box.x1 >= line->x1 &&
+		    box.y1 < line->y2 && box.y2 > line->y1) {
+			line->x2 = MAX (line->x2, box.x2);
+			line->y1 = MIN (line->y1, box.y1);
+			line->y2 = MAX (line->y2, box.y2);
+			continue;
+		}
+
+		line = ev_rectangle_copy (&box);
+		matches = g_list_prepend (matches, line);
+	}
+
+	return matches;
+}
+
+static GList *
+ev_text_index_find_in_page (EvTextIndex    *text_index,
+			    gint            page,
+			    const gunichar *needle,
+			    glong           needle_length,
+			    EvFindOptions   options)
+{
+	const EvTextIndexPage *index_page = text_index->pages + page;
+	gunichar              *chars;
+	glong                  n_chars, i;
+	GList                 *matches = NULL;
+
+	chars = g_utf8_to_ucs4_fast (text_index->text + index_page->text_offset,
+				     index_page->text_length, &n_chars);
+	if (n_chars != index_page->n_chars) {
+		g_free (chars);
+		return NULL;
+	}
+
+	for (i = 0; i + needle_length <= n_chars; i++) {
+		glong k;
+
+		for (k = 0; k < needle_length; k++) {
+			gunichar c = chars[i + k];
+
+			if (c == '\n')
+				break;
+
+			if (options & EV_FIND_CASE_SENSITIVE) {
+				if (g_unichar_isspace (c) ? needle[k] != ' ' : c != needle[k])
+					break;
+			} else if (ev_text_index_fold (c) != needle[k]) {
+				break;
+			}
+		}
+		if (k < needle_length)
+			continue;
+
+		if ((options & EV_FIND_WHOLE_WORDS_ONLY) &&
+		    ((i > 0 && g_unichar_isalnum (chars[i - 1])) ||
+		     (i + needle_length < n_chars && g_unichar_isalnum (chars[i + needle_length]))))
+			continue;
+
+		matches = ev_text_index_add_match (text_index, index_page, chars,
+						   i, i + needle_length, matches);
+		i += needle_length - 1;
+	}
+	g_free (chars);
+
+	return g_list_reverse (matches);
+}
+
+/**
+ * ev_text_index_find:
+ * @text_index: an #EvTextIndex
+ * @text: the text to search
+ * @options: the #EvFindOptions
+ *
+ * Searches @text in all the indexed pages. The matches are in the same
+ * coordinates returned by ev_document_find_find_text_with_options().
+ *
+ * Returns: (transfer full): a newly allocated array with a #GList of
+ * #EvRectangle<!-- -->s for every page
+ *
+ * Since: 3.6
+ */
+GList **
+ev_text_index_find (EvTextIndex   *text_index,
+		    const gchar   *text,
+		    EvFindOptions  options)
+{
+	GList   **results;
+	gunichar *needle;
+	glong     needle_length, i;
+	guint8   *candidates;
+	guint8   *pages;
+	guint     n_pages, page;
+
+	g_return_val_if_fail (text_index != NULL, NULL);
+	g_return_val_if_fail (text != NULL, NULL);
+
+	n_pages = text_index->header->n_pages;
+	results = g_new0 (GList *, n_pages);
+
+	needle = g_utf8_to_ucs4_fast (text, -1, &needle_length);
+	if (needle_length == 0) {
+		g_free (needle);
+		return results;
+	}
+
+	for (i = 0; i < needle_length; i++) {
+		if (!(options & EV_FIND_CASE_SENSITIVE))
+			needle[i] = ev_text_index_fold (needle[i]);
+		else if (g_unichar_isspace (needle[i]))
+			needle[i] = ' ';
+	}
+
+	/* Candidate pages contain all the trigrams of the text */
+	candidates = g_malloc (n_pages);
+	memset (candidates, 1, n_pages);
+	pages = g_malloc (n_pages);
+	for (i = 0; i + 2 < needle_length; i++) {
+		memset (pages, 0, n_pages);
+		ev_text_index_mark_bucket (text_index,
+					   ev_text_index_bucket (ev_text_index_fold (needle[i]),
+								 ev_text_index_fold (needle[i + 1]),
+								 ev_text_index_fold (needle[i + 2])),
+					   pages);
+		for (page = 0; page < n_pages; page++)
+			candidates[page] &= pages[page];
+	}
+	g_free (pages);
+
+	for (page = 0; page < n_pages; page++) {
+		if (!candidates[page] || !ev_text_index_has_page (text_index, page))
+			continue;
+
+		results[page] = ev_text_index_find_in_page (text_index, page,
+							    needle, needle_length,
+							    options);
+	}
+	g_free (candidates);
+	g_free (needle);
+
+	return results;
+}
@@ -0,0 +1,58 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (__EV_EVINCE_DOCUMENT_H_INSIDE__) && !defined (EVINCE_COMPILATION)
+#error "Only <evince-document.h> can be included directly."
+#endif
+
+#ifndef EV_TEXT_INDEX_H
+#define EV_TEXT_INDEX_H
+
+#include <gio/gio.h>
+
+#include "ev-document.h"
+#include "ev-document-find.h"
+
+G_BEGIN_DECLS
+
+typedef struct _EvTextIndex        EvTextIndex;
+typedef struct _EvTextIndexBuilder EvTextIndexBuilder;
+
+EvTextIndexBuilder *ev_text_index_builder_new      (EvDocument         *document,
+						    const gchar        *uri,
+						    GError            **error);
+void                ev_text_index_builder_free     (EvTextIndexBuilder *builder);
+gboolean            ev_text_index_builder_add_page (EvTextIndexBuilder *builder);
+gboolean            ev_text_index_builder_save     (EvTextIndexBuilder *builder,
+						    GError            **error);
+
+EvTextIndex *ev_text_index_load         (EvDocument    *document,
+					 const gchar   *uri,
+					 GError       **error);
+EvTextIndex *ev_text_index_ref          (EvTextIndex   *text_index);
+void         ev_text_index_unref        (EvTextIndex   *text_index);
+
+gint         ev_text_index_get_n_pages  (EvTextIndex   *text_index);
+gboolean     ev_text_index_has_page     (EvTextIndex   *text_index,
+					 gint           page);
+GList      **ev_text_index_find         (EvTextIndex   *text_index,
+					 const gchar   *text,
+					 EvFindOptions  options);
+
+G_END_DECLS
+
+#endif /* EV_TEXT_INDEX_H */
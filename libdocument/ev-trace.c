@@ -0,0 +1,482 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <stdarg.h>
+#include <string.h>
+#include <glib.h>
+#ifdef G_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "ev-trace.h"
+
+/* Every thread records its spans in its own ring buffer, so recording
+ * never takes a lock. Once a buffer is full the oldest spans are
+ * overwritten.
+ */
+#define EV_TRACE_BUFFER_SIZE 8192
+#define EV_TRACE_MAX_ARGS    3
+
+typedef enum {
+	EV_TRACE_SPAN,
+	EV_TRACE_ASYNC_SPAN
+} EvTraceEventType;
+
+typedef struct {
+	EvTraceEventType type;
+	const gchar     *category;
+	const gchar     *name;
+	gint64           start;
+	gint64           duration;
+	gconstpointer    id;
+	guint            n_args;
+	const gchar     *arg_names[EV_TRACE_MAX_ARGS];
+	gint64           args[EV_TRACE_MAX_ARGS];
+} EvTraceEvent;
+
+typedef struct _EvTraceBuffer EvTraceBuffer;
+struct _EvTraceBuffer {
+	EvTraceBuffer *next;
+	guint          tid;
+	const gchar   *thread_name;
+
+	/* Number of events ever written, only the thread
+	 * owning the buffer modifies it
+	 */
+	volatile gint  n_events;
+	EvTraceEvent   events[EV_TRACE_BUFFER_SIZE];
+};
+
+static gboolean       trace_enabled = FALSE;
+static gchar         *trace_filename = NULL;
+static EvTraceBuffer *trace_buffers = NULL;
+static volatile gint  trace_next_tid = 1;
+static GPrivate       trace_buffer_key;
+
+#ifdef G_OS_UNIX
+static gint trace_signal_pipe[2] = { -1, -1 };
+static guint trace_signal_watch = 0;
+#endif
+
+static EvTraceBuffer *
+ev_trace_get_buffer (void)
+{
+	EvTraceBuffer *buffer;
+
+	buffer = g_private_get (&trace_buffer_key);
+	if (G_LIKELY (buffer))
+		return buffer;
+
+	/* Buffers are never freed, so that the spans of
+	 * finished threads can still be dumped
+	 */
+	buffer = g_new0 (EvTraceBuffer, 1);
+	buffer->tid = g_atomic_int_add (&trace_next_tid, 1);
+	do {
+		buffer->next = g_atomic_pointer_get (&trace_buffers);
+	} while (!g_atomic_pointer_compare_and_exchange (&trace_buffers, buffer->next, buffer));
+
+	g_private_set (&trace_buffer_key, buffer);
+
+	return buffer;
+}
+
+static EvTraceEvent *
+ev_trace_buffer_reserve (EvTraceBuffer *buffer)
+{
+	EvTraceEvent *event;
+
+	event = &buffer->events[(guint)buffer->n_events % EV_TRACE_BUFFER_SIZE];
+	memset (event, 0, sizeof (EvTraceEvent));
+
+	return event;
+}
+
+static void
+ev_trace_buffer_commit (EvTraceBuffer *buffer)
+{
+	g_atomic_int_inc (&buffer->n_events);
+}
+
+/**
+ * ev_trace_begin:
+ *
+ * Returns: the start time of a span, to be passed to ev_trace_end(),
+ *     or 0 when tracing is disabled
+ */
+gint64
+ev_trace_begin (void)
+{
+	if (G_LIKELY (!trace_enabled))
+		return 0;
+
+	return g_get_monotonic_time ();
+}
+
+static void
+ev_trace_add_span (EvTraceEventType type,
+		   const gchar     *category,
+		   const gchar     *name,
+		   gconstpointer    id,
+		   gint64           start,
+		   const gchar     *first_arg_name,
+		   va_list         *args)
+{
+	EvTraceBuffer *buffer;
+	EvTraceEvent  *event;
+	const gchar   *arg_name;
+
+	buffer = ev_trace_get_buffer ();
+	event = ev_trace_buffer_reserve (buffer);
+	event->type = type;
+	event->category = category;
+	event->name = name;
+	event->id = id;
+	event->start = start;
+	event->duration = g_get_monotonic_time () - start;
+
+	for (arg_name = first_arg_name;
+	     arg_name && event->n_args < EV_TRACE_MAX_ARGS;
+	     arg_name = va_arg (*args, const gchar *)) {
+		event->arg_names[event->n_args] = arg_name;
+		event->args[event->n_args] = va_arg (*args, gint64);
+		event->n_args++;
+	}
+
+	ev_trace_buffer_commit (buffer);
+}
+
+/**
+ * ev_trace_end:
+ * @category: the category of the span
+ * @name: the name of the span
+ * @start: the value returned by ev_trace_begin()
+ *
+ * Records a span of the current thread from @start until now.
+ */
+void
+ev_trace_end (const gchar *category,
+	      const gchar *name,
+	      gint64       start)
+{
+	if (G_LIKELY (start == 0))
+		return;
+
+	ev_trace_add_span (EV_TRACE_SPAN, category, name, NULL, start, NULL, NULL);
+}
+
+/**
+ * ev_trace_end_with_args:
+ * @category: the category of the span
+ * @name: the name of the span
+ * @start: the value returned by ev_trace_begin()
+ * @first_arg_name: the name of the first argument
+ * @...: the #gint64 value of the first argument, followed optionally
+ *     by more name/value pairs, followed by %NULL
+ *
+ * Like ev_trace_end(), but also records up to three integer arguments.
+ */
+void
+ev_trace_end_with_args (const gchar *category,
+			const gchar *name,
+			gint64       start,
+			const gchar *first_arg_name,
+			...)
+{
+	va_list args;
+
+	if (G_LIKELY (start == 0))
+		return;
+
+	va_start (args, first_arg_name);
+	ev_trace_add_span (EV_TRACE_SPAN, category, name, NULL, start, first_arg_name, &args);
+	va_end (args);
+}
+
+/**
+ * ev_trace_async_end:
+ * @category: the category of the span
+ * @name: the name of the span
+ * @id: the object the span belongs to
+ * @start: the value returned by ev_trace_begin()
+ *
+ * Records a span from @start until now that is not tied to the
+ * current thread, like the time a job waited in a queue.
+ */
+void
+ev_trace_async_end (const gchar   *category,
+		    const gchar   *name,
+		    gconstpointer  id,
+		    gint64         start)
+{
+	if (G_LIKELY (start == 0))
+		return;
+
+	ev_trace_add_span (EV_TRACE_ASYNC_SPAN, category, name, id, start, NULL, NULL);
+}
+
+/**
+ * ev_trace_set_thread_name:
+ * @name: a static string
+ *
+ * Sets the name the current thread is shown with in the trace.
+ */
+void
+ev_trace_set_thread_name (const gchar *name)
+{
+	if (G_LIKELY (!trace_enabled))
+		return;
+
+	ev_trace_get_buffer ()->thread_name = name;
+}
+
+static void
+ev_trace_append_string (GString     *json,
+			const gchar *str)
+{
+	g_string_append_c (json, '"');
+	for (; str && *str; str++) {
+		if (*str == '"' || *str == '\\')
+			g_string_append_c (json, '\\');
+		if ((guchar)*str < 0x20)
+			g_string_append_printf (json, "\\u%04x", (guchar)*str);
+		else
+			g_string_append_c (json, *str);
+	}
+	g_string_append_c (json, '"');
+}
+
+static void
+ev_trace_append_event_header (GString       *json,
+			      EvTraceEvent  *event,
+			      const gchar   *phase,
+			      gint64         timestamp,
+			      gint           pid,
+			      guint          tid)
+{
+	g_string_append (json, "{\"name\":");
+	ev_trace_append_string (json, event->name);
+	g_string_append (json, ",\"cat\":");
+	ev_trace_append_string (json, event->category);
+	g_string_append_printf (json, ",\"ph\":\"%s\",\"ts\":%" G_GINT64_FORMAT
+				",\"pid\":%d,\"tid\":%u",
+				phase, timestamp, pid, tid);
+}
+
+static void
+ev_trace_append_event (GString       *json,
+		       EvTraceEvent  *event,
+		       gint           pid,
+		       guint          tid)
+{
+	guint i;
+
+	if (event->type == EV_TRACE_ASYNC_SPAN) {
+		ev_trace_append_event_header (json, event, "b", event->start, pid, tid);
+		g_string_append_printf (json, ",\"id\":\"%p\"},\n", event->id);
+		ev_trace_append_event_header (json, event, "e",
+					      event->start + event->duration,
+					      pid, tid);
+		g_string_append_printf (json, ",\"id\":\"%p\"},\n", event->id);
+
+		return;
+	}
+
+	ev_trace_append_event_header (json, event, "X", event->start, pid, tid);
+	g_string_append_printf (json, ",\"dur\":%" G_GINT64_FORMAT, event->duration);
+	if (event->n_args > 0) {
+		g_string_append (json, ",\"args\":{");
+		for (i = 0; i < event->n_args; i++) {
+			if (i > 0)
+				g_string_append_c (json, ',');
+			ev_trace_append_string (json, event->arg_names[i]);
+			g_string_append_printf (json, ":%" G_GINT64_FORMAT, event->args[i]);
+		}
+		g_string_append_c (json, '}');
+	}
+	g_string_append (json, "},\n");
+}
+
+/**
+ * ev_trace_dump:
+ * @filename: the file to write the trace to
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Writes the spans recorded so far to @filename in the Chrome trace
+ * event format, which can be loaded in chrome://tracing or Perfetto.
+ *
+ * Spans recorded while the trace is written might be missing or
+ * partially written.
+ *
+ * Returns: %TRUE on success, or %FALSE on error with @error filled in
+ */
+gboolean
+ev_trace_dump (const gchar *filename,
+	       GError     **error)
+{
+	EvTraceBuffer *buffer;
+	GString       *json;
+	gint           pid;
+	gboolean       retval;
+
+#ifdef G_OS_UNIX
+	pid = getpid ();
+#else
+	pid = 1;
+#endif
+
+	json = g_string_new ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for (buffer = g_atomic_pointer_get (&trace_buffers); buffer; buffer = buffer->next) {
+		guint n_events = g_atomic_int_get (&buffer->n_events);
+		guint first = n_events > EV_TRACE_BUFFER_SIZE ? n_events - EV_TRACE_BUFFER_SIZE : 0;
+		guint i;
+
+		if (buffer->thread_name) {
+			g_string_append_printf (json,
+						"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+						pid, buffer->tid);
+			ev_trace_append_string (json, buffer->thread_name);
+			g_string_append (json, "}},\n");
+		}
+
+		for (i = first; i < n_events; i++)
+			ev_trace_append_event (json, &buffer->events[i % EV_TRACE_BUFFER_SIZE],
+					       pid, buffer->tid);
+	}
+
+	/* Drop the trailing separator */
+	if (g_str_has_suffix (json->str, ",\n"))
+		g_string_truncate (json, json->len - 2);
+	g_string_append (json, "\n]}\n");
+
+	retval = g_file_set_contents (filename, json->str, json->len, error);
+	g_string_free (json, TRUE);
+
+	return retval;
+}
+
+static void
+ev_trace_dump_to_file (void)
+{
+	GError *error = NULL;
+
+	if (!ev_trace_dump (trace_filename, &error)) {
+		g_warning ("Failed to write trace to %s: %s", trace_filename, error->message);
+		g_error_free (error);
+	}
+}
+
+#ifdef G_OS_UNIX
+static void
+ev_trace_signal_handler (int signum)
+{
+	int saved_errno = errno;
+	char c = 0;
+
+	/* Dumping is not async-signal-safe, so wake up the main loop */
+	if (write (trace_signal_pipe[1], &c, 1) < 0) {
+		/* Nothing to do, a dump is already pending */
+	}
+
+	errno = saved_errno;
+}
+
+static gboolean
+ev_trace_signal_cb (GIOChannel   *channel,
+		    GIOCondition  condition,
+		    gpointer      data)
+{
+	char buf[64];
+
+	while (read (trace_signal_pipe[0], buf, sizeof (buf)) > 0);
+
+	ev_trace_dump_to_file ();
+
+	return TRUE;
+}
+
+static void
+ev_trace_install_signal_handler (void)
+{
+	struct sigaction action;
+	GIOChannel      *channel;
+
+	if (pipe (trace_signal_pipe) < 0)
+		return;
+
+	fcntl (trace_signal_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl (trace_signal_pipe[1], F_SETFL, O_NONBLOCK);
+
+	channel = g_io_channel_unix_new (trace_signal_pipe[0]);
+	trace_signal_watch = g_io_add_watch (channel, G_IO_IN, ev_trace_signal_cb, NULL);
+	g_io_channel_unref (channel);
+
+	memset (&action, 0, sizeof (action));
+	action.sa_handler = ev_trace_signal_handler;
+	sigemptyset (&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction (SIGUSR1, &action, NULL);
+}
+#endif /* G_OS_UNIX */
+
+void
+_ev_trace_init (void)
+{
+	const gchar *filename;
+
+	filename = g_getenv ("EV_TRACE");
+	if (!filename || filename[0] == '\0')
+		return;
+
+	trace_filename = g_strdup (filename);
+	trace_enabled = TRUE;
+
+	ev_trace_set_thread_name ("Main");
+
+#ifdef G_OS_UNIX
+	ev_trace_install_signal_handler ();
+#endif
+}
+
+void
+_ev_trace_shutdown (void)
+{
+	if (!trace_enabled)
+		return;
+
+	ev_trace_dump_to_file ();
+
+#ifdef G_OS_UNIX
+	if (trace_signal_watch > 0) {
+		signal (SIGUSR1, SIG_DFL);
+		g_source_remove (trace_signal_watch);
+		trace_signal_watch = 0;
+		close (trace_signal_pipe[0]);
+		close (trace_signal_pipe[1]);
+	}
+#endif
+
+	trace_enabled = FALSE;
+	g_free (trace_filename);
+	trace_filename = NULL;
+}
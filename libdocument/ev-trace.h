@@ -0,0 +1,59 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (EVINCE_COMPILATION)
+#error "This is a private header."
+#endif
+
+#ifndef EV_TRACE_H
+#define EV_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Set EV_TRACE to a file name to record spans of the jobs, the
+ * document lock and the view drawing. The recorded spans are written
+ * to that file as Chrome trace events when the library is shut down,
+ * and on SIGUSR1. Names, categories and argument names are stored by
+ * pointer, so they must be static strings.
+ */
+
+void     _ev_trace_init           (void);
+void     _ev_trace_shutdown       (void);
+
+gint64   ev_trace_begin           (void);
+void     ev_trace_end             (const gchar   *category,
+				   const gchar   *name,
+				   gint64         start);
+void     ev_trace_end_with_args   (const gchar   *category,
+				   const gchar   *name,
+				   gint64         start,
+				   const gchar   *first_arg_name,
+				   ...) G_GNUC_NULL_TERMINATED;
+void     ev_trace_async_end       (const gchar   *category,
+				   const gchar   *name,
+				   gconstpointer  id,
+				   gint64         start);
+void     ev_trace_set_thread_name (const gchar   *name);
+gboolean ev_trace_dump            (const gchar   *filename,
+				   GError       **error);
+
+G_END_DECLS
+
+#endif /* EV_TRACE_H */
@@ -19,16 +19,23 @@
  */
 
 #include "ev-debug.h"
+#include "ev-trace.h"
 #include "ev-job-scheduler.h"
 
 typedef struct _EvSchedulerJob {
 	EvJob         *job;
 	EvJobPriority  priority;
-	GSList        *job_link;
+	guint          distance;
+	guint64        sequence;
+	gint64         queued_time;
+
+	/* Position in the job queue, -1 when not queued */
+	gint           queue_index;
 } EvSchedulerJob;
 
+/* Scheduled jobs by EvJob */
 G_LOCK_DEFINE_STATIC(job_list);
-static GSList *job_list = NULL;
+static GHashTable *job_list = NULL;
 
 static volatile EvJob *running_job = NULL;
 
@@ -36,30 +43,127 @@ static gpointer ev_job_thread_proxy               (gpointer        data);
 static void     ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 						   GCancellable   *cancellable);
 
-/* EvJobQueue */
-static GQueue queue_urgent = G_QUEUE_INIT;
-static GQueue queue_high = G_QUEUE_INIT;
-static GQueue queue_low = G_QUEUE_INIT;
-static GQueue queue_none = G_QUEUE_INIT;
+/* EvJobQueue: a binary heap of thread jobs, the most urgent first.
+ * Jobs are ordered by priority, then distance to the visible pages,
+ * and finally in the order they were pushed.
+ */
+static GPtrArray *job_queue = NULL;
+static guint64 job_queue_sequence = 0;
 static GCond job_queue_cond;
 static GMutex job_queue_mutex;
 
-static GQueue *job_queue[EV_JOB_N_PRIORITIES] = {
-	&queue_urgent,
-	&queue_high,
-	&queue_low,
-	&queue_none
-};
+static inline gboolean
+ev_scheduler_job_before (EvSchedulerJob *a,
+			 EvSchedulerJob *b)
+{
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	if (a->distance != b->distance)
+		return a->distance < b->distance;
+	return a->sequence < b->sequence;
+}
+
+static inline void
+ev_job_queue_set (gint            index,
+		  EvSchedulerJob *job)
+{
+	g_ptr_array_index (job_queue, index) = job;
+	job->queue_index = index;
+}
+
+static void
+ev_job_queue_sift_up (gint index)
+{
+	EvSchedulerJob *job = g_ptr_array_index (job_queue, index);
+
+	while (index > 0) {
+		gint            parent_index = (index - 1) / 2;
+		EvSchedulerJob *parent = g_ptr_array_index (job_queue, parent_index);
+
+		if (!ev_scheduler_job_before (job, parent))
+			break;
+
+		ev_job_queue_set (index, parent);
+		index = parent_index;
+	}
+	ev_job_queue_set (index, job);
+}
+
+static void
+ev_job_queue_sift_down (gint index)
+{
+	EvSchedulerJob *job = g_ptr_array_index (job_queue, index);
+	gint            len = job_queue->len;
+
+	while (TRUE) {
+		gint            child_index = 2 * index + 1;
+		EvSchedulerJob *child;
+
+		if (child_index >= len)
+			break;
+
+		child = g_ptr_array_index (job_queue, child_index);
+		if (child_index + 1 < len &&
+		    ev_scheduler_job_before (g_ptr_array_index (job_queue, child_index + 1), child)) {
+			child_index++;
+			child = g_ptr_array_index (job_queue, child_index);
+		}
+
+		if (!ev_scheduler_job_before (child, job))
+			break;
+
+		ev_job_queue_set (index, child);
+		index = child_index;
+	}
+	ev_job_queue_set (index, job);
+}
+
+/* Restores the heap order after the key of a queued job changed */
+static void
+ev_job_queue_update_unlocked (EvSchedulerJob *job)
+{
+	gint index = job->queue_index;
+
+	ev_job_queue_sift_up (index);
+	if (job->queue_index == index)
+		ev_job_queue_sift_down (index);
+}
+
+static void
+ev_job_queue_push_unlocked (EvSchedulerJob *job)
+{
+	job->queued_time = ev_trace_begin ();
+	g_ptr_array_add (job_queue, job);
+	job->queue_index = job_queue->len - 1;
+	ev_job_queue_sift_up (job->queue_index);
+}
+
+static void
+ev_job_queue_remove_unlocked (EvSchedulerJob *job)
+{
+	gint            index = job->queue_index;
+	EvSchedulerJob *last;
+
+	g_assert (index >= 0 && (guint) index < job_queue->len);
+
+	last = g_ptr_array_remove_index_fast (job_queue, job_queue->len - 1);
+	job->queue_index = -1;
+	if (last == job)
+		return;
+
+	ev_job_queue_set (index, last);
+	ev_job_queue_update_unlocked (last);
+}
 
 static void
-ev_job_queue_push (EvSchedulerJob *job,
-		   EvJobPriority   priority)
+ev_job_queue_push (EvSchedulerJob *job)
 {
-	ev_debug_message (DEBUG_JOBS, "%s priority %d", EV_GET_TYPE_NAME (job->job), priority);
+	ev_debug_message (DEBUG_JOBS, "%s priority %d", EV_GET_TYPE_NAME (job->job), job->priority);
 	
 	g_mutex_lock (&job_queue_mutex);
 
-	g_queue_push_tail (job_queue[priority], job);
+	job->sequence = job_queue_sequence++;
+	ev_job_queue_push_unlocked (job);
 	g_cond_broadcast (&job_queue_cond);
 	
 	g_mutex_unlock (&job_queue_mutex);
@@ -68,13 +172,11 @@ ev_job_queue_push (EvSchedulerJob *job,
 static EvSchedulerJob *
 ev_job_queue_get_next_unlocked (void)
 {
-	gint i;
 	EvSchedulerJob *job = NULL;
-	
-	for (i = EV_JOB_PRIORITY_URGENT; i < EV_JOB_N_PRIORITIES; i++) {
-		job = (EvSchedulerJob *) g_queue_pop_head (job_queue[i]);
-		if (job)
-			break;
+
+	if (job_queue->len > 0) {
+		job = g_ptr_array_index (job_queue, 0);
+		ev_job_queue_remove_unlocked (job);
 	}
 
 	ev_debug_message (DEBUG_JOBS, "%s", job ? EV_GET_TYPE_NAME (job->job) : "No jobs in queue");
@@ -82,9 +184,28 @@ ev_job_queue_get_next_unlocked (void)
 	return job;
 }
 
+static gboolean
+ev_job_queue_has_more_urgent (EvJobPriority priority)
+{
+	gboolean retval = FALSE;
+
+	g_mutex_lock (&job_queue_mutex);
+	if (job_queue->len > 0) {
+		EvSchedulerJob *next = g_ptr_array_index (job_queue, 0);
+
+		retval = next->priority < priority;
+	}
+	g_mutex_unlock (&job_queue_mutex);
+
+	return retval;
+}
+
 static gpointer
 ev_job_scheduler_init (gpointer data)
 {
+	job_list = g_hash_table_new (g_direct_hash, g_direct_equal);
+	job_queue = g_ptr_array_new ();
+
 	g_thread_new ("EvJobScheduler", ev_job_thread_proxy, NULL);
 
 	return NULL;
@@ -97,8 +218,7 @@ ev_scheduler_job_list_add (EvSchedulerJob *job)
 	
 	G_LOCK (job_list);
 
-	job_list = g_slist_prepend (job_list, job);
-	job->job_link = job_list;
+	g_hash_table_insert (job_list, job->job, job);
 	
 	G_UNLOCK (job_list);
 }
@@ -110,7 +230,9 @@ ev_scheduler_job_list_remove (EvSchedulerJob *job)
 	
 	G_LOCK (job_list);
 
-	job_list = g_slist_delete_link (job_list, job->job_link);
+	/* The same job might have been pushed again */
+	if (g_hash_table_lookup (job_list, job->job) == job)
+		g_hash_table_remove (job_list, job->job);
 	
 	G_UNLOCK (job_list);
 }
@@ -148,8 +270,6 @@ static void
 ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 				   GCancellable   *cancellable)
 {
-	GList   *list;
-	
 	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job->job));
 
 	g_mutex_lock (&job_queue_mutex);
@@ -159,9 +279,8 @@ ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 	 * If the job is currently running, it will be
 	 * destroyed as soon as it finishes. 
 	 */
-	list = g_queue_find (job_queue[job->priority], job);
-	if (list) {
-		g_queue_delete_link (job_queue[job->priority], list);
+	if (job->queue_index >= 0) {
+		ev_job_queue_remove_unlocked (job);
 		g_mutex_unlock (&job_queue_mutex);
 		ev_scheduler_job_destroy (job);
 	} else {
@@ -169,13 +288,21 @@ ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 	}
 }
 
-static void
-ev_job_thread (EvJob *job)
+/* Returns TRUE when the job didn't finish because
+ * a job with a higher priority is waiting
+ */
+static gboolean
+ev_job_thread (EvSchedulerJob *s_job)
 {
+	EvJob   *job = s_job->job;
 	gboolean result;
+	gint64   trace_start;
 
 	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job));
 
+	ev_trace_async_end ("scheduler", "Queue wait", job, s_job->queued_time);
+	trace_start = ev_trace_begin ();
+
 	do {
 		if (g_cancellable_is_cancelled (job->cancellable))
 			result = FALSE;
@@ -183,9 +310,16 @@ ev_job_thread (EvJob *job)
                         g_atomic_pointer_set (&running_job, job);
 			result = ev_job_run (job);
                 }
-	} while (result);
+	} while (result && !ev_job_queue_has_more_urgent (s_job->priority));
 
         g_atomic_pointer_set (&running_job, NULL);
+
+	ev_trace_end_with_args ("job", EV_GET_TYPE_NAME (job), trace_start,
+				"priority", (gint64)s_job->priority,
+				"distance", (gint64)s_job->distance,
+				NULL);
+
+	return result;
 }
 
 static gboolean
@@ -202,6 +336,8 @@ ev_job_idle (EvJob *job)
 static gpointer
 ev_job_thread_proxy (gpointer data)
 {
+	ev_trace_set_thread_name ("EvJobScheduler");
+
 	while (TRUE) {
 		EvSchedulerJob *job;
 
@@ -213,28 +349,53 @@ ev_job_thread_proxy (gpointer data)
 			continue;
 		}
 		g_mutex_unlock (&job_queue_mutex);
-		
-		ev_job_thread (job->job);
+
+		if (ev_job_thread (job)) {
+			/* Keeping its sequence number, it's resumed as
+			 * soon as the more urgent jobs are done
+			 */
+			g_mutex_lock (&job_queue_mutex);
+			ev_job_queue_push_unlocked (job);
+			g_mutex_unlock (&job_queue_mutex);
+			continue;
+		}
+
 		ev_scheduler_job_destroy (job);
 	}
 
 	return NULL;
 }
 
+/**
+ * ev_job_scheduler_push_job_full:
+ * @job: an #EvJob
+ * @priority: the #EvJobPriority of @job
+ * @distance: the distance in pages of the page of @job to the visible
+ *     pages, or 0
+ *
+ * Schedules @job. Thread jobs run in order of @priority; jobs with the
+ * same priority run in order of @distance, and then in the order they
+ * were pushed.
+ *
+ * Since: 3.6
+ */
 void
-ev_job_scheduler_push_job (EvJob         *job,
-			   EvJobPriority  priority)
+ev_job_scheduler_push_job_full (EvJob         *job,
+				EvJobPriority  priority,
+				guint          distance)
 {
 	static GOnce once_init = G_ONCE_INIT;
 	EvSchedulerJob *s_job;
 
 	g_once (&once_init, ev_job_scheduler_init, NULL);
 
-	ev_debug_message (DEBUG_JOBS, "%s pirority %d", EV_GET_TYPE_NAME (job), priority);
+	ev_debug_message (DEBUG_JOBS, "%s priority %d", EV_GET_TYPE_NAME (job), priority);
 
 	s_job = g_new0 (EvSchedulerJob, 1);
 	s_job->job = g_object_ref (job);
 	s_job->priority = priority;
+	s_job->distance = distance;
+	s_job->queue_index = -1;
 
 	ev_scheduler_job_list_add (s_job);
 	
@@ -243,7 +404,7 @@ ev_job_scheduler_push_job (EvJob         *job,
 		g_signal_connect_swapped (job->cancellable, "cancelled",
 					  G_CALLBACK (ev_scheduler_thread_job_cancelled),
 					  s_job);
-		ev_job_queue_push (s_job, priority);
+		ev_job_queue_push (s_job);
 		break;
 	case EV_JOB_RUN_MAIN_LOOP:
 		g_signal_connect_swapped (job, "finished",
@@ -263,48 +424,97 @@ ev_job_scheduler_push_job (EvJob         *job,
 }
 
 void
-ev_job_scheduler_update_job (EvJob         *job,
-			     EvJobPriority  priority)
+ev_job_scheduler_push_job (EvJob         *job,
+			   EvJobPriority  priority)
+{
+	ev_job_scheduler_push_job_full (job, priority, 0);
+}
+
+/* Must be called with both the job list and the job queue locked */
+static gboolean
+ev_job_scheduler_update_job_unlocked (EvJob         *job,
+				      EvJobPriority  priority,
+				      guint          distance)
+{
+	EvSchedulerJob *s_job;
+
+	s_job = g_hash_table_lookup (job_list, job);
+	if (!s_job || s_job->queue_index < 0)
+		return FALSE;
+
+	if (s_job->priority == priority && s_job->distance == distance)
+		return FALSE;
+
+	ev_debug_message (DEBUG_JOBS, "Moving job %s from priority %d to %d",
+			  EV_GET_TYPE_NAME (job), s_job->priority, priority);
+
+	s_job->priority = priority;
+	s_job->distance = distance;
+	ev_job_queue_update_unlocked (s_job);
+
+	return TRUE;
+}
+
+/**
+ * ev_job_scheduler_update_jobs:
+ * @updates: (array length=n_updates): the new priorities and distances
+ * @n_updates: the number of elements in @updates
+ *
+ * Changes the priority and distance of several scheduled jobs at once.
+ * Jobs that are not waiting in the queue anymore are ignored.
+ *
+ * Since: 3.6
+ */
+void
+ev_job_scheduler_update_jobs (const EvJobSchedulerUpdate *updates,
+			      guint                       n_updates)
 {
-	GSList         *l;
-	EvSchedulerJob *s_job = NULL;
-	gboolean        need_resort = FALSE;
+	gboolean changed = FALSE;
+	guint    i;
 
-	/* Main loop jobs are scheduled inmediately */
-	if (ev_job_get_run_mode (job) == EV_JOB_RUN_MAIN_LOOP)
+	if (n_updates == 0 || !job_list)
 		return;
 
-	ev_debug_message (DEBUG_JOBS, "%s pirority %d", EV_GET_TYPE_NAME (job), priority);
-	
 	G_LOCK (job_list);
+	g_mutex_lock (&job_queue_mutex);
 
-	for (l = job_list; l; l = l->next) {
-		s_job = (EvSchedulerJob *)l->data;
+	for (i = 0; i < n_updates; i++) {
+		/* Main loop jobs are scheduled immediately */
+		if (ev_job_get_run_mode (updates[i].job) == EV_JOB_RUN_MAIN_LOOP)
+			continue;
 
-		if (s_job->job == job) {
-			need_resort = (s_job->priority != priority);
-			break;
-		}
+		if (ev_job_scheduler_update_job_unlocked (updates[i].job,
+							  updates[i].priority,
+							  updates[i].distance))
+			changed = TRUE;
 	}
-	
+
+	if (changed)
+		g_cond_broadcast (&job_queue_cond);
+
+	g_mutex_unlock (&job_queue_mutex);
 	G_UNLOCK (job_list);
+}
 
-	if (need_resort) {
-		GList *list;
-	
-		g_mutex_lock (&job_queue_mutex);
-		
-		list = g_queue_find (job_queue[s_job->priority], s_job);
-		if (list) {
-			ev_debug_message (DEBUG_JOBS, "Moving job %s from pirority %d to %d",
-					  EV_GET_TYPE_NAME (job), s_job->priority, priority);
-			g_queue_delete_link (job_queue[s_job->priority], list);
-			g_queue_push_tail (job_queue[priority], s_job);
-			g_cond_broadcast (&job_queue_cond);
-		}
-		
-		g_mutex_unlock (&job_queue_mutex);
-	}
+void
+ev_job_scheduler_update_job (EvJob         *job,
+			     EvJobPriority  priority)
+{
+	EvJobSchedulerUpdate update;
+	EvSchedulerJob      *s_job;
+
+	if (!job_list)
+		return;
+
+	/* Keep the distance of the job */
+	G_LOCK (job_list);
+	s_job = g_hash_table_lookup (job_list, job);
+	update.distance = s_job ? s_job->distance : 0;
+	G_UNLOCK (job_list);
+
+	update.job = job;
+	update.priority = priority;
+	ev_job_scheduler_update_jobs (&update, 1);
 }
 
 EvJob *
@@ -38,10 +38,21 @@ typedef enum {
 	EV_JOB_N_PRIORITIES
 } EvJobPriority;
 
+typedef struct {
+	EvJob         *job;
+	EvJobPriority  priority;
+	guint          distance;
+} EvJobSchedulerUpdate;
+
 void   ev_job_scheduler_push_job               (EvJob        *job,
                                                 EvJobPriority priority);
+void   ev_job_scheduler_push_job_full          (EvJob        *job,
+                                                EvJobPriority priority,
+                                                guint         distance);
 void   ev_job_scheduler_update_job             (EvJob        *job,
                                                 EvJobPriority priority);
+void   ev_job_scheduler_update_jobs            (const EvJobSchedulerUpdate *updates,
+                                                guint                       n_updates);
 EvJob *ev_job_scheduler_get_running_thread_job (void);
 
 G_END_DECLS
@@ -36,11 +36,17 @@
 #include "ev-document-annotations.h"
 #include "ev-document-attachments.h"
 #include "ev-document-text.h"
+#include "ev-render-registry.h"
+#include "ev-thumbnails-cache.h"
 #include "ev-debug.h"
+#include "ev-trace.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 static void ev_job_init                   (EvJob                 *job);
@@ -63,6 +69,8 @@ static void ev_job_save_init              (EvJobSave             *job);
 static void ev_job_save_class_init        (EvJobSaveClass        *class);
 static void ev_job_find_init              (EvJobFind             *job);
 static void ev_job_find_class_init        (EvJobFindClass        *class);
+static void ev_job_index_init             (EvJobIndex            *job);
+static void ev_job_index_class_init       (EvJobIndexClass       *class);
 static void ev_job_layers_init            (EvJobLayers           *job);
 static void ev_job_layers_class_init      (EvJobLayersClass      *class);
 static void ev_job_export_init            (EvJobExport           *job);
@@ -86,9 +94,15 @@ enum {
 	FIND_LAST_SIGNAL
 };
 
+enum {
+	ANNOTS_UPDATED,
+	ANNOTS_LAST_SIGNAL
+};
+
 static guint job_signals[LAST_SIGNAL] = { 0 };
 static guint job_fonts_signals[FONTS_LAST_SIGNAL] = { 0 };
 static guint job_find_signals[FIND_LAST_SIGNAL] = { 0 };
+static guint job_annots_signals[ANNOTS_LAST_SIGNAL] = { 0 };
 
 G_DEFINE_ABSTRACT_TYPE (EvJob, ev_job, G_TYPE_OBJECT)
 G_DEFINE_TYPE (EvJobLinks, ev_job_links, EV_TYPE_JOB)
@@ -103,6 +117,7 @@ G_DEFINE_TYPE (EvJobLoadStream, ev_job_load_stream, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobLoadGFile, ev_job_load_gfile, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobSave, ev_job_save, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobFind, ev_job_find, EV_TYPE_JOB)
+G_DEFINE_TYPE (EvJobIndex, ev_job_index, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobLayers, ev_job_layers, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobExport, ev_job_export, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobPrint, ev_job_print, EV_TYPE_JOB)
@@ -337,11 +352,13 @@ ev_job_links_dispose (GObject *object)
 	(* G_OBJECT_CLASS (ev_job_links_parent_class)->dispose) (object);
 }
 
-static gboolean
-fill_page_labels (GtkTreeModel   *tree_model,
-		  GtkTreePath    *path,
-		  GtkTreeIter    *iter,
-		  EvJob          *job)
+/* Number of page labels filled in every lock hold */
+#define EV_JOB_LINKS_LABELS_CHUNK 32
+
+static void
+fill_page_label (GtkTreeModel *tree_model,
+		 GtkTreeIter  *iter,
+		 EvJob        *job)
 {
 	EvDocumentLinks *document_links;
 	EvLink          *link;
@@ -352,36 +369,79 @@ fill_page_labels (GtkTreeModel   *tree_model,
 			    -1);
 
 	if (!link)
-		return FALSE;
+		return;
 
 	document_links = EV_DOCUMENT_LINKS (job->document);
 	page_label = ev_document_links_get_link_page_label (document_links, link);
-	if (!page_label)
-		return FALSE;
-
-	gtk_tree_store_set (GTK_TREE_STORE (tree_model), iter,
-			    EV_DOCUMENT_LINKS_COLUMN_PAGE_LABEL, page_label,
-			    -1);
+	if (page_label) {
+		gtk_tree_store_set (GTK_TREE_STORE (tree_model), iter,
+				    EV_DOCUMENT_LINKS_COLUMN_PAGE_LABEL, page_label,
+				    -1);
+		g_free (page_label);
+	}
 
-	g_free (page_label);
 	g_object_unref (link);
+}
 
-	return FALSE;
+/* Moves @iter to the next row of @tree_model in depth-first order */
+static gboolean
+links_model_iter_next (GtkTreeModel *tree_model,
+		       GtkTreeIter  *iter)
+{
+	GtkTreeIter next;
+
+	if (gtk_tree_model_iter_children (tree_model, &next, iter)) {
+		*iter = next;
+		return TRUE;
+	}
+
+	do {
+		GtkTreeIter parent;
+
+		next = *iter;
+		if (gtk_tree_model_iter_next (tree_model, &next)) {
+			*iter = next;
+			return TRUE;
+		}
+
+		if (!gtk_tree_model_iter_parent (tree_model, &parent, iter))
+			return FALSE;
+		*iter = parent;
+	} while (TRUE);
 }
 
 static gboolean
 ev_job_links_run (EvJob *job)
 {
 	EvJobLinks *job_links = EV_JOB_LINKS (job);
+	gint        i;
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
-	
+
+	if (!job_links->model) {
+		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+
+		ev_document_doc_mutex_lock ();
+		job_links->model = ev_document_links_get_links_model (EV_DOCUMENT_LINKS (job->document));
+		ev_document_doc_mutex_unlock ();
+
+		job_links->label_iter_valid =
+			gtk_tree_model_get_iter_first (job_links->model, &job_links->label_iter);
+	}
+
+	/* Release the document between chunks of labels, so that
+	 * other jobs can use it
+	 */
 	ev_document_doc_mutex_lock ();
-	job_links->model = ev_document_links_get_links_model (EV_DOCUMENT_LINKS (job->document));
+	for (i = 0; i < EV_JOB_LINKS_LABELS_CHUNK && job_links->label_iter_valid; i++) {
+		fill_page_label (job_links->model, &job_links->label_iter, job);
+		job_links->label_iter_valid =
+			links_model_iter_next (job_links->model, &job_links->label_iter);
+	}
 	ev_document_doc_mutex_unlock ();
 
-	gtk_tree_model_foreach (job_links->model, (GtkTreeModelForeachFunc)fill_page_labels, job);
+	if (job_links->label_iter_valid)
+		return TRUE;
 
 	ev_job_succeeded (job);
 	
@@ -481,7 +541,7 @@ ev_job_attachments_new (EvDocument *document)
 static void
 ev_job_annots_init (EvJobAnnots *job)
 {
-	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
+	EV_JOB (job)->run_mode = EV_JOB_RUN_MAIN_LOOP;
 }
 
 static void
@@ -502,29 +562,49 @@ ev_job_annots_dispose (GObject *object)
 	G_OBJECT_CLASS (ev_job_annots_parent_class)->dispose (object);
 }
 
+/* Annotations are read one page at a time, like EvJobFind
+ * searches, so the document is not locked for long
+ */
 static gboolean
 ev_job_annots_run (EvJob *job)
 {
-	EvJobAnnots *job_annots = EV_JOB_ANNOTS (job);
-	gint         i;
+	EvJobAnnots   *job_annots = EV_JOB_ANNOTS (job);
+	EvMappingList *mapping_list = NULL;
+	gint           n_pages;
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
 
-	ev_document_doc_mutex_lock ();
-	for (i = 0; i < ev_document_get_n_pages (job->document); i++) {
-		EvMappingList *mapping_list;
-		EvPage        *page;
+	n_pages = ev_document_get_n_pages (job->document);
+	if (job_annots->current_page < n_pages) {
+		EvPage *page;
+
+		/* Do not block the main loop */
+		if (!ev_document_doc_mutex_trylock ())
+			return TRUE;
+
+#ifdef EV_ENABLE_DEBUG
+		/* We use the #ifdef in this case because of the if */
+		if (job_annots->current_page == 0)
+			ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+#endif
 
-		page = ev_document_get_page (job->document, i);
+		page = ev_document_get_page (job->document, job_annots->current_page);
 		mapping_list = ev_document_annotations_get_annotations (EV_DOCUMENT_ANNOTATIONS (job->document),
 									page);
 		g_object_unref (page);
 
-		if (mapping_list)
-			job_annots->annots = g_list_prepend (job_annots->annots, mapping_list);
+		ev_document_doc_mutex_unlock ();
+
+		job_annots->current_page++;
 	}
-	ev_document_doc_mutex_unlock ();
+
+	if (mapping_list) {
+		job_annots->annots = g_list_prepend (job_annots->annots, mapping_list);
+		g_signal_emit (job_annots, job_annots_signals[ANNOTS_UPDATED], 0, mapping_list);
+	}
+
+	if (job_annots->current_page < n_pages)
+		return !g_cancellable_is_cancelled (job->cancellable);
 
 	job_annots->annots = g_list_reverse (job_annots->annots);
 
@@ -541,6 +621,16 @@ ev_job_annots_class_init (EvJobAnnotsClass *class)
 
 	oclass->dispose = ev_job_annots_dispose;
 	job_class->run = ev_job_annots_run;
+
+	job_annots_signals[ANNOTS_UPDATED] =
+		g_signal_new ("updated",
+			      EV_TYPE_JOB_ANNOTS,
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvJobAnnotsClass, updated),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__POINTER,
+			      G_TYPE_NONE,
+			      1, G_TYPE_POINTER);
 }
 
 EvJob *
@@ -596,9 +686,26 @@ ev_job_render_run (EvJob *job)
 	EvJobRender     *job_render = EV_JOB_RENDER (job);
 	EvPage          *ev_page;
 	EvRenderContext *rc;
+	gboolean         include_selection;
 
 	ev_debug_message (DEBUG_JOBS, "page: %d (%p)", job_render->page, job);
 	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+
+	/* Share the surface of an identical request rendered before,
+	 * unless the page changed since then
+	 */
+	if (!job_render->reload)
+		job_render->surface = ev_render_registry_lookup (job->document,
+								 job_render->page,
+								 job_render->rotation,
+								 job_render->scale);
+	include_selection = job_render->include_selection && EV_IS_SELECTION (job->document);
+	if (job_render->surface && !include_selection) {
+		ev_debug_message (DEBUG_JOBS, "page: %d (%p) shared", job_render->page, job);
+		ev_job_succeeded (job);
+
+		return FALSE;
+	}
 	
 	ev_document_doc_mutex_lock ();
 
@@ -610,19 +717,34 @@ ev_job_render_run (EvJob *job)
 	rc = ev_render_context_new (ev_page, job_render->rotation, job_render->scale);
 	g_object_unref (ev_page);
 
-	job_render->surface = ev_document_render (job->document, rc);
-	/* If job was cancelled during the page rendering,
-	 * we return now, so that the thread is finished ASAP
-	 */
-	if (g_cancellable_is_cancelled (job->cancellable)) {
-		ev_document_fc_mutex_unlock ();
-		ev_document_doc_mutex_unlock ();
-		g_object_unref (rc);
+	if (!job_render->surface) {
+		gint64 trace_start = ev_trace_begin ();
+
+		job_render->surface = ev_document_render (job->document, rc);
+		ev_trace_end_with_args ("render", "Render page", trace_start,
+					"page", (gint64)job_render->page,
+					"width", (gint64)(job_render->surface ? cairo_image_surface_get_width (job_render->surface) : 0),
+					"height", (gint64)(job_render->surface ? cairo_image_surface_get_height (job_render->surface) : 0),
+					NULL);
+		/* If job was cancelled during the page rendering,
+		 * we return now, so that the thread is finished ASAP
+		 */
+		if (g_cancellable_is_cancelled (job->cancellable)) {
+			ev_document_fc_mutex_unlock ();
+			ev_document_doc_mutex_unlock ();
+			g_object_unref (rc);
+
+			return FALSE;
+		}
 
-		return FALSE;
+		ev_render_registry_add (job->document,
+					job_render->page,
+					job_render->rotation,
+					job_render->scale,
+					job_render->surface);
 	}
 
-	if (job_render->include_selection && EV_IS_SELECTION (job->document)) {
+	if (include_selection) {
 		ev_selection_render_selection (EV_SELECTION (job->document),
 					       rc,
 					       &(job_render->selection),
@@ -796,9 +918,49 @@ ev_job_thumbnail_dispose (GObject *object)
 		job->thumbnail = NULL;
 	}
 
+	if (job->cache) {
+		ev_thumbnails_cache_unref (job->cache);
+		job->cache = NULL;
+	}
+
 	(* G_OBJECT_CLASS (ev_job_thumbnail_parent_class)->dispose) (object);
 }
 
+static GdkPixbuf *
+ev_job_thumbnail_get_from_registry (EvJobThumbnail *job_thumb)
+{
+	cairo_surface_t *surface;
+	cairo_surface_t *scaled;
+	GdkPixbuf       *thumbnail;
+	gdouble          scale;
+	gint             width, height;
+
+	surface = ev_render_registry_lookup_scaled (EV_JOB (job_thumb)->document,
+						    job_thumb->page,
+						    job_thumb->rotation,
+						    job_thumb->scale,
+						    &scale);
+	if (!surface)
+		return NULL;
+
+	if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+		cairo_surface_destroy (surface);
+		return NULL;
+	}
+
+	width = MAX ((gint)(cairo_image_surface_get_width (surface) * job_thumb->scale / scale + 0.5), 1);
+	height = MAX ((gint)(cairo_image_surface_get_height (surface) * job_thumb->scale / scale + 0.5), 1);
+
+	/* Downscaling the surface averages all the source pixels */
+	scaled = ev_document_misc_surface_rotate_and_scale (surface, width, height, 0);
+	cairo_surface_destroy (surface);
+
+	thumbnail = ev_document_misc_pixbuf_from_surface (scaled);
+	cairo_surface_destroy (scaled);
+
+	return thumbnail;
+}
+
 static gboolean
 ev_job_thumbnail_run (EvJob *job)
 {
@@ -809,20 +971,36 @@ ev_job_thumbnail_run (EvJob *job)
 
 	ev_debug_message (DEBUG_JOBS, "%d (%p)", job_thumb->page, job);
 	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
-	
-	ev_document_doc_mutex_lock ();
 
-	page = ev_document_get_page (job->document, job_thumb->page);
-	rc = ev_render_context_new (page, job_thumb->rotation, job_thumb->scale);
-	g_object_unref (page);
+	pixbuf = job_thumb->cache ?
+		ev_thumbnails_cache_lookup (job_thumb->cache, job_thumb->page) : NULL;
+	if (pixbuf)
+		ev_debug_message (DEBUG_JOBS, "%d (%p) cached", job_thumb->page, job);
 
-	pixbuf = ev_document_get_thumbnail (job->document, rc);
-	g_object_unref (rc);
-	ev_document_doc_mutex_unlock ();
+	/* Pages already rendered by a view don't need the backend */
+	if (!pixbuf) {
+		pixbuf = ev_job_thumbnail_get_from_registry (job_thumb);
+		if (!pixbuf) {
+			ev_document_doc_mutex_lock ();
 
-	if (pixbuf)
+			page = ev_document_get_page (job->document, job_thumb->page);
+			rc = ev_render_context_new (page, job_thumb->rotation, job_thumb->scale);
+			g_object_unref (page);
+
+			pixbuf = ev_document_get_thumbnail (job->document, rc);
+			g_object_unref (rc);
+			ev_document_doc_mutex_unlock ();
+		}
+
+		if (pixbuf && job_thumb->cache &&
+		    !g_cancellable_is_cancelled (job->cancellable))
+			ev_thumbnails_cache_store (job_thumb->cache, job_thumb->page, pixbuf);
+	}
+
+	if (pixbuf) {
 		job_thumb->thumbnail = ev_document_misc_get_thumbnail_frame (-1, -1, pixbuf);
-	g_object_unref (pixbuf);
+		g_object_unref (pixbuf);
+	}
 
 	ev_job_succeeded (job);
 	
@@ -859,6 +1037,24 @@ ev_job_thumbnail_new (EvDocument *document,
 	return EV_JOB (job);
 }
 
+/* Makes @job take the thumbnail from @cache when it's stored there, and
+ * store it otherwise, so that the cache is only read and written from
+ * the job thread. @cache must have been created for the rotation of
+ * @job. This must be called before the job is scheduled.
+ */
+void
+ev_job_thumbnail_set_cache (EvJobThumbnail    *job,
+			    EvThumbnailsCache *cache)
+{
+	g_return_if_fail (EV_IS_JOB_THUMBNAIL (job));
+
+	if (cache)
+		ev_thumbnails_cache_ref (cache);
+	if (job->cache)
+		ev_thumbnails_cache_unref (job->cache);
+	job->cache = cache;
+}
+
 /* EvJobFonts */
 static void
 ev_job_fonts_init (EvJobFonts *job)
@@ -987,9 +1183,9 @@ ev_job_load_run (EvJob *job)
 
 		uncompressed_uri = g_object_get_data (G_OBJECT (job->document),
 						      "uri-uncompressed");
-		ev_document_load (job->document,
-				  uncompressed_uri ? uncompressed_uri : job_load->uri,
-				  &error);
+		ev_document_load_mapped (job->document,
+					 uncompressed_uri ? uncompressed_uri : job_load->uri,
+					 &error);
 	} else {
 		job->document = ev_document_factory_get_document (job_load->uri,
 								  &error);
@@ -1363,95 +1559,249 @@ ev_job_save_dispose (GObject *object)
 	(* G_OBJECT_CLASS (ev_job_save_parent_class)->dispose) (object);
 }
 
-static gboolean
-ev_job_save_run (EvJob *job)
+static EvCompressionType
+ev_job_save_get_compression (EvJobSave *job)
 {
-	EvJobSave *job_save = EV_JOB_SAVE (job);
-	gint       fd;
-	gchar     *tmp_filename = NULL;
-	gchar     *local_uri;
-	GError    *error = NULL;
-	
-	ev_debug_message (DEBUG_JOBS, "uri: %s, document_uri: %s", job_save->uri, job_save->document_uri);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+	const gchar *ext;
 
-        fd = ev_mkstemp ("saveacopy.XXXXXX", &tmp_filename, &error);
-        if (fd == -1) {
-                ev_job_failed_from_error (job, error);
-                g_error_free (error);
+	/* If original document was compressed,
+	 * compress it again before saving
+	 */
+	if (!g_object_get_data (G_OBJECT (EV_JOB (job)->document), "uri-uncompressed"))
+		return EV_COMPRESSION_NONE;
+
+	ext = g_strrstr (job->document_uri, ".gz");
+	if (ext && g_ascii_strcasecmp (ext, ".gz") == 0)
+		return EV_COMPRESSION_GZIP;
+
+	ext = g_strrstr (job->document_uri, ".bz2");
+	if (ext && g_ascii_strcasecmp (ext, ".bz2") == 0)
+		return EV_COMPRESSION_BZIP2;
+
+	ext = g_strrstr (job->document_uri, ".xz");
+	if (ext && g_ascii_strcasecmp (ext, ".xz") == 0)
+		return EV_COMPRESSION_LZMA;
+
+	return EV_COMPRESSION_NONE;
+}
+
+/* Follows @path while it's a symbolic link, so that saving writes
+ * the file it points to instead of replacing the link
+ */
+static gchar *
+ev_job_save_resolve_symlinks (gchar *path)
+{
+	gint i;
+
+	/* Give up on loops like the kernel does */
+	for (i = 0; i < 40 && g_file_test (path, G_FILE_TEST_IS_SYMLINK); i++) {
+		gchar *link;
+
+		link = g_file_read_link (path, NULL);
+		if (!link)
+			break;
+
+		if (!g_path_is_absolute (link)) {
+			gchar *dirname;
+			gchar *resolved;
+
+			dirname = g_path_get_dirname (path);
+			resolved = g_build_filename (dirname, link, NULL);
+			g_free (dirname);
+			g_free (link);
+			link = resolved;
+		}
+
+		g_free (path);
+		path = link;
+	}
+
+	return path;
+}
+
+/* Saves the document into a temp file created next to the target,
+ * and atomically renames it over the target, so that the document
+ * is written exactly once. The temp file takes the mode and owner of
+ * the target, like g_file_replace() does.
+ */
+static gboolean
+ev_job_save_local (EvJobSave *job,
+		   GFile     *target,
+		   GError   **error)
+{
+	gchar    *path;
+	gchar    *dirname, *basename;
+	gchar    *tmp_basename, *tmp_filename;
+	gchar    *tmp_uri;
+	GStatBuf  target_stat;
+	gint      fd;
+	gboolean  retval;
+
+	path = ev_job_save_resolve_symlinks (g_file_get_path (target));
+	dirname = g_path_get_dirname (path);
+	basename = g_path_get_basename (path);
+	tmp_basename = g_strdup_printf (".%s.XXXXXX", basename);
+	tmp_filename = g_build_filename (dirname, tmp_basename, NULL);
+	g_free (tmp_basename);
+	g_free (basename);
+	g_free (dirname);
+
+	/* Use the default permissions, like g_file_copy() does */
+	fd = g_mkstemp_full (tmp_filename, O_RDWR, 0666);
+	if (fd == -1) {
+		int errsv = errno;
+
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     _("Failed to create a temporary file: %s"),
+			     g_strerror (errsv));
+		g_free (tmp_filename);
+		g_free (path);
 
 		return FALSE;
 	}
-	close (fd);
 
-	ev_document_doc_mutex_lock ();
+	if (g_stat (path, &target_stat) == 0) {
+		/* Changing the owner needs privileges we usually don't
+		 * have, so failing to keep it is not an error
+		 */
+		if (fchown (fd, target_stat.st_uid, target_stat.st_gid) == -1 &&
+		    fchown (fd, -1, target_stat.st_gid) == -1)
+			ev_debug_message (DEBUG_JOBS, "can't keep the owner of %s", path);
+		if (fchmod (fd, target_stat.st_mode & 07777) == -1)
+			ev_debug_message (DEBUG_JOBS, "can't keep the mode of %s", path);
+	}
+	close (fd);
 
-	/* Save document to temp filename */
-	local_uri = g_filename_to_uri (tmp_filename, NULL, &error);
-        if (local_uri != NULL) {
-                ev_document_save (job->document, local_uri, &error);
-        }
+	tmp_uri = g_filename_to_uri (tmp_filename, NULL, error);
+	if (tmp_uri) {
+		ev_document_doc_mutex_lock ();
+		retval = ev_document_save (EV_JOB (job)->document, tmp_uri, error);
+		ev_document_doc_mutex_unlock ();
+		g_free (tmp_uri);
+	} else {
+		retval = FALSE;
+	}
 
-	ev_document_doc_mutex_unlock ();
+	if (retval && g_rename (tmp_filename, path) == -1) {
+		int errsv = errno;
 
-	if (error) {
-		g_free (local_uri);
-		ev_job_failed_from_error (job, error);
-		g_error_free (error);
-		
-		return FALSE;
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     _("Failed to rename “%s” to “%s”: %s"),
+			     tmp_filename, path, g_strerror (errsv));
+		retval = FALSE;
 	}
 
-	/* If original document was compressed,
-	 * compress it again before saving
-	 */
-	if (g_object_get_data (G_OBJECT (job->document), "uri-uncompressed")) {
-		EvCompressionType ctype = EV_COMPRESSION_NONE;
-		const gchar      *ext;
-		gchar            *uri_comp;
-		
-		ext = g_strrstr (job_save->document_uri, ".gz");
-		if (ext && g_ascii_strcasecmp (ext, ".gz") == 0)
-			ctype = EV_COMPRESSION_GZIP;
-		
-		ext = g_strrstr (job_save->document_uri, ".bz2");
-		if (ext && g_ascii_strcasecmp (ext, ".bz2") == 0)
-			ctype = EV_COMPRESSION_BZIP2;
+	if (!retval)
+		g_unlink (tmp_filename);
+
+	g_free (tmp_filename);
+	g_free (path);
+
+	return retval;
+}
 
-		uri_comp = ev_file_compress (local_uri, ctype, &error);
-		g_free (local_uri);
+/* Saves the document into a temp file and streams it to the target,
+ * compressing it on the fly if needed. For local targets
+ * g_file_replace() takes care of the atomic rename.
+ */
+static gboolean
+ev_job_save_stream (EvJobSave        *job,
+		    GFile            *target,
+		    EvCompressionType ctype,
+		    GError          **error)
+{
+	GFileOutputStream *output;
+	gint               fd;
+	gchar             *tmp_filename = NULL;
+	gchar             *local_uri;
+	gboolean           retval;
+
+	fd = ev_mkstemp ("saveacopy.XXXXXX", &tmp_filename, error);
+	if (fd == -1)
+		return FALSE;
+	close (fd);
+
+	local_uri = g_filename_to_uri (tmp_filename, NULL, error);
+	if (!local_uri) {
 		g_unlink (tmp_filename);
+		g_free (tmp_filename);
+
+		return FALSE;
+	}
 
-		if (!uri_comp || error) {
-			local_uri = NULL;
+	ev_document_doc_mutex_lock ();
+	retval = ev_document_save (EV_JOB (job)->document, local_uri, error);
+	ev_document_doc_mutex_unlock ();
+
+	if (retval) {
+		output = g_file_replace (target, NULL, FALSE,
+					 G_FILE_CREATE_NONE,
+					 EV_JOB (job)->cancellable, error);
+		if (output) {
+			retval = ev_file_compress_to_stream (local_uri, ctype,
+							     G_OUTPUT_STREAM (output),
+							     EV_JOB (job)->cancellable,
+							     error);
+			if (retval) {
+				retval = g_output_stream_close (G_OUTPUT_STREAM (output),
+								EV_JOB (job)->cancellable,
+								error);
+			} else {
+				GCancellable *abort;
+
+				/* Closing the stream commits the replacement,
+				 * closing it cancelled discards it instead.
+				 */
+				abort = g_cancellable_new ();
+				g_cancellable_cancel (abort);
+				g_output_stream_close (G_OUTPUT_STREAM (output), abort, NULL);
+				g_object_unref (abort);
+			}
+			g_object_unref (output);
 		} else {
-			local_uri = uri_comp;
+			retval = FALSE;
 		}
 	}
 
+	g_unlink (tmp_filename);
 	g_free (tmp_filename);
+	g_free (local_uri);
 
-	if (error) {
-		g_free (local_uri);
-		ev_job_failed_from_error (job, error);
-		g_error_free (error);
-		
-		return FALSE;
-	}
+	return retval;
+}
 
-	if (!local_uri)
-		return FALSE;
+static gboolean
+ev_job_save_run (EvJob *job)
+{
+	EvJobSave        *job_save = EV_JOB_SAVE (job);
+	EvCompressionType ctype;
+	GFile            *target;
+	gboolean          retval;
+	GError           *error = NULL;
+	
+	ev_debug_message (DEBUG_JOBS, "uri: %s, document_uri: %s", job_save->uri, job_save->document_uri);
+	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+
+	target = g_file_new_for_uri (job_save->uri);
+	ctype = ev_job_save_get_compression (job_save);
 
-	ev_xfer_uri_simple (local_uri, job_save->uri, &error);
-	ev_tmp_uri_unlink (local_uri);
+	if (ctype == EV_COMPRESSION_NONE && g_file_is_native (target))
+		retval = ev_job_save_local (job_save, target, &error);
+	else
+		retval = ev_job_save_stream (job_save, target, ctype, &error);
+
+	g_object_unref (target);
 
         /* Copy the metadata from the original file */
-        if (!error)
+        if (retval)
                 ev_file_copy_metadata (job_save->document_uri, job_save->uri, &error);
 
 	if (error) {
 		ev_job_failed_from_error (job, error);
 		g_error_free (error);
+	} else if (!retval) {
+		ev_job_failed (job, G_IO_ERROR, G_IO_ERROR_FAILED,
+			       _("Failed to save document"));
 	} else {
 		ev_job_succeeded (job);
 	}
@@ -1488,87 +1838,667 @@ ev_job_save_new (EvDocument  *document,
 }
 
 /* EvJobFind */
-static void
-ev_job_find_init (EvJobFind *job)
+
+/* Maximum number of threads searching a document at the same time */
+#define EV_JOB_FIND_MAX_WORKERS 8
+
+/* Pages are searched by a pool of threads when the backend supports
+ * search contexts. Results are collected here and handed to the job
+ * in page order from the main loop. Every thread creates its own
+ * context, so that the main loop never waits for the document lock
+ * or for the backend to open the document again. If no thread gets a
+ * context, the job searches the pages from the main loop instead.
+ */
+typedef struct _EvJobFindWorkers EvJobFindWorkers;
+
+struct _EvJobFindWorkers {
+	volatile gint   ref_count;
+	GMutex          mutex;
+
+	/* Only accessed from the main thread */
+	EvJobFind      *job;
+
+	EvDocument     *document;
+	GCancellable   *cancellable;
+	gchar          *text;
+	EvFindOptions   options;
+	gint            start_page;
+	gint            n_pages;
+
+	/* Protected by mutex */
+	gint            next_page;
+	GList         **results;
+	gboolean       *done;
+	gboolean       *scan;
+	guint           flush_id;
+	gint            n_workers;
+	gint            n_failed;
+};
+
+static EvJobFindWorkers *
+ev_job_find_workers_ref (EvJobFindWorkers *workers)
 {
-	EV_JOB (job)->run_mode = EV_JOB_RUN_MAIN_LOOP;
+	g_atomic_int_inc (&workers->ref_count);
+
+	return workers;
 }
 
 static void
-ev_job_find_dispose (GObject *object)
+ev_job_find_workers_unref (EvJobFindWorkers *workers)
 {
-	EvJobFind *job = EV_JOB_FIND (object);
+	gint i;
 
-	ev_debug_message (DEBUG_JOBS, NULL);
+	if (!g_atomic_int_dec_and_test (&workers->ref_count))
+		return;
 
-	if (job->text) {
-		g_free (job->text);
-		job->text = NULL;
+	for (i = 0; i < workers->n_pages; i++) {
+		g_list_foreach (workers->results[i], (GFunc)ev_rectangle_free, NULL);
+		g_list_free (workers->results[i]);
 	}
+	g_free (workers->results);
+	g_free (workers->done);
+	g_free (workers->scan);
+	g_free (workers->text);
+	g_object_unref (workers->cancellable);
+	g_object_unref (workers->document);
+	g_mutex_clear (&workers->mutex);
+	g_slice_free (EvJobFindWorkers, workers);
+}
 
-	if (job->pages) {
-		gint i;
+static gint
+ev_job_find_get_n_workers (gint n_pages)
+{
+	glong n_cpus = 1;
 
-		for (i = 0; i < job->n_pages; i++) {
-			g_list_foreach (job->pages[i], (GFunc)ev_rectangle_free, NULL);
-			g_list_free (job->pages[i]);
-		}
+#ifdef _SC_NPROCESSORS_ONLN
+	n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
 
-		g_free (job->pages);
-		job->pages = NULL;
+	return CLAMP ((gint) MIN (n_cpus, n_pages), 1, EV_JOB_FIND_MAX_WORKERS);
+}
+
+/* Number of previous searches kept to refine new ones */
+#define EV_JOB_FIND_MAX_HISTORY 16
+
+/* Maximum number of pages with known results handled per iteration */
+#define EV_JOB_FIND_MAX_KNOWN_PAGES 64
+
+static const gchar *
+ev_job_find_get_key (EvJobFind *job)
+{
+	if (!job->key) {
+		job->key = (job->options & EV_FIND_CASE_SENSITIVE) ?
+			g_strdup (job->text) : g_utf8_casefold (job->text, -1);
 	}
-	
-	(* G_OBJECT_CLASS (ev_job_find_parent_class)->dispose) (object);
+
+	return job->key;
 }
 
 static gboolean
-ev_job_find_run (EvJob *job)
+ev_job_find_page_searched (EvJobFind *job,
+			   gint       page)
 {
-	EvJobFind      *job_find = EV_JOB_FIND (job);
-	EvDocumentFind *find = EV_DOCUMENT_FIND (job->document);
-	EvPage         *ev_page;
-	GList          *matches;
-
-	ev_debug_message (DEBUG_JOBS, NULL);
-	
-	/* Do not block the main loop */
-	if (!ev_document_doc_mutex_trylock ())
+	if (ev_job_is_finished (EV_JOB (job)))
 		return TRUE;
-	
-#ifdef EV_ENABLE_DEBUG
-	/* We use the #ifdef in this case because of the if */
-	if (job_find->current_page == job_find->start_page)
-		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
-#endif
 
-	ev_page = ev_document_get_page (job->document, job_find->current_page);
-	matches = ev_document_find_find_text_with_options (find, ev_page, job_find->text,
-                                                           job_find->options);
-	g_object_unref (ev_page);
-	
-	ev_document_doc_mutex_unlock ();
+	/* Pages are searched in order from start_page */
+	if (job->current_page >= job->start_page)
+		return page >= job->start_page && page < job->current_page;
+	return page >= job->start_page || page < job->current_page;
+}
 
-	if (!job_find->has_results)
-		job_find->has_results = (matches != NULL);
+static GList *
+ev_job_find_copy_matches (GList *matches)
+{
+	GList *retval = NULL;
+	GList *l;
 
-	job_find->pages[job_find->current_page] = matches;
-	g_signal_emit (job_find, job_find_signals[FIND_UPDATED], 0, job_find->current_page);
-		       
-	job_find->current_page = (job_find->current_page + 1) % job_find->n_pages;
-	if (job_find->current_page == job_find->start_page) {
-		ev_job_succeeded (job);
+	for (l = matches; l; l = g_list_next (l))
+		retval = g_list_prepend (retval, ev_rectangle_copy (l->data));
 
-		return FALSE;
-	}
+	return g_list_reverse (retval);
+}
 
-	return TRUE;
+static GList *
+ev_job_find_get_matches (EvJobFind *job,
+			 gint       page)
+{
+	EvRectangle *rects;
+	GList       *retval = NULL;
+	gint         i;
+
+	rects = &g_array_index (job->results, EvRectangle, job->page_offsets[page]);
+	for (i = job->n_results[page] - 1; i >= 0; i--)
+		retval = g_list_prepend (retval, ev_rectangle_copy (rects + i));
+
+	return retval;
 }
 
+/* Moves the matches of @page to the results array. The lists are
+ * only kept when ev_job_find_get_results() has been called.
+ */
 static void
-ev_job_find_class_init (EvJobFindClass *class)
+ev_job_find_store_matches (EvJobFind *job,
+			   gint       page,
+			   GList     *matches)
 {
-	EvJobClass   *job_class = EV_JOB_CLASS (class);
-	GObjectClass *gobject_class = G_OBJECT_CLASS (class);
+	GList *l;
+	gint   n = 0;
+
+	job->page_offsets[page] = job->results->len;
+	for (l = matches; l; l = g_list_next (l)) {
+		g_array_append_vals (job->results, l->data, 1);
+		n++;
+	}
+
+	job->n_results[page] = n;
+	job->n_total_results += n;
+	if (n > 0) {
+		job->has_results = TRUE;
+		job->n_valid_result_offsets = MIN (job->n_valid_result_offsets, page + 1);
+	}
+
+	if (job->pages) {
+		job->pages[page] = matches;
+	} else {
+		g_list_foreach (matches, (GFunc)ev_rectangle_free, NULL);
+		g_list_free (matches);
+	}
+}
+
+/* Returns TRUE when the matches of @page are known without searching
+ * the document: from the text index, because the same text was already
+ * searched, or because a substring of the text had no matches in the page.
+ */
+static gboolean
+ev_job_find_lookup_page (EvJobFind *job,
+			 gint       page,
+			 GList    **matches)
+{
+	EvJobFind *previous;
+
+	if (job->index_results && ev_text_index_has_page (job->text_index, page)) {
+		*matches = ev_job_find_copy_matches (job->index_results[page]);
+
+		return TRUE;
+	}
+
+	for (previous = job->previous; previous; previous = previous->previous) {
+		if (previous->options != job->options ||
+		    !ev_job_find_page_searched (previous, page))
+			continue;
+
+		if (strcmp (ev_job_find_get_key (previous), ev_job_find_get_key (job)) == 0) {
+			*matches = ev_job_find_get_matches (previous, page);
+
+			return TRUE;
+		}
+
+		/* A whole word match doesn't contain whole word
+		 * matches of its substrings
+		 */
+		if (previous->n_results[page] == 0 &&
+		    !(job->options & EV_FIND_WHOLE_WORDS_ONLY) &&
+		    strstr (ev_job_find_get_key (job), ev_job_find_get_key (previous))) {
+			*matches = NULL;
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gboolean
+ev_job_find_resume (EvJob *job)
+{
+	if (g_cancellable_is_cancelled (job->cancellable))
+		return FALSE;
+
+	return ev_job_run (job);
+}
+
+static gboolean
+ev_job_find_flush (EvJobFindWorkers *workers)
+{
+	EvJobFind *job_find = workers->job;
+	GList    **results;
+	gint       n_ready = 0;
+	gint       page, i;
+	gboolean   failed;
+
+	g_mutex_lock (&workers->mutex);
+	workers->flush_id = 0;
+
+	if (!job_find || g_cancellable_is_cancelled (workers->cancellable)) {
+		g_mutex_unlock (&workers->mutex);
+		return FALSE;
+	}
+
+	failed = workers->n_failed == workers->n_workers;
+
+	/* Take the results finished since the last flush, in page order */
+	results = g_new (GList *, workers->n_pages);
+	page = job_find->current_page;
+	while (workers->done[page]) {
+		results[n_ready++] = workers->results[page];
+		workers->results[page] = NULL;
+		workers->done[page] = FALSE;
+
+		page = (page + 1) % workers->n_pages;
+		if (page == workers->start_page)
+			break;
+	}
+	g_mutex_unlock (&workers->mutex);
+
+	g_object_ref (job_find);
+	for (i = 0; i < n_ready; i++) {
+		page = job_find->current_page;
+
+		ev_job_find_store_matches (job_find, page, results[i]);
+		job_find->current_page = (page + 1) % job_find->n_pages;
+		g_signal_emit (job_find, job_find_signals[FIND_UPDATED], 0, page);
+
+		/* The job might have been cancelled by a signal handler */
+		if (g_cancellable_is_cancelled (workers->cancellable)) {
+			for (i++; i < n_ready; i++) {
+				g_list_foreach (results[i], (GFunc)ev_rectangle_free, NULL);
+				g_list_free (results[i]);
+			}
+			break;
+		}
+
+		if (job_find->current_page == job_find->start_page) {
+			ev_job_succeeded (EV_JOB (job_find));
+			failed = FALSE;
+			break;
+		}
+	}
+
+	/* No thread could search, continue from the main loop where
+	 * the results of the threads stopped
+	 */
+	if (failed && !g_cancellable_is_cancelled (workers->cancellable)) {
+		job_find->workers = NULL;
+		workers->job = NULL;
+		ev_job_find_workers_unref (workers);
+
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 (GSourceFunc)ev_job_find_resume,
+				 g_object_ref (job_find),
+				 (GDestroyNotify)g_object_unref);
+	}
+	g_object_unref (job_find);
+	g_free (results);
+
+	return FALSE;
+}
+
+/* Must be called with the workers locked */
+static void
+ev_job_find_queue_flush (EvJobFindWorkers *workers)
+{
+	if (workers->flush_id > 0)
+		return;
+
+	workers->flush_id =
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 (GSourceFunc)ev_job_find_flush,
+				 ev_job_find_workers_ref (workers),
+				 (GDestroyNotify)ev_job_find_workers_unref);
+}
+
+static gpointer
+ev_job_find_worker_thread (EvJobFindWorkers *workers)
+{
+	EvDocumentFind *find = EV_DOCUMENT_FIND (workers->document);
+	gpointer        context;
+
+	context = ev_document_find_create_context (find);
+	if (!context) {
+		g_mutex_lock (&workers->mutex);
+		if (++workers->n_failed == workers->n_workers)
+			ev_job_find_queue_flush (workers);
+		g_mutex_unlock (&workers->mutex);
+		ev_job_find_workers_unref (workers);
+
+		return NULL;
+	}
+
+	while (!g_cancellable_is_cancelled (workers->cancellable)) {
+		GList *matches;
+		gint   page;
+
+		page = -1;
+		g_mutex_lock (&workers->mutex);
+		while (page == -1 && workers->next_page < workers->n_pages) {
+			page = (workers->start_page + workers->next_page++) % workers->n_pages;
+			if (!workers->scan[page])
+				page = -1;
+		}
+		g_mutex_unlock (&workers->mutex);
+
+		if (page == -1)
+			break;
+
+		matches = ev_document_find_find_text_in_context (find, context, page,
+								 workers->text, workers->options);
+
+		g_mutex_lock (&workers->mutex);
+		workers->results[page] = matches;
+		workers->done[page] = TRUE;
+		ev_job_find_queue_flush (workers);
+		g_mutex_unlock (&workers->mutex);
+	}
+
+	ev_document_find_free_context (find, context);
+	ev_job_find_workers_unref (workers);
+
+	return NULL;
+}
+
+static gboolean
+ev_job_find_start_workers (EvJobFind *job_find)
+{
+	EvJob            *job = EV_JOB (job_find);
+	EvJobFindWorkers *workers;
+	GList           **results;
+	gboolean         *scan;
+	gint              n_scan = 0;
+	gint              n_workers, i;
+
+	/* Pages already known from previous searches are not searched again */
+	results = g_new0 (GList *, job_find->n_pages);
+	scan = g_new0 (gboolean, job_find->n_pages);
+	for (i = 0; i < job_find->n_pages; i++) {
+		scan[i] = !ev_job_find_lookup_page (job_find, i, &results[i]);
+		if (scan[i])
+			n_scan++;
+	}
+
+	if (n_scan == 0 || !ev_document_find_has_contexts (EV_DOCUMENT_FIND (job->document))) {
+		for (i = 0; i < job_find->n_pages; i++) {
+			g_list_foreach (results[i], (GFunc)ev_rectangle_free, NULL);
+			g_list_free (results[i]);
+		}
+		g_free (results);
+		g_free (scan);
+
+		return FALSE;
+	}
+
+	workers = g_slice_new0 (EvJobFindWorkers);
+	workers->ref_count = 1;
+	g_mutex_init (&workers->mutex);
+	workers->job = job_find;
+	workers->document = g_object_ref (job->document);
+	workers->cancellable = g_object_ref (job->cancellable);
+	workers->text = g_strdup (job_find->text);
+	workers->options = job_find->options;
+	workers->start_page = job_find->start_page;
+	workers->n_pages = job_find->n_pages;
+	workers->results = results;
+	workers->scan = scan;
+	workers->done = g_new0 (gboolean, job_find->n_pages);
+	for (i = 0; i < job_find->n_pages; i++)
+		workers->done[i] = !scan[i];
+	n_workers = ev_job_find_get_n_workers (n_scan);
+	workers->n_workers = n_workers;
+	job_find->workers = workers;
+
+	if (n_scan < job_find->n_pages)
+		ev_job_find_queue_flush (workers);
+
+	for (i = 0; i < n_workers; i++) {
+		g_thread_unref (g_thread_new ("EvJobFind",
+					      (GThreadFunc)ev_job_find_worker_thread,
+					      ev_job_find_workers_ref (workers)));
+	}
+
+	return TRUE;
+}
+
+typedef struct {
+	EvJobFind     *job;
+	EvTextIndex   *text_index;
+	gchar         *text;
+	EvFindOptions  options;
+	GList        **results;
+} EvJobFindIndexSearch;
+
+static gboolean
+ev_job_find_index_searched (EvJobFindIndexSearch *search)
+{
+	EvJobFind *job_find = search->job;
+
+	if (!g_cancellable_is_cancelled (EV_JOB (job_find)->cancellable)) {
+		job_find->index_results = search->results;
+		search->results = NULL;
+		if (!job_find->index_results) {
+			ev_text_index_unref (job_find->text_index);
+			job_find->text_index = NULL;
+		}
+
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 (GSourceFunc)ev_job_find_resume,
+				 g_object_ref (job_find),
+				 (GDestroyNotify)g_object_unref);
+	}
+
+	if (search->results) {
+		gint i;
+
+		for (i = 0; i < ev_text_index_get_n_pages (search->text_index); i++) {
+			g_list_foreach (search->results[i], (GFunc)ev_rectangle_free, NULL);
+			g_list_free (search->results[i]);
+		}
+		g_free (search->results);
+	}
+	ev_text_index_unref (search->text_index);
+	g_free (search->text);
+	g_object_unref (job_find);
+	g_slice_free (EvJobFindIndexSearch, search);
+
+	return FALSE;
+}
+
+static gpointer
+ev_job_find_index_search_thread (EvJobFindIndexSearch *search)
+{
+	search->results = ev_text_index_find (search->text_index,
+					      search->text,
+					      search->options);
+
+	/* The job is released in the main thread */
+	g_idle_add ((GSourceFunc)ev_job_find_index_searched, search);
+
+	return NULL;
+}
+
+/* Searching the index scans the text of every candidate page, which
+ * can take a while on large documents, so it's done in a thread
+ */
+static void
+ev_job_find_search_index (EvJobFind *job_find)
+{
+	EvJobFindIndexSearch *search;
+
+	search = g_slice_new0 (EvJobFindIndexSearch);
+	search->job = g_object_ref (job_find);
+	search->text_index = ev_text_index_ref (job_find->text_index);
+	search->text = g_strdup (job_find->text);
+	search->options = job_find->options;
+	g_thread_unref (g_thread_new ("EvJobFindIndex",
+				      (GThreadFunc)ev_job_find_index_search_thread,
+				      search));
+}
+
+static void
+ev_job_find_init (EvJobFind *job)
+{
+	EV_JOB (job)->run_mode = EV_JOB_RUN_MAIN_LOOP;
+}
+
+static void
+ev_job_find_dispose (GObject *object)
+{
+	EvJobFind *job = EV_JOB_FIND (object);
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	if (job->workers) {
+		/* Running threads exit after the current page */
+		g_cancellable_cancel (EV_JOB (job)->cancellable);
+		job->workers->job = NULL;
+		ev_job_find_workers_unref (job->workers);
+		job->workers = NULL;
+	}
+
+	if (job->previous) {
+		g_object_unref (job->previous);
+		job->previous = NULL;
+	}
+
+	if (job->text) {
+		g_free (job->text);
+		job->text = NULL;
+	}
+
+	if (job->key) {
+		g_free (job->key);
+		job->key = NULL;
+	}
+
+	if (job->index_results) {
+		gint i;
+
+		for (i = 0; i < job->n_pages; i++) {
+			g_list_foreach (job->index_results[i], (GFunc)ev_rectangle_free, NULL);
+			g_list_free (job->index_results[i]);
+		}
+
+		g_free (job->index_results);
+		job->index_results = NULL;
+	}
+
+	if (job->text_index) {
+		ev_text_index_unref (job->text_index);
+		job->text_index = NULL;
+	}
+
+	if (job->pages) {
+		gint i;
+
+		for (i = 0; i < job->n_pages; i++) {
+			g_list_foreach (job->pages[i], (GFunc)ev_rectangle_free, NULL);
+			g_list_free (job->pages[i]);
+		}
+
+		g_free (job->pages);
+		job->pages = NULL;
+	}
+
+	if (job->results) {
+		g_array_free (job->results, TRUE);
+		job->results = NULL;
+	}
+
+	g_free (job->page_offsets);
+	job->page_offsets = NULL;
+	g_free (job->n_results);
+	job->n_results = NULL;
+	g_free (job->result_offsets);
+	job->result_offsets = NULL;
+	
+	(* G_OBJECT_CLASS (ev_job_find_parent_class)->dispose) (object);
+}
+
+/* Returns FALSE when the job is done */
+static gboolean
+ev_job_find_page_done (EvJobFind *job_find,
+		       GList     *matches)
+{
+	EvJob *job = EV_JOB (job_find);
+
+	ev_job_find_store_matches (job_find, job_find->current_page, matches);
+	g_signal_emit (job_find, job_find_signals[FIND_UPDATED], 0, job_find->current_page);
+		       
+	job_find->current_page = (job_find->current_page + 1) % job_find->n_pages;
+	if (job_find->current_page == job_find->start_page) {
+		ev_job_succeeded (job);
+
+		return FALSE;
+	}
+
+	return !g_cancellable_is_cancelled (job->cancellable);
+}
+
+static gboolean
+ev_job_find_run (EvJob *job)
+{
+	EvJobFind      *job_find = EV_JOB_FIND (job);
+	EvDocumentFind *find = EV_DOCUMENT_FIND (job->document);
+	EvPage         *ev_page;
+	GList          *matches;
+	gint            i;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	if (!job_find->workers_tried) {
+		/* The job is resumed when the index has been searched */
+		if (job_find->text_index && !job_find->index_results) {
+			ev_job_find_search_index (job_find);
+			return FALSE;
+		}
+
+		job_find->workers_tried = TRUE;
+
+		/* Search in worker threads when possible, the results
+		 * are handed to the job from the main loop as they arrive
+		 */
+		if (ev_job_find_start_workers (job_find)) {
+			ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+			return FALSE;
+		}
+	}
+
+	/* Pages with known matches don't need the document */
+	for (i = 0; i < EV_JOB_FIND_MAX_KNOWN_PAGES; i++) {
+		if (!ev_job_find_lookup_page (job_find, job_find->current_page, &matches))
+			break;
+
+		if (!ev_job_find_page_done (job_find, matches))
+			return FALSE;
+	}
+
+	if (i > 0)
+		return TRUE;
+
+	/* Do not block the main loop */
+	if (!ev_document_doc_mutex_trylock ())
+		return TRUE;
+
+#ifdef EV_ENABLE_DEBUG
+	/* We use the #ifdef in this case because of the if */
+	if (job_find->current_page == job_find->start_page)
+		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+#endif
+
+	ev_page = ev_document_get_page (job->document, job_find->current_page);
+	matches = ev_document_find_find_text_with_options (find, ev_page, job_find->text,
+							   job_find->options);
+	g_object_unref (ev_page);
+
+	ev_document_doc_mutex_unlock ();
+
+	return ev_job_find_page_done (job_find, matches);
+}
+
+static void
+ev_job_find_class_init (EvJobFindClass *class)
+{
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
+	GObjectClass *gobject_class = G_OBJECT_CLASS (class);
 	
 	job_class->run = ev_job_find_run;
 	gobject_class->dispose = ev_job_find_dispose;
@@ -1601,7 +2531,11 @@ ev_job_find_new (EvDocument  *document,
 	job->start_page = start_page;
 	job->current_page = start_page;
 	job->n_pages = n_pages;
-	job->pages = g_new0 (GList *, n_pages);
+	job->results = g_array_new (FALSE, FALSE, sizeof (EvRectangle));
+	job->page_offsets = g_new0 (gint, n_pages);
+	job->n_results = g_new0 (gint, n_pages);
+	job->result_offsets = g_new0 (gint, n_pages + 1);
+	job->n_valid_result_offsets = 1;
 	job->text = g_strdup (text);
         /* Keep for compatibility */
 	job->case_sensitive = case_sensitive;
@@ -1619,6 +2553,81 @@ ev_job_find_set_options (EvJobFind     *job,
         job->options = options;
         /* Keep compatibility */
         job->case_sensitive = options & EV_FIND_CASE_SENSITIVE;
+
+	g_free (job->key);
+	job->key = NULL;
+}
+
+/**
+ * ev_job_find_set_text_index:
+ * @job: an #EvJobFind
+ * @text_index: (allow-none): the #EvTextIndex of the document
+ *
+ * Makes @job answer from @text_index for all the pages it contains,
+ * instead of searching the document. This must be called before the job
+ * is scheduled.
+ *
+ * Since: 3.6
+ */
+void
+ev_job_find_set_text_index (EvJobFind   *job,
+			    EvTextIndex *text_index)
+{
+	g_return_if_fail (EV_IS_JOB_FIND (job));
+
+	if (text_index && ev_text_index_get_n_pages (text_index) != job->n_pages)
+		text_index = NULL;
+
+	if (text_index)
+		ev_text_index_ref (text_index);
+	if (job->text_index)
+		ev_text_index_unref (job->text_index);
+	job->text_index = text_index;
+}
+
+/**
+ * ev_job_find_set_previous:
+ * @job: an #EvJobFind
+ * @previous: (allow-none): a previous #EvJobFind on the same document
+ *
+ * Seeds @job with the results of @previous, which might be finished or
+ * cancelled. Pages that had no matches for a substring of the text of
+ * @job, and pages already searched for the same text, are not searched
+ * again. This makes refining a search while typing much cheaper.
+ *
+ * This must be called before the job is scheduled.
+ *
+ * Since: 3.6
+ */
+void
+ev_job_find_set_previous (EvJobFind *job,
+			  EvJobFind *previous)
+{
+	EvJobFind *last;
+	gint       i;
+
+	g_return_if_fail (EV_IS_JOB_FIND (job));
+	g_return_if_fail (previous == NULL || EV_IS_JOB_FIND (previous));
+
+	if (job->previous)
+		g_object_unref (job->previous);
+	job->previous = NULL;
+
+	if (!previous ||
+	    EV_JOB (previous)->document != EV_JOB (job)->document ||
+	    previous->n_pages != job->n_pages)
+		return;
+
+	job->previous = g_object_ref (previous);
+
+	/* Limit the history */
+	last = job->previous;
+	for (i = 1; last && i < EV_JOB_FIND_MAX_HISTORY; i++)
+		last = last->previous;
+	if (last && last->previous) {
+		g_object_unref (last->previous);
+		last->previous = NULL;
+	}
 }
 
 EvFindOptions
@@ -1631,7 +2640,129 @@ gint
 ev_job_find_get_n_results (EvJobFind *job,
 			   gint       page)
 {
-	return g_list_length (job->pages[page]);
+	return job->n_results[page];
+}
+
+/**
+ * ev_job_find_get_n_total_results:
+ * @job: an #EvJobFind
+ *
+ * Returns: the number of matches found so far in all the pages
+ *
+ * Since: 3.6
+ */
+gint
+ev_job_find_get_n_total_results (EvJobFind *job)
+{
+	g_return_val_if_fail (EV_IS_JOB_FIND (job), 0);
+
+	return job->n_total_results;
+}
+
+/**
+ * ev_job_find_get_result:
+ * @job: an #EvJobFind
+ * @page: a page index
+ * @result: the index of the match in @page
+ *
+ * The returned rectangle is owned by @job, and is only valid until the
+ * next #EvJobFind::updated signal.
+ *
+ * Returns: (transfer none): the area of the @result match in @page
+ *
+ * Since: 3.6
+ */
+EvRectangle *
+ev_job_find_get_result (EvJobFind *job,
+			gint       page,
+			gint       result)
+{
+	g_return_val_if_fail (EV_IS_JOB_FIND (job), NULL);
+	g_return_val_if_fail (page >= 0 && page < job->n_pages, NULL);
+	g_return_val_if_fail (result >= 0 && result < job->n_results[page], NULL);
+
+	return &g_array_index (job->results, EvRectangle, job->page_offsets[page] + result);
+}
+
+static void
+ev_job_find_update_result_offsets (EvJobFind *job,
+				   gint       page)
+{
+	gint i;
+
+	for (i = job->n_valid_result_offsets; i <= page; i++)
+		job->result_offsets[i] = job->result_offsets[i - 1] + job->n_results[i - 1];
+	job->n_valid_result_offsets = MAX (job->n_valid_result_offsets, page + 1);
+}
+
+/**
+ * ev_job_find_get_result_offset:
+ * @job: an #EvJobFind
+ * @page: a page index
+ *
+ * Returns: the number of matches found in the pages before @page, which
+ *     is the index of the first match of @page in the whole document
+ *
+ * Since: 3.6
+ */
+gint
+ev_job_find_get_result_offset (EvJobFind *job,
+			       gint       page)
+{
+	g_return_val_if_fail (EV_IS_JOB_FIND (job), 0);
+	g_return_val_if_fail (page >= 0 && page <= job->n_pages, 0);
+
+	ev_job_find_update_result_offsets (job, page);
+
+	return job->result_offsets[page];
+}
+
+/**
+ * ev_job_find_get_nth_result:
+ * @job: an #EvJobFind
+ * @n: the index of a match in the whole document
+ * @page: (out): return location for the page of the match
+ * @result: (out): return location for the index of the match in @page
+ *
+ * Returns: %TRUE if there's a @n match in the pages searched so far
+ *
+ * Since: 3.6
+ */
+gboolean
+ev_job_find_get_nth_result (EvJobFind *job,
+			    gint       n,
+			    gint      *page,
+			    gint      *result)
+{
+	gint low, high;
+
+	g_return_val_if_fail (EV_IS_JOB_FIND (job), FALSE);
+
+	if (n < 0 || n >= job->n_total_results)
+		return FALSE;
+
+	ev_job_find_update_result_offsets (job, job->n_pages);
+
+	/* Pages without matches have the offset of the next page,
+	 * so the last page with offset <= @n contains the match
+	 */
+	low = 0;
+	high = job->n_pages - 1;
+	while (low < high) {
+		gint mid = (low + high + 1) / 2;
+
+		if (job->result_offsets[mid] <= n)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	if (page)
+		*page = low;
+	if (result)
+		*result = n - job->result_offsets[low];
+
+	return TRUE;
 }
 
 gdouble
@@ -1659,12 +2790,165 @@ ev_job_find_has_results (EvJobFind *job)
 	return job->has_results;
 }
 
+/**
+ * ev_job_find_get_results: (skip)
+ * @job: an #EvJobFind
+ *
+ * Returns the matches as a list of #EvRectangle per page. The lists are
+ * built the first time this is called and then kept up to date, which
+ * takes much more memory than the results array, so use
+ * ev_job_find_get_result() instead.
+ *
+ * Returns: an array of lists of #EvRectangle owned by @job
+ */
 GList **
 ev_job_find_get_results (EvJobFind *job)
 {
+	if (!job->pages) {
+		gint i;
+
+		job->pages = g_new0 (GList *, job->n_pages);
+		for (i = 0; i < job->n_pages; i++) {
+			if (job->n_results[i] > 0)
+				job->pages[i] = ev_job_find_get_matches (job, i);
+		}
+	}
+
 	return job->pages;
 }
 
+/* EvJobIndex */
+static void
+ev_job_index_init (EvJobIndex *job)
+{
+	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
+}
+
+static void
+ev_job_index_dispose (GObject *object)
+{
+	EvJobIndex *job;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	job = EV_JOB_INDEX (object);
+
+	if (job->builder) {
+		ev_text_index_builder_free (job->builder);
+		job->builder = NULL;
+	}
+
+	if (job->text_index) {
+		ev_text_index_unref (job->text_index);
+		job->text_index = NULL;
+	}
+
+	if (job->uri) {
+		g_free (job->uri);
+		job->uri = NULL;
+	}
+
+	(* G_OBJECT_CLASS (ev_job_index_parent_class)->dispose) (object);
+}
+
+static gboolean
+ev_job_index_run (EvJob *job)
+{
+	EvJobIndex *job_index = EV_JOB_INDEX (job);
+	GError     *error = NULL;
+
+	if (!job_index->builder) {
+		ev_debug_message (DEBUG_JOBS, NULL);
+		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+
+		job_index->text_index = ev_text_index_load (job->document, job_index->uri, &error);
+		if (job_index->text_index) {
+			ev_job_succeeded (job);
+			return FALSE;
+		}
+
+		/* Invalid indexes are removed when loaded, so they're built again */
+		if (job_index->build &&
+		    (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) ||
+		     g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA))) {
+			g_clear_error (&error);
+			job_index->builder = ev_text_index_builder_new (job->document,
+									job_index->uri,
+									&error);
+		}
+
+		if (!job_index->builder) {
+			ev_job_failed_from_error (job, error);
+			g_error_free (error);
+			return FALSE;
+		}
+
+		return TRUE;
+	}
+
+	/* A page at a time, so that the scheduler runs more urgent
+	 * jobs, like the renders of visible pages, in between
+	 */
+	if (ev_text_index_builder_add_page (job_index->builder))
+		return TRUE;
+
+	if (ev_text_index_builder_save (job_index->builder, &error))
+		job_index->text_index = ev_text_index_load (job->document, job_index->uri, &error);
+	ev_text_index_builder_free (job_index->builder);
+	job_index->builder = NULL;
+
+	if (job_index->text_index) {
+		ev_job_succeeded (job);
+	} else {
+		ev_job_failed_from_error (job, error);
+		g_error_free (error);
+	}
+
+	return FALSE;
+}
+
+static void
+ev_job_index_class_init (EvJobIndexClass *class)
+{
+	GObjectClass *oclass = G_OBJECT_CLASS (class);
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
+
+	oclass->dispose = ev_job_index_dispose;
+	job_class->run = ev_job_index_run;
+}
+
+/**
+ * ev_job_index_new:
+ * @document: an #EvDocument implementing #EvDocumentText
+ * @uri: (allow-none): the URI @document was opened from, or %NULL to
+ *   use the URI of @document
+ * @build: whether to build the index when there isn't any yet
+ *
+ * Creates a job loading the #EvTextIndex of @document from the user
+ * cache dir, and building it first if @build is %TRUE. When the job
+ * succeeds the index is available in the text_index field.
+ *
+ * Returns: (transfer full): a new #EvJobIndex
+ *
+ * Since: 3.6
+ */
+EvJob *
+ev_job_index_new (EvDocument  *document,
+		  const gchar *uri,
+		  gboolean     build)
+{
+	EvJobIndex *job;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	job = g_object_new (EV_TYPE_JOB_INDEX, NULL);
+	EV_JOB (job)->document = g_object_ref (document);
+	job->uri = g_strdup (uri);
+	job->build = build;
+
+	return EV_JOB (job);
+}
+
 /* EvJobLayers */
 static void
 ev_job_layers_init (EvJobLayers *job)
@@ -75,6 +75,9 @@ typedef struct _EvJobFindClass EvJobFindClass;
 typedef struct _EvJobLayers EvJobLayers;
 typedef struct _EvJobLayersClass EvJobLayersClass;
 
+typedef struct _EvJobIndex EvJobIndex;
+typedef struct _EvJobIndexClass EvJobIndexClass;
+
 typedef struct _EvJobExport EvJobExport;
 typedef struct _EvJobExportClass EvJobExportClass;
 
@@ -147,6 +150,11 @@ typedef struct _EvJobPrintClass EvJobPrintClass;
 #define EV_JOB_FIND_CLASS(klass)             (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_FIND, EvJobFindClass))
 #define EV_IS_JOB_FIND(object)               (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_FIND))
 
+#define EV_TYPE_JOB_INDEX                    (ev_job_index_get_type())
+#define EV_JOB_INDEX(object)                 (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB_INDEX, EvJobIndex))
+#define EV_JOB_INDEX_CLASS(klass)            (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_INDEX, EvJobIndexClass))
+#define EV_IS_JOB_INDEX(object)              (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_INDEX))
+
 #define EV_TYPE_JOB_LAYERS                   (ev_job_layers_get_type())
 #define EV_JOB_LAYERS(object)                (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB_LAYERS, EvJobLayers))
 #define EV_JOB_LAYERS_CLASS(klass)           (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_LAYERS, EvJobLayersClass))
@@ -202,6 +210,10 @@ struct _EvJobLinks
 	EvJob parent;
 
 	GtkTreeModel *model;
+
+	/* Next link to get the page label for */
+	GtkTreeIter label_iter;
+	gboolean label_iter_valid;
 };
 
 struct _EvJobLinksClass
@@ -226,11 +238,16 @@ struct _EvJobAnnots
 	EvJob parent;
 
 	GList *annots;
+	gint current_page;
 };
 
 struct _EvJobAnnotsClass
 {
 	EvJobClass parent_class;
+
+	/* Signals */
+	void (* updated)  (EvJobAnnots   *job,
+			   EvMappingList *annots);
 };
 
 struct _EvJobRender
@@ -245,6 +262,7 @@ struct _EvJobRender
 	gint target_width;
 	gint target_height;
 	cairo_surface_t *surface;
+	gboolean reload;
 
 	gboolean include_selection;
 	cairo_surface_t *selection;
@@ -303,6 +321,7 @@ struct _EvJobThumbnail
 	gdouble scale;
 	
 	GdkPixbuf *thumbnail;
+	struct _EvThumbnailsCache *cache;
 };
 
 struct _EvJobThumbnailClass
@@ -391,6 +410,22 @@ struct _EvJobFind
 	gboolean case_sensitive;
 	gboolean has_results;
         EvFindOptions options;
+
+	/* Matches of all pages in a single array */
+	GArray *results;
+	gint *page_offsets;
+	gint *n_results;
+	gint n_total_results;
+	/* Number of matches in the pages before every page */
+	gint *result_offsets;
+	gint n_valid_result_offsets;
+
+	gboolean workers_tried;
+	struct _EvJobFindWorkers *workers;
+	EvJobFind *previous;
+	gchar *key;
+	EvTextIndex *text_index;
+	GList **index_results;
 };
 
 struct _EvJobFindClass
@@ -402,6 +437,21 @@ struct _EvJobFindClass
 			   gint       page);
 };
 
+struct _EvJobIndex
+{
+	EvJob parent;
+
+	gchar *uri;
+	gboolean build;
+	EvTextIndexBuilder *builder;
+	EvTextIndex *text_index;
+};
+
+struct _EvJobIndexClass
+{
+	EvJobClass parent_class;
+};
+
 struct _EvJobLayers
 {
 	EvJob parent;
@@ -544,12 +594,32 @@ EvJob          *ev_job_find_new           (EvDocument      *document,
 void            ev_job_find_set_options   (EvJobFind       *job,
                                            EvFindOptions    options);
 EvFindOptions   ev_job_find_get_options   (EvJobFind       *job);
+void            ev_job_find_set_previous  (EvJobFind       *job,
+					   EvJobFind       *previous);
+void            ev_job_find_set_text_index (EvJobFind      *job,
+					    EvTextIndex    *text_index);
 gint            ev_job_find_get_n_results (EvJobFind       *job,
 					   gint             pages);
+gint            ev_job_find_get_n_total_results (EvJobFind *job);
+EvRectangle    *ev_job_find_get_result    (EvJobFind       *job,
+					   gint             page,
+					   gint             result);
+gint            ev_job_find_get_result_offset (EvJobFind   *job,
+					       gint         page);
+gboolean        ev_job_find_get_nth_result (EvJobFind      *job,
+					    gint            n,
+					    gint           *page,
+					    gint           *result);
 gdouble         ev_job_find_get_progress  (EvJobFind       *job);
 gboolean        ev_job_find_has_results   (EvJobFind       *job);
 GList         **ev_job_find_get_results   (EvJobFind       *job);
 
+/* EvJobIndex */
+GType           ev_job_index_get_type     (void) G_GNUC_CONST;
+EvJob          *ev_job_index_new          (EvDocument     *document,
+					   const gchar    *uri,
+					   gboolean        build);
+
 /* EvJobLayers */
 GType           ev_job_layers_get_type    (void) G_GNUC_CONST;
 EvJob          *ev_job_layers_new         (EvDocument     *document);
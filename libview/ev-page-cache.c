@@ -19,6 +19,7 @@
 
 #include <config.h>
 
+#include <string.h>
 #include <glib.h>
 #include "ev-jobs.h"
 #include "ev-job-scheduler.h"
@@ -45,6 +46,10 @@ typedef struct _EvPageCacheData {
 	EvRectangle       *text_layout;
 	guint              text_layout_length;
 	gchar             *text;
+
+	/* LRU */
+	gsize              size;
+	GList             *lru_link;
 } EvPageCacheData;
 
 struct _EvPageCache {
@@ -59,6 +64,10 @@ struct _EvPageCache {
 	gint               end_page;
 
 	EvJobPageDataFlags flags;
+
+	/* Fetched pages, most recently used first */
+	GQueue             lru;
+	gsize              size;
 };
 
 struct _EvPageCacheClass {
@@ -72,6 +81,9 @@ struct _EvPageCacheClass {
 	EV_PAGE_DATA_INCLUDE_FORMS        | \
 	EV_PAGE_DATA_INCLUDE_ANNOTS)
 
+/* Memory budget for the data of the pages outside of the current range */
+#define EV_PAGE_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
 
 static void job_page_data_finished_cb (EvJob       *job,
 				       EvPageCache *cache);
@@ -123,6 +135,65 @@ ev_page_cache_data_free (EvPageCacheData *data)
 		g_free (data->text);
 		data->text = NULL;
 	}
+
+	data->size = 0;
+}
+
+static gsize
+ev_page_cache_mapping_list_size (EvMappingList *mapping_list)
+{
+	if (!mapping_list)
+		return 0;
+
+	/* Mapping data (links, images, etc.) is not accounted */
+	return g_list_length (ev_mapping_list_get_list (mapping_list)) *
+		(sizeof (EvMapping) + sizeof (GList));
+}
+
+static gsize
+ev_page_cache_data_get_size (EvPageCacheData *data)
+{
+	gsize size = sizeof (EvPageCacheData);
+
+	size += ev_page_cache_mapping_list_size (data->link_mapping);
+	size += ev_page_cache_mapping_list_size (data->image_mapping);
+	size += ev_page_cache_mapping_list_size (data->form_field_mapping);
+	size += ev_page_cache_mapping_list_size (data->annot_mapping);
+	if (data->text_mapping)
+		size += cairo_region_num_rectangles (data->text_mapping) * sizeof (cairo_rectangle_int_t);
+	size += data->text_layout_length * sizeof (EvRectangle);
+	if (data->text)
+		size += strlen (data->text) + 1;
+
+	return size;
+}
+
+static void
+ev_page_cache_evict (EvPageCache *cache)
+{
+	GList *l = cache->lru.tail;
+
+	while (l && cache->size > EV_PAGE_CACHE_MAX_SIZE) {
+		gint             page = GPOINTER_TO_INT (l->data);
+		EvPageCacheData *data = &cache->page_list[page];
+		GList           *prev = l->prev;
+
+		/* Never evict the pages in the current range, they are in
+		 * use by the view and would be immediately fetched again
+		 */
+		if ((page < cache->start_page || page > cache->end_page) && !data->job) {
+			g_queue_delete_link (&cache->lru, l);
+			data->lru_link = NULL;
+			cache->size -= data->size;
+
+			ev_page_cache_data_free (data);
+			data->done = FALSE;
+			data->dirty = FALSE;
+			data->flags = EV_PAGE_DATA_INCLUDE_NONE;
+		}
+
+		l = prev;
+	}
 }
 
 static void
@@ -148,6 +219,7 @@ ev_page_cache_finalize (GObject *object)
 			ev_page_cache_data_free (data);
 		}
 
+		g_queue_clear (&cache->lru);
 		g_free (cache->page_list);
 		cache->page_list = NULL;
 		cache->n_pages = 0;
@@ -275,6 +347,20 @@ job_page_data_finished_cb (EvJob       *job,
 
 	g_object_unref (data->job);
 	data->job = NULL;
+
+	cache->size -= data->size;
+	data->size = ev_page_cache_data_get_size (data);
+	cache->size += data->size;
+
+	if (data->lru_link) {
+		g_queue_unlink (&cache->lru, data->lru_link);
+		g_queue_push_head_link (&cache->lru, data->lru_link);
+	} else {
+		g_queue_push_head (&cache->lru, GINT_TO_POINTER (job_data->page));
+		data->lru_link = cache->lru.head;
+	}
+
+	ev_page_cache_evict (cache);
 }
 
 static void
@@ -302,6 +388,12 @@ ev_page_cache_set_page_range (EvPageCache *cache,
 		EvPageCacheData   *data = &cache->page_list[i];
 		EvJobPageDataFlags flags;
 
+		/* Mark visited pages as most recently used */
+		if (data->lru_link) {
+			g_queue_unlink (&cache->lru, data->lru_link);
+			g_queue_push_head_link (&cache->lru, data->lru_link);
+		}
+
 		if (data->flags == cache->flags && !data->dirty && (data->done || data->job))
 			continue;
 
@@ -341,6 +433,14 @@ ev_page_cache_set_flags (EvPageCache       *cache,
 	ev_page_cache_set_page_range (cache, cache->start_page, cache->end_page);
 }
 
+gsize
+ev_page_cache_get_size (EvPageCache *cache)
+{
+	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), 0);
+
+	return cache->size;
+}
+
 void
 ev_page_cache_mark_dirty (EvPageCache *cache,
 			  gint         page)
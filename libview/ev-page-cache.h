@@ -47,6 +47,7 @@ void               ev_page_cache_set_page_range         (EvPageCache       *cach
 EvJobPageDataFlags ev_page_cache_get_flags              (EvPageCache       *cache);
 void               ev_page_cache_set_flags              (EvPageCache       *cache,
 							 EvJobPageDataFlags flags);
+gsize              ev_page_cache_get_size               (EvPageCache       *cache);
 void               ev_page_cache_mark_dirty             (EvPageCache       *cache,
 							 gint               page);
 EvMappingList     *ev_page_cache_get_link_mapping       (EvPageCache       *cache,
@@ -1,6 +1,10 @@
 #include <config.h>
+#include <math.h>
+
 #include "ev-pixbuf-cache.h"
 #include "ev-job-scheduler.h"
+#include "ev-render-registry.h"
+#include "ev-surface-pool.h"
 #include "ev-view-private.h"
 
 typedef struct _CacheJobInfo
@@ -13,6 +17,11 @@ typedef struct _CacheJobInfo
 
 	/* Data we get from rendering */
 	cairo_surface_t *surface;
+	/* Colors are inverted when the surface is drawn */
+	gboolean         surface_inverted;
+	/* Surface rotated from one rendered with another rotation,
+	 * shown until the page is rendered with its own layout */
+	gboolean         surface_rotated;
 
 	/* Selection data. 
 	 * Selection_points are the coordinates encapsulated in selection.
@@ -37,6 +46,8 @@ struct _EvPixbufCache
 	int start_page;
 	int end_page;
 	gboolean inverted_colors;
+	/* Rotation of the surfaces we hold */
+	gint rotation;
 
 	gsize max_size;
 
@@ -169,6 +180,7 @@ dispose_cache_job_info (CacheJobInfo *job_info,
 		cairo_surface_destroy (job_info->surface);
 		job_info->surface = NULL;
 	}
+	job_info->surface_rotated = FALSE;
 	if (job_info->region) {
 		cairo_region_destroy (job_info->region);
 		job_info->region = NULL;
@@ -202,6 +214,9 @@ ev_pixbuf_cache_dispose (GObject *object)
 		dispose_cache_job_info (pixbuf_cache->job_list + i, pixbuf_cache);
 	}
 
+	/* Pages of other sizes are likely to come next */
+	ev_surface_pool_trim ();
+
 	G_OBJECT_CLASS (ev_pixbuf_cache_parent_class)->dispose (object);
 }
 
@@ -218,6 +233,7 @@ ev_pixbuf_cache_new (GtkWidget       *view,
 	pixbuf_cache->view = view;
 	pixbuf_cache->model = g_object_ref (model);
 	pixbuf_cache->document = ev_document_model_get_document (model);
+	pixbuf_cache->rotation = ev_document_model_get_rotation (model);
 	pixbuf_cache->max_size = max_size;
 
 	return pixbuf_cache;
@@ -230,8 +246,10 @@ ev_pixbuf_cache_set_max_size (EvPixbufCache *pixbuf_cache,
 	if (pixbuf_cache->max_size == max_size)
 		return;
 
-	if (pixbuf_cache->max_size > max_size)
+	if (pixbuf_cache->max_size > max_size) {
 		ev_pixbuf_cache_clear (pixbuf_cache);
+		ev_surface_pool_trim ();
+	}
 	pixbuf_cache->max_size = max_size;
 }
 
@@ -244,9 +262,8 @@ copy_job_to_job_info (EvJobRender   *job_render,
 		cairo_surface_destroy (job_info->surface);
 	}
 	job_info->surface = cairo_surface_reference (job_render->surface);
-	if (pixbuf_cache->inverted_colors) {
-		ev_document_misc_invert_surface (job_info->surface);
-	}
+	job_info->surface_inverted = FALSE;
+	job_info->surface_rotated = FALSE;
 
 	job_info->points_set = FALSE;
 	if (job_render->include_selection) {
@@ -330,8 +347,22 @@ check_job_size_and_unref (EvPixbufCache *pixbuf_cache,
 	job_info->job = NULL;
 }
 
+/* Number of pages between @page and the visible range */
+static guint
+get_page_distance (int page,
+		   int start_page,
+		   int end_page)
+{
+	if (page < start_page)
+		return start_page - page;
+	if (page > end_page)
+		return page - end_page;
+	return 0;
+}
+
 /* Do all function that copies a job from an older cache to it's position in the
  * new cache.  It clears the old job if it doesn't have a place.
+ * The new scheduling of the job is added to @updates.
  */
 static void
 move_one_job (CacheJobInfo  *job_info,
@@ -343,7 +374,7 @@ move_one_job (CacheJobInfo  *job_info,
 	      int            new_preload_cache_size,
 	      int            start_page,
 	      int            end_page,
-	      gint           priority)
+	      GArray        *updates)
 {
 	CacheJobInfo *target_page = NULL;
 	int page_offset;
@@ -383,8 +414,13 @@ move_one_job (CacheJobInfo  *job_info,
 	job_info->region = NULL;
 	job_info->surface = NULL;
 
-	if (new_priority != priority && target_page->job) {
-		ev_job_scheduler_update_job (target_page->job, new_priority);
+	if (target_page->job) {
+		EvJobSchedulerUpdate update;
+
+		update.job = target_page->job;
+		update.priority = new_priority;
+		update.distance = get_page_distance (page, start_page, end_page);
+		g_array_append_val (updates, update);
 	}
 }
 
@@ -469,6 +505,7 @@ ev_pixbuf_cache_update_range (EvPixbufCache *pixbuf_cache,
 	CacheJobInfo *new_next_job = NULL;
 	gint          new_preload_cache_size;
 	guint         new_job_list_len;
+	GArray       *updates;
 	int           i, page;
 
 	new_preload_cache_size = ev_pixbuf_cache_get_preload_size (pixbuf_cache,
@@ -489,7 +526,8 @@ ev_pixbuf_cache_update_range (EvPixbufCache *pixbuf_cache,
 	}
 
 	/* We go through each job in the old cache and either clear it or move
-	 * it to a new location. */
+	 * it to a new location. The scheduler is updated once for all of them. */
+	updates = g_array_new (FALSE, FALSE, sizeof (EvJobSchedulerUpdate));
 
 	/* Start with the prev cache. */
 	page = pixbuf_cache->start_page - pixbuf_cache->preload_cache_size;
@@ -501,7 +539,7 @@ ev_pixbuf_cache_update_range (EvPixbufCache *pixbuf_cache,
 				      pixbuf_cache, page,
 				      new_job_list, new_prev_job, new_next_job,
 				      new_preload_cache_size,
-				      start_page, end_page, EV_JOB_PRIORITY_LOW);
+				      start_page, end_page, updates);
 		}
 		page ++;
 	}
@@ -512,7 +550,7 @@ ev_pixbuf_cache_update_range (EvPixbufCache *pixbuf_cache,
 			      pixbuf_cache, page,
 			      new_job_list, new_prev_job, new_next_job,
 			      new_preload_cache_size,
-			      start_page, end_page, EV_JOB_PRIORITY_URGENT);
+			      start_page, end_page, updates);
 		page ++;
 	}
 
@@ -524,7 +562,7 @@ ev_pixbuf_cache_update_range (EvPixbufCache *pixbuf_cache,
 				      pixbuf_cache, page,
 				      new_job_list, new_prev_job, new_next_job,
 				      new_preload_cache_size,
-				      start_page, end_page, EV_JOB_PRIORITY_LOW);
+				      start_page, end_page, updates);
 		}
 		page ++;
 	}
@@ -551,6 +589,9 @@ ev_pixbuf_cache_update_range (EvPixbufCache *pixbuf_cache,
 
 	pixbuf_cache->start_page = start_page;
 	pixbuf_cache->end_page = end_page;
+
+	ev_job_scheduler_update_jobs ((EvJobSchedulerUpdate *) updates->data, updates->len);
+	g_array_free (updates, TRUE);
 }
 
 static CacheJobInfo *
@@ -632,7 +673,8 @@ add_job (EvPixbufCache  *pixbuf_cache,
 	 gint            page,
 	 gint            rotation,
 	 gfloat          scale,
-	 EvJobPriority   priority)
+	 EvJobPriority   priority,
+	 gboolean        reload)
 {
 	job_info->page_ready = FALSE;
 
@@ -643,6 +685,7 @@ add_job (EvPixbufCache  *pixbuf_cache,
 	job_info->job = ev_job_render_new (pixbuf_cache->document,
 					   page, rotation, scale,
 					   width, height);
+	EV_JOB_RENDER (job_info->job)->reload = reload;
 
 	if (new_selection_surface_needed (pixbuf_cache, job_info, page, scale)) {
 		GdkColor text, base;
@@ -657,7 +700,10 @@ add_job (EvPixbufCache  *pixbuf_cache,
 	g_signal_connect (job_info->job, "finished",
 			  G_CALLBACK (job_finished_cb),
 			  pixbuf_cache);
-	ev_job_scheduler_push_job (job_info->job, priority);
+	ev_job_scheduler_push_job_full (job_info->job, priority,
+					get_page_distance (page,
+							   pixbuf_cache->start_page,
+							   pixbuf_cache->end_page));
 }
 
 static void
@@ -679,8 +725,14 @@ add_job_if_needed (EvPixbufCache *pixbuf_cache,
 
 	if (job_info->surface &&
 	    cairo_image_surface_get_width (job_info->surface) == width &&
-	    cairo_image_surface_get_height (job_info->surface) == height)
+	    cairo_image_surface_get_height (job_info->surface) == height) {
+		/* Keep showing the rotated surface while the page is rendered */
+		if (job_info->surface_rotated)
+			add_job (pixbuf_cache, job_info, NULL,
+				 width, height, page, rotation, scale,
+				 EV_JOB_PRIORITY_LOW, FALSE);
 		return;
+	}
 
 	/* Free old surfaces for non visible pages */
 	if (priority == EV_JOB_PRIORITY_LOW) {
@@ -697,7 +749,7 @@ add_job_if_needed (EvPixbufCache *pixbuf_cache,
 
 	add_job (pixbuf_cache, job_info, NULL,
 		 width, height, page, rotation, scale,
-		 priority);
+		 priority, FALSE);
 }
 
 static void
@@ -769,36 +821,29 @@ ev_pixbuf_cache_set_page_range (EvPixbufCache  *pixbuf_cache,
 	ev_pixbuf_cache_add_jobs_if_needed (pixbuf_cache, rotation, scale);
 }
 
+/* Surfaces are inverted when they are going to be drawn, so that
+ * toggling the inverted colors only costs inverting the visible pages.
+ * Rendered surfaces might be shared with other views.
+ */
+static cairo_surface_t *
+get_job_info_surface (EvPixbufCache *pixbuf_cache,
+		      CacheJobInfo  *job_info)
+{
+	if (job_info->surface &&
+	    job_info->surface_inverted != pixbuf_cache->inverted_colors) {
+		job_info->surface = ev_render_registry_ensure_private (job_info->surface);
+		ev_document_misc_invert_surface (job_info->surface);
+		job_info->surface_inverted = pixbuf_cache->inverted_colors;
+	}
+
+	return job_info->surface;
+}
+
 void
 ev_pixbuf_cache_set_inverted_colors (EvPixbufCache *pixbuf_cache,
 				     gboolean       inverted_colors)
 {
-	gint i;
-
-	if (pixbuf_cache->inverted_colors == inverted_colors)
-		return;
-
 	pixbuf_cache->inverted_colors = inverted_colors;
-
-	for (i = 0; i < pixbuf_cache->preload_cache_size; i++) {
-		CacheJobInfo *job_info;
-
-		job_info = pixbuf_cache->prev_job + i;
-		if (job_info && job_info->surface)
-			ev_document_misc_invert_surface (job_info->surface);
-
-		job_info = pixbuf_cache->next_job + i;
-		if (job_info && job_info->surface)
-			ev_document_misc_invert_surface (job_info->surface);
-	}
-
-	for (i = 0; i < PAGE_CACHE_LEN (pixbuf_cache); i++) {
-		CacheJobInfo *job_info;
-
-		job_info = pixbuf_cache->job_list + i;
-		if (job_info && job_info->surface)
-			ev_document_misc_invert_surface (job_info->surface);
-	}
 }
 
 cairo_surface_t *
@@ -812,7 +857,7 @@ ev_pixbuf_cache_get_surface (EvPixbufCache *pixbuf_cache,
 		return NULL;
 
 	if (job_info->page_ready)
-		return job_info->surface;
+		return get_job_info_surface (pixbuf_cache, job_info);
 
 	/* We don't need to wait for the idle to handle the callback */
 	if (job_info->job &&
@@ -821,7 +866,7 @@ ev_pixbuf_cache_get_surface (EvPixbufCache *pixbuf_cache,
 		g_signal_emit (pixbuf_cache, signals[JOB_FINISHED], 0, job_info->region);
 	}
 
-	return job_info->surface;
+	return get_job_info_surface (pixbuf_cache, job_info);
 }
 
 static gboolean
@@ -865,6 +910,115 @@ clear_selection_if_needed (EvPixbufCache *pixbuf_cache,
 	}
 }
 
+/* Backends fit the page into the rounded surface size starting from
+ * the corner that the rotation brings to the origin. Rotating the
+ * surface only gives the same pixels when the page size is a whole
+ * number of pixels, otherwise the layout is off by a fraction of pixel.
+ */
+static gboolean
+rotated_surface_is_exact (EvPixbufCache *pixbuf_cache,
+			  gint           page,
+			  gdouble        scale)
+{
+	gdouble width, height;
+
+	ev_document_get_page_size (pixbuf_cache->document, page, &width, &height);
+	width *= scale;
+	height *= scale;
+
+	return fabs (width - floor (width + 0.5)) < 0.01 &&
+		fabs (height - floor (height + 0.5)) < 0.01;
+}
+
+static void
+rotate_job_info (EvPixbufCache *pixbuf_cache,
+		 CacheJobInfo  *job_info,
+		 gint           page,
+		 gint           rotation,
+		 gdouble        scale)
+{
+	cairo_surface_t *surface;
+	gboolean         reload = FALSE;
+
+	/* Running jobs render the previous rotation */
+	if (job_info->job) {
+		reload = EV_JOB_RENDER (job_info->job)->reload;
+
+		g_signal_handlers_disconnect_by_func (job_info->job,
+						      G_CALLBACK (job_finished_cb),
+						      pixbuf_cache);
+		ev_job_cancel (job_info->job);
+		g_object_unref (job_info->job);
+		job_info->job = NULL;
+	}
+
+	if (job_info->selection) {
+		cairo_surface_destroy (job_info->selection);
+		job_info->selection = NULL;
+		job_info->selection_points.x1 = -1;
+	}
+
+	if (job_info->surface) {
+		surface = ev_document_misc_surface_rotate_and_scale (job_info->surface,
+								     cairo_image_surface_get_width (job_info->surface),
+								     cairo_image_surface_get_height (job_info->surface),
+								     rotation);
+		cairo_surface_destroy (job_info->surface);
+		job_info->surface = surface;
+		if (!rotated_surface_is_exact (pixbuf_cache, page, scale))
+			job_info->surface_rotated = TRUE;
+	}
+
+	/* The surface doesn't have the changes the reload job was
+	 * rendering, so the page is reloaded with the new rotation
+	 */
+	if (reload) {
+		gint width, height;
+
+		_get_page_size_for_scale_and_rotation (pixbuf_cache->document,
+						       page, scale, pixbuf_cache->rotation,
+						       &width, &height);
+		add_job (pixbuf_cache, job_info, NULL,
+			 width, height, page, pixbuf_cache->rotation, scale,
+			 EV_JOB_PRIORITY_URGENT, TRUE);
+	}
+}
+
+/* Rotates the surfaces we hold instead of rendering the pages again.
+ * Pages are only rendered again, with a low priority, when the rotated
+ * surface is not what the backend would render.
+ */
+void
+ev_pixbuf_cache_set_rotation (EvPixbufCache *pixbuf_cache,
+			      gint           rotation)
+{
+	gdouble scale;
+	gint    delta;
+	gint    i;
+
+	delta = (rotation - pixbuf_cache->rotation + 360) % 360;
+	pixbuf_cache->rotation = rotation;
+	if (delta == 0 || !pixbuf_cache->job_list)
+		return;
+
+	scale = ev_document_model_get_scale (pixbuf_cache->model);
+
+	for (i = 0; i < pixbuf_cache->preload_cache_size; i++) {
+		rotate_job_info (pixbuf_cache, pixbuf_cache->prev_job + i,
+				 pixbuf_cache->start_page - pixbuf_cache->preload_cache_size + i,
+				 delta, scale);
+		rotate_job_info (pixbuf_cache, pixbuf_cache->next_job + i,
+				 pixbuf_cache->end_page + 1 + i,
+				 delta, scale);
+	}
+
+	for (i = 0; i < PAGE_CACHE_LEN (pixbuf_cache); i++) {
+		rotate_job_info (pixbuf_cache, pixbuf_cache->job_list + i,
+				 pixbuf_cache->start_page + i,
+				 delta, scale);
+	}
+}
+
 /* Clears the cache of jobs and pixbufs.
  */
 void
@@ -1188,6 +1342,9 @@ ev_pixbuf_cache_reload_page (EvPixbufCache  *pixbuf_cache,
 	CacheJobInfo *job_info;
         gint width, height;
 
+	/* The page changed, surfaces rendered before can't be shared */
+	ev_render_registry_remove_page (pixbuf_cache->document, page);
+
 	job_info = find_job_cache (pixbuf_cache, page);
 	if (job_info == NULL)
 		return;
@@ -1197,7 +1354,7 @@ ev_pixbuf_cache_reload_page (EvPixbufCache  *pixbuf_cache,
 					       &width, &height);
         add_job (pixbuf_cache, job_info, region,
 		 width, height, page, rotation, scale,
-		 EV_JOB_PRIORITY_URGENT);
+		 EV_JOB_PRIORITY_URGENT, TRUE);
 }
 
 
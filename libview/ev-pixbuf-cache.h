@@ -42,13 +42,15 @@ G_BEGIN_DECLS
 
 
 /* The coordinates in the rect here are at scale == 1.0, so that we can ignore
- * resizings.  There is one per page, maximum.
+ * resizings.  There is one per page, maximum. layout_scale is the scale the
+ * covered region was computed at from the text layout, or 0.
  */
 typedef struct {
 	int page;
 	EvRectangle rect;
 	cairo_region_t *covered_region;
 	EvSelectionStyle style;
+	gdouble layout_scale;
 } EvViewSelection;
 
 typedef struct _EvPixbufCache       EvPixbufCache;
@@ -75,6 +77,8 @@ void           ev_pixbuf_cache_reload_page 	    (EvPixbufCache  *pixbuf_cache,
 						     gdouble         scale);
 void           ev_pixbuf_cache_set_inverted_colors  (EvPixbufCache *pixbuf_cache,
 						     gboolean       inverted_colors);
+void           ev_pixbuf_cache_set_rotation         (EvPixbufCache *pixbuf_cache,
+						     gint           rotation);
 /* Selection */
 cairo_surface_t *ev_pixbuf_cache_get_selection_surface (EvPixbufCache   *pixbuf_cache,
 							gint             page,
@@ -0,0 +1,339 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include "ev-render-registry.h"
+#include "ev-surface-pool.h"
+
+/* Surfaces rendered for the pages of the open documents, so that
+ * identical render requests share a single surface instead of
+ * rendering the page again. The registry keeps a reference to every
+ * surface, that is dropped the next time the registry is used once
+ * nobody else is using it, so surfaces are only shared while they are
+ * alive.
+ *
+ * Shared surfaces must not be modified, ev_render_registry_ensure_private()
+ * gives a copy that can be.
+ */
+
+typedef struct {
+	guint   document_id;
+	gint    page;
+	gint    rotation;
+	gdouble scale;
+} EvRenderKey;
+
+#define EV_RENDER_REGISTRY_DOCUMENT_ID "ev-render-registry-document-id"
+
+static GMutex      registry_mutex;
+static GHashTable *registry = NULL;
+static guint       next_document_id = 1;
+
+static const cairo_user_data_key_t shared_surface_key;
+
+static guint
+ev_render_key_hash (gconstpointer v)
+{
+	const EvRenderKey *key = v;
+
+	return (key->document_id * 31 + key->page) * 31 +
+		key->rotation + g_double_hash (&key->scale);
+}
+
+static gboolean
+ev_render_key_equal (gconstpointer a,
+		     gconstpointer b)
+{
+	const EvRenderKey *key_a = a;
+	const EvRenderKey *key_b = b;
+
+	return key_a->document_id == key_b->document_id &&
+		key_a->page == key_b->page &&
+		key_a->rotation == key_b->rotation &&
+		key_a->scale == key_b->scale;
+}
+
+static void
+ev_render_key_free (EvRenderKey *key)
+{
+	g_slice_free (EvRenderKey, key);
+}
+
+static gboolean
+ev_render_registry_entry_is_document (EvRenderKey     *key,
+				      cairo_surface_t *surface,
+				      gpointer         document_id)
+{
+	return key->document_id == GPOINTER_TO_UINT (document_id);
+}
+
+static void
+ev_render_registry_document_finalized (gpointer  document_id,
+				       GObject  *document)
+{
+	g_mutex_lock (&registry_mutex);
+	g_hash_table_foreach_remove (registry,
+				     (GHRFunc)ev_render_registry_entry_is_document,
+				     document_id);
+	g_mutex_unlock (&registry_mutex);
+}
+
+/* Document addresses might be reused after the document is finalized,
+ * so entries are keyed by a unique id instead
+ */
+static guint
+ev_render_registry_get_document_id_unlocked (EvDocument *document)
+{
+	guint document_id;
+
+	document_id = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (document),
+							   EV_RENDER_REGISTRY_DOCUMENT_ID));
+	if (document_id == 0) {
+		document_id = next_document_id++;
+		g_object_set_data (G_OBJECT (document),
+				   EV_RENDER_REGISTRY_DOCUMENT_ID,
+				   GUINT_TO_POINTER (document_id));
+		g_object_weak_ref (G_OBJECT (document),
+				   (GWeakNotify)ev_render_registry_document_finalized,
+				   GUINT_TO_POINTER (document_id));
+	}
+
+	return document_id;
+}
+
+static void
+ev_render_registry_ensure_unlocked (void)
+{
+	if (registry)
+		return;
+
+	registry = g_hash_table_new_full (ev_render_key_hash,
+					  ev_render_key_equal,
+					  (GDestroyNotify)ev_render_key_free,
+					  (GDestroyNotify)cairo_surface_destroy);
+}
+
+static gboolean
+ev_render_registry_entry_is_unused (EvRenderKey     *key,
+				    cairo_surface_t *surface,
+				    gpointer         user_data)
+{
+	/* Nobody can get a new reference without the lock */
+	return cairo_surface_get_reference_count (surface) == 1;
+}
+
+/* Releases the surfaces nobody is using anymore */
+static void
+ev_render_registry_purge_unlocked (void)
+{
+	g_hash_table_foreach_remove (registry,
+				     (GHRFunc)ev_render_registry_entry_is_unused,
+				     NULL);
+}
+
+/* Returns a new reference to the surface already rendered, and still in use,
+ * for the given page, or %NULL
+ */
+cairo_surface_t *
+ev_render_registry_lookup (EvDocument *document,
+			   gint        page,
+			   gint        rotation,
+			   gdouble     scale)
+{
+	EvRenderKey      key;
+	cairo_surface_t *surface;
+
+	g_mutex_lock (&registry_mutex);
+
+	ev_render_registry_ensure_unlocked ();
+	ev_render_registry_purge_unlocked ();
+
+	key.document_id = ev_render_registry_get_document_id_unlocked (document);
+	key.page = page;
+	key.rotation = rotation;
+	key.scale = scale;
+
+	surface = g_hash_table_lookup (registry, &key);
+	if (surface)
+		cairo_surface_reference (surface);
+
+	g_mutex_unlock (&registry_mutex);
+
+	return surface;
+}
+
+/* Returns a new reference to the smallest surface already rendered for
+ * the given page at @min_scale or more, or %NULL
+ */
+cairo_surface_t *
+ev_render_registry_lookup_scaled (EvDocument *document,
+				  gint        page,
+				  gint        rotation,
+				  gdouble     min_scale,
+				  gdouble    *scale)
+{
+	GHashTableIter   iter;
+	EvRenderKey     *key;
+	cairo_surface_t *surface;
+	cairo_surface_t *best = NULL;
+	gdouble          best_scale = 0;
+	guint            document_id;
+
+	g_mutex_lock (&registry_mutex);
+
+	ev_render_registry_ensure_unlocked ();
+	ev_render_registry_purge_unlocked ();
+
+	document_id = ev_render_registry_get_document_id_unlocked (document);
+
+	g_hash_table_iter_init (&iter, registry);
+	while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&surface)) {
+		if (key->document_id != document_id ||
+		    key->page != page ||
+		    key->rotation != rotation ||
+		    key->scale < min_scale)
+			continue;
+
+		if (!best || key->scale < best_scale) {
+			best = surface;
+			best_scale = key->scale;
+		}
+	}
+
+	if (best) {
+		cairo_surface_reference (best);
+		if (scale)
+			*scale = best_scale;
+	}
+
+	g_mutex_unlock (&registry_mutex);
+
+	return best;
+}
+
+void
+ev_render_registry_add (EvDocument      *document,
+			gint             page,
+			gint             rotation,
+			gdouble          scale,
+			cairo_surface_t *surface)
+{
+	EvRenderKey *key;
+
+	if (!surface || cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+		return;
+
+	cairo_surface_set_user_data (surface, &shared_surface_key,
+				     GINT_TO_POINTER (TRUE), NULL);
+
+	g_mutex_lock (&registry_mutex);
+
+	ev_render_registry_ensure_unlocked ();
+	ev_render_registry_purge_unlocked ();
+
+	key = g_slice_new (EvRenderKey);
+	key->document_id = ev_render_registry_get_document_id_unlocked (document);
+	key->page = page;
+	key->rotation = rotation;
+	key->scale = scale;
+
+	g_hash_table_replace (registry, key, cairo_surface_reference (surface));
+
+	g_mutex_unlock (&registry_mutex);
+}
+
+static gboolean
+ev_render_registry_entry_is_page (EvRenderKey     *key,
+				  cairo_surface_t *surface,
+				  EvRenderKey     *page_key)
+{
+	return key->document_id == page_key->document_id &&
+		key->page == page_key->page;
+}
+
+/* Forgets the surfaces rendered for @page, for when its contents change.
+ * A job that was already rendering might still add an old surface, so
+ * the jobs rendering the changed page don't look it up
+ */
+void
+ev_render_registry_remove_page (EvDocument *document,
+				gint        page)
+{
+	EvRenderKey page_key;
+
+	g_mutex_lock (&registry_mutex);
+
+	if (registry) {
+		page_key.document_id = ev_render_registry_get_document_id_unlocked (document);
+		page_key.page = page;
+
+		g_hash_table_foreach_remove (registry,
+					     (GHRFunc)ev_render_registry_entry_is_page,
+					     &page_key);
+	}
+
+	g_mutex_unlock (&registry_mutex);
+}
+
+/* Forgets all the surfaces rendered for @document, for when the contents
+ * of any of its pages might have changed
+ */
+void
+ev_render_registry_remove_document (EvDocument *document)
+{
+	guint document_id;
+
+	g_mutex_lock (&registry_mutex);
+
+	if (registry) {
+		document_id = ev_render_registry_get_document_id_unlocked (document);
+		g_hash_table_foreach_remove (registry,
+					     (GHRFunc)ev_render_registry_entry_is_document,
+					     GUINT_TO_POINTER (document_id));
+	}
+
+	g_mutex_unlock (&registry_mutex);
+}
+
+/* Takes ownership of @surface, and returns a surface with the same
+ * contents that can be modified without affecting other users
+ */
+cairo_surface_t *
+ev_render_registry_ensure_private (cairo_surface_t *surface)
+{
+	cairo_surface_t *copy;
+	cairo_t         *cr;
+
+	if (!cairo_surface_get_user_data (surface, &shared_surface_key) ||
+	    cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE)
+		return surface;
+
+	copy = ev_surface_pool_create_surface (cairo_image_surface_get_format (surface),
+					       cairo_image_surface_get_width (surface),
+					       cairo_image_surface_get_height (surface),
+					       FALSE);
+	cr = cairo_create (copy);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface (cr, surface, 0, 0);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	cairo_surface_destroy (surface);
+
+	return copy;
+}
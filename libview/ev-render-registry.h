@@ -0,0 +1,51 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (EVINCE_COMPILATION)
+#error "This is a private header."
+#endif
+
+#ifndef EV_RENDER_REGISTRY_H
+#define EV_RENDER_REGISTRY_H
+
+#include <cairo.h>
+#include <evince-document.h>
+
+G_BEGIN_DECLS
+
+cairo_surface_t *ev_render_registry_lookup          (EvDocument      *document,
+						     gint             page,
+						     gint             rotation,
+						     gdouble          scale);
+cairo_surface_t *ev_render_registry_lookup_scaled   (EvDocument      *document,
+						     gint             page,
+						     gint             rotation,
+						     gdouble          min_scale,
+						     gdouble         *scale);
+void             ev_render_registry_add             (EvDocument      *document,
+						     gint             page,
+						     gint             rotation,
+						     gdouble          scale,
+						     cairo_surface_t *surface);
+void             ev_render_registry_remove_page     (EvDocument      *document,
+						     gint             page);
+void             ev_render_registry_remove_document (EvDocument      *document);
+cairo_surface_t *ev_render_registry_ensure_private  (cairo_surface_t *surface);
+
+G_END_DECLS
+
+#endif /* EV_RENDER_REGISTRY_H */
@@ -0,0 +1,427 @@
+/* ev-thumbnails-cache.c
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "ev-thumbnails-cache.h"
+
+/* The thumbnails of a document are kept in a directory of the cache
+ * dir, named after the identity of the document file, the rotation and
+ * the thumbnail width, with a PNG file per page.
+ *
+ * Every thumbnail is written to a temp file that is renamed when
+ * complete, so windows showing the same document can store thumbnails
+ * at the same time, and an interrupted write never leaves a broken
+ * thumbnail behind. Lookups and stores do file I/O, so they are meant
+ * to be called from the thumbnail jobs, not from the main loop.
+ *
+ * Thumbnails are written unencrypted, so callers must not create a cache
+ * for documents that needed a password.
+ */
+
+/* Documents not opened for this long lose their thumbnails, and the
+ * least recently opened go first when all of them take more than the
+ * max size
+ */
+#define EV_THUMBNAILS_CACHE_MAX_AGE  (30 * 24 * 60 * 60)
+#define EV_THUMBNAILS_CACHE_MAX_SIZE (128 * 1024 * 1024)
+
+struct _EvThumbnailsCache {
+	volatile gint ref_count;
+
+	GMutex   mutex;
+	gchar   *uri;
+	gint     rotation;
+	gint     thumbnail_width;
+	gchar   *dir;
+	gboolean dir_resolved;
+};
+
+static gchar *
+ev_thumbnails_cache_get_root_dir (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "evince", "thumbnails", NULL);
+}
+
+/* Compressed and remote documents are loaded from a temp copy, with a
+ * new modification time every time, so the thumbnails are keyed on the
+ * file the document was opened from
+ */
+static gchar *
+ev_thumbnails_cache_get_dir (const gchar *uri,
+			     gint         rotation,
+			     gint         thumbnail_width)
+{
+	GFile       *file;
+	GFileInfo   *info;
+	const gchar *id;
+	gchar       *key;
+	gchar       *checksum;
+	gchar       *root;
+	gchar       *dir;
+
+	file = g_file_new_for_uri (uri);
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_ID_FILE ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL, NULL);
+	g_object_unref (file);
+	if (!info)
+		return NULL;
+
+	/* The same file, unmodified, gets the same thumbnails */
+	id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+	key = g_strdup_printf ("%s:%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ":%d:%d",
+			       id ? id : uri,
+			       (guint64) g_file_info_get_size (info),
+			       g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+			       rotation, thumbnail_width);
+	g_object_unref (info);
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+	g_free (key);
+
+	root = ev_thumbnails_cache_get_root_dir ();
+	dir = g_build_filename (root, checksum, NULL);
+	g_free (root);
+	g_free (checksum);
+
+	return dir;
+}
+
+/* Returns a copy of the directory of the document, or %NULL if the
+ * document file can't be identified
+ */
+static gchar *
+ev_thumbnails_cache_dup_dir (EvThumbnailsCache *cache)
+{
+	gchar *dir;
+
+	g_mutex_lock (&cache->mutex);
+
+	if (!cache->dir_resolved) {
+		cache->dir_resolved = TRUE;
+		cache->dir = ev_thumbnails_cache_get_dir (cache->uri,
+							  cache->rotation,
+							  cache->thumbnail_width);
+		/* Mark the thumbnails as recently used, so they're not pruned */
+		if (cache->dir)
+			g_utime (cache->dir, NULL);
+	}
+	dir = g_strdup (cache->dir);
+
+	g_mutex_unlock (&cache->mutex);
+
+	return dir;
+}
+
+/* Returns the size of the thumbnails in @path, removing the temp files
+ * left by a crash while storing a thumbnail
+ */
+static goffset
+ev_thumbnails_cache_get_dir_size (const gchar *path,
+				  time_t       now)
+{
+	GDir        *dir;
+	const gchar *name;
+	goffset      size = 0;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (!dir)
+		return 0;
+
+	while ((name = g_dir_read_name (dir))) {
+		GStatBuf  buf;
+		gchar    *file_path;
+
+		file_path = g_build_filename (path, name, NULL);
+		if (g_stat (file_path, &buf) == 0 && S_ISREG (buf.st_mode)) {
+			if (!g_str_has_suffix (name, ".png") && now - buf.st_mtime > 60 * 60)
+				g_unlink (file_path);
+			else
+				size += buf.st_size;
+		}
+		g_free (file_path);
+	}
+	g_dir_close (dir);
+
+	return size;
+}
+
+static void
+ev_thumbnails_cache_remove_dir (const gchar *path)
+{
+	GDir        *dir;
+	const gchar *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (!dir)
+		return;
+
+	while ((name = g_dir_read_name (dir))) {
+		gchar *file_path;
+
+		file_path = g_build_filename (path, name, NULL);
+		g_unlink (file_path);
+		g_free (file_path);
+	}
+	g_dir_close (dir);
+
+	g_rmdir (path);
+}
+
+typedef struct {
+	gchar  *path;
+	goffset size;
+	time_t  mtime;
+} EvThumbnailsCacheDir;
+
+static gint
+ev_thumbnails_cache_dir_compare (const EvThumbnailsCacheDir *a,
+				 const EvThumbnailsCacheDir *b)
+{
+	if (a->mtime == b->mtime)
+		return 0;
+
+	return a->mtime < b->mtime ? 1 : -1;
+}
+
+/* Removes the thumbnails of the documents not opened recently. The
+ * modification time of the directory of a document is updated every
+ * time it's opened, so it tells when it was last used.
+ */
+static gpointer
+ev_thumbnails_cache_prune_thread (gpointer data)
+{
+	GDir        *dir;
+	gchar       *root;
+	const gchar *name;
+	GList       *dirs = NULL, *l;
+	goffset      total_size = 0;
+	time_t       now = time (NULL);
+
+	root = ev_thumbnails_cache_get_root_dir ();
+	dir = g_dir_open (root, 0, NULL);
+	if (!dir) {
+		g_free (root);
+		return NULL;
+	}
+
+	while ((name = g_dir_read_name (dir))) {
+		EvThumbnailsCacheDir *cache_dir;
+		GStatBuf              buf;
+		gchar                *path;
+
+		path = g_build_filename (root, name, NULL);
+		if (g_stat (path, &buf) != 0) {
+			g_free (path);
+			continue;
+		}
+
+		/* Stores of older versions were single files */
+		if (S_ISREG (buf.st_mode)) {
+			g_unlink (path);
+			g_free (path);
+			continue;
+		}
+
+		if (!S_ISDIR (buf.st_mode)) {
+			g_free (path);
+			continue;
+		}
+
+		if (now - buf.st_mtime > EV_THUMBNAILS_CACHE_MAX_AGE) {
+			ev_thumbnails_cache_remove_dir (path);
+			g_free (path);
+			continue;
+		}
+
+		cache_dir = g_slice_new (EvThumbnailsCacheDir);
+		cache_dir->path = path;
+		cache_dir->size = ev_thumbnails_cache_get_dir_size (path, now);
+		cache_dir->mtime = buf.st_mtime;
+		dirs = g_list_prepend (dirs, cache_dir);
+	}
+	g_dir_close (dir);
+	g_free (root);
+
+	/* Most recently used first */
+	dirs = g_list_sort (dirs, (GCompareFunc)ev_thumbnails_cache_dir_compare);
+	for (l = dirs; l; l = g_list_next (l)) {
+		EvThumbnailsCacheDir *cache_dir = l->data;
+
+		total_size += cache_dir->size;
+		if (total_size > EV_THUMBNAILS_CACHE_MAX_SIZE)
+			ev_thumbnails_cache_remove_dir (cache_dir->path);
+
+		g_free (cache_dir->path);
+		g_slice_free (EvThumbnailsCacheDir, cache_dir);
+	}
+	g_list_free (dirs);
+
+	return NULL;
+}
+
+/* Scanning the whole cache dir takes a while, so it's done once per
+ * process, in a thread of its own started when the main loop is idle,
+ * not to delay the jobs rendering the visible pages
+ */
+static gboolean
+ev_thumbnails_cache_prune_idle (gpointer data)
+{
+	g_thread_unref (g_thread_new ("EvThumbnailsCachePrune",
+				      ev_thumbnails_cache_prune_thread,
+				      NULL));
+
+	return FALSE;
+}
+
+/* Creates a store for the thumbnails of the document opened from @uri,
+ * with @thumbnail_width the width of the thumbnails of unrotated pages.
+ * Nothing is read until a thumbnail is looked up, so this is meant to
+ * be called from the main loop.
+ */
+EvThumbnailsCache *
+ev_thumbnails_cache_new (const gchar *uri,
+			 gint         rotation,
+			 gint         thumbnail_width)
+{
+	static gsize       prune_scheduled = 0;
+	EvThumbnailsCache *cache;
+
+	g_return_val_if_fail (uri != NULL, NULL);
+
+	if (g_once_init_enter (&prune_scheduled)) {
+		g_idle_add_full (G_PRIORITY_LOW,
+				 ev_thumbnails_cache_prune_idle,
+				 NULL, NULL);
+		g_once_init_leave (&prune_scheduled, 1);
+	}
+
+	cache = g_slice_new0 (EvThumbnailsCache);
+	cache->ref_count = 1;
+	g_mutex_init (&cache->mutex);
+	cache->uri = g_strdup (uri);
+	cache->rotation = rotation;
+	cache->thumbnail_width = thumbnail_width;
+
+	return cache;
+}
+
+EvThumbnailsCache *
+ev_thumbnails_cache_ref (EvThumbnailsCache *cache)
+{
+	g_return_val_if_fail (cache != NULL, NULL);
+	g_return_val_if_fail (cache->ref_count > 0, cache);
+
+	g_atomic_int_inc (&cache->ref_count);
+
+	return cache;
+}
+
+void
+ev_thumbnails_cache_unref (EvThumbnailsCache *cache)
+{
+	g_return_if_fail (cache != NULL);
+	g_return_if_fail (cache->ref_count > 0);
+
+	if (g_atomic_int_dec_and_test (&cache->ref_count)) {
+		g_mutex_clear (&cache->mutex);
+		g_free (cache->uri);
+		g_free (cache->dir);
+		g_slice_free (EvThumbnailsCache, cache);
+	}
+}
+
+/* Returns the stored thumbnail of @page, or %NULL. This does file I/O,
+ * so it should be called from a thread.
+ */
+GdkPixbuf *
+ev_thumbnails_cache_lookup (EvThumbnailsCache *cache,
+			    gint               page)
+{
+	GdkPixbuf *thumbnail;
+	gchar     *dir;
+	gchar     *name;
+	gchar     *path;
+
+	g_return_val_if_fail (cache != NULL, NULL);
+	g_return_val_if_fail (page >= 0, NULL);
+
+	dir = ev_thumbnails_cache_dup_dir (cache);
+	if (!dir)
+		return NULL;
+
+	name = g_strdup_printf ("%d.png", page);
+	path = g_build_filename (dir, name, NULL);
+	g_free (name);
+	g_free (dir);
+
+	thumbnail = gdk_pixbuf_new_from_file (path, NULL);
+	g_free (path);
+
+	return thumbnail;
+}
+
+/* Saves @thumbnail as the thumbnail of @page. Failures are ignored, the
+ * thumbnail will just be rendered again next time. This does file I/O,
+ * so it should be called from a thread.
+ */
+void
+ev_thumbnails_cache_store (EvThumbnailsCache *cache,
+			   gint               page,
+			   GdkPixbuf         *thumbnail)
+{
+	gchar    *dir;
+	gchar    *name;
+	gchar    *path;
+	gchar    *data;
+	gsize     length;
+
+	g_return_if_fail (cache != NULL);
+	g_return_if_fail (page >= 0);
+	g_return_if_fail (GDK_IS_PIXBUF (thumbnail));
+
+	dir = ev_thumbnails_cache_dup_dir (cache);
+	if (!dir)
+		return;
+
+	if (g_mkdir_with_parents (dir, 0700) != 0 ||
+	    !gdk_pixbuf_save_to_buffer (thumbnail, &data, &length, "png", NULL, NULL)) {
+		g_free (dir);
+		return;
+	}
+
+	name = g_strdup_printf ("%d.png", page);
+	path = g_build_filename (dir, name, NULL);
+	g_free (name);
+	g_free (dir);
+
+	/* Written to a temp file renamed over the thumbnail */
+	g_file_set_contents (path, data, length, NULL);
+	g_free (path);
+	g_free (data);
+}
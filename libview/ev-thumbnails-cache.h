@@ -0,0 +1,47 @@
+/* ev-thumbnails-cache.h
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (EVINCE_COMPILATION)
+#error "This is a private header."
+#endif
+
+#ifndef EV_THUMBNAILS_CACHE_H
+#define EV_THUMBNAILS_CACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "ev-jobs.h"
+
+G_BEGIN_DECLS
+
+typedef struct _EvThumbnailsCache EvThumbnailsCache;
+
+EvThumbnailsCache *ev_thumbnails_cache_new    (const gchar       *uri,
+					       gint               rotation,
+					       gint               thumbnail_width);
+EvThumbnailsCache *ev_thumbnails_cache_ref    (EvThumbnailsCache *cache);
+void               ev_thumbnails_cache_unref  (EvThumbnailsCache *cache);
+GdkPixbuf         *ev_thumbnails_cache_lookup (EvThumbnailsCache *cache,
+					       gint               page);
+void               ev_thumbnails_cache_store  (EvThumbnailsCache *cache,
+					       gint               page,
+					       GdkPixbuf         *thumbnail);
+
+G_END_DECLS
+
+#endif /* EV_THUMBNAILS_CACHE_H */
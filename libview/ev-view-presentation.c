@@ -30,6 +30,7 @@
 #include "ev-transition-animation.h"
 #include "ev-view-cursor.h"
 #include "ev-page-cache.h"
+#include "ev-render-registry.h"
 
 enum {
 	PROP_0,
@@ -333,8 +334,10 @@ job_finished_cb (EvJob              *job,
 {
 	EvJobRender *job_render = EV_JOB_RENDER (job);
 
-	if (pview->inverted_colors)
+	if (pview->inverted_colors) {
+		job_render->surface = ev_render_registry_ensure_private (job_render->surface);
 		ev_document_misc_invert_surface (job_render->surface);
+	}
 
 	if (job != pview->curr_job)
 		return;
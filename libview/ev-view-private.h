@@ -118,6 +118,7 @@ struct _EvView {
 
 	/* Find */
 	GList **find_pages;
+	EvJobFind *find_job;
 	gint find_result;
 	gboolean jump_to_find_result;
 	gboolean highlight_find_results;
@@ -33,9 +33,11 @@
 #include "ev-document-images.h"
 #include "ev-document-links.h"
 #include "ev-document-layers.h"
+#include "ev-document-text.h"
 #include "ev-document-misc.h"
 #include "ev-pixbuf-cache.h"
 #include "ev-page-cache.h"
+#include "ev-render-registry.h"
 #include "ev-view-marshal.h"
 #include "ev-document-annotations.h"
 #include "ev-annotation-window.h"
@@ -44,6 +46,7 @@
 #include "ev-view-accessible.h"
 #include "ev-view-private.h"
 #include "ev-view-type-builtins.h"
+#include "ev-trace.h"
 
 #define EV_VIEW_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), EV_TYPE_VIEW, EvViewClass))
 #define EV_IS_VIEW_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EV_TYPE_VIEW))
@@ -267,6 +270,7 @@ static void       ev_view_handle_cursor_over_xy              (EvView *view,
 							      gint y);
 
 /*** Find ***/
+static void         ev_view_find_clear_results               (EvView             *view);
 static gint         ev_view_find_get_n_results               (EvView             *view,
 							      gint                page);
 static EvRectangle *ev_view_find_get_result                  (EvView             *view,
@@ -282,6 +286,8 @@ static void       compute_selections                         (EvView
 							      GdkPoint           *start,
 							      GdkPoint           *stop);
 static void       clear_selection                            (EvView             *view);
+static GList     *ev_view_get_rendered_selections            (EvView             *view,
+							      GList              *selections);
 static void       clear_link_selected                        (EvView             *view);
 static void       selection_free                             (EvViewSelection    *selection);
 static char*      get_selected_text                          (EvView             *ev_view);
@@ -636,6 +642,7 @@ view_update_range_and_current_page (EvView *view)
 {
 	gint start = view->start_page;
 	gint end = view->end_page;
+	GList *selections;
 
 	if (ev_document_get_n_pages (view->document) <= 0 ||
 	    !ev_document_check_dimensions (view->document))
@@ -735,10 +742,12 @@ view_update_range_and_current_page (EvView *view)
 	ev_page_cache_set_page_range (view->page_cache,
 				      view->start_page,
 				      view->end_page);
+	selections = ev_view_get_rendered_selections (view, view->selection_info.selections);
 	ev_pixbuf_cache_set_page_range (view->pixbuf_cache,
 					view->start_page,
 					view->end_page,
-					view->selection_info.selections);
+					selections);
+	g_list_free (selections);
 
 	if (ev_pixbuf_cache_get_surface (view->pixbuf_cache, view->current_page))
 	    gtk_widget_queue_draw (GTK_WIDGET (view));
@@ -2934,6 +2943,27 @@ ev_view_create_annotation (EvView          *view,
 	g_signal_emit (view, signals[SIGNAL_ANNOT_ADDED], 0, annot);
 }
 
+/* The focused annotation is a copy of the given mapping, since the
+ * mapping lists it comes from can be freed at any time: the page cache
+ * evicts them and the annotations sidebar drops them when reloaded.
+ */
+static void
+ev_view_set_focus_annotation (EvView    *view,
+			      EvMapping *annot_mapping)
+{
+	if (view->focus_annotation) {
+		g_object_unref (view->focus_annotation->data);
+		g_slice_free (EvMapping, view->focus_annotation);
+		view->focus_annotation = NULL;
+	}
+
+	if (annot_mapping) {
+		view->focus_annotation = g_slice_new (EvMapping);
+		view->focus_annotation->area = annot_mapping->area;
+		view->focus_annotation->data = g_object_ref (annot_mapping->data);
+	}
+}
+
 void
 ev_view_focus_annotation (EvView    *view,
 			  EvMapping *annot_mapping)
@@ -2945,11 +2975,11 @@ ev_view_focus_annotation (EvView    *view,
 	if (!EV_IS_DOCUMENT_ANNOTATIONS (view->document))
 		return;
 
-	if (view->focus_annotation == annot_mapping)
+	annot = (EvAnnotation *)annot_mapping->data;
+	if (view->focus_annotation && view->focus_annotation->data == annot)
 		return;
 
-	view->focus_annotation = annot_mapping;
-	annot = (EvAnnotation *)annot_mapping->data;
+	ev_view_set_focus_annotation (view, annot_mapping);
 
 	page = ev_annotation_get_page_index (annot);
 	ev_document_model_set_page (view->model, page);
@@ -3398,6 +3428,7 @@ ev_view_draw (GtkWidget *widget,
 	EvView      *view = EV_VIEW (widget);
 	gint         i;
 	GdkRectangle clip_rect;
+	gint64       trace_start;
 
 	if (view->loading) {
 		show_loading_window (view);
@@ -3412,6 +3443,8 @@ ev_view_draw (GtkWidget *widget,
         if (!gdk_cairo_get_clip_rectangle (cr, &clip_rect))
                 return FALSE;
 
+	trace_start = ev_trace_begin ();
+
 	for (i = view->start_page; i >= 0 && i <= view->end_page; i++) {
 		GdkRectangle page_area;
 		GtkBorder border;
@@ -3425,7 +3458,7 @@ ev_view_draw (GtkWidget *widget,
 
 		draw_one_page (view, i, cr, &page_area, &border, &clip_rect, &page_ready);
 
-		if (page_ready && view->find_pages && view->highlight_find_results)
+		if (page_ready && (view->find_job || view->find_pages) && view->highlight_find_results)
 			highlight_find_results (view, cr, i);
 		if (page_ready && EV_IS_DOCUMENT_ANNOTATIONS (view->document))
 			show_annotation_windows (view, i);
@@ -3438,6 +3471,11 @@ ev_view_draw (GtkWidget *widget,
         if (GTK_WIDGET_CLASS (ev_view_parent_class)->draw)
                 GTK_WIDGET_CLASS (ev_view_parent_class)->draw (widget, cr);
 
+	ev_trace_end_with_args ("view", "Draw", trace_start,
+				"start_page", (gint64)view->start_page,
+				"end_page", (gint64)view->end_page,
+				NULL);
+
 	return FALSE;
 }
 
@@ -3672,8 +3710,7 @@ ev_view_button_press_event (GtkWidget      *widget,
 					gtk_widget_queue_draw (widget);
 				}
 
-				if (view->focus_annotation)
-					view->focus_annotation = NULL;
+				ev_view_set_focus_annotation (view, NULL);
 
 				if (EV_IS_SELECTION (view->document))
 					start_selection_for_event (view, event);
@@ -4413,6 +4450,271 @@ hide_loading_window (EvView *view)
 	}
 }
 
+/* Text selections are painted from the text layout kept in the page
+ * cache, so that dragging a selection doesn't need the backend to
+ * render the selected glyphs.
+ */
+static gboolean
+ev_view_selection_from_layout (EvView *view)
+{
+	return view->selection_mode == EV_VIEW_SELECTION_TEXT &&
+		view->page_cache &&
+		view->rotation == 0 &&
+		EV_IS_DOCUMENT_TEXT (view->document);
+}
+
+static gboolean
+ev_view_page_has_text_layout (EvView *view,
+			      gint    page)
+{
+	EvRectangle *areas = NULL;
+	guint        n_areas = 0;
+
+	return ev_page_cache_get_text_layout (view->page_cache, page, &areas, &n_areas) &&
+		areas && ev_page_cache_get_text (view->page_cache, page);
+}
+
+/* Returns the selections of @selections the pixbuf cache has to render,
+ * that is, all of them unless they are painted from the text layout,
+ * and then only those of the pages whose layout isn't in the page
+ * cache, because it was evicted or not fetched yet. The list has to be
+ * freed with g_list_free().
+ */
+static GList *
+ev_view_get_rendered_selections (EvView *view,
+				 GList  *selections)
+{
+	GList *rendered = NULL;
+	GList *l;
+
+	if (!ev_view_selection_from_layout (view))
+		return g_list_copy (selections);
+
+	for (l = selections; l; l = g_list_next (l)) {
+		EvViewSelection *selection = l->data;
+
+		if (!ev_view_page_has_text_layout (view, selection->page))
+			rendered = g_list_prepend (rendered, selection);
+	}
+
+	return g_list_reverse (rendered);
+}
+
+static void
+ev_view_update_rendered_selections (EvView *view)
+{
+	GList *selections;
+
+	selections = ev_view_get_rendered_selections (view, view->selection_info.selections);
+	ev_pixbuf_cache_set_selection_list (view->pixbuf_cache, selections);
+	g_list_free (selections);
+}
+
+static guint
+text_layout_offset_at_point (EvRectangle *areas,
+			     gunichar    *chars,
+			     guint        n_areas,
+			     gdouble      page_width,
+			     gdouble      page_height,
+			     gdouble      x,
+			     gdouble      y)
+{
+	gdouble distance = G_MAXDOUBLE;
+	guint   offset = 0;
+	guint   i;
+
+	/* Page corners are used for the pages in the middle
+	 * of a selection spanning several pages
+	 */
+	if (x <= 0 && y <= 0)
+		return 0;
+	if (x >= page_width && y >= page_height)
+		return n_areas;
+
+	for (i = 0; i < n_areas; i++) {
+		EvRectangle *area = areas + i;
+		gdouble      dx, dy, d;
+
+		if (chars[i] == '\n')
+			continue;
+
+		dx = MAX (MAX (area->x1 - x, x - area->x2), 0);
+		dy = MAX (MAX (area->y1 - y, y - area->y2), 0);
+		d = dx * dx + dy * dy;
+
+		if (d < distance) {
+			distance = d;
+			offset = (x > (area->x1 + area->x2) / 2) ? i + 1 : i;
+
+			if (d == 0)
+				break;
+		}
+	}
+
+	return offset;
+}
+
+static cairo_region_t *
+compute_selection_region_from_layout (EvView          *view,
+				      EvViewSelection *selection)
+{
+	EvRectangle    *areas = NULL;
+	guint           n_areas = 0;
+	const gchar    *text;
+	gunichar       *chars;
+	glong           n_chars;
+	gdouble         width, height;
+	guint           start, end, i;
+	EvRectangle     line = { 0, };
+	gboolean        in_line = FALSE;
+	cairo_region_t *region;
+
+	if (!ev_page_cache_get_text_layout (view->page_cache, selection->page, &areas, &n_areas) || !areas)
+		return NULL;
+
+	text = ev_page_cache_get_text (view->page_cache, selection->page);
+	if (!text)
+		return NULL;
+
+	chars = g_utf8_to_ucs4_fast (text, -1, &n_chars);
+	if (n_chars != n_areas) {
+		g_free (chars);
+		return NULL;
+	}
+
+	get_doc_page_size (view, selection->page, &width, &height);
+	start = text_layout_offset_at_point (areas, chars, n_areas, width, height,
+					     selection->rect.x1, selection->rect.y1);
+	end = text_layout_offset_at_point (areas, chars, n_areas, width, height,
+					   selection->rect.x2, selection->rect.y2);
+	if (start > end) {
+		guint tmp = start;
+
+		start = end;
+		end = tmp;
+	}
+
+	switch (selection->style) {
+	case EV_SELECTION_STYLE_WORD:
+		while (start > 0 && !g_unichar_isspace (chars[start - 1]))
+			start--;
+		while (end < n_areas && !g_unichar_isspace (chars[end]))
+			end++;
+		break;
+	case EV_SELECTION_STYLE_LINE:
+		while (start > 0 && chars[start - 1] != '\n')
+			start--;
+		while (end < n_areas && chars[end] != '\n')
+			end++;
+		break;
+	case EV_SELECTION_STYLE_GLYPH:
+		break;
+	}
+
+	/* Merge the glyphs of every line into a single rectangle */
+	region = cairo_region_create ();
+	for (i = start; i <= end; i++) {
+		EvRectangle *area = (i < end) ? areas + i : NULL;
+
+		if (area && chars[i] == '\n')
+			area = NULL;
+
+		if (in_line && area &&
+		    area->x1 >= line.x1 &&
+		    area->y1 < line.y2 && area->y2 > line.y1) {
+			line.x2 = MAX (line.x2, area->x2);
+			line.y1 = MIN (line.y1, area->y1);
+			line.y2 = MAX (line.y2, area->y2);
+			continue;
+		}
+
+		if (in_line) {
+			cairo_rectangle_int_t rect;
+
+			rect.x = (gint) floor (line.x1 * view->scale);
+			rect.y = (gint) floor (line.y1 * view->scale);
+			rect.width = (gint) ceil (line.x2 * view->scale) - rect.x;
+			rect.height = (gint) ceil (line.y2 * view->scale) - rect.y;
+			cairo_region_union_rectangle (region, &rect);
+		}
+
+		in_line = area != NULL;
+		if (in_line)
+			line = *area;
+	}
+	g_free (chars);
+
+	if (cairo_region_is_empty (region)) {
+		cairo_region_destroy (region);
+		return NULL;
+	}
+
+	return region;
+}
+
+/* Computes the region covered by @selection from the text layout, only
+ * once for every scale since it's needed on every draw. Returns FALSE
+ * when the text layout of the page isn't available.
+ */
+static gboolean
+update_selection_region_from_layout (EvView          *view,
+				     EvViewSelection *selection)
+{
+	cairo_region_t *region;
+
+	if (selection->covered_region && selection->layout_scale == view->scale)
+		return TRUE;
+
+	region = compute_selection_region_from_layout (view, selection);
+	if (!region)
+		return FALSE;
+
+	if (selection->covered_region)
+		cairo_region_destroy (selection->covered_region);
+	selection->covered_region = region;
+	selection->layout_scale = view->scale;
+
+	return TRUE;
+}
+
+/* Returns FALSE when the text layout of the page isn't available,
+ * so that the selection rendered by the pixbuf cache is used instead
+ */
+static gboolean
+draw_selection_from_layout (EvView          *view,
+			    cairo_t         *cr,
+			    EvViewSelection *selection,
+			    GdkRectangle    *page_area)
+{
+	GtkStyleContext *context;
+	GtkStateFlags    state;
+	GdkRGBA          color;
+
+	if (!update_selection_region_from_layout (view, selection))
+		return FALSE;
+
+	context = gtk_widget_get_style_context (GTK_WIDGET (view));
+	state = gtk_widget_has_focus (GTK_WIDGET (view)) ? GTK_STATE_FLAG_SELECTED : GTK_STATE_FLAG_ACTIVE;
+	gtk_style_context_get_background_color (context, state, &color);
+
+	cairo_save (cr);
+	cairo_translate (cr, page_area->x, page_area->y);
+	gdk_cairo_region (cr, selection->covered_region);
+	/* Multiplying keeps dark text on light pages readable, but it
+	 * would make the selection disappear on inverted pages, where the
+	 * background is dark and the text light, so lighten them instead
+	 */
+	if (ev_document_model_get_inverted_colors (view->model))
+		cairo_set_operator (cr, CAIRO_OPERATOR_SCREEN);
+	else
+		cairo_set_operator (cr, CAIRO_OPERATOR_MULTIPLY);
+	cairo_set_source_rgb (cr, color.red, color.green, color.blue);
+	cairo_fill (cr);
+	cairo_restore (cr);
+
+	return TRUE;
+}
+
 static void
 draw_one_page (EvView       *view,
 	       gint          page,
@@ -4455,6 +4757,7 @@ draw_one_page (EvView       *view,
 		cairo_surface_t *page_surface = NULL;
 		gint             selection_width, selection_height;
 		cairo_surface_t *selection_surface = NULL;
+		EvViewSelection *selection;
 
 		page_surface = ev_pixbuf_cache_get_surface (view->pixbuf_cache, page);
 
@@ -4494,8 +4797,18 @@ draw_one_page (EvView       *view,
 		cairo_restore (cr);
 		
 		/* Get the selection pixbuf iff we have something to draw */
-		if (find_selection_for_page (view, page) &&
-		    view->selection_mode == EV_VIEW_SELECTION_TEXT) {
+		selection = find_selection_for_page (view, page);
+		if (selection && view->selection_mode == EV_VIEW_SELECTION_TEXT) {
+			if (ev_view_selection_from_layout (view)) {
+				if (draw_selection_from_layout (view, cr, selection, &real_page_area))
+					return;
+
+				/* The layout of the page was evicted since the
+				 * selection changed, so it has to be rendered
+				 */
+				ev_view_update_rendered_selections (view);
+			}
+
 			selection_surface =
 				ev_pixbuf_cache_get_selection_surface (view->pixbuf_cache,
 								       page,
@@ -4550,6 +4863,8 @@ ev_view_finalize (GObject *object)
 		g_object_unref (view->image_dnd_info.image);
 	view->image_dnd_info.image = NULL;
 
+	ev_view_set_focus_annotation (view, NULL);
+
 	G_OBJECT_CLASS (ev_view_parent_class)->finalize (object);
 }
 
@@ -4578,6 +4893,8 @@ ev_view_dispose (GObject *object)
 		view->page_cache = NULL;
 	}
 
+	ev_view_find_clear_results (view);
+
 	ev_view_window_children_free (view);
 
 	if (view->selection_scroll_id) {
@@ -5177,6 +5494,7 @@ ev_view_document_changed_cb (EvDocumentModel *model,
 
 		ev_view_remove_all (view);
 		clear_caches (view);
+		ev_view_set_focus_annotation (view, NULL);
 
 		if (view->document) {
 			g_object_unref (view->document);
@@ -5211,7 +5529,7 @@ ev_view_rotation_changed_cb (EvDocumentModel *model,
 	view->rotation = rotation;
 
 	if (view->pixbuf_cache) {
-		ev_pixbuf_cache_clear (view->pixbuf_cache);
+		ev_pixbuf_cache_set_rotation (view->pixbuf_cache, rotation);
 		if (!ev_document_is_page_size_uniform (view->document))
 			view->pending_scroll = SCROLL_TO_PAGE_POSITION;
 		gtk_widget_queue_resize (GTK_WIDGET (view));
@@ -5396,6 +5714,11 @@ ev_view_reload_page (EvView         *view,
 void
 ev_view_reload (EvView *view)
 {
+	/* Pages might look different now, e.g. after a layer or an
+	 * annotation changed, so surfaces rendered before can't be shared
+	 */
+	if (view->document)
+		ev_render_registry_remove_document (view->document);
 	ev_pixbuf_cache_clear (view->pixbuf_cache);
 	view_update_range_and_current_page (view);
 }
@@ -5641,15 +5964,31 @@ ev_view_zoom_for_size (EvView *view,
 }
 
 /*** Find ***/
+static void
+ev_view_find_clear_results (EvView *view)
+{
+	view->find_pages = NULL;
+	if (view->find_job) {
+		g_object_unref (view->find_job);
+		view->find_job = NULL;
+	}
+}
+
 static gint
 ev_view_find_get_n_results (EvView *view, gint page)
 {
+	if (view->find_job)
+		return ev_job_find_get_n_results (view->find_job, page);
+
 	return view->find_pages ? g_list_length (view->find_pages[page]) : 0;
 }
 
 static EvRectangle *
 ev_view_find_get_result (EvView *view, gint page, gint result)
 {
+	if (view->find_job)
+		return ev_job_find_get_result (view->find_job, page, result);
+
 	return view->find_pages ? (EvRectangle *) g_list_nth_data (view->find_pages[page], result) : NULL;
 }
 
@@ -5710,11 +6049,9 @@ jump_to_find_page (EvView *view, EvViewFindDirection direction, gint shift)
 	}
 }
 
-void
-ev_view_find_changed (EvView *view, GList **results, gint page)
+static void
+ev_view_find_update (EvView *view, gint page)
 {
-	view->find_pages = results;
-	
 	if (view->jump_to_find_result == TRUE) {
 		jump_to_find_page (view, EV_VIEW_FIND_NEXT, 0);
 		jump_to_find_result (view);
@@ -5724,11 +6061,97 @@ ev_view_find_changed (EvView *view, GList **results, gint page)
 		gtk_widget_queue_draw (GTK_WIDGET (view));
 }
 
+/**
+ * ev_view_find_changed: (skip)
+ * @view: an #EvView
+ * @results: the results of ev_job_find_get_results()
+ * @page: the page whose results changed
+ *
+ * Deprecated: 3.6: Use ev_view_find_results_changed() instead, which
+ *     doesn't need the results of every page in a list
+ */
+void
+ev_view_find_changed (EvView *view, GList **results, gint page)
+{
+	ev_view_find_clear_results (view);
+	view->find_pages = results;
+
+	ev_view_find_update (view, page);
+}
+
+/**
+ * ev_view_find_results_changed:
+ * @view: an #EvView
+ * @job: the #EvJobFind whose results are shown
+ * @page: the page whose results changed
+ *
+ * Updates the find results highlighted in @view. This is usually
+ * called from the #EvJobFind::updated signal handler.
+ *
+ * Since: 3.6
+ */
+void
+ev_view_find_results_changed (EvView    *view,
+			      EvJobFind *job,
+			      gint       page)
+{
+	g_return_if_fail (EV_IS_VIEW (view));
+	g_return_if_fail (EV_IS_JOB_FIND (job));
+
+	if (view->find_job != job) {
+		ev_view_find_clear_results (view);
+		view->find_job = g_object_ref (job);
+	}
+
+	ev_view_find_update (view, page);
+}
+
+/* Moves @delta matches from the current one, in document order. The
+ * job knows how many matches precede every page, so this doesn't have
+ * to look at the pages in between.
+ */
+static void
+ev_view_find_move_from_job (EvView *view,
+			    gint    delta)
+{
+	gint n_total;
+	gint n, page, result;
+
+	n_total = ev_job_find_get_n_total_results (view->find_job);
+	if (n_total == 0)
+		return;
+
+	/* Without matches in the current page, the next one is the
+	 * first match of the following pages
+	 */
+	n = ev_job_find_get_result_offset (view->find_job, view->current_page);
+	if (ev_job_find_get_n_results (view->find_job, view->current_page) > 0)
+		n += view->find_result + delta;
+	else if (delta < 0)
+		n += delta;
+	n = (n % n_total + n_total) % n_total;
+
+	if (!ev_job_find_get_nth_result (view->find_job, n, &page, &result))
+		return;
+
+	if (page != view->current_page)
+		ev_document_model_set_page (view->model, page);
+	view->find_result = result;
+
+	jump_to_find_result (view);
+	gtk_widget_queue_draw (GTK_WIDGET (view));
+}
+
 void
 ev_view_find_next (EvView *view)
 {
 	gint n_results;
 
+	if (view->find_job) {
+		ev_view_find_move_from_job (view, 1);
+		return;
+	}
+
 	n_results = ev_view_find_get_n_results (view, view->current_page);
 	view->find_result++;
 
@@ -5745,6 +6168,11 @@ ev_view_find_next (EvView *view)
 void
 ev_view_find_previous (EvView *view)
 {
+	if (view->find_job) {
+		ev_view_find_move_from_job (view, -1);
+		return;
+	}
+
 	view->find_result--;
 
 	if (view->find_result < 0) {
@@ -5762,7 +6190,7 @@ ev_view_find_search_changed (EvView *view)
 {
 	/* search string has changed, focus on new search result */
 	view->jump_to_find_result = TRUE;
-	view->find_pages = NULL;
+	ev_view_find_clear_results (view);
 }
 
 void
@@ -5775,7 +6203,7 @@ ev_view_find_set_highlight_search (EvView *view, gboolean value)
 void
 ev_view_find_cancel (EvView *view)
 {
-	view->find_pages = NULL;
+	ev_view_find_clear_results (view);
 }
 
 /*** Synctex ***/
@@ -5962,13 +6390,22 @@ merge_selection_region (EvView *view,
 {
 	GList *old_list;
 	GList *new_list_ptr, *old_list_ptr;
+	gboolean from_layout;
 
-	/* Update the selection */
-	old_list = ev_pixbuf_cache_get_selection_list (view->pixbuf_cache);
-	g_list_foreach (view->selection_info.selections, (GFunc)selection_free, NULL);
-	g_list_free (view->selection_info.selections);
+	/* Update the selection. When painting from the text layout the
+	 * pixbuf cache only renders the selection of pages whose layout
+	 * isn't in the page cache, because it was evicted or not fetched yet.
+	 */
+	from_layout = ev_view_selection_from_layout (view);
+	if (from_layout) {
+		old_list = view->selection_info.selections;
+	} else {
+		old_list = ev_pixbuf_cache_get_selection_list (view->pixbuf_cache);
+		g_list_foreach (view->selection_info.selections, (GFunc)selection_free, NULL);
+		g_list_free (view->selection_info.selections);
+	}
 	view->selection_info.selections = new_list;
-	ev_pixbuf_cache_set_selection_list (view->pixbuf_cache, new_list);
+	ev_view_update_rendered_selections (view);
 	g_signal_emit (view, signals[SIGNAL_SELECTION_CHANGED], 0, NULL);
 
 	new_list_ptr = new_list;
@@ -6011,7 +6448,10 @@ merge_selection_region (EvView *view,
 
 		/* seed the cache with a new page.  We are going to need the new
 		 * region too. */
-		if (new_sel) {
+		if (new_sel && from_layout)
+			update_selection_region_from_layout (view, new_sel);
+
+		if (new_sel && !new_sel->covered_region) {
 			cairo_region_t *tmp_region = NULL;
 
 			ev_pixbuf_cache_get_selection_surface (view->pixbuf_cache,
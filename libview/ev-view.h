@@ -29,6 +29,7 @@
 #include <evince-document.h>
 
 #include "ev-document-model.h"
+#include "ev-jobs.h"
 
 G_BEGIN_DECLS
 
@@ -74,9 +75,13 @@ void            ev_view_find_previous             (EvView         *view);
 void            ev_view_find_search_changed       (EvView         *view);
 void     	ev_view_find_set_highlight_search (EvView         *view,
 						   gboolean        value);
+EV_DEPRECATED_FOR(ev_view_find_results_changed)
 void            ev_view_find_changed              (EvView         *view,
 						   GList         **results,
 						   gint            page);
+void            ev_view_find_results_changed      (EvView         *view,
+						   EvJobFind      *job,
+						   gint            page);
 void            ev_view_find_cancel               (EvView         *view);
 
 /* Synctex */
@@ -58,10 +58,19 @@ struct _EvSidebarAnnotationsPrivate {
 
 	EvJob       *job;
 	guint        selection_changed_id;
+
+	/* Model being filled by the job */
+	GtkTreeStore *model;
+	GdkPixbuf    *text_icon;
+	GdkPixbuf    *attachment_icon;
+
+	/* Annotations shown in the tree view */
+	GList        *mapping_lists;
 };
 
 static void ev_sidebar_annotations_page_iface_init (EvSidebarPageInterface *iface);
 static void ev_sidebar_annotations_load            (EvSidebarAnnotations   *sidebar_annots);
+static void ev_sidebar_annotations_clear_job       (EvSidebarAnnotations   *sidebar_annots);
 
 static guint signals[N_SIGNALS];
 
@@ -86,6 +95,14 @@ ev_sidebar_annotations_dispose (GObject *object)
 		priv->document = NULL;
 	}
 
+	ev_sidebar_annotations_clear_job (sidebar_annots);
+
+	if (priv->mapping_lists) {
+		g_list_foreach (priv->mapping_lists, (GFunc)ev_mapping_list_unref, NULL);
+		g_list_free (priv->mapping_lists);
+		priv->mapping_lists = NULL;
+	}
+
 	G_OBJECT_CLASS (ev_sidebar_annotations_parent_class)->dispose (object);
 }
 
@@ -341,140 +358,186 @@ selection_changed_cb (GtkTreeSelection     *selection,
 	}
 }
 
+/* Replaces the model of the tree view, and releases the
+ * annotations of the previous one
+ */
 static void
-job_finished_callback (EvJobAnnots          *job,
-		       EvSidebarAnnotations *sidebar_annots)
+ev_sidebar_annotations_set_tree_model (EvSidebarAnnotations *sidebar_annots,
+				       GtkTreeModel         *model)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
+
+	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), model);
+
+	if (priv->mapping_lists) {
+		g_list_foreach (priv->mapping_lists, (GFunc)ev_mapping_list_unref, NULL);
+		g_list_free (priv->mapping_lists);
+		priv->mapping_lists = NULL;
+	}
+}
+
+static void
+job_updated_callback (EvJobAnnots          *job,
+		      EvMappingList        *mapping_list,
+		      EvSidebarAnnotations *sidebar_annots)
 {
 	EvSidebarAnnotationsPrivate *priv;
-	GtkTreeStore *model;
-	GtkTreeSelection *selection;
 	GList *l;
-	GdkPixbuf *text_icon = NULL;
-	GdkPixbuf *attachment_icon = NULL;
+	gchar *page_label;
+	GtkTreeIter iter;
+	gboolean found = FALSE;
 
 	priv = sidebar_annots->priv;
 
-	if (!job->annots) {
-		GtkTreeModel *list;
+	if (!priv->model) {
+		GtkTreeSelection *selection;
 
-		list = ev_sidebar_annotations_create_simple_model (_("Document contains no annotations"));
-		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), list);
-		g_object_unref (list);
+		priv->model = gtk_tree_store_new (N_COLUMNS,
+						  G_TYPE_STRING,
+						  GDK_TYPE_PIXBUF,
+						  G_TYPE_POINTER);
 
-		g_object_unref (job);
-		priv->job = NULL;
+		/* Show the annotations as they are found */
+		ev_sidebar_annotations_set_tree_model (sidebar_annots, GTK_TREE_MODEL (priv->model));
 
-		return;
+		selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
+		gtk_tree_selection_set_mode (selection, GTK_SELECTION_SINGLE);
+		if (priv->selection_changed_id == 0) {
+			priv->selection_changed_id =
+				g_signal_connect (selection, "changed",
+						  G_CALLBACK (selection_changed_cb),
+						  sidebar_annots);
+		}
 	}
 
-	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
-	gtk_tree_selection_set_mode (selection, GTK_SELECTION_SINGLE);
-	if (priv->selection_changed_id == 0) {
-		priv->selection_changed_id =
-			g_signal_connect (selection, "changed",
-					  G_CALLBACK (selection_changed_cb),
-					  sidebar_annots);
-	}
+	page_label = g_strdup_printf (_("Page %d"),
+				      ev_mapping_list_get_page (mapping_list) + 1);
+	gtk_tree_store_append (priv->model, &iter, NULL);
+	gtk_tree_store_set (priv->model, &iter,
+			    COLUMN_MARKUP, page_label,
+			    -1);
+	g_free (page_label);
+
+	for (l = ev_mapping_list_get_list (mapping_list); l; l = g_list_next (l)) {
+		EvAnnotation *annot;
+		const gchar  *label;
+		const gchar  *modified;
+		gchar        *markup;
+		GtkTreeIter   child_iter;
+		GdkPixbuf    *pixbuf = NULL;
+
+		annot = ((EvMapping *)(l->data))->data;
+		if (!EV_IS_ANNOTATION_MARKUP (annot))
+			continue;
+
+		label = ev_annotation_markup_get_label (EV_ANNOTATION_MARKUP (annot));
+		modified = ev_annotation_get_modified (annot);
+		if (modified) {
+			markup = g_strdup_printf ("<span weight=\"bold\">%s</span>\n%s",
+						  label, modified);
+		} else {
+			markup = g_strdup_printf ("<span weight=\"bold\">%s</span>", label);
+		}
 
-	model = gtk_tree_store_new (N_COLUMNS,
-				    G_TYPE_STRING,
-				    GDK_TYPE_PIXBUF,
-				    G_TYPE_POINTER);
-
-	for (l = job->annots; l; l = g_list_next (l)) {
-		EvMappingList *mapping_list;
-		GList         *ll;
-		gchar         *page_label;
-		GtkTreeIter    iter;
-		gboolean       found = FALSE;
-
-		mapping_list = (EvMappingList *)l->data;
-		page_label = g_strdup_printf (_("Page %d"),
-					      ev_mapping_list_get_page (mapping_list) + 1);
-		gtk_tree_store_append (model, &iter, NULL);
-		gtk_tree_store_set (model, &iter,
-				    COLUMN_MARKUP, page_label,
-				    -1);
-		g_free (page_label);
-
-		for (ll = ev_mapping_list_get_list (mapping_list); ll; ll = g_list_next (ll)) {
-			EvAnnotation *annot;
-			const gchar  *label;
-			const gchar  *modified;
-			gchar        *markup;
-			GtkTreeIter   child_iter;
-			GdkPixbuf    *pixbuf = NULL;
-
-			annot = ((EvMapping *)(ll->data))->data;
-			if (!EV_IS_ANNOTATION_MARKUP (annot))
-				continue;
-
-			label = ev_annotation_markup_get_label (EV_ANNOTATION_MARKUP (annot));
-			modified = ev_annotation_get_modified (annot);
-			if (modified) {
-				markup = g_strdup_printf ("<span weight=\"bold\">%s</span>\n%s",
-							  label, modified);
-			} else {
-				markup = g_strdup_printf ("<span weight=\"bold\">%s</span>", label);
+		if (EV_IS_ANNOTATION_TEXT (annot)) {
+			if (!priv->text_icon) {
+				/* FIXME: use a better icon than EDIT */
+				priv->text_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+										 GTK_STOCK_EDIT,
+										 GTK_ICON_SIZE_BUTTON);
 			}
-
-			if (EV_IS_ANNOTATION_TEXT (annot)) {
-				if (!text_icon) {
-					/* FIXME: use a better icon than EDIT */
-					text_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
-                                                                                   GTK_STOCK_EDIT,
-                                                                                   GTK_ICON_SIZE_BUTTON);
-				}
-				pixbuf = text_icon;
-			} else if (EV_IS_ANNOTATION_ATTACHMENT (annot)) {
-				if (!attachment_icon) {
-					attachment_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
-                                                                                         EV_STOCK_ATTACHMENT,
-                                                                                         GTK_ICON_SIZE_BUTTON);
-				}
-				pixbuf = attachment_icon;
+			pixbuf = priv->text_icon;
+		} else if (EV_IS_ANNOTATION_ATTACHMENT (annot)) {
+			if (!priv->attachment_icon) {
+				priv->attachment_icon = gtk_widget_render_icon_pixbuf (priv->tree_view,
+										       EV_STOCK_ATTACHMENT,
+										       GTK_ICON_SIZE_BUTTON);
 			}
-
-			gtk_tree_store_append (model, &child_iter, &iter);
-			gtk_tree_store_set (model, &child_iter,
-					    COLUMN_MARKUP, markup,
-					    COLUMN_ICON, pixbuf,
-					    COLUMN_ANNOT_MAPPING, ll->data,
-					    -1);
-			g_free (markup);
-			found = TRUE;
+			pixbuf = priv->attachment_icon;
 		}
 
-		if (!found)
-			gtk_tree_store_remove (model, &iter);
+		gtk_tree_store_append (priv->model, &child_iter, &iter);
+		gtk_tree_store_set (priv->model, &child_iter,
+				    COLUMN_MARKUP, markup,
+				    COLUMN_ICON, pixbuf,
+				    COLUMN_ANNOT_MAPPING, l->data,
+				    -1);
+		g_free (markup);
+		found = TRUE;
 	}
 
-	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view),
-				 GTK_TREE_MODEL (model));
-	g_object_unref (model);
+	if (found) {
+		/* The model keeps pointers to the mappings */
+		priv->mapping_lists = g_list_prepend (priv->mapping_lists,
+						      ev_mapping_list_ref (mapping_list));
+	} else {
+		gtk_tree_store_remove (priv->model, &iter);
+	}
+}
+
+static void
+job_finished_callback (EvJobAnnots          *job,
+		       EvSidebarAnnotations *sidebar_annots)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
 
-	if (text_icon)
-		g_object_unref (text_icon);
-	if (attachment_icon)
-		g_object_unref (attachment_icon);
+	if (!priv->model || !priv->mapping_lists) {
+		GtkTreeModel *list;
+
+		list = ev_sidebar_annotations_create_simple_model (_("Document contains no annotations"));
+		ev_sidebar_annotations_set_tree_model (sidebar_annots, list);
+		g_object_unref (list);
+	}
 
-	g_object_unref (job);
-	priv->job = NULL;
+	ev_sidebar_annotations_clear_job (sidebar_annots);
 }
 
 static void
-ev_sidebar_annotations_load (EvSidebarAnnotations *sidebar_annots)
+ev_sidebar_annotations_clear_job (EvSidebarAnnotations *sidebar_annots)
 {
 	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
 
 	if (priv->job) {
+		if (!ev_job_is_finished (priv->job))
+			ev_job_cancel (priv->job);
+
+		g_signal_handlers_disconnect_by_func (priv->job,
+						      job_updated_callback,
+						      sidebar_annots);
 		g_signal_handlers_disconnect_by_func (priv->job,
 						      job_finished_callback,
 						      sidebar_annots);
 		g_object_unref (priv->job);
+		priv->job = NULL;
+	}
+
+	if (priv->model) {
+		g_object_unref (priv->model);
+		priv->model = NULL;
+	}
+
+	if (priv->text_icon) {
+		g_object_unref (priv->text_icon);
+		priv->text_icon = NULL;
+	}
+
+	if (priv->attachment_icon) {
+		g_object_unref (priv->attachment_icon);
+		priv->attachment_icon = NULL;
 	}
+}
+
+static void
+ev_sidebar_annotations_load (EvSidebarAnnotations *sidebar_annots)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
+
+	ev_sidebar_annotations_clear_job (sidebar_annots);
 
 	priv->job = ev_job_annots_new (priv->document);
+	g_signal_connect (priv->job, "updated",
+			  G_CALLBACK (job_updated_callback),
+			  sidebar_annots);
 	g_signal_connect (priv->job, "finished",
 			  G_CALLBACK (job_finished_callback),
 			  sidebar_annots);
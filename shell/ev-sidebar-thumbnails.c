@@ -32,9 +32,12 @@
 #include <gtk/gtk.h>
 
 #include "ev-document-misc.h"
+#include "ev-document-security.h"
 #include "ev-job-scheduler.h"
 #include "ev-sidebar-page.h"
 #include "ev-sidebar-thumbnails.h"
+#include "ev-thumbnails-cache.h"
+#include "ev-thumbnails-model.h"
 #include "ev-utils.h"
 #include "ev-window.h"
 
@@ -44,29 +47,15 @@
  * limit its use */
 #define MAX_ICON_VIEW_PAGE_COUNT 1500
 
-typedef struct _EvThumbsSize
-{
-	gint width;
-	gint height;
-} EvThumbsSize;
-
-typedef struct _EvThumbsSizeCache {
-	gboolean uniform;
-	gint uniform_width;
-	gint uniform_height;
-	EvThumbsSize *sizes;
-} EvThumbsSizeCache;
-
 struct _EvSidebarThumbnailsPrivate {
 	GtkWidget *swindow;
 	GtkWidget *icon_view;
 	GtkWidget *tree_view;
 	GtkAdjustment *vadjustment;
-	GtkListStore *list_store;
-	GHashTable *loading_icons;
+	EvThumbnailsModel *thumbnails_model;
+	EvThumbnailsCache *thumbnails_cache;
 	EvDocument *document;
 	EvDocumentModel *model;
-	EvThumbsSizeCache *size_cache;
 
 	gint n_pages, pages_done;
 
@@ -77,20 +66,14 @@ struct _EvSidebarThumbnailsPrivate {
 	gint start_page, end_page;
 };
 
-enum {
-	COLUMN_PAGE_STRING,
-	COLUMN_PIXBUF,
-	COLUMN_THUMBNAIL_SET,
-	COLUMN_JOB,
-	NUM_COLUMNS
-};
-
 enum {
 	PROP_0,
 	PROP_WIDGET,
 };
 
 static void         ev_sidebar_thumbnails_clear_model      (EvSidebarThumbnails     *sidebar);
+static void         ev_sidebar_thumbnails_clear_job        (EvJob                   *job,
+							    EvSidebarThumbnails     *sidebar_thumbnails);
 static gboolean     ev_sidebar_thumbnails_support_document (EvSidebarPage           *sidebar_page,
 							    EvDocument              *document);
 static void         ev_sidebar_thumbnails_page_iface_init  (EvSidebarPageInterface  *iface);
@@ -109,129 +92,12 @@ G_DEFINE_TYPE_EXTENDED (EvSidebarThumbnails,
 #define EV_SIDEBAR_THUMBNAILS_GET_PRIVATE(object) \
 	(G_TYPE_INSTANCE_GET_PRIVATE ((object), EV_TYPE_SIDEBAR_THUMBNAILS, EvSidebarThumbnailsPrivate));
 
-/* Thumbnails dimensions cache */
-#define EV_THUMBNAILS_SIZE_CACHE_KEY "ev-thumbnails-size-cache"
-
-static void
-get_thumbnail_size_for_page (EvDocument *document,
-			     guint       page,
-			     gint       *width,
-			     gint       *height)
-{
-	gdouble scale;
-	gdouble w, h;
-
-	ev_document_get_page_size (document, page, &w, &h);
-	scale = (gdouble)THUMBNAIL_WIDTH / w;
-
-	*width = MAX ((gint)(w * scale + 0.5), 1);
-	*height = MAX ((gint)(h * scale + 0.5), 1);
-}
-
-static EvThumbsSizeCache *
-ev_thumbnails_size_cache_new (EvDocument *document)
-{
-	EvThumbsSizeCache *cache;
-	gint               i, n_pages;
-	EvThumbsSize      *thumb_size;
-
-	cache = g_new0 (EvThumbsSizeCache, 1);
-
-	if (ev_document_is_page_size_uniform (document)) {
-		cache->uniform = TRUE;
-		get_thumbnail_size_for_page (document, 0,
-					     &cache->uniform_width,
-					     &cache->uniform_height);
-		return cache;
-	}
-
-	n_pages = ev_document_get_n_pages (document);
-	cache->sizes = g_new0 (EvThumbsSize, n_pages);
-
-	for (i = 0; i < n_pages; i++) {
-		thumb_size = &(cache->sizes[i]);
-		get_thumbnail_size_for_page (document, i,
-					     &thumb_size->width,
-					     &thumb_size->height);
-	}
-
-	return cache;
-}
-
-static void
-ev_thumbnails_size_cache_get_size (EvThumbsSizeCache *cache,
-				   gint               page,
-				   gint               rotation,
-				   gint              *width,
-				   gint              *height)
-{
-	gint w, h;
-
-	if (cache->uniform) {
-		w = cache->uniform_width;
-		h = cache->uniform_height;
-	} else {
-		EvThumbsSize *thumb_size;
-
-		thumb_size = &(cache->sizes[page]);
-
-		w = thumb_size->width;
-		h = thumb_size->height;
-	}
-
-	if (rotation == 0 || rotation == 180) {
-		if (width) *width = w;
-		if (height) *height = h;
-	} else {
-		if (width) *width = h;
-		if (height) *height = w;
-	}
-}
-
-static void
-ev_thumbnails_size_cache_free (EvThumbsSizeCache *cache)
-{
-	if (cache->sizes) {
-		g_free (cache->sizes);
-		cache->sizes = NULL;
-	}
-
-	g_free (cache);
-}
-
-static EvThumbsSizeCache *
-ev_thumbnails_size_cache_get (EvDocument *document)
-{
-	EvThumbsSizeCache *cache;
-
-	cache = g_object_get_data (G_OBJECT (document), EV_THUMBNAILS_SIZE_CACHE_KEY);
-	if (!cache) {
-		cache = ev_thumbnails_size_cache_new (document);
-		g_object_set_data_full (G_OBJECT (document),
-					EV_THUMBNAILS_SIZE_CACHE_KEY,
-					cache,
-					(GDestroyNotify)ev_thumbnails_size_cache_free);
-	}
-
-	return cache;
-}
-
-
 static void
 ev_sidebar_thumbnails_dispose (GObject *object)
 {
 	EvSidebarThumbnails *sidebar_thumbnails = EV_SIDEBAR_THUMBNAILS (object);
-	
-	if (sidebar_thumbnails->priv->loading_icons) {
-		g_hash_table_destroy (sidebar_thumbnails->priv->loading_icons);
-		sidebar_thumbnails->priv->loading_icons = NULL;
-	}
-	
-	if (sidebar_thumbnails->priv->list_store) {
-		ev_sidebar_thumbnails_clear_model (sidebar_thumbnails);
-		g_object_unref (sidebar_thumbnails->priv->list_store);
-		sidebar_thumbnails->priv->list_store = NULL;
-	}
+
+	ev_sidebar_thumbnails_clear_model (sidebar_thumbnails);
 
 	G_OBJECT_CLASS (ev_sidebar_thumbnails_parent_class)->dispose (object);
 }
@@ -299,82 +165,27 @@ ev_sidebar_thumbnails_new (void)
 	return ev_sidebar_thumbnails;
 }
 
-static GdkPixbuf *
-ev_sidebar_thumbnails_get_loading_icon (EvSidebarThumbnails *sidebar_thumbnails,
-					gint                 width,
-					gint                 height)
-{
-	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
-	GdkPixbuf *icon;
-	gchar     *key;
-
-	key = g_strdup_printf ("%dx%d", width, height);
-	icon = g_hash_table_lookup (priv->loading_icons, key);
-	if (!icon) {
-		gboolean inverted_colors;
-
-		inverted_colors = ev_document_model_get_inverted_colors (priv->model);
-		icon = ev_document_misc_get_loading_thumbnail (width, height, inverted_colors);
-		g_hash_table_insert (priv->loading_icons, key, icon);
-	} else {
-		g_free (key);
-	}
-	
-	return icon;
-}
-
 static void
 clear_range (EvSidebarThumbnails *sidebar_thumbnails,
 	     gint                 start_page,
 	     gint                 end_page)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
-	GtkTreePath *path;
-	GtkTreeIter iter;
-	gboolean result;
-	gint prev_width = -1;
-	gint prev_height = -1;
+	gint page;
 
 	g_assert (start_page <= end_page);
 
-	path = gtk_tree_path_new_from_indices (start_page, -1);
-	for (result = gtk_tree_model_get_iter (GTK_TREE_MODEL (priv->list_store), &iter, path);
-	     result && start_page <= end_page;
-	     result = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->list_store), &iter), start_page ++) {
-		EvJobThumbnail *job;
-		GdkPixbuf *loading_icon = NULL;
-		gint width, height;
-
-		gtk_tree_model_get (GTK_TREE_MODEL (priv->list_store),
-				    &iter,
-				    COLUMN_JOB, &job,
-				    -1);
+	for (page = start_page; page <= end_page; page++) {
+		EvJob *job;
 
+		job = ev_thumbnails_model_get_job (priv->thumbnails_model, page);
 		if (job) {
 			g_signal_handlers_disconnect_by_func (job, thumbnail_job_completed_callback, sidebar_thumbnails);
-			ev_job_cancel (EV_JOB (job));
-			g_object_unref (job);
+			ev_job_cancel (job);
 		}
 
-		ev_thumbnails_size_cache_get_size (priv->size_cache, start_page,
-						  priv->rotation,
-						  &width, &height);
-		if (!loading_icon || (width != prev_width && height != prev_height)) {
-			loading_icon =
-				ev_sidebar_thumbnails_get_loading_icon (sidebar_thumbnails,
-									width, height);
-		}
-
-		prev_width = width;
-		prev_height = height;
-
-		gtk_list_store_set (priv->list_store, &iter,
-				    COLUMN_JOB, NULL,
-				    COLUMN_THUMBNAIL_SET, FALSE,
-				    COLUMN_PIXBUF, loading_icon,
-				    -1);
+		ev_thumbnails_model_clear_page (priv->thumbnails_model, page);
 	}
-	gtk_tree_path_free (path);
 }
 
 static gdouble
@@ -395,48 +206,32 @@ add_range (EvSidebarThumbnails *sidebar_thumbnails,
 	   gint                 end_page)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
-	GtkTreePath *path;
-	GtkTreeIter iter;
-	gboolean result;
-	gint page = start_page;
+	gint page;
 
 	g_assert (start_page <= end_page);
 
-	path = gtk_tree_path_new_from_indices (start_page, -1);
-	for (result = gtk_tree_model_get_iter (GTK_TREE_MODEL (priv->list_store), &iter, path);
-	     result && page <= end_page;
-	     result = gtk_tree_model_iter_next (GTK_TREE_MODEL (priv->list_store), &iter), page ++) {
+	for (page = start_page; page <= end_page && page < priv->n_pages; page++) {
 		EvJob *job;
-		gboolean thumbnail_set;
-
-		gtk_tree_model_get (GTK_TREE_MODEL (priv->list_store), &iter,
-				    COLUMN_JOB, &job,
-				    COLUMN_THUMBNAIL_SET, &thumbnail_set,
-				    -1);
-
-		if (job == NULL && !thumbnail_set) {
-			job = ev_job_thumbnail_new (priv->document,
-						    page, priv->rotation,
-						    get_scale_for_page (sidebar_thumbnails, page));
-			ev_job_scheduler_push_job (EV_JOB (job), EV_JOB_PRIORITY_HIGH);
-			
-			g_object_set_data_full (G_OBJECT (job), "tree_iter",
-						gtk_tree_iter_copy (&iter),
-						(GDestroyNotify) gtk_tree_iter_free);
-			g_signal_connect (job, "finished",
-					  G_CALLBACK (thumbnail_job_completed_callback),
-					  sidebar_thumbnails);
-			gtk_list_store_set (priv->list_store, &iter,
-					    COLUMN_JOB, job,
-					    -1);
-			
-			/* The queue and the list own a ref to the job now */
-			g_object_unref (job);
-		} else if (job) {
-			g_object_unref (job);
-		}
+
+		if (ev_thumbnails_model_get_job (priv->thumbnails_model, page) ||
+		    ev_thumbnails_model_has_thumbnail (priv->thumbnails_model, page))
+			continue;
+
+		job = ev_job_thumbnail_new (priv->document,
+					    page, priv->rotation,
+					    get_scale_for_page (sidebar_thumbnails, page));
+		/* The job reads the stored thumbnail, if any */
+		ev_job_thumbnail_set_cache (EV_JOB_THUMBNAIL (job), priv->thumbnails_cache);
+		ev_job_scheduler_push_job (EV_JOB (job), EV_JOB_PRIORITY_HIGH);
+
+		g_signal_connect (job, "finished",
+				  G_CALLBACK (thumbnail_job_completed_callback),
+				  sidebar_thumbnails);
+		ev_thumbnails_model_set_job (priv->thumbnails_model, page, job);
+
+		/* The queue and the model own a ref to the job now */
+		g_object_unref (job);
 	}
-	gtk_tree_path_free (path);
 }
 
 /* This modifies start */
@@ -525,44 +320,58 @@ adjustment_changed_cb (EvSidebarThumbnails *sidebar_thumbnails)
 	gtk_tree_path_free (path2);
 }
 
+/* Compressed and remote documents are loaded from a temp copy, so the
+ * thumbnails are stored for the file the window opened. Thumbnails of
+ * protected documents are never written to disk.
+ */
+static EvThumbnailsCache *
+ev_sidebar_thumbnails_create_cache (EvSidebarThumbnails *sidebar_thumbnails)
+{
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+	GtkWidget                  *window;
+	const gchar                *uri = NULL;
+
+	if (EV_IS_DOCUMENT_SECURITY (priv->document) &&
+	    ev_document_security_has_document_security (EV_DOCUMENT_SECURITY (priv->document)))
+		return NULL;
+
+	window = gtk_widget_get_toplevel (GTK_WIDGET (sidebar_thumbnails));
+	if (EV_IS_WINDOW (window)) {
+		if (ev_window_is_document_protected (EV_WINDOW (window)))
+			return NULL;
+		uri = ev_window_get_uri (EV_WINDOW (window));
+	}
+	if (!uri)
+		uri = ev_document_get_uri (priv->document);
+	if (!uri)
+		return NULL;
+
+	/* The model inverts the colors of the thumbnails,
+	 * so only the rotation picks a different store
+	 */
+	return ev_thumbnails_cache_new (uri, priv->rotation, THUMBNAIL_WIDTH);
+}
+
 static void
 ev_sidebar_thumbnails_fill_model (EvSidebarThumbnails *sidebar_thumbnails)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
-	GtkTreeIter iter;
-	int i;
-	gint prev_width = -1;
-	gint prev_height = -1;
-
-	for (i = 0; i < sidebar_thumbnails->priv->n_pages; i++) {
-		gchar     *page_label;
-		gchar     *page_string;
-		GdkPixbuf *loading_icon = NULL;
-		gint       width, height;
-
-		page_label = ev_document_get_page_label (priv->document, i);
-		page_string = g_markup_printf_escaped ("<i>%s</i>", page_label);
-		ev_thumbnails_size_cache_get_size (sidebar_thumbnails->priv->size_cache, i,
-						  sidebar_thumbnails->priv->rotation,
-						  &width, &height);
-		if (!loading_icon || (width != prev_width && height != prev_height)) {
-			loading_icon =
-				ev_sidebar_thumbnails_get_loading_icon (sidebar_thumbnails,
-									width, height);
-		}
 
-		prev_width = width;
-		prev_height = height;
-		
-		gtk_list_store_append (priv->list_store, &iter);
-		gtk_list_store_set (priv->list_store, &iter,
-				    COLUMN_PAGE_STRING, page_string,
-				    COLUMN_PIXBUF, loading_icon,
-				    COLUMN_THUMBNAIL_SET, FALSE,
-				    -1);
-		g_free (page_label);
-		g_free (page_string);
-	}
+	/* Rows are made up by the model when shown, so this
+	 * doesn't depend on the number of pages
+	 */
+	priv->thumbnails_model = ev_thumbnails_model_new (priv->document,
+							  THUMBNAIL_WIDTH,
+							  priv->rotation,
+							  priv->inverted_colors);
+	priv->thumbnails_cache = ev_sidebar_thumbnails_create_cache (sidebar_thumbnails);
+
+	if (priv->tree_view)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view),
+					 GTK_TREE_MODEL (priv->thumbnails_model));
+	else if (priv->icon_view)
+		gtk_icon_view_set_model (GTK_ICON_VIEW (priv->icon_view),
+					 GTK_TREE_MODEL (priv->thumbnails_model));
 }
 
 static void
@@ -577,7 +386,7 @@ ev_sidebar_tree_selection_changed (GtkTreeSelection *selection,
 	if (!gtk_tree_selection_get_selected (selection, NULL, &iter))
 		return;
 
-	path = gtk_tree_model_get_path (GTK_TREE_MODEL (priv->list_store),
+	path = gtk_tree_model_get_path (GTK_TREE_MODEL (priv->thumbnails_model),
 					&iter);
 	page = gtk_tree_path_get_indices (path)[0];
 	gtk_tree_path_free (path);
@@ -618,7 +427,7 @@ ev_sidebar_init_tree_view (EvSidebarThumbnails *ev_sidebar_thumbnails)
 	GtkCellRenderer *renderer;
 
 	priv = ev_sidebar_thumbnails->priv;
-	priv->tree_view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (priv->list_store));
+	priv->tree_view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (priv->thumbnails_model));
 
 	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
 	g_signal_connect (selection, "changed",
@@ -630,11 +439,11 @@ ev_sidebar_init_tree_view (EvSidebarThumbnails *ev_sidebar_thumbnails)
 				 NULL);
 	gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (priv->tree_view), -1,
 						     NULL, renderer,
-						     "pixbuf", 1,
+						     "pixbuf", EV_THUMBNAILS_MODEL_COLUMN_PIXBUF,
 						     NULL);
 	gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (priv->tree_view), -1,
 						     NULL, gtk_cell_renderer_text_new (),
-						     "markup", 0, NULL);
+						     "markup", EV_THUMBNAILS_MODEL_COLUMN_PAGE_STRING, NULL);
 	gtk_container_add (GTK_CONTAINER (priv->swindow), priv->tree_view);
 	gtk_widget_show (priv->tree_view);
 }
@@ -646,9 +455,11 @@ ev_sidebar_init_icon_view (EvSidebarThumbnails *ev_sidebar_thumbnails)
 
 	priv = ev_sidebar_thumbnails->priv;
 
-	priv->icon_view = gtk_icon_view_new_with_model (GTK_TREE_MODEL (priv->list_store));
-	gtk_icon_view_set_markup_column (GTK_ICON_VIEW (priv->icon_view), 0);
-	gtk_icon_view_set_pixbuf_column (GTK_ICON_VIEW (priv->icon_view), 1);
+	priv->icon_view = gtk_icon_view_new_with_model (GTK_TREE_MODEL (priv->thumbnails_model));
+	gtk_icon_view_set_markup_column (GTK_ICON_VIEW (priv->icon_view),
+					 EV_THUMBNAILS_MODEL_COLUMN_PAGE_STRING);
+	gtk_icon_view_set_pixbuf_column (GTK_ICON_VIEW (priv->icon_view),
+					 EV_THUMBNAILS_MODEL_COLUMN_PIXBUF);
 	g_signal_connect (priv->icon_view, "selection-changed",
 			  G_CALLBACK (ev_sidebar_icon_selection_changed), ev_sidebar_thumbnails);
 
@@ -671,12 +482,6 @@ ev_sidebar_thumbnails_init (EvSidebarThumbnails *ev_sidebar_thumbnails)
 
 	priv = ev_sidebar_thumbnails->priv = EV_SIDEBAR_THUMBNAILS_GET_PRIVATE (ev_sidebar_thumbnails);
 
-	priv->list_store = gtk_list_store_new (NUM_COLUMNS,
-					       G_TYPE_STRING,
-					       GDK_TYPE_PIXBUF,
-					       G_TYPE_BOOLEAN,
-					       EV_TYPE_JOB_THUMBNAIL);
-
 	priv->swindow = gtk_scrolled_window_new (NULL, NULL);
 
 	gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (priv->swindow),
@@ -748,9 +553,6 @@ ev_sidebar_thumbnails_reload (EvSidebarThumbnails *sidebar_thumbnails)
 {
 	EvDocumentModel *model;
 
-	if (sidebar_thumbnails->priv->loading_icons)
-		g_hash_table_remove_all (sidebar_thumbnails->priv->loading_icons);
-
 	if (sidebar_thumbnails->priv->document == NULL ||
 	    sidebar_thumbnails->priv->n_pages <= 0)
 		return;
@@ -773,10 +575,44 @@ ev_sidebar_thumbnails_rotation_changed_cb (EvDocumentModel     *model,
 					   GParamSpec          *pspec,
 					   EvSidebarThumbnails *sidebar_thumbnails)
 {
-	gint rotation = ev_document_model_get_rotation (model);
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
 
-	sidebar_thumbnails->priv->rotation = rotation;
-	ev_sidebar_thumbnails_reload (sidebar_thumbnails);
+	priv->rotation = ev_document_model_get_rotation (model);
+	if (!priv->thumbnails_model)
+		return;
+
+	/* The thumbnails we have are rotated instead of rendered again,
+	 * only the jobs for the previous rotation are dropped
+	 */
+	ev_thumbnails_model_foreach_job (priv->thumbnails_model,
+					 (GFunc)ev_sidebar_thumbnails_clear_job,
+					 sidebar_thumbnails);
+
+	/* Rows change their size, so the view takes the model again */
+	if (priv->tree_view)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), NULL);
+	else if (priv->icon_view)
+		gtk_icon_view_set_model (GTK_ICON_VIEW (priv->icon_view), NULL);
+
+	ev_thumbnails_model_set_rotation (priv->thumbnails_model, priv->rotation);
+
+	if (priv->tree_view)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view),
+					 GTK_TREE_MODEL (priv->thumbnails_model));
+	else if (priv->icon_view)
+		gtk_icon_view_set_model (GTK_ICON_VIEW (priv->icon_view),
+					 GTK_TREE_MODEL (priv->thumbnails_model));
+
+	if (priv->thumbnails_cache)
+		ev_thumbnails_cache_unref (priv->thumbnails_cache);
+	priv->thumbnails_cache = ev_sidebar_thumbnails_create_cache (sidebar_thumbnails);
+
+	/* Trigger a redraw */
+	priv->start_page = -1;
+	priv->end_page = -1;
+	ev_sidebar_thumbnails_set_current_page (sidebar_thumbnails,
+						ev_document_model_get_page (model));
+	g_idle_add ((GSourceFunc)refresh, sidebar_thumbnails);
 }
 
 static void
@@ -784,10 +620,19 @@ ev_sidebar_thumbnails_inverted_colors_changed_cb (EvDocumentModel     *model,
 						  GParamSpec          *pspec,
 						  EvSidebarThumbnails *sidebar_thumbnails)
 {
-	gboolean inverted_colors = ev_document_model_get_inverted_colors (model);
+	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
+
+	priv->inverted_colors = ev_document_model_get_inverted_colors (model);
+	if (!priv->thumbnails_model)
+		return;
 
-	sidebar_thumbnails->priv->inverted_colors = inverted_colors;
-	ev_sidebar_thumbnails_reload (sidebar_thumbnails);
+	/* No need to render the thumbnails again */
+	ev_thumbnails_model_set_inverted_colors (priv->thumbnails_model,
+						 priv->inverted_colors);
+	if (priv->tree_view)
+		gtk_widget_queue_draw (priv->tree_view);
+	else if (priv->icon_view)
+		gtk_widget_queue_draw (priv->icon_view);
 }
 
 static void
@@ -795,17 +640,9 @@ thumbnail_job_completed_callback (EvJobThumbnail      *job,
 				  EvSidebarThumbnails *sidebar_thumbnails)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
-	GtkTreeIter *iter;
 
-	iter = (GtkTreeIter *) g_object_get_data (G_OBJECT (job), "tree_iter");
-	if (priv->inverted_colors)
-		ev_document_misc_invert_pixbuf (job->thumbnail);
-	gtk_list_store_set (priv->list_store,
-			    iter,
-			    COLUMN_PIXBUF, job->thumbnail,
-			    COLUMN_THUMBNAIL_SET, TRUE,
-			    COLUMN_JOB, NULL,
-			    -1);
+	ev_thumbnails_model_set_thumbnail (priv->thumbnails_model,
+					   job->page, job->thumbnail);
 }
 
 static void
@@ -821,15 +658,10 @@ ev_sidebar_thumbnails_document_changed_cb (EvDocumentModel     *model,
 		return;
 	}
 
-	priv->size_cache = ev_thumbnails_size_cache_get (document);
 	priv->document = document;
 	priv->n_pages = ev_document_get_n_pages (document);
 	priv->rotation = ev_document_model_get_rotation (model);
 	priv->inverted_colors = ev_document_model_get_inverted_colors (model);
-	priv->loading_icons = g_hash_table_new_full (g_str_hash,
-						     g_str_equal,
-						     (GDestroyNotify)g_free,
-						     (GDestroyNotify)g_object_unref);
 
 	ev_sidebar_thumbnails_clear_model (sidebar_thumbnails);
 	ev_sidebar_thumbnails_fill_model (sidebar_thumbnails);
@@ -892,32 +724,38 @@ ev_sidebar_thumbnails_set_model (EvSidebarPage   *sidebar_page,
 			  sidebar_page);
 }
 
-static gboolean
-ev_sidebar_thumbnails_clear_job (GtkTreeModel *model,                                             
-			         GtkTreePath *path,
-			         GtkTreeIter *iter,
-				 gpointer data)
+static void
+ev_sidebar_thumbnails_clear_job (EvJob               *job,
+				 EvSidebarThumbnails *sidebar_thumbnails)
 {
-	EvJob *job;
-	
-	gtk_tree_model_get (model, iter, COLUMN_JOB, &job, -1);
-	
-	if (job != NULL) {
-		ev_job_cancel (job);
-		g_signal_handlers_disconnect_by_func (job, thumbnail_job_completed_callback, data);
-		g_object_unref (job);
-	}
-	
-	return FALSE;    
+	ev_job_cancel (job);
+	g_signal_handlers_disconnect_by_func (job, thumbnail_job_completed_callback, sidebar_thumbnails);
 }
 
 static void 
 ev_sidebar_thumbnails_clear_model (EvSidebarThumbnails *sidebar_thumbnails)
 {
 	EvSidebarThumbnailsPrivate *priv = sidebar_thumbnails->priv;
-	
-	gtk_tree_model_foreach (GTK_TREE_MODEL (priv->list_store), ev_sidebar_thumbnails_clear_job, sidebar_thumbnails);
-	gtk_list_store_clear (priv->list_store);
+
+	if (priv->thumbnails_cache) {
+		ev_thumbnails_cache_unref (priv->thumbnails_cache);
+		priv->thumbnails_cache = NULL;
+	}
+
+	if (!priv->thumbnails_model)
+		return;
+
+	ev_thumbnails_model_foreach_job (priv->thumbnails_model,
+					 (GFunc)ev_sidebar_thumbnails_clear_job,
+					 sidebar_thumbnails);
+
+	if (priv->tree_view)
+		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), NULL);
+	else if (priv->icon_view)
+		gtk_icon_view_set_model (GTK_ICON_VIEW (priv->icon_view), NULL);
+
+	g_object_unref (priv->thumbnails_model);
+	priv->thumbnails_model = NULL;
 }
 
 static gboolean
@@ -0,0 +1,747 @@
+/* ev-thumbnails-model.c
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ev-document-misc.h"
+#include "ev-imaging.h"
+#include "ev-thumbnails-model.h"
+
+/* A list model with a row for every page of the document. Rows are
+ * not stored: they are made up when asked for, from the thumbnail
+ * sizes of the pages and from the thumbnails and jobs of the pages
+ * being shown, which are the only ones stored. So the memory used
+ * depends on the visible pages, not on the number of pages.
+ */
+
+typedef struct _EvThumbsSize
+{
+	gint width;
+	gint height;
+} EvThumbsSize;
+
+typedef struct _EvThumbsSizeCache {
+	gboolean uniform;
+	gint uniform_width;
+	gint uniform_height;
+	EvThumbsSize *sizes;
+} EvThumbsSizeCache;
+
+typedef struct {
+	GdkPixbuf *thumbnail;
+	gboolean   thumbnail_inverted;
+	EvJob     *job;
+} EvThumbnailsModelPage;
+
+struct _EvThumbnailsModel {
+	GObject parent;
+
+	gint               stamp;
+	EvDocument        *document;
+	gint               n_pages;
+	gint               rotation;
+	gboolean           inverted_colors;
+	EvThumbsSizeCache *size_cache;
+
+	/* Loading icons by size and colors */
+	GHashTable        *loading_icons;
+
+	/* Pages with a thumbnail or a job */
+	GHashTable        *pages;
+};
+
+struct _EvThumbnailsModelClass {
+	GObjectClass parent_class;
+};
+
+static void ev_thumbnails_model_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (EvThumbnailsModel, ev_thumbnails_model, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+						ev_thumbnails_model_tree_model_init))
+
+/* Thumbnails dimensions cache */
+#define EV_THUMBNAILS_SIZE_CACHE_KEY "ev-thumbnails-size-cache"
+
+static void
+get_thumbnail_size_for_page (EvDocument *document,
+			     guint       page,
+			     gint        thumbnail_width,
+			     gint       *width,
+			     gint       *height)
+{
+	gdouble scale;
+	gdouble w, h;
+
+	ev_document_get_page_size (document, page, &w, &h);
+	scale = (gdouble)thumbnail_width / w;
+
+	*width = MAX ((gint)(w * scale + 0.5), 1);
+	*height = MAX ((gint)(h * scale + 0.5), 1);
+}
+
+static EvThumbsSizeCache *
+ev_thumbnails_size_cache_new (EvDocument *document,
+			      gint        thumbnail_width)
+{
+	EvThumbsSizeCache *cache;
+	gint               i, n_pages;
+	EvThumbsSize      *thumb_size;
+
+	cache = g_new0 (EvThumbsSizeCache, 1);
+
+	if (ev_document_is_page_size_uniform (document)) {
+		cache->uniform = TRUE;
+		get_thumbnail_size_for_page (document, 0, thumbnail_width,
+					     &cache->uniform_width,
+					     &cache->uniform_height);
+		return cache;
+	}
+
+	n_pages = ev_document_get_n_pages (document);
+	cache->sizes = g_new0 (EvThumbsSize, n_pages);
+
+	for (i = 0; i < n_pages; i++) {
+		thumb_size = &(cache->sizes[i]);
+		get_thumbnail_size_for_page (document, i, thumbnail_width,
+					     &thumb_size->width,
+					     &thumb_size->height);
+	}
+
+	return cache;
+}
+
+static void
+ev_thumbnails_size_cache_get_size (EvThumbsSizeCache *cache,
+				   gint               page,
+				   gint               rotation,
+				   gint              *width,
+				   gint              *height)
+{
+	gint w, h;
+
+	if (cache->uniform) {
+		w = cache->uniform_width;
+		h = cache->uniform_height;
+	} else {
+		EvThumbsSize *thumb_size;
+
+		thumb_size = &(cache->sizes[page]);
+
+		w = thumb_size->width;
+		h = thumb_size->height;
+	}
+
+	if (rotation == 0 || rotation == 180) {
+		if (width) *width = w;
+		if (height) *height = h;
+	} else {
+		if (width) *width = h;
+		if (height) *height = w;
+	}
+}
+
+static void
+ev_thumbnails_size_cache_free (EvThumbsSizeCache *cache)
+{
+	if (cache->sizes) {
+		g_free (cache->sizes);
+		cache->sizes = NULL;
+	}
+
+	g_free (cache);
+}
+
+static EvThumbsSizeCache *
+ev_thumbnails_size_cache_get (EvDocument *document,
+			      gint        thumbnail_width)
+{
+	EvThumbsSizeCache *cache;
+
+	cache = g_object_get_data (G_OBJECT (document), EV_THUMBNAILS_SIZE_CACHE_KEY);
+	if (!cache) {
+		cache = ev_thumbnails_size_cache_new (document, thumbnail_width);
+		g_object_set_data_full (G_OBJECT (document),
+					EV_THUMBNAILS_SIZE_CACHE_KEY,
+					cache,
+					(GDestroyNotify)ev_thumbnails_size_cache_free);
+	}
+
+	return cache;
+}
+
+static void
+ev_thumbnails_model_page_free (EvThumbnailsModelPage *page)
+{
+	if (page->thumbnail)
+		g_object_unref (page->thumbnail);
+	if (page->job)
+		g_object_unref (page->job);
+	g_slice_free (EvThumbnailsModelPage, page);
+}
+
+static void
+ev_thumbnails_model_finalize (GObject *object)
+{
+	EvThumbnailsModel *model = EV_THUMBNAILS_MODEL (object);
+
+	g_hash_table_destroy (model->pages);
+	g_hash_table_destroy (model->loading_icons);
+	if (model->document)
+		g_object_unref (model->document);
+
+	G_OBJECT_CLASS (ev_thumbnails_model_parent_class)->finalize (object);
+}
+
+static void
+ev_thumbnails_model_init (EvThumbnailsModel *model)
+{
+	model->stamp = g_random_int ();
+	model->pages = g_hash_table_new_full (g_direct_hash,
+					      g_direct_equal,
+					      NULL,
+					      (GDestroyNotify)ev_thumbnails_model_page_free);
+	model->loading_icons = g_hash_table_new_full (g_str_hash,
+						      g_str_equal,
+						      (GDestroyNotify)g_free,
+						      (GDestroyNotify)g_object_unref);
+}
+
+static void
+ev_thumbnails_model_class_init (EvThumbnailsModelClass *klass)
+{
+	GObjectClass *g_object_class = G_OBJECT_CLASS (klass);
+
+	g_object_class->finalize = ev_thumbnails_model_finalize;
+}
+
+static GdkPixbuf *
+ev_thumbnails_model_get_loading_icon (EvThumbnailsModel *model,
+				      gint               page)
+{
+	GdkPixbuf *icon;
+	gchar     *key;
+	gint       width, height;
+
+	ev_thumbnails_size_cache_get_size (model->size_cache, page,
+					   model->rotation,
+					   &width, &height);
+
+	key = g_strdup_printf ("%dx%d%s", width, height,
+			       model->inverted_colors ? "-inverted" : "");
+	icon = g_hash_table_lookup (model->loading_icons, key);
+	if (!icon) {
+		icon = ev_document_misc_get_loading_thumbnail (width, height,
+							       model->inverted_colors);
+		g_hash_table_insert (model->loading_icons, key, icon);
+	} else {
+		g_free (key);
+	}
+
+	return icon;
+}
+
+static inline EvThumbnailsModelPage *
+ev_thumbnails_model_lookup_page (EvThumbnailsModel *model,
+				 gint               page)
+{
+	return g_hash_table_lookup (model->pages, GINT_TO_POINTER (page));
+}
+
+static EvThumbnailsModelPage *
+ev_thumbnails_model_ensure_page (EvThumbnailsModel *model,
+				 gint               page)
+{
+	EvThumbnailsModelPage *model_page;
+
+	model_page = ev_thumbnails_model_lookup_page (model, page);
+	if (!model_page) {
+		model_page = g_slice_new0 (EvThumbnailsModelPage);
+		g_hash_table_insert (model->pages, GINT_TO_POINTER (page), model_page);
+	}
+
+	return model_page;
+}
+
+static void
+ev_thumbnails_model_row_changed (EvThumbnailsModel *model,
+				 gint               page)
+{
+	GtkTreePath *path;
+	GtkTreeIter  iter;
+
+	iter.stamp = model->stamp;
+	iter.user_data = GINT_TO_POINTER (page);
+
+	path = gtk_tree_path_new_from_indices (page, -1);
+	gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+/* GtkTreeModel */
+static GtkTreeModelFlags
+ev_thumbnails_model_get_flags (GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+ev_thumbnails_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	return EV_THUMBNAILS_MODEL_N_COLUMNS;
+}
+
+static GType
+ev_thumbnails_model_get_column_type (GtkTreeModel *tree_model,
+				     gint          index)
+{
+	switch (index) {
+	case EV_THUMBNAILS_MODEL_COLUMN_PAGE_STRING:
+		return G_TYPE_STRING;
+	case EV_THUMBNAILS_MODEL_COLUMN_PIXBUF:
+		return GDK_TYPE_PIXBUF;
+	case EV_THUMBNAILS_MODEL_COLUMN_THUMBNAIL_SET:
+		return G_TYPE_BOOLEAN;
+	case EV_THUMBNAILS_MODEL_COLUMN_JOB:
+		return EV_TYPE_JOB_THUMBNAIL;
+	default:
+		g_assert_not_reached ();
+	}
+
+	return G_TYPE_INVALID;
+}
+
+static gboolean
+ev_thumbnails_model_iter_nth_child (GtkTreeModel *tree_model,
+				    GtkTreeIter  *iter,
+				    GtkTreeIter  *parent,
+				    gint          n)
+{
+	EvThumbnailsModel *model = EV_THUMBNAILS_MODEL (tree_model);
+
+	if (parent || n < 0 || n >= model->n_pages)
+		return FALSE;
+
+	iter->stamp = model->stamp;
+	iter->user_data = GINT_TO_POINTER (n);
+
+	return TRUE;
+}
+
+static gboolean
+ev_thumbnails_model_get_iter (GtkTreeModel *tree_model,
+			      GtkTreeIter  *iter,
+			      GtkTreePath  *path)
+{
+	if (gtk_tree_path_get_depth (path) != 1)
+		return FALSE;
+
+	return ev_thumbnails_model_iter_nth_child (tree_model, iter, NULL,
+						   gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+ev_thumbnails_model_get_path (GtkTreeModel *tree_model,
+			      GtkTreeIter  *iter)
+{
+	EvThumbnailsModel *model = EV_THUMBNAILS_MODEL (tree_model);
+
+	g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+	return gtk_tree_path_new_from_indices (GPOINTER_TO_INT (iter->user_data), -1);
+}
+
+static void
+ev_thumbnails_model_get_value (GtkTreeModel *tree_model,
+			       GtkTreeIter  *iter,
+			       gint          column,
+			       GValue       *value)
+{
+	EvThumbnailsModel     *model = EV_THUMBNAILS_MODEL (tree_model);
+	EvThumbnailsModelPage *model_page;
+	gint                   page;
+
+	g_return_if_fail (iter->stamp == model->stamp);
+
+	page = GPOINTER_TO_INT (iter->user_data);
+	model_page = ev_thumbnails_model_lookup_page (model, page);
+
+	g_value_init (value, ev_thumbnails_model_get_column_type (tree_model, column));
+
+	switch (column) {
+	case EV_THUMBNAILS_MODEL_COLUMN_PAGE_STRING: {
+		gchar *page_label;
+
+		page_label = ev_document_get_page_label (model->document, page);
+		g_value_take_string (value, g_markup_printf_escaped ("<i>%s</i>", page_label));
+		g_free (page_label);
+	}
+		break;
+	case EV_THUMBNAILS_MODEL_COLUMN_PIXBUF:
+		if (model_page && model_page->thumbnail) {
+			/* Colors are inverted when the thumbnail is shown,
+			 * so toggling them doesn't need any new thumbnail
+			 */
+			if (model_page->thumbnail_inverted != model->inverted_colors) {
+				ev_document_misc_invert_pixbuf (model_page->thumbnail);
+				model_page->thumbnail_inverted = model->inverted_colors;
+			}
+			g_value_set_object (value, model_page->thumbnail);
+		} else
+			g_value_set_object (value, ev_thumbnails_model_get_loading_icon (model, page));
+		break;
+	case EV_THUMBNAILS_MODEL_COLUMN_THUMBNAIL_SET:
+		g_value_set_boolean (value, model_page && model_page->thumbnail);
+		break;
+	case EV_THUMBNAILS_MODEL_COLUMN_JOB:
+		g_value_set_object (value, model_page ? model_page->job : NULL);
+		break;
+	}
+}
+
+static gboolean
+ev_thumbnails_model_iter_next (GtkTreeModel *tree_model,
+			       GtkTreeIter  *iter)
+{
+	EvThumbnailsModel *model = EV_THUMBNAILS_MODEL (tree_model);
+	gint               page = GPOINTER_TO_INT (iter->user_data) + 1;
+
+	if (page >= model->n_pages) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	iter->user_data = GINT_TO_POINTER (page);
+
+	return TRUE;
+}
+
+static gboolean
+ev_thumbnails_model_iter_previous (GtkTreeModel *tree_model,
+				   GtkTreeIter  *iter)
+{
+	gint page = GPOINTER_TO_INT (iter->user_data) - 1;
+
+	if (page < 0) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	iter->user_data = GINT_TO_POINTER (page);
+
+	return TRUE;
+}
+
+static gboolean
+ev_thumbnails_model_iter_children (GtkTreeModel *tree_model,
+				   GtkTreeIter  *iter,
+				   GtkTreeIter  *parent)
+{
+	return ev_thumbnails_model_iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gboolean
+ev_thumbnails_model_iter_has_child (GtkTreeModel *tree_model,
+				    GtkTreeIter  *iter)
+{
+	return FALSE;
+}
+
+static gint
+ev_thumbnails_model_iter_n_children (GtkTreeModel *tree_model,
+				     GtkTreeIter  *iter)
+{
+	return iter ? 0 : EV_THUMBNAILS_MODEL (tree_model)->n_pages;
+}
+
+static gboolean
+ev_thumbnails_model_iter_parent (GtkTreeModel *tree_model,
+				 GtkTreeIter  *iter,
+				 GtkTreeIter  *child)
+{
+	return FALSE;
+}
+
+static void
+ev_thumbnails_model_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags = ev_thumbnails_model_get_flags;
+	iface->get_n_columns = ev_thumbnails_model_get_n_columns;
+	iface->get_column_type = ev_thumbnails_model_get_column_type;
+	iface->get_iter = ev_thumbnails_model_get_iter;
+	iface->get_path = ev_thumbnails_model_get_path;
+	iface->get_value = ev_thumbnails_model_get_value;
+	iface->iter_next = ev_thumbnails_model_iter_next;
+	iface->iter_previous = ev_thumbnails_model_iter_previous;
+	iface->iter_children = ev_thumbnails_model_iter_children;
+	iface->iter_has_child = ev_thumbnails_model_iter_has_child;
+	iface->iter_n_children = ev_thumbnails_model_iter_n_children;
+	iface->iter_nth_child = ev_thumbnails_model_iter_nth_child;
+	iface->iter_parent = ev_thumbnails_model_iter_parent;
+}
+
+EvThumbnailsModel *
+ev_thumbnails_model_new (EvDocument *document,
+			 gint        thumbnail_width,
+			 gint        rotation,
+			 gboolean    inverted_colors)
+{
+	EvThumbnailsModel *model;
+
+	g_return_val_if_fail (EV_IS_DOCUMENT (document), NULL);
+
+	model = g_object_new (EV_TYPE_THUMBNAILS_MODEL, NULL);
+	model->document = g_object_ref (document);
+	model->n_pages = ev_document_get_n_pages (document);
+	model->rotation = rotation;
+	model->inverted_colors = inverted_colors;
+	model->size_cache = ev_thumbnails_size_cache_get (document, thumbnail_width);
+
+	return model;
+}
+
+/* Pixels of four channels are moved as 32 bit words,
+ * like in image surfaces
+ */
+static GdkPixbuf *
+ev_thumbnails_model_rotate_pixbuf (GdkPixbuf *thumbnail,
+				   gint       rotation)
+{
+	GdkPixbuf *rotated;
+	gint       width, height;
+
+	if (gdk_pixbuf_get_n_channels (thumbnail) != 4)
+		return gdk_pixbuf_rotate_simple (thumbnail, (GdkPixbufRotation) (360 - rotation));
+
+	width = gdk_pixbuf_get_width (thumbnail);
+	height = gdk_pixbuf_get_height (thumbnail);
+	rotated = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8,
+				  rotation == 180 ? width : height,
+				  rotation == 180 ? height : width);
+	if (!rotated)
+		return NULL;
+
+	ev_imaging_rotate_argb32 (gdk_pixbuf_get_pixels (thumbnail),
+				  width, height,
+				  gdk_pixbuf_get_rowstride (thumbnail),
+				  gdk_pixbuf_get_pixels (rotated),
+				  gdk_pixbuf_get_rowstride (rotated),
+				  rotation);
+
+	return rotated;
+}
+
+/* Turning the page only moves its pixels, so the thumbnails are
+ * rotated instead of rendered again. The frame has the shadow on the
+ * right and bottom sides, so only the page is rotated, and then
+ * framed again
+ */
+static GdkPixbuf *
+ev_thumbnails_model_rotate_thumbnail (GdkPixbuf *thumbnail,
+				      gint       rotation)
+{
+	GdkPixbuf *page;
+	GdkPixbuf *rotated;
+	GdkPixbuf *framed;
+	gint       width, height;
+
+	/* See ev_document_misc_get_thumbnail_frame() */
+	width = gdk_pixbuf_get_width (thumbnail) - 4;
+	height = gdk_pixbuf_get_height (thumbnail) - 4;
+	if (width <= 0 || height <= 0)
+		return NULL;
+
+	page = gdk_pixbuf_new_subpixbuf (thumbnail, 1, 1, width, height);
+	rotated = ev_thumbnails_model_rotate_pixbuf (page, rotation);
+	g_object_unref (page);
+	if (!rotated)
+		return NULL;
+
+	framed = ev_document_misc_get_thumbnail_frame (-1, -1, rotated);
+	g_object_unref (rotated);
+
+	return framed;
+}
+
+/* Thumbnails are rotated to @rotation and jobs, which render the
+ * previous rotation, are dropped. The sizes of the rows change, so
+ * the views showing @model have to take it again
+ */
+void
+ev_thumbnails_model_set_rotation (EvThumbnailsModel *model,
+				  gint               rotation)
+{
+	GHashTableIter         iter;
+	EvThumbnailsModelPage *model_page;
+	gint                   delta;
+
+	g_return_if_fail (EV_IS_THUMBNAILS_MODEL (model));
+
+	delta = (rotation - model->rotation + 360) % 360;
+	model->rotation = rotation;
+	if (delta == 0)
+		return;
+
+	g_hash_table_iter_init (&iter, model->pages);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&model_page)) {
+		GdkPixbuf *rotated = NULL;
+
+		if (model_page->job) {
+			g_object_unref (model_page->job);
+			model_page->job = NULL;
+		}
+
+		if (model_page->thumbnail) {
+			/* The new frame is not inverted */
+			if (model_page->thumbnail_inverted) {
+				ev_document_misc_invert_pixbuf (model_page->thumbnail);
+				model_page->thumbnail_inverted = FALSE;
+			}
+
+			rotated = ev_thumbnails_model_rotate_thumbnail (model_page->thumbnail, delta);
+			g_object_unref (model_page->thumbnail);
+			model_page->thumbnail = rotated;
+		}
+
+		if (!rotated)
+			g_hash_table_iter_remove (&iter);
+	}
+}
+
+/* Rows are not changed, the views showing @model have to be redrawn */
+void
+ev_thumbnails_model_set_inverted_colors (EvThumbnailsModel *model,
+					 gboolean           inverted_colors)
+{
+	g_return_if_fail (EV_IS_THUMBNAILS_MODEL (model));
+
+	model->inverted_colors = inverted_colors;
+}
+
+EvJob *
+ev_thumbnails_model_get_job (EvThumbnailsModel *model,
+			     gint               page)
+{
+	EvThumbnailsModelPage *model_page;
+
+	g_return_val_if_fail (EV_IS_THUMBNAILS_MODEL (model), NULL);
+
+	model_page = ev_thumbnails_model_lookup_page (model, page);
+
+	return model_page ? model_page->job : NULL;
+}
+
+void
+ev_thumbnails_model_set_job (EvThumbnailsModel *model,
+			     gint               page,
+			     EvJob             *job)
+{
+	EvThumbnailsModelPage *model_page;
+
+	g_return_if_fail (EV_IS_THUMBNAILS_MODEL (model));
+	g_return_if_fail (page >= 0 && page < model->n_pages);
+
+	model_page = ev_thumbnails_model_ensure_page (model, page);
+	if (model_page->job == job)
+		return;
+
+	if (model_page->job)
+		g_object_unref (model_page->job);
+	model_page->job = job ? g_object_ref (job) : NULL;
+}
+
+gboolean
+ev_thumbnails_model_has_thumbnail (EvThumbnailsModel *model,
+				   gint               page)
+{
+	EvThumbnailsModelPage *model_page;
+
+	g_return_val_if_fail (EV_IS_THUMBNAILS_MODEL (model), FALSE);
+
+	model_page = ev_thumbnails_model_lookup_page (model, page);
+
+	return model_page && model_page->thumbnail;
+}
+
+/* Sets the thumbnail of @page, with the colors as rendered,
+ * and drops its job
+ */
+void
+ev_thumbnails_model_set_thumbnail (EvThumbnailsModel *model,
+				   gint               page,
+				   GdkPixbuf         *thumbnail)
+{
+	EvThumbnailsModelPage *model_page;
+
+	g_return_if_fail (EV_IS_THUMBNAILS_MODEL (model));
+	g_return_if_fail (page >= 0 && page < model->n_pages);
+
+	model_page = ev_thumbnails_model_ensure_page (model, page);
+	if (model_page->thumbnail)
+		g_object_unref (model_page->thumbnail);
+	model_page->thumbnail = thumbnail ? g_object_ref (thumbnail) : NULL;
+	model_page->thumbnail_inverted = FALSE;
+	if (model_page->job) {
+		g_object_unref (model_page->job);
+		model_page->job = NULL;
+	}
+
+	ev_thumbnails_model_row_changed (model, page);
+}
+
+/* Forgets the thumbnail and the job of @page, so that the page is
+ * shown as loading again
+ */
+void
+ev_thumbnails_model_clear_page (EvThumbnailsModel *model,
+				gint               page)
+{
+	EvThumbnailsModelPage *model_page;
+	gboolean               had_thumbnail;
+
+	g_return_if_fail (EV_IS_THUMBNAILS_MODEL (model));
+
+	model_page = ev_thumbnails_model_lookup_page (model, page);
+	if (!model_page)
+		return;
+
+	had_thumbnail = model_page->thumbnail != NULL;
+	g_hash_table_remove (model->pages, GINT_TO_POINTER (page));
+
+	if (had_thumbnail)
+		ev_thumbnails_model_row_changed (model, page);
+}
+
+void
+ev_thumbnails_model_foreach_job (EvThumbnailsModel *model,
+				 GFunc              func,
+				 gpointer           user_data)
+{
+	GHashTableIter         iter;
+	EvThumbnailsModelPage *model_page;
+
+	g_return_if_fail (EV_IS_THUMBNAILS_MODEL (model));
+
+	g_hash_table_iter_init (&iter, model->pages);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&model_page)) {
+		if (model_page->job)
+			func (model_page->job, user_data);
+	}
+}
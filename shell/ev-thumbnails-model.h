@@ -0,0 +1,74 @@
+/* ev-thumbnails-model.h
+ *  this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __EV_THUMBNAILS_MODEL_H__
+#define __EV_THUMBNAILS_MODEL_H__
+
+#include <gtk/gtk.h>
+
+#include "ev-jobs.h"
+
+G_BEGIN_DECLS
+
+typedef struct _EvThumbnailsModel EvThumbnailsModel;
+typedef struct _EvThumbnailsModelClass EvThumbnailsModelClass;
+
+#define EV_TYPE_THUMBNAILS_MODEL		(ev_thumbnails_model_get_type())
+#define EV_THUMBNAILS_MODEL(object)		(G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_THUMBNAILS_MODEL, EvThumbnailsModel))
+#define EV_THUMBNAILS_MODEL_CLASS(klass)	(G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_THUMBNAILS_MODEL, EvThumbnailsModelClass))
+#define EV_IS_THUMBNAILS_MODEL(object)		(G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_THUMBNAILS_MODEL))
+#define EV_IS_THUMBNAILS_MODEL_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE((klass), EV_TYPE_THUMBNAILS_MODEL))
+#define EV_THUMBNAILS_MODEL_GET_CLASS(object)	(G_TYPE_INSTANCE_GET_CLASS((object), EV_TYPE_THUMBNAILS_MODEL, EvThumbnailsModelClass))
+
+typedef enum {
+	EV_THUMBNAILS_MODEL_COLUMN_PAGE_STRING,
+	EV_THUMBNAILS_MODEL_COLUMN_PIXBUF,
+	EV_THUMBNAILS_MODEL_COLUMN_THUMBNAIL_SET,
+	EV_THUMBNAILS_MODEL_COLUMN_JOB,
+	EV_THUMBNAILS_MODEL_N_COLUMNS
+} EvThumbnailsModelColumn;
+
+GType              ev_thumbnails_model_get_type      (void) G_GNUC_CONST;
+EvThumbnailsModel *ev_thumbnails_model_new           (EvDocument        *document,
+						      gint               thumbnail_width,
+						      gint               rotation,
+						      gboolean           inverted_colors);
+void               ev_thumbnails_model_set_rotation  (EvThumbnailsModel *model,
+						      gint               rotation);
+void               ev_thumbnails_model_set_inverted_colors
+						     (EvThumbnailsModel *model,
+						      gboolean           inverted_colors);
+EvJob             *ev_thumbnails_model_get_job       (EvThumbnailsModel *model,
+						      gint               page);
+void               ev_thumbnails_model_set_job       (EvThumbnailsModel *model,
+						      gint               page,
+						      EvJob             *job);
+gboolean           ev_thumbnails_model_has_thumbnail (EvThumbnailsModel *model,
+						      gint               page);
+void               ev_thumbnails_model_set_thumbnail (EvThumbnailsModel *model,
+						      gint               page,
+						      GdkPixbuf         *thumbnail);
+void               ev_thumbnails_model_clear_page    (EvThumbnailsModel *model,
+						      gint               page);
+void               ev_thumbnails_model_foreach_job   (EvThumbnailsModel *model,
+						      GFunc              func,
+						      gpointer           user_data);
+
+G_END_DECLS
+
+#endif /* __EV_THUMBNAILS_MODEL_H__ */
@@ -59,6 +59,9 @@
 #include "ev-document-annotations.h"
 #include "ev-document-type-builtins.h"
 #include "ev-document-misc.h"
+#include "ev-document-text.h"
+#include "ev-document-security.h"
+#include "ev-cached-input-stream.h"
 #include "ev-file-exporter.h"
 #include "ev-file-helpers.h"
 #include "ev-file-monitor.h"
@@ -82,6 +85,7 @@
 #include "ev-sidebar-thumbnails.h"
 #include "ev-sidebar-layers.h"
 #include "ev-stock-icons.h"
+#include "ev-text-index.h"
 #include "ev-utils.h"
 #include "ev-keyring.h"
 #include "ev-view.h"
@@ -189,7 +193,12 @@ struct _EvWindowPrivate {
 	char *uri;
 	glong uri_mtime;
 	char *local_uri;
+	EvCachedInputStream *remote_stream;
+	gboolean progressive_failed;
+	gboolean reload_pending;
+	EvLinkDest *reload_dest;
 	gboolean in_reload;
+	gboolean password_protected;
 	EvFileMonitor *monitor;
 	guint setup_document_idle;
 	
@@ -210,6 +219,10 @@ struct _EvWindowPrivate {
 	EvJob            *thumbnail_job;
 	EvJob            *save_job;
 	EvJob            *find_job;
+	EvJob            *index_job;
+
+	/* Full-text index */
+	EvTextIndex      *text_index;
 
 	/* Printing */
 	GQueue           *print_queue;
@@ -246,6 +259,8 @@ struct _EvWindowPrivate {
 #define GS_SCHEMA_NAME           "org.gnome.Evince"
 #define GS_OVERRIDE_RESTRICTIONS "override-restrictions"
 #define GS_AUTO_RELOAD           "auto-reload"
+#define GS_PROGRESSIVE_LOADING   "progressive-loading"
+#define GS_BUILD_TEXT_INDEX      "build-text-index"
 #define GS_LAST_DOCUMENT_DIRECTORY "document-directory"
 #define GS_LAST_PICTURES_DIRECTORY "pictures-directory"
 
@@ -306,6 +321,8 @@ static void     ev_window_reload_job_cb                 (EvJob            *job,
 							 EvWindow         *window);
 static void     ev_window_set_icon_from_thumbnail       (EvJobThumbnail   *job,
 							 EvWindow         *ev_window);
+static void     ev_window_index_job_finished_cb         (EvJobIndex       *job,
+							 EvWindow         *ev_window);
 static void     ev_window_save_job_cb                   (EvJob            *save,
 							 EvWindow         *window);
 static void     ev_window_sizing_mode_changed_cb        (EvDocumentModel  *model,
@@ -359,6 +376,9 @@ static void     view_external_link_cb                   (EvWindow         *windo
 							 EvLinkAction     *action);
 static void     ev_window_load_file_remote              (EvWindow         *ev_window,
 							 GFile            *source_file);
+static void     ev_window_load_remote_fallback          (EvWindow         *ev_window);
+static void     ev_window_remote_stream_complete_cb     (EvCachedInputStream *stream,
+							 EvWindow         *ev_window);
 static void     ev_window_media_player_key_pressed      (EvWindow         *window,
 							 const gchar      *key,
 							 gpointer          user_data);
@@ -1456,6 +1476,69 @@ ev_window_ensure_settings (EvWindow *ev_window)
         return priv->settings;
 }
 
+static void
+ev_window_clear_index_job (EvWindow *ev_window)
+{
+	if (ev_window->priv->index_job != NULL) {
+		if (!ev_job_is_finished (ev_window->priv->index_job))
+			ev_job_cancel (ev_window->priv->index_job);
+
+		g_signal_handlers_disconnect_by_func (ev_window->priv->index_job,
+						      ev_window_index_job_finished_cb,
+						      ev_window);
+		g_object_unref (ev_window->priv->index_job);
+		ev_window->priv->index_job = NULL;
+	}
+}
+
+static void
+ev_window_clear_text_index (EvWindow *ev_window)
+{
+	ev_window_clear_index_job (ev_window);
+
+	if (ev_window->priv->text_index) {
+		ev_text_index_unref (ev_window->priv->text_index);
+		ev_window->priv->text_index = NULL;
+	}
+}
+
+static void
+ev_window_index_job_finished_cb (EvJobIndex *job,
+				 EvWindow   *ev_window)
+{
+	if (!ev_job_is_failed (EV_JOB (job)) && job->text_index)
+		ev_window->priv->text_index = ev_text_index_ref (job->text_index);
+
+	ev_window_clear_index_job (ev_window);
+}
+
+static void
+ev_window_setup_text_index (EvWindow *ev_window)
+{
+	EvDocument *document = ev_window->priv->document;
+
+	ev_window_clear_text_index (ev_window);
+
+	if (!EV_IS_DOCUMENT_TEXT (document) || !EV_IS_DOCUMENT_FIND (document))
+		return;
+
+	/* The index keeps the whole text unencrypted in the cache dir */
+	if (ev_window_is_document_protected (ev_window))
+		return;
+
+	/* The index is keyed on the file the user opened, not on the
+	 * local copy of compressed or remote documents
+	 */
+	ev_window->priv->index_job =
+		ev_job_index_new (document, ev_window->priv->uri,
+				  g_settings_get_boolean (ev_window->priv->settings,
+							  GS_BUILD_TEXT_INDEX));
+	g_signal_connect (ev_window->priv->index_job, "finished",
+			  G_CALLBACK (ev_window_index_job_finished_cb),
+			  ev_window);
+	ev_job_scheduler_push_job (ev_window->priv->index_job, EV_JOB_PRIORITY_NONE);
+}
+
 static gboolean
 ev_window_setup_document (EvWindow *ev_window)
 {
@@ -1484,6 +1567,7 @@ ev_window_setup_document (EvWindow *ev_window)
 #endif
 
 	ev_window_setup_action_sensitivity (ev_window);
+	ev_window_setup_text_index (ev_window);
 
 	if (ev_window->priv->history)
 		g_object_unref (ev_window->priv->history);
@@ -1568,6 +1652,28 @@ ev_window_document_changed (EvWindow *ev_window,
 		ev_window_reload_document (ev_window, NULL);
 }
 
+/* The load job is an EvJobLoadStream when loading a remote
+ * document progressively, and an EvJobLoad otherwise
+ */
+static const gchar *
+ev_window_load_job_get_password (EvJob *job)
+{
+	if (EV_IS_JOB_LOAD_STREAM (job))
+		return EV_JOB_LOAD_STREAM (job)->password;
+
+	return EV_JOB_LOAD (job)->password;
+}
+
+static void
+ev_window_load_job_set_password (EvJob       *job,
+				 const gchar *password)
+{
+	if (EV_IS_JOB_LOAD_STREAM (job))
+		ev_job_load_stream_set_password (EV_JOB_LOAD_STREAM (job), password);
+	else
+		ev_job_load_set_password (EV_JOB_LOAD (job), password);
+}
+
 static void
 ev_window_password_view_unlock (EvWindow *ev_window)
 {
@@ -1576,7 +1682,7 @@ ev_window_password_view_unlock (EvWindow *ev_window)
 	g_assert (ev_window->priv->load_job);
 
 	password = ev_password_view_get_password (EV_PASSWORD_VIEW (ev_window->priv->password_view));
-	ev_job_load_set_password (EV_JOB_LOAD (ev_window->priv->load_job), password);
+	ev_window_load_job_set_password (ev_window->priv->load_job, password);
 	ev_job_scheduler_push_job (ev_window->priv->load_job, EV_JOB_PRIORITY_NONE);
 }
 
@@ -1606,9 +1712,36 @@ ev_window_clear_reload_job (EvWindow *ev_window)
 	}
 }
 
+static void
+ev_window_clear_pending_reload (EvWindow *ev_window)
+{
+	ev_window->priv->reload_pending = FALSE;
+	if (ev_window->priv->reload_dest) {
+		g_object_unref (ev_window->priv->reload_dest);
+		ev_window->priv->reload_dest = NULL;
+	}
+}
+
+static void
+ev_window_clear_remote_stream (EvWindow *ev_window)
+{
+	ev_window_clear_pending_reload (ev_window);
+
+	if (ev_window->priv->remote_stream != NULL) {
+		g_signal_handlers_disconnect_by_func (ev_window->priv->remote_stream,
+						      ev_window_remote_stream_complete_cb,
+						      ev_window);
+		ev_cached_input_stream_cancel_prefetch (ev_window->priv->remote_stream);
+		g_object_unref (ev_window->priv->remote_stream);
+		ev_window->priv->remote_stream = NULL;
+	}
+}
+
 static void
 ev_window_clear_local_uri (EvWindow *ev_window)
 {
+	ev_window_clear_remote_stream (ev_window);
+
 	if (ev_window->priv->local_uri) {
 		ev_tmp_uri_unlink (ev_window->priv->local_uri);
 		g_free (ev_window->priv->local_uri);
@@ -1645,14 +1778,15 @@ ev_window_load_job_cb (EvJob *job,
 {
 	EvWindow *ev_window = EV_WINDOW (data);
 	EvDocument *document = EV_JOB (job)->document;
-	EvJobLoad *job_load = EV_JOB_LOAD (job);
+	const gchar *job_password;
 
-	g_assert (job_load->uri);
+	job_password = ev_window_load_job_get_password (job);
 
 	ev_view_set_loading (EV_VIEW (ev_window->priv->view), FALSE);
 
 	/* Success! */
 	if (!ev_job_is_failed (job)) {
+		ev_window->priv->password_protected = job_password != NULL;
 		ev_document_model_set_document (ev_window->priv->model, document);
 
 #ifdef ENABLE_DBUS
@@ -1667,13 +1801,13 @@ ev_window_load_job_cb (EvJob *job,
 
 		ev_window_title_set_type (ev_window->priv->title,
 					  EV_WINDOW_TITLE_DOCUMENT);
-		if (job_load->password) {
+		if (job_password) {
 			GPasswordSave flags;
 
 			flags = ev_password_view_get_password_save_flags (
 				EV_PASSWORD_VIEW (ev_window->priv->password_view));
 			ev_keyring_save_password (ev_window->priv->uri,
-						  job_load->password,
+						  job_password,
 						  flags);
 		}
 
@@ -1723,12 +1857,12 @@ ev_window_load_job_cb (EvJob *job,
 		/* First look whether password is in keyring */
 		password = ev_keyring_lookup_password (ev_window->priv->uri);
 		if (password) {
-			if (job_load->password && strcmp (password, job_load->password) == 0) {
+			if (job_password && strcmp (password, job_password) == 0) {
 				/* Password in kering is wrong */
-				ev_job_load_set_password (job_load, NULL);
+				ev_window_load_job_set_password (job, NULL);
 				/* FIXME: delete password from keyring? */
 			} else {
-				ev_job_load_set_password (job_load, password);
+				ev_window_load_job_set_password (job, password);
 				ev_job_scheduler_push_job (job, EV_JOB_PRIORITY_NONE);
 				g_free (password);
 				return;
@@ -1744,12 +1878,18 @@ ev_window_load_job_cb (EvJob *job,
 					  EV_WINDOW_TITLE_PASSWORD);
 
 		ev_password_view_set_uri (EV_PASSWORD_VIEW (ev_window->priv->password_view),
-					  job_load->uri);
+					  ev_window->priv->uri);
 
 		ev_window_set_page_mode (ev_window, PAGE_MODE_PASSWORD);
 
-		ev_job_load_set_password (job_load, NULL);
+		ev_window_load_job_set_password (job, NULL);
 		ev_password_view_ask_password (EV_PASSWORD_VIEW (ev_window->priv->password_view));
+	} else if (EV_IS_JOB_LOAD_STREAM (job) &&
+		   !g_error_matches (job->error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		/* The document can't be loaded progressively,
+		 * download it completely instead
+		 */
+		ev_window_load_remote_fallback (ev_window);
 	} else {
 		ev_window_error_message (ev_window, job->error, 
 					 "%s", _("Unable to open document"));
@@ -1810,6 +1950,28 @@ ev_window_get_uri (EvWindow *ev_window)
 	return ev_window->priv->uri;
 }
 
+/**
+ * ev_window_is_document_protected:
+ * @ev_window: The instance of the #EvWindow.
+ *
+ * Whether the document showed in the #EvWindow needed a password to be
+ * opened or has security set, so that nothing read from it should be
+ * written to disk.
+ *
+ * Returns: %TRUE if the document is protected
+ */
+gboolean
+ev_window_is_document_protected (EvWindow *ev_window)
+{
+	EvDocument *document = ev_window->priv->document;
+
+	if (ev_window->priv->password_protected)
+		return TRUE;
+
+	return document && EV_IS_DOCUMENT_SECURITY (document) &&
+		ev_document_security_has_document_security (EV_DOCUMENT_SECURITY (document));
+}
+
 /**
  * ev_window_close_dialogs:
  * @ev_window: The window where dialogs will be closed.
@@ -2042,6 +2204,109 @@ window_open_file_copy_progress_cb (goffset   n_bytes,
 	g_free (status);
 }
 
+static void
+ev_window_remote_stream_mtime_cb (GFile        *source,
+				  GAsyncResult *async_result,
+				  EvWindow     *ev_window)
+{
+	EvLinkDest *dest;
+
+	set_uri_mtime (source, async_result, ev_window);
+
+	/* Reloads requested while downloading */
+	if (!ev_window->priv->reload_pending)
+		return;
+
+	dest = ev_window->priv->reload_dest;
+	ev_window->priv->reload_dest = NULL;
+	ev_window->priv->reload_pending = FALSE;
+
+	ev_window_reload_document (ev_window, dest);
+	if (dest)
+		g_object_unref (dest);
+}
+
+static void
+ev_window_remote_stream_complete_cb (EvCachedInputStream *stream,
+				     EvWindow            *ev_window)
+{
+	GFile *source;
+
+	/* The local copy is now complete, it can be used
+	 * like a downloaded one from now on
+	 */
+	source = g_file_new_for_uri (ev_window->priv->uri);
+	g_file_query_info_async (source,
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				 0, G_PRIORITY_DEFAULT,
+				 NULL,
+				 (GAsyncReadyCallback)ev_window_remote_stream_mtime_cb,
+				 ev_window);
+}
+
+/* Opens the remote document through a stream that downloads on demand
+ * the parts the backend reads, so that the first page can be shown
+ * before the whole file has been transferred. The rest of the document
+ * keeps downloading into the local copy in the background.
+ */
+static gboolean
+ev_window_load_file_progressive (EvWindow *ev_window,
+				 GFile    *source_file)
+{
+	GFile            *cache_file;
+	GFileInputStream *stream;
+
+	if (ev_window->priv->progressive_failed)
+		return FALSE;
+
+	if (!g_settings_get_boolean (ev_window_ensure_settings (ev_window),
+				     GS_PROGRESSIVE_LOADING))
+		return FALSE;
+
+	cache_file = g_file_new_for_uri (ev_window->priv->local_uri);
+	stream = ev_cached_input_stream_new (source_file, cache_file);
+	g_object_unref (cache_file);
+	g_object_unref (source_file);
+
+	ev_window_clear_remote_stream (ev_window);
+	ev_window->priv->remote_stream = EV_CACHED_INPUT_STREAM (stream);
+	g_signal_connect (stream, "complete",
+			  G_CALLBACK (ev_window_remote_stream_complete_cb),
+			  ev_window);
+
+	ev_window_clear_load_job (ev_window);
+	ev_window->priv->load_job = ev_job_load_stream_new (G_INPUT_STREAM (stream),
+							    EV_DOCUMENT_LOAD_FLAG_NONE);
+	g_signal_connect (ev_window->priv->load_job,
+			  "finished",
+			  G_CALLBACK (ev_window_load_job_cb),
+			  ev_window);
+
+	ev_view_set_loading (EV_VIEW (ev_window->priv->view), TRUE);
+	ev_job_scheduler_push_job (ev_window->priv->load_job, EV_JOB_PRIORITY_NONE);
+
+	return TRUE;
+}
+
+static void
+ev_window_load_remote_fallback (EvWindow *ev_window)
+{
+	GFile *source_file;
+
+	ev_window->priv->progressive_failed = TRUE;
+	ev_window_clear_remote_stream (ev_window);
+	ev_window_clear_load_job (ev_window);
+
+	ev_window->priv->load_job = ev_job_load_new (ev_window->priv->local_uri);
+	g_signal_connect (ev_window->priv->load_job,
+			  "finished",
+			  G_CALLBACK (ev_window_load_job_cb),
+			  ev_window);
+
+	source_file = g_file_new_for_uri (ev_window->priv->uri);
+	ev_window_load_file_remote (ev_window, source_file);
+}
+
 static void
 ev_window_load_file_remote (EvWindow *ev_window,
 			    GFile    *source_file)
@@ -2076,6 +2341,9 @@ ev_window_load_file_remote (EvWindow *ev_window,
 				     ev_window->priv->local_uri);
 	}
 
+	if (ev_window_load_file_progressive (ev_window, source_file))
+		return;
+
 	ev_window_reset_progress_cancellable (ev_window);
 	
 	target_file = g_file_new_for_uri (ev_window->priv->local_uri);
@@ -2103,6 +2371,7 @@ ev_window_open_uri (EvWindow       *ev_window,
 	GFile *source_file;
 
 	ev_window->priv->in_reload = FALSE;
+	ev_window->priv->progressive_failed = FALSE;
 	
 	if (ev_window->priv->uri &&
 	    g_ascii_strcasecmp (ev_window->priv->uri, uri) == 0) {
@@ -2402,6 +2671,21 @@ static void
 ev_window_reload_document (EvWindow *ev_window,
 			   EvLinkDest *dest)
 {
+	/* The local copy of a progressively loaded document is not
+	 * usable until it has been completely downloaded, so the
+	 * reload is done once it is
+	 */
+	if (ev_window->priv->remote_stream &&
+	    !ev_cached_input_stream_is_complete (ev_window->priv->remote_stream)) {
+		if (dest)
+			g_object_ref (dest);
+		ev_window_clear_pending_reload (ev_window);
+		ev_window->priv->reload_pending = TRUE;
+		ev_window->priv->reload_dest = dest;
+
+		return;
+	}
+
 	ev_window_clear_reload_job (ev_window);
 	ev_window->priv->in_reload = TRUE;
 
@@ -2546,6 +2830,7 @@ ev_window_open_copy_at_dest (EvWindow   *window,
 
 	if (window->priv->metadata)
 		new_window->priv->metadata = g_object_ref (window->priv->metadata);
+	new_window->priv->password_protected = window->priv->password_protected;
 	ev_window_open_document (new_window,
 				 window->priv->document,
 				 dest, 0, NULL);
@@ -5311,13 +5596,21 @@ ev_window_update_find_status_message (EvWindow *ev_window)
 
 			n_results = ev_job_find_get_n_results (job_find,
 							       ev_document_model_get_page (ev_window->priv->model));
-			/* TRANS: Sometimes this could be better translated as
-			   "%d hit(s) on this page".  Therefore this string
-			   contains plural cases. */
-			message = g_strdup_printf (ngettext ("%d found on this page",
-							     "%d found on this page",
-							     n_results),
-						   n_results);
+			if (n_results > 0) {
+				/* TRANS: Sometimes this could be better translated as
+				   "%d hit(s) on this page".  Therefore this string
+				   contains plural cases. */
+				message = g_strdup_printf (ngettext ("%d found on this page",
+								     "%d found on this page",
+								     n_results),
+							   n_results);
+			} else {
+				n_results = ev_job_find_get_n_total_results (job_find);
+				message = g_strdup_printf (ngettext ("%d found in the document",
+								     "%d found in the document",
+								     n_results),
+							   n_results);
+			}
 		} else {
 			message = g_strdup (_("Not found"));
 		}
@@ -5347,9 +5640,8 @@ ev_window_find_job_updated_cb (EvJobFind *job,
 {
 	ev_window_update_actions (ev_window);
 	
-	ev_view_find_changed (EV_VIEW (ev_window->priv->view),
-			      ev_job_find_get_results (job),
-			      page);
+	ev_view_find_results_changed (EV_VIEW (ev_window->priv->view),
+				      job, page);
 	ev_window_update_find_status_message (ev_window);
 }
 
@@ -5400,13 +5692,22 @@ ev_window_search_start (EvWindow *ev_window)
 {
 	EggFindBar *find_bar = EGG_FIND_BAR (ev_window->priv->find_bar);
 	const char *search_string;
+	EvJob      *previous = NULL;
 
 	if (!ev_window->priv->document || !EV_IS_DOCUMENT_FIND (ev_window->priv->document))
 		return;
 
 	search_string = egg_find_bar_get_search_string (find_bar);
 
+	/* Keep the current search to refine the new one */
+	if (ev_window->priv->find_job)
+		previous = g_object_ref (ev_window->priv->find_job);
+
 	ev_window_clear_find_job (ev_window);
+	/* The view keeps a reference to the job it shows results from,
+	 * and with it the whole chain of previous searches
+	 */
+	ev_view_find_cancel (EV_VIEW (ev_window->priv->view));
 	if (search_string && search_string[0]) {
 		EvFindOptions options = EV_FIND_DEFAULT;
 
@@ -5421,6 +5722,12 @@ ev_window_search_start (EvWindow *ev_window)
 		if (egg_find_bar_get_whole_words_only (find_bar))
 			options |= EV_FIND_WHOLE_WORDS_ONLY;
 		ev_job_find_set_options (EV_JOB_FIND (ev_window->priv->find_job), options);
+		if (previous)
+			ev_job_find_set_previous (EV_JOB_FIND (ev_window->priv->find_job),
+						  EV_JOB_FIND (previous));
+		if (ev_window->priv->text_index)
+			ev_job_find_set_text_index (EV_JOB_FIND (ev_window->priv->find_job),
+						    ev_window->priv->text_index);
 
 		g_signal_connect (ev_window->priv->find_job, "finished",
 				  G_CALLBACK (ev_window_find_job_finished_cb),
@@ -5434,6 +5741,9 @@ ev_window_search_start (EvWindow *ev_window)
 		egg_find_bar_set_status_text (find_bar, NULL);
 		gtk_widget_queue_draw (GTK_WIDGET (ev_window->priv->view));
 	}
+
+	if (previous)
+		g_object_unref (previous);
 }
 
 static void
@@ -5700,6 +6010,8 @@ ev_window_dispose (GObject *object)
 	if (priv->find_job) {
 		ev_window_clear_find_job (window);
 	}
+
+	ev_window_clear_text_index (window);
 	
 	if (priv->local_uri) {
 		ev_window_clear_local_uri (window);
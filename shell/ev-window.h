@@ -71,6 +71,7 @@ struct _EvWindowClass {
 GType		ev_window_get_type	(void) G_GNUC_CONST;
 GtkWidget      *ev_window_new           (void);
 const char     *ev_window_get_uri       (EvWindow       *ev_window);
+gboolean        ev_window_is_document_protected (EvWindow *ev_window);
 void		ev_window_open_uri	(EvWindow       *ev_window,
 					 const char     *uri,
 					 EvLinkDest     *dest,
@@ -0,0 +1,457 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* ev-bench: renders a document without any UI and reports the
+ * latency of every phase as JSON, to catch backend performance
+ * regressions.
+ */
+
+#include <config.h>
+
+#include <evince-document.h>
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+typedef struct {
+	const gchar *name;
+	GArray      *samples; /* gdouble, in milliseconds */
+	guint64      pixels;
+} BenchPhase;
+
+static gchar    *pages_range = NULL;
+static gchar    *scales_list = NULL;
+static gchar    *rotations_list = NULL;
+static gint      iterations = 1;
+static gint      thumbnail_size = 128;
+static gchar    *find_text = NULL;
+static gchar    *output_file = NULL;
+static gchar   **file_arguments = NULL;
+
+static const GOptionEntry goption_options[] = {
+	{ "pages", 'p', 0, G_OPTION_ARG_STRING, &pages_range, "Pages to render, like 1-10 (default: all)", "RANGE" },
+	{ "scales", 's', 0, G_OPTION_ARG_STRING, &scales_list, "Comma separated list of scales (default: 1.0)", "SCALES" },
+	{ "rotations", 'r', 0, G_OPTION_ARG_STRING, &rotations_list, "Comma separated list of rotations (default: 0)", "ROTATIONS" },
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Number of times every operation is repeated (default: 1)", "N" },
+	{ "thumbnail-size", 't', 0, G_OPTION_ARG_INT, &thumbnail_size, "Width of the thumbnails (default: 128)", "SIZE" },
+	{ "find", 'f', 0, G_OPTION_ARG_STRING, &find_text, "Text to search for (default: \"the\")", "TEXT" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file, "Write the report to FILE instead of stdout", "FILE" },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &file_arguments, NULL, "FILE" },
+	{ NULL }
+};
+
+static void
+bench_phase_init (BenchPhase  *phase,
+		  const gchar *name)
+{
+	phase->name = name;
+	phase->samples = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	phase->pixels = 0;
+}
+
+static void
+bench_phase_add_sample (BenchPhase *phase,
+			gint64      start)
+{
+	gdouble ms = (g_get_monotonic_time () - start) / 1000.;
+
+	g_array_append_val (phase->samples, ms);
+}
+
+static gint
+compare_doubles (gconstpointer a,
+		 gconstpointer b)
+{
+	gdouble da = *(const gdouble *)a;
+	gdouble db = *(const gdouble *)b;
+
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/* Nearest rank percentile of the sorted samples */
+static gdouble
+bench_phase_percentile (BenchPhase *phase,
+			guint       percentile)
+{
+	guint rank;
+
+	if (phase->samples->len == 0)
+		return 0;
+
+	rank = (percentile * phase->samples->len + 99) / 100;
+	rank = CLAMP (rank, 1, phase->samples->len);
+
+	return g_array_index (phase->samples, gdouble, rank - 1);
+}
+
+static void
+bench_phase_print (BenchPhase *phase,
+		   GString    *json,
+		   gboolean    last)
+{
+	gdouble total = 0;
+	guint   i;
+
+	g_array_sort (phase->samples, compare_doubles);
+	for (i = 0; i < phase->samples->len; i++)
+		total += g_array_index (phase->samples, gdouble, i);
+
+	g_string_append_printf (json, "    \"%s\": {\n", phase->name);
+	g_string_append_printf (json, "      \"count\": %u,\n", phase->samples->len);
+	g_string_append_printf (json, "      \"total_ms\": %.3f,\n", total);
+	g_string_append_printf (json, "      \"p50_ms\": %.3f,\n", bench_phase_percentile (phase, 50));
+	g_string_append_printf (json, "      \"p95_ms\": %.3f,\n", bench_phase_percentile (phase, 95));
+	g_string_append_printf (json, "      \"p99_ms\": %.3f,\n", bench_phase_percentile (phase, 99));
+	g_string_append_printf (json, "      \"max_ms\": %.3f,\n",
+				phase->samples->len > 0 ?
+				g_array_index (phase->samples, gdouble, phase->samples->len - 1) : 0);
+	if (phase->pixels > 0)
+		g_string_append_printf (json, "      \"megapixels_per_second\": %.3f,\n",
+					total > 0 ? phase->pixels / (total * 1000.) : 0);
+	g_string_append_printf (json, "      \"per_second\": %.3f\n",
+				total > 0 ? phase->samples->len / (total / 1000.) : 0);
+	g_string_append_printf (json, "    }%s\n", last ? "" : ",");
+
+	g_array_free (phase->samples, TRUE);
+}
+
+static void
+append_json_string (GString     *json,
+		    const gchar *str)
+{
+	g_string_append_c (json, '"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			g_string_append_c (json, '\\');
+		if ((guchar)*str < 0x20)
+			g_string_append_printf (json, "\\u%04x", (guchar)*str);
+		else
+			g_string_append_c (json, *str);
+	}
+	g_string_append_c (json, '"');
+}
+
+static glong
+get_peak_rss (void)
+{
+#ifdef G_OS_UNIX
+	struct rusage usage;
+
+	/* In kilobytes on Linux */
+	if (getrusage (RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss;
+#endif
+	return -1;
+}
+
+static GArray *
+parse_double_list (const gchar *list,
+		   gdouble      default_value)
+{
+	GArray  *values;
+	gchar  **items;
+	gint     i;
+
+	values = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	if (!list) {
+		g_array_append_val (values, default_value);
+		return values;
+	}
+
+	items = g_strsplit (list, ",", -1);
+	for (i = 0; items[i]; i++) {
+		gdouble value = g_ascii_strtod (items[i], NULL);
+
+		g_array_append_val (values, value);
+	}
+	g_strfreev (items);
+
+	return values;
+}
+
+static gboolean
+parse_pages_range (const gchar *range,
+		   gint         n_pages,
+		   gint        *first,
+		   gint        *last)
+{
+	gchar *end;
+
+	*first = 0;
+	*last = n_pages - 1;
+	if (!range)
+		return TRUE;
+
+	*first = strtol (range, &end, 10) - 1;
+	*last = *end == '-' ? strtol (end + 1, NULL, 10) - 1 : *first;
+
+	return *first >= 0 && *first <= *last && *last < n_pages;
+}
+
+static void
+bench_render (EvDocument *document,
+	      gint        first,
+	      gint        last,
+	      GArray     *scales,
+	      GArray     *rotations,
+	      BenchPhase *phase)
+{
+	gint  i, it;
+	guint s, r;
+
+	for (it = 0; it < iterations; it++) {
+		for (i = first; i <= last; i++) {
+			EvPage *page = ev_document_get_page (document, i);
+
+			for (s = 0; s < scales->len; s++) {
+				for (r = 0; r < rotations->len; r++) {
+					EvRenderContext *rc;
+					cairo_surface_t *surface;
+					gint64           start;
+
+					rc = ev_render_context_new (page,
+								    (gint) g_array_index (rotations, gdouble, r),
+								    g_array_index (scales, gdouble, s));
+					start = g_get_monotonic_time ();
+					surface = ev_document_render (document, rc);
+					bench_phase_add_sample (phase, start);
+					if (surface) {
+						phase->pixels += cairo_image_surface_get_width (surface) *
+							cairo_image_surface_get_height (surface);
+						cairo_surface_destroy (surface);
+					}
+					g_object_unref (rc);
+				}
+			}
+			g_object_unref (page);
+		}
+	}
+}
+
+static void
+bench_thumbnails (EvDocument *document,
+		  gint        first,
+		  gint        last,
+		  BenchPhase *phase)
+{
+	gint i, it;
+
+	for (it = 0; it < iterations; it++) {
+		for (i = first; i <= last; i++) {
+			EvRenderContext *rc;
+			EvPage          *page;
+			GdkPixbuf       *pixbuf;
+			gdouble          width, height;
+			gint64           start;
+
+			page = ev_document_get_page (document, i);
+			ev_document_get_page_size (document, i, &width, &height);
+			rc = ev_render_context_new (page, 0, thumbnail_size / width);
+			start = g_get_monotonic_time ();
+			pixbuf = ev_document_get_thumbnail (document, rc);
+			bench_phase_add_sample (phase, start);
+			if (pixbuf)
+				g_object_unref (pixbuf);
+			g_object_unref (rc);
+			g_object_unref (page);
+		}
+	}
+}
+
+static void
+bench_text (EvDocument *document,
+	    gint        first,
+	    gint        last,
+	    BenchPhase *phase)
+{
+	gint i, it;
+
+	for (it = 0; it < iterations; it++) {
+		for (i = first; i <= last; i++) {
+			EvPage *page = ev_document_get_page (document, i);
+			gchar  *text;
+			gint64  start;
+
+			start = g_get_monotonic_time ();
+			text = ev_document_text_get_text (EV_DOCUMENT_TEXT (document), page);
+			bench_phase_add_sample (phase, start);
+			g_free (text);
+			g_object_unref (page);
+		}
+	}
+}
+
+static void
+bench_find (EvDocument *document,
+	    gint        first,
+	    gint        last,
+	    BenchPhase *phase)
+{
+	gint i, it;
+
+	for (it = 0; it < iterations; it++) {
+		for (i = first; i <= last; i++) {
+			EvPage *page = ev_document_get_page (document, i);
+			GList  *matches;
+			gint64  start;
+
+			start = g_get_monotonic_time ();
+			matches = ev_document_find_find_text_with_options (EV_DOCUMENT_FIND (document),
+									   page,
+									   find_text ? find_text : "the",
+									   0);
+			bench_phase_add_sample (phase, start);
+			g_list_foreach (matches, (GFunc)ev_rectangle_free, NULL);
+			g_list_free (matches);
+			g_object_unref (page);
+		}
+	}
+}
+
+static void
+print_usage (GOptionContext *context)
+{
+	gchar *help;
+
+	help = g_option_context_get_help (context, TRUE, NULL);
+	g_print ("%s", help);
+	g_free (help);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	EvDocument     *document;
+	GFile          *file;
+	gchar          *uri;
+	GError         *error = NULL;
+	BenchPhase      phases[5];
+	guint           n_phases = 0;
+	GArray         *scales;
+	GArray         *rotations;
+	gint            first, last;
+	gint64          start;
+	GString        *json;
+	guint           i;
+
+	context = g_option_context_new ("- Benchmark document rendering");
+	g_option_context_add_main_entries (context, goption_options, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		print_usage (context);
+		g_option_context_free (context);
+
+		return 1;
+	}
+
+	if (!file_arguments || !file_arguments[0] || iterations < 1 || thumbnail_size < 1) {
+		print_usage (context);
+		g_option_context_free (context);
+
+		return 1;
+	}
+	g_option_context_free (context);
+
+	g_type_init ();
+
+	if (!ev_init ())
+		return 1;
+
+	file = g_file_new_for_commandline_arg (file_arguments[0]);
+	uri = g_file_get_uri (file);
+	g_object_unref (file);
+
+	bench_phase_init (&phases[n_phases], "load");
+	start = g_get_monotonic_time ();
+	document = ev_document_factory_get_document (uri, &error);
+	bench_phase_add_sample (&phases[n_phases++], start);
+	g_free (uri);
+
+	if (!document) {
+		g_printerr ("Error loading document: %s\n", error->message);
+		g_error_free (error);
+		ev_shutdown ();
+
+		return 2;
+	}
+
+	if (!parse_pages_range (pages_range, ev_document_get_n_pages (document), &first, &last)) {
+		g_printerr ("Invalid page range %s\n", pages_range);
+		g_object_unref (document);
+		ev_shutdown ();
+
+		return 1;
+	}
+
+	scales = parse_double_list (scales_list, 1.0);
+	rotations = parse_double_list (rotations_list, 0);
+
+	bench_phase_init (&phases[n_phases], "render");
+	bench_render (document, first, last, scales, rotations, &phases[n_phases++]);
+
+	bench_phase_init (&phases[n_phases], "thumbnail");
+	bench_thumbnails (document, first, last, &phases[n_phases++]);
+
+	if (EV_IS_DOCUMENT_TEXT (document)) {
+		bench_phase_init (&phases[n_phases], "text");
+		bench_text (document, first, last, &phases[n_phases++]);
+	}
+
+	if (EV_IS_DOCUMENT_FIND (document)) {
+		bench_phase_init (&phases[n_phases], "find");
+		bench_find (document, first, last, &phases[n_phases++]);
+	}
+
+	json = g_string_new ("{\n");
+	g_string_append (json, "  \"file\": ");
+	append_json_string (json, file_arguments[0]);
+	g_string_append (json, ",\n");
+	g_string_append_printf (json, "  \"backend\": \"%s\",\n", G_OBJECT_TYPE_NAME (document));
+	g_string_append_printf (json, "  \"n_pages\": %d,\n", ev_document_get_n_pages (document));
+	g_string_append_printf (json, "  \"first_page\": %d,\n", first + 1);
+	g_string_append_printf (json, "  \"last_page\": %d,\n", last + 1);
+	g_string_append_printf (json, "  \"iterations\": %d,\n", iterations);
+	g_string_append (json, "  \"phases\": {\n");
+	for (i = 0; i < n_phases; i++)
+		bench_phase_print (&phases[i], json, i == n_phases - 1);
+	g_string_append (json, "  },\n");
+	g_string_append_printf (json, "  \"peak_rss_kb\": %ld\n", get_peak_rss ());
+	g_string_append (json, "}\n");
+
+	if (output_file) {
+		if (!g_file_set_contents (output_file, json->str, json->len, &error)) {
+			g_printerr ("Error writing report: %s\n", error->message);
+			g_error_free (error);
+		}
+	} else {
+		g_print ("%s", json->str);
+	}
+
+	g_string_free (json, TRUE);
+	g_array_free (scales, TRUE);
+	g_array_free (rotations, TRUE);
+	g_object_unref (document);
+	ev_shutdown ();
+
+	return 0;
+}
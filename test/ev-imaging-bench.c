@@ -0,0 +1,394 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* ev-imaging-bench: times the image operations of ev-document-misc on
+ * a synthetic page, next to the generic cairo and gdk-pixbuf code
+ * doing the same, and reports the median times as JSON.
+ */
+
+#include <config.h>
+
+#include <evince-document.h>
+
+#include <stdlib.h>
+
+typedef void (* BenchFunc) (cairo_surface_t *surface,
+			    GdkPixbuf       *pixbuf);
+
+typedef struct {
+	const gchar *name;
+	BenchFunc    func;
+	BenchFunc    reference;
+} BenchKernel;
+
+static gint   page_width = 1275;
+static gint   page_height = 1650;
+static gint   thumbnail_width = 128;
+static gint   iterations = 20;
+
+static const GOptionEntry goption_options[] = {
+	{ "width", 0, 0, G_OPTION_ARG_INT, &page_width, "Width of the page (default: 1275)", "WIDTH" },
+	{ "height", 0, 0, G_OPTION_ARG_INT, &page_height, "Height of the page (default: 1650)", "HEIGHT" },
+	{ "thumbnail-width", 't', 0, G_OPTION_ARG_INT, &thumbnail_width, "Width of the thumbnails (default: 128)", "WIDTH" },
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Number of times every operation is repeated (default: 20)", "N" },
+	{ NULL }
+};
+
+static void
+draw_text_stripes (cairo_t *cr)
+{
+	gint y;
+
+	cairo_set_source_rgb (cr, 0.1, 0.1, 0.1);
+	for (y = 40; y < page_height - 40; y += 24)
+		cairo_rectangle (cr, 40, y, page_width - 80, 10);
+	cairo_fill (cr);
+}
+
+/* Some text-like stripes and a translucent band, so that both the
+ * opaque and the translucent paths are used
+ */
+static cairo_surface_t *
+create_page (void)
+{
+	cairo_surface_t *surface;
+	cairo_t         *cr;
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, page_width, page_height);
+	cr = cairo_create (surface);
+	cairo_set_source_rgb (cr, 1., 1., 1.);
+	cairo_paint (cr);
+
+	draw_text_stripes (cr);
+
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_rgba (cr, 0.8, 0.2, 0.2, 0.5);
+	cairo_rectangle (cr, 0, page_height / 2, page_width, page_height / 8);
+	cairo_fill (cr);
+	cairo_destroy (cr);
+
+	return surface;
+}
+
+static gint
+thumbnail_height (void)
+{
+	return MAX (page_height * thumbnail_width / page_width, 1);
+}
+
+static void
+invert_surface (cairo_surface_t *surface,
+		GdkPixbuf       *pixbuf)
+{
+	ev_document_misc_invert_surface (surface);
+}
+
+static void
+invert_surface_reference (cairo_surface_t *surface,
+			  GdkPixbuf       *pixbuf)
+{
+	cairo_t *cr = cairo_create (surface);
+
+	cairo_set_operator (cr, CAIRO_OPERATOR_DIFFERENCE);
+	cairo_set_source_rgb (cr, 1., 1., 1.);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+}
+
+static void
+invert_pixbuf (cairo_surface_t *surface,
+	       GdkPixbuf       *pixbuf)
+{
+	ev_document_misc_invert_pixbuf (pixbuf);
+}
+
+static void
+invert_pixbuf_reference (cairo_surface_t *surface,
+			 GdkPixbuf       *pixbuf)
+{
+	guchar *data = gdk_pixbuf_get_pixels (pixbuf);
+	gint    rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	gint    n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	gint    x, y;
+
+	for (y = 0; y < gdk_pixbuf_get_height (pixbuf); y++) {
+		guchar *p = data + y * rowstride;
+
+		for (x = 0; x < gdk_pixbuf_get_width (pixbuf); x++, p += n_channels) {
+			p[0] = 255 - p[0];
+			p[1] = 255 - p[1];
+			p[2] = 255 - p[2];
+		}
+	}
+}
+
+static void
+pixbuf_from_surface (cairo_surface_t *surface,
+		     GdkPixbuf       *pixbuf)
+{
+	g_object_unref (ev_document_misc_pixbuf_from_surface (surface));
+}
+
+static void
+pixbuf_from_surface_reference (cairo_surface_t *surface,
+			       GdkPixbuf       *pixbuf)
+{
+	g_object_unref (gdk_pixbuf_get_from_surface (surface, 0, 0, page_width, page_height));
+}
+
+static void
+surface_from_pixbuf (cairo_surface_t *surface,
+		     GdkPixbuf       *pixbuf)
+{
+	cairo_surface_destroy (ev_document_misc_surface_from_pixbuf (pixbuf));
+}
+
+static void
+surface_from_pixbuf_reference (cairo_surface_t *surface,
+			       GdkPixbuf       *pixbuf)
+{
+	cairo_surface_t *new_surface;
+	cairo_t         *cr;
+
+	new_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, page_width, page_height);
+	cr = cairo_create (new_surface);
+	gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+	cairo_surface_destroy (new_surface);
+}
+
+static void
+rotate_and_scale_reference (cairo_surface_t *surface,
+			    gint             dest_width,
+			    gint             dest_height,
+			    gint             rotation)
+{
+	cairo_surface_t *new_surface;
+	cairo_t         *cr;
+	gint             new_width = rotation % 180 ? dest_height : dest_width;
+	gint             new_height = rotation % 180 ? dest_width : dest_height;
+
+	new_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, new_width, new_height);
+	cr = cairo_create (new_surface);
+	if (rotation == 90)
+		cairo_translate (cr, new_width, 0);
+	cairo_rotate (cr, rotation * G_PI / 180.0);
+	cairo_scale (cr, (gdouble) dest_width / page_width, (gdouble) dest_height / page_height);
+	cairo_set_source_surface (cr, surface, 0, 0);
+	cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_BILINEAR);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+	cairo_surface_destroy (new_surface);
+}
+
+static void
+downscale (cairo_surface_t *surface,
+	   GdkPixbuf       *pixbuf)
+{
+	cairo_surface_destroy (ev_document_misc_surface_rotate_and_scale (surface,
+									  thumbnail_width,
+									  thumbnail_height (),
+									  0));
+}
+
+static void
+downscale_reference (cairo_surface_t *surface,
+		     GdkPixbuf       *pixbuf)
+{
+	rotate_and_scale_reference (surface, thumbnail_width, thumbnail_height (), 0);
+}
+
+static void
+rotate (cairo_surface_t *surface,
+	GdkPixbuf       *pixbuf)
+{
+	cairo_surface_destroy (ev_document_misc_surface_rotate_and_scale (surface,
+									  page_width,
+									  page_height,
+									  90));
+}
+
+static void
+rotate_reference (cairo_surface_t *surface,
+		  GdkPixbuf       *pixbuf)
+{
+	rotate_and_scale_reference (surface, page_width, page_height, 90);
+}
+
+/* Pages rendered like the backends do: over the white background on
+ * an opaque surface, against drawing over a cleared transparent
+ * surface and painting the background below afterwards, which takes
+ * one more pass over the page
+ */
+static void
+page_background (cairo_surface_t *surface,
+		 GdkPixbuf       *pixbuf)
+{
+	cairo_surface_t *page;
+	cairo_t         *cr;
+
+	page = cairo_image_surface_create (CAIRO_FORMAT_RGB24, page_width, page_height);
+	cr = cairo_create (page);
+	cairo_set_source_rgb (cr, 1., 1., 1.);
+	cairo_paint (cr);
+	draw_text_stripes (cr);
+	cairo_destroy (cr);
+	cairo_surface_destroy (page);
+}
+
+static void
+page_background_reference (cairo_surface_t *surface,
+			   GdkPixbuf       *pixbuf)
+{
+	cairo_surface_t *page;
+	cairo_t         *cr;
+
+	page = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, page_width, page_height);
+	cr = cairo_create (page);
+	draw_text_stripes (cr);
+	cairo_set_operator (cr, CAIRO_OPERATOR_DEST_OVER);
+	cairo_set_source_rgb (cr, 1., 1., 1.);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+	cairo_surface_destroy (page);
+}
+
+static const BenchKernel kernels[] = {
+	{ "invert_surface", invert_surface, invert_surface_reference },
+	{ "invert_pixbuf", invert_pixbuf, invert_pixbuf_reference },
+	{ "pixbuf_from_surface", pixbuf_from_surface, pixbuf_from_surface_reference },
+	{ "surface_from_pixbuf", surface_from_pixbuf, surface_from_pixbuf_reference },
+	{ "downscale", downscale, downscale_reference },
+	{ "rotate_90", rotate, rotate_reference },
+	{ "page_background", page_background, page_background_reference }
+};
+
+static gint
+compare_doubles (gconstpointer a,
+		 gconstpointer b)
+{
+	gdouble da = *(const gdouble *)a;
+	gdouble db = *(const gdouble *)b;
+
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/* Median time of the function, in milliseconds */
+static gdouble
+bench_func (BenchFunc        func,
+	    cairo_surface_t *surface,
+	    GdkPixbuf       *pixbuf)
+{
+	gdouble *samples;
+	gdouble  median;
+	gint     i;
+
+	samples = g_new (gdouble, iterations);
+	for (i = 0; i < iterations; i++) {
+		gint64 start = g_get_monotonic_time ();
+
+		func (surface, pixbuf);
+		samples[i] = (g_get_monotonic_time () - start) / 1000.;
+	}
+
+	qsort (samples, iterations, sizeof (gdouble), compare_doubles);
+	median = samples[iterations / 2];
+	g_free (samples);
+
+	return median;
+}
+
+static void
+print_usage (GOptionContext *context)
+{
+	gchar *help;
+
+	help = g_option_context_get_help (context, TRUE, NULL);
+	g_print ("%s", help);
+	g_free (help);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext  *context;
+	GError          *error = NULL;
+	cairo_surface_t *surface;
+	GdkPixbuf       *pixbuf;
+	GString         *json;
+	gdouble          megapixels;
+	guint            i;
+
+	context = g_option_context_new ("- Benchmark image operations");
+	g_option_context_add_main_entries (context, goption_options, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		print_usage (context);
+		g_option_context_free (context);
+
+		return 1;
+	}
+
+	if (page_width < 1 || page_height < 1 || iterations < 1 ||
+	    thumbnail_width < 1 || thumbnail_width > page_width) {
+		print_usage (context);
+		g_option_context_free (context);
+
+		return 1;
+	}
+	g_option_context_free (context);
+
+	g_type_init ();
+
+	surface = create_page ();
+	pixbuf = gdk_pixbuf_get_from_surface (surface, 0, 0, page_width, page_height);
+	megapixels = page_width * page_height / 1000000.;
+
+	json = g_string_new ("{\n");
+	g_string_append_printf (json, "  \"width\": %d,\n", page_width);
+	g_string_append_printf (json, "  \"height\": %d,\n", page_height);
+	g_string_append_printf (json, "  \"iterations\": %d,\n", iterations);
+	g_string_append (json, "  \"kernels\": {\n");
+	for (i = 0; i < G_N_ELEMENTS (kernels); i++) {
+		gdouble ms, reference_ms;
+
+		ms = bench_func (kernels[i].func, surface, pixbuf);
+		reference_ms = bench_func (kernels[i].reference, surface, pixbuf);
+
+		g_string_append_printf (json, "    \"%s\": {\n", kernels[i].name);
+		g_string_append_printf (json, "      \"p50_ms\": %.3f,\n", ms);
+		g_string_append_printf (json, "      \"reference_p50_ms\": %.3f,\n", reference_ms);
+		g_string_append_printf (json, "      \"megapixels_per_second\": %.3f,\n",
+					ms > 0 ? megapixels / (ms / 1000.) : 0);
+		g_string_append_printf (json, "      \"speedup\": %.2f\n",
+					ms > 0 ? reference_ms / ms : 0);
+		g_string_append_printf (json, "    }%s\n",
+					i == G_N_ELEMENTS (kernels) - 1 ? "" : ",");
+	}
+	g_string_append (json, "  }\n");
+	g_string_append (json, "}\n");
+	g_print ("%s", json->str);
+
+	g_string_free (json, TRUE);
+	g_object_unref (pixbuf);
+	cairo_surface_destroy (surface);
+
+	return 0;
+}
@@ -0,0 +1,594 @@
+/* this file is part of evince, a gnome document viewer
+ *
+ * Evince is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Evince is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* ev-imaging-test: checks the image operations of ev-document-misc,
+ * which use the SSE2 or NEON kernels when available, pixel by pixel
+ * against the scalar code or cairo and gdk-pixbuf doing the same.
+ *
+ * Images are filled with opaque, transparent and translucent pixels,
+ * in runs of four so that the vector paths for opaque pixels are taken
+ * too, and sizes include odd widths and tails of less than four pixels.
+ */
+
+#include <config.h>
+
+#include <evince-document.h>
+
+#include <string.h>
+
+static const gint widths[] = { 1, 2, 3, 4, 5, 7, 8, 15, 16, 17, 33, 67 };
+static const gint heights[] = { 1, 2, 3, 17, 35 };
+
+static gint n_failures = 0;
+
+static guint32
+random_pixel (GRand *rand,
+	      gint   kind)
+{
+	guint32 a, r, g, b;
+
+	switch (kind) {
+	case 0:
+		a = 0xff;
+		break;
+	case 1:
+		a = 0;
+		break;
+	default:
+		a = g_rand_int_range (rand, 0, 256);
+		break;
+	}
+
+	/* Premultiplied, so no channel is above alpha */
+	r = a ? g_rand_int_range (rand, 0, a + 1) : 0;
+	g = a ? g_rand_int_range (rand, 0, a + 1) : 0;
+	b = a ? g_rand_int_range (rand, 0, a + 1) : 0;
+
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static cairo_surface_t *
+create_surface (GRand          *rand,
+		cairo_format_t  format,
+		gint            width,
+		gint            height)
+{
+	cairo_surface_t *surface;
+	guchar          *data;
+	gint             stride;
+	gint             x, y;
+
+	surface = cairo_image_surface_create (format, width, height);
+	cairo_surface_flush (surface);
+	data = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+
+	for (y = 0; y < height; y++) {
+		guint32 *p = (guint32 *) (data + y * stride);
+
+		for (x = 0; x < width; x++) {
+			/* Runs of opaque, transparent and random pixels */
+			p[x] = random_pixel (rand, format == CAIRO_FORMAT_RGB24 ? 0 : (x / 4 + y) % 3);
+		}
+	}
+	cairo_surface_mark_dirty (surface);
+
+	return surface;
+}
+
+static GdkPixbuf *
+create_pixbuf (GRand    *rand,
+	       gboolean  has_alpha,
+	       gint      width,
+	       gint      height)
+{
+	GdkPixbuf *pixbuf;
+	guchar    *data;
+	gint       rowstride;
+	gint       n_channels;
+	gint       x, y;
+
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+	data = gdk_pixbuf_get_pixels (pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+
+	for (y = 0; y < height; y++) {
+		guchar *p = data + y * rowstride;
+
+		for (x = 0; x < width; x++, p += n_channels) {
+			gint kind = (x / 4 + y) % 3;
+
+			p[0] = g_rand_int_range (rand, 0, 256);
+			p[1] = g_rand_int_range (rand, 0, 256);
+			p[2] = g_rand_int_range (rand, 0, 256);
+			if (has_alpha)
+				p[3] = kind == 0 ? 0xff : (kind == 1 ? 0 : g_rand_int_range (rand, 0, 256));
+		}
+	}
+
+	return pixbuf;
+}
+
+static cairo_surface_t *
+copy_surface (cairo_surface_t *surface)
+{
+	cairo_surface_t *copy;
+	cairo_t         *cr;
+
+	copy = cairo_image_surface_create (cairo_image_surface_get_format (surface),
+					   cairo_image_surface_get_width (surface),
+					   cairo_image_surface_get_height (surface));
+	cr = cairo_create (copy);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface (cr, surface, 0, 0);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	return copy;
+}
+
+/* Compares two images byte by byte. Only the first mismatch of every
+ * image is reported.
+ */
+static void
+compare_pixels (const gchar  *name,
+		gint          width,
+		gint          height,
+		gint          n_channels,
+		const guchar *data,
+		gint          stride,
+		const guchar *reference,
+		gint          reference_stride)
+{
+	gint x, y, i;
+
+	for (y = 0; y < height; y++) {
+		const guchar *p = data + y * stride;
+		const guchar *r = reference + y * reference_stride;
+
+		for (x = 0; x < width; x++) {
+			for (i = 0; i < n_channels; i++) {
+				gint a = p[x * n_channels + i];
+				gint b = r[x * n_channels + i];
+
+				if (a == b)
+					continue;
+
+				g_printerr ("FAIL %s %dx%d: pixel (%d, %d) channel %d is %d, expected %d\n",
+					    name, width, height, x, y, i, a, b);
+				n_failures++;
+
+				return;
+			}
+		}
+	}
+}
+
+/* Compares two surfaces pixel by pixel, with channels differing by up
+ * to @tolerance
+ */
+static void
+compare_surfaces (const gchar     *name,
+		  cairo_surface_t *surface,
+		  cairo_surface_t *reference,
+		  gint             tolerance)
+{
+	const guchar *data;
+	const guchar *reference_data;
+	gint          stride, reference_stride;
+	gint          width = cairo_image_surface_get_width (surface);
+	gint          height = cairo_image_surface_get_height (surface);
+	guint32       mask;
+	gint          x, y, i;
+
+	if (width != cairo_image_surface_get_width (reference) ||
+	    height != cairo_image_surface_get_height (reference)) {
+		g_printerr ("FAIL %s: size is %dx%d, expected %dx%d\n", name,
+			    width, height,
+			    cairo_image_surface_get_width (reference),
+			    cairo_image_surface_get_height (reference));
+		n_failures++;
+		return;
+	}
+
+	cairo_surface_flush (surface);
+	cairo_surface_flush (reference);
+	data = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+	reference_data = cairo_image_surface_get_data (reference);
+	reference_stride = cairo_image_surface_get_stride (reference);
+
+	/* The unused byte of RGB24 pixels can be anything */
+	mask = cairo_image_surface_get_format (surface) == CAIRO_FORMAT_RGB24 ?
+		0x00ffffff : 0xffffffff;
+
+	for (y = 0; y < height; y++) {
+		const guint32 *p = (const guint32 *) (data + y * stride);
+		const guint32 *r = (const guint32 *) (reference_data + y * reference_stride);
+
+		for (x = 0; x < width; x++) {
+			guint32 a = p[x] & mask;
+			guint32 b = r[x] & mask;
+
+			for (i = 0; i < 4; i++) {
+				gint ca = (a >> (i * 8)) & 0xff;
+				gint cb = (b >> (i * 8)) & 0xff;
+
+				if (ABS (ca - cb) <= tolerance)
+					continue;
+
+				g_printerr ("FAIL %s %dx%d: pixel (%d, %d) is 0x%08x, expected 0x%08x\n",
+					    name, width, height, x, y, a, b);
+				n_failures++;
+
+				return;
+			}
+		}
+	}
+}
+
+static void
+compare_pixbufs (const gchar *name,
+		 GdkPixbuf   *pixbuf,
+		 GdkPixbuf   *reference)
+{
+	if (gdk_pixbuf_get_n_channels (pixbuf) != gdk_pixbuf_get_n_channels (reference)) {
+		g_printerr ("FAIL %s: %d channels, expected %d\n", name,
+			    gdk_pixbuf_get_n_channels (pixbuf),
+			    gdk_pixbuf_get_n_channels (reference));
+		n_failures++;
+		return;
+	}
+
+	compare_pixels (name,
+			gdk_pixbuf_get_width (pixbuf),
+			gdk_pixbuf_get_height (pixbuf),
+			gdk_pixbuf_get_n_channels (pixbuf),
+			gdk_pixbuf_get_pixels (pixbuf),
+			gdk_pixbuf_get_rowstride (pixbuf),
+			gdk_pixbuf_get_pixels (reference),
+			gdk_pixbuf_get_rowstride (reference));
+}
+
+static void
+test_invert_surface (GRand *rand,
+		     gint   width,
+		     gint   height)
+{
+	cairo_surface_t *surface;
+	cairo_surface_t *reference;
+	cairo_surface_t *scalar;
+	cairo_t         *cr;
+	guchar          *data;
+	gint             stride;
+	gint             x, y;
+
+	surface = create_surface (rand, CAIRO_FORMAT_ARGB32, width, height);
+	reference = copy_surface (surface);
+	scalar = copy_surface (surface);
+
+	ev_document_misc_invert_surface (surface);
+
+	/* Painting white with DIFFERENCE, pixman might round differently */
+	cr = cairo_create (reference);
+	cairo_set_operator (cr, CAIRO_OPERATOR_DIFFERENCE);
+	cairo_set_source_rgb (cr, 1., 1., 1.);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+	compare_surfaces ("invert_surface (cairo)", surface, reference, 1);
+
+	cairo_surface_flush (scalar);
+	data = cairo_image_surface_get_data (scalar);
+	stride = cairo_image_surface_get_stride (scalar);
+	for (y = 0; y < height; y++) {
+		guint32 *p = (guint32 *) (data + y * stride);
+
+		for (x = 0; x < width; x++)
+			p[x] = ~p[x] | 0xff000000;
+	}
+	cairo_surface_mark_dirty (scalar);
+	compare_surfaces ("invert_surface", surface, scalar, 0);
+
+	cairo_surface_destroy (surface);
+	cairo_surface_destroy (reference);
+	cairo_surface_destroy (scalar);
+}
+
+static void
+test_invert_pixbuf (GRand    *rand,
+		    gboolean  has_alpha,
+		    gint      width,
+		    gint      height)
+{
+	GdkPixbuf *pixbuf;
+	GdkPixbuf *reference;
+	guchar    *data;
+	gint       rowstride;
+	gint       n_channels;
+	gint       x, y;
+
+	pixbuf = create_pixbuf (rand, has_alpha, width, height);
+	reference = gdk_pixbuf_copy (pixbuf);
+
+	ev_document_misc_invert_pixbuf (pixbuf);
+
+	data = gdk_pixbuf_get_pixels (reference);
+	rowstride = gdk_pixbuf_get_rowstride (reference);
+	n_channels = gdk_pixbuf_get_n_channels (reference);
+	for (y = 0; y < height; y++) {
+		guchar *p = data + y * rowstride;
+
+		for (x = 0; x < width; x++, p += n_channels) {
+			p[0] = 255 - p[0];
+			p[1] = 255 - p[1];
+			p[2] = 255 - p[2];
+		}
+	}
+
+	compare_pixbufs (has_alpha ? "invert_pixbuf (RGBA)" : "invert_pixbuf (RGB)",
+			 pixbuf, reference);
+
+	g_object_unref (pixbuf);
+	g_object_unref (reference);
+}
+
+static void
+test_pixbuf_from_surface (GRand          *rand,
+			  cairo_format_t  format,
+			  gint            width,
+			  gint            height)
+{
+	cairo_surface_t *surface;
+	GdkPixbuf       *pixbuf;
+	GdkPixbuf       *reference;
+
+	surface = create_surface (rand, format, width, height);
+
+	pixbuf = ev_document_misc_pixbuf_from_surface (surface);
+	reference = gdk_pixbuf_get_from_surface (surface, 0, 0, width, height);
+	compare_pixbufs (format == CAIRO_FORMAT_ARGB32 ?
+			 "pixbuf_from_surface (ARGB32)" : "pixbuf_from_surface (RGB24)",
+			 pixbuf, reference);
+
+	g_object_unref (pixbuf);
+	g_object_unref (reference);
+	cairo_surface_destroy (surface);
+}
+
+static void
+test_surface_from_pixbuf (GRand    *rand,
+			  gboolean  has_alpha,
+			  gint      width,
+			  gint      height)
+{
+	GdkPixbuf       *pixbuf;
+	cairo_surface_t *surface;
+	cairo_surface_t *reference;
+	cairo_t         *cr;
+
+	pixbuf = create_pixbuf (rand, has_alpha, width, height);
+
+	surface = ev_document_misc_surface_from_pixbuf (pixbuf);
+
+	reference = cairo_image_surface_create (cairo_image_surface_get_format (surface),
+						width, height);
+	cr = cairo_create (reference);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	compare_surfaces (has_alpha ? "surface_from_pixbuf (RGBA)" : "surface_from_pixbuf (RGB)",
+			  surface, reference, 0);
+
+	g_object_unref (pixbuf);
+	cairo_surface_destroy (surface);
+	cairo_surface_destroy (reference);
+}
+
+/* Area averaging in double precision: every destination pixel is the
+ * mean of the source area it covers
+ */
+static cairo_surface_t *
+downscale_reference (cairo_surface_t *surface,
+		     gint             dest_width,
+		     gint             dest_height)
+{
+	cairo_surface_t *reference;
+	const guchar    *src;
+	guchar          *dest;
+	gint             width, height;
+	gint             src_stride, dest_stride;
+	gdouble          scale_x, scale_y;
+	gint             x, y, sx, sy, i;
+
+	width = cairo_image_surface_get_width (surface);
+	height = cairo_image_surface_get_height (surface);
+	scale_x = (gdouble) width / dest_width;
+	scale_y = (gdouble) height / dest_height;
+
+	reference = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, dest_width, dest_height);
+	cairo_surface_flush (surface);
+	cairo_surface_flush (reference);
+	src = cairo_image_surface_get_data (surface);
+	src_stride = cairo_image_surface_get_stride (surface);
+	dest = cairo_image_surface_get_data (reference);
+	dest_stride = cairo_image_surface_get_stride (reference);
+
+	for (y = 0; y < dest_height; y++) {
+		gdouble y0 = y * scale_y;
+		gdouble y1 = MIN ((y + 1) * scale_y, height);
+
+		for (x = 0; x < dest_width; x++) {
+			gdouble x0 = x * scale_x;
+			gdouble x1 = MIN ((x + 1) * scale_x, width);
+			gdouble sum[4] = { 0, 0, 0, 0 };
+			guint32 pixel = 0;
+
+			for (sy = (gint) y0; sy < y1; sy++) {
+				const guint32 *s = (const guint32 *) (src + sy * src_stride);
+				gdouble        wy = MIN (y1, sy + 1) - MAX (y0, sy);
+
+				for (sx = (gint) x0; sx < x1; sx++) {
+					gdouble wx = MIN (x1, sx + 1) - MAX (x0, sx);
+
+					for (i = 0; i < 4; i++)
+						sum[i] += ((s[sx] >> (i * 8)) & 0xff) * wx * wy;
+				}
+			}
+
+			for (i = 0; i < 4; i++) {
+				gint c = (gint) (sum[i] / (scale_x * scale_y) + 0.5);
+
+				pixel |= (guint32) CLAMP (c, 0, 255) << (i * 8);
+			}
+			((guint32 *) (dest + y * dest_stride))[x] = pixel;
+		}
+	}
+	cairo_surface_mark_dirty (reference);
+
+	return reference;
+}
+
+static void
+test_downscale (GRand *rand,
+		gint   width,
+		gint   height)
+{
+	static const gint divisors[] = { 2, 3, 7 };
+	cairo_surface_t  *surface;
+	guint             i;
+
+	surface = create_surface (rand, CAIRO_FORMAT_ARGB32, width, height);
+
+	for (i = 0; i < G_N_ELEMENTS (divisors); i++) {
+		cairo_surface_t *scaled;
+		cairo_surface_t *reference;
+		gint             dest_width = MAX (width / divisors[i], 1);
+		gint             dest_height = MAX (height / divisors[i], 1);
+
+		if (dest_width == width && dest_height == height)
+			continue;
+
+		scaled = ev_document_misc_surface_rotate_and_scale (surface, dest_width, dest_height, 0);
+		reference = downscale_reference (surface, dest_width, dest_height);
+		/* Weights are floats in the kernels */
+		compare_surfaces ("downscale", scaled, reference, 1);
+
+		cairo_surface_destroy (scaled);
+		cairo_surface_destroy (reference);
+	}
+
+	cairo_surface_destroy (surface);
+}
+
+static void
+test_rotate (GRand *rand,
+	     gint   width,
+	     gint   height)
+{
+	static const gint rotations[] = { 90, 180, 270 };
+	cairo_surface_t  *surface;
+	guint             i;
+
+	surface = create_surface (rand, CAIRO_FORMAT_ARGB32, width, height);
+
+	for (i = 0; i < G_N_ELEMENTS (rotations); i++) {
+		cairo_surface_t *rotated;
+		cairo_surface_t *reference;
+		cairo_t         *cr;
+		gint             rotation = rotations[i];
+		gint             new_width = rotation == 180 ? width : height;
+		gint             new_height = rotation == 180 ? height : width;
+		gchar           *name;
+
+		rotated = ev_document_misc_surface_rotate_and_scale (surface, width, height, rotation);
+
+		/* Quarter turns move pixel centers onto pixel centers,
+		 * so cairo gives the exact pixels
+		 */
+		reference = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, new_width, new_height);
+		cr = cairo_create (reference);
+		switch (rotation) {
+		case 90:
+			cairo_translate (cr, new_width, 0);
+			break;
+		case 180:
+			cairo_translate (cr, new_width, new_height);
+			break;
+		case 270:
+			cairo_translate (cr, 0, new_height);
+			break;
+		}
+		cairo_rotate (cr, rotation * G_PI / 180.0);
+		cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_surface (cr, surface, 0, 0);
+		cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_NEAREST);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+
+		name = g_strdup_printf ("rotate_%d", rotation);
+		compare_surfaces (name, rotated, reference, 0);
+		g_free (name);
+
+		cairo_surface_destroy (rotated);
+		cairo_surface_destroy (reference);
+	}
+
+	cairo_surface_destroy (surface);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GRand *rand;
+	guint  i, j;
+
+	g_type_init ();
+
+	/* Always the same images, so failures can be reproduced */
+	rand = g_rand_new_with_seed (0x45564d47);
+
+	for (i = 0; i < G_N_ELEMENTS (widths); i++) {
+		for (j = 0; j < G_N_ELEMENTS (heights); j++) {
+			gint width = widths[i];
+			gint height = heights[j];
+
+			test_invert_surface (rand, width, height);
+			test_invert_pixbuf (rand, FALSE, width, height);
+			test_invert_pixbuf (rand, TRUE, width, height);
+			test_pixbuf_from_surface (rand, CAIRO_FORMAT_ARGB32, width, height);
+			test_pixbuf_from_surface (rand, CAIRO_FORMAT_RGB24, width, height);
+			test_surface_from_pixbuf (rand, FALSE, width, height);
+			test_surface_from_pixbuf (rand, TRUE, width, height);
+			test_downscale (rand, width, height);
+			test_rotate (rand, width, height);
+		}
+	}
+
+	g_rand_free (rand);
+
+	if (n_failures > 0) {
+		g_printerr ("%d checks failed\n", n_failures);
+		return 1;
+	}
+
+	g_print ("All checks passed\n");
+
+	return 0;
+}
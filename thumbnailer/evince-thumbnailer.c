@@ -21,9 +21,15 @@
 #include <evince-document.h>
 
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
 
 #ifdef G_OS_WIN32
 #include <io.h>
@@ -36,16 +42,23 @@
 
 #define THUMBNAIL_SIZE 128
 #define DEFAULT_SLEEP_TIME (15 * G_USEC_PER_SEC) /* 15 seconds */
+#define DEFAULT_BATCH_JOBS 2
 
 static gboolean finished = TRUE;
 
 static gint size = THUMBNAIL_SIZE;
 static gboolean time_limit = TRUE;
+static gboolean batch = FALSE;
+static gchar *manifest = NULL;
+static gint n_jobs = 0;
 static const gchar **file_arguments;
 
 static const GOptionEntry goption_options[] = {
 	{ "size", 's', 0, G_OPTION_ARG_INT, &size, NULL, "SIZE" },
         { "no-limit", 'l', G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &time_limit, "Don't limit the thumbnailing time to 15 seconds", NULL },
+	{ "batch", 'b', 0, G_OPTION_ARG_NONE, &batch, "Read tab separated <input> <output> pairs from stdin, one per line, and report the results as JSON", NULL },
+	{ "manifest", 'm', 0, G_OPTION_ARG_FILENAME, &manifest, "Read the batch pairs from FILE instead of stdin", "FILE" },
+	{ "jobs", 'j', 0, G_OPTION_ARG_INT, &n_jobs, "Number of files thumbnailed at the same time in batch mode", "N" },
 	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &file_arguments, NULL, "<input> <ouput>" },
 	{ NULL }
 };
@@ -57,6 +70,20 @@ struct AsyncData {
 	gboolean     success;
 };
 
+typedef struct {
+	gchar *input;
+	gchar *output;
+} BatchTask;
+
+/* Batch state: the number of tasks queued or running is bounded, so
+ * that a long manifest doesn't pile up in memory
+ */
+static GMutex batch_mutex;
+static GCond  batch_cond;
+static guint  batch_pending = 0;
+static guint  batch_n_files = 0;
+static guint  batch_n_failed = 0;
+
 /* Time monitor: copied from totem */
 G_GNUC_NORETURN static gpointer
 time_monitor (gpointer data)
@@ -101,12 +128,13 @@ delete_temp_file (GFile *file)
 }
 
 static EvDocument *
-evince_thumbnailer_get_document (GFile *file)
+evince_thumbnailer_get_document (GFile   *file,
+				 GError **error)
 {
 	EvDocument *document = NULL;
 	gchar      *uri;
 	GFile      *tmp_file = NULL;
-	GError     *error = NULL;
+	GError     *err = NULL;
 
 	if (!g_file_is_native (file)) {
 		gchar *base_name, *template;
@@ -115,20 +143,18 @@ evince_thumbnailer_get_document (GFile *file)
 		template = g_strdup_printf ("document.XXXXXX-%s", base_name);
 		g_free (base_name);
 
-		tmp_file = ev_mkstemp_file (template, &error);
+		tmp_file = ev_mkstemp_file (template, &err);
 		g_free (template);
 		if (!tmp_file) {
-			g_printerr ("Error loading remote document: %s\n", error->message);
-			g_error_free (error);
+			g_propagate_prefixed_error (error, err, "Error loading remote document: ");
 
 			return NULL;
 		}
 
 		g_file_copy (file, tmp_file, G_FILE_COPY_OVERWRITE,
-			     NULL, NULL, NULL, &error);
-		if (error) {
-			g_printerr ("Error loading remote document: %s\n", error->message);
-			g_error_free (error);
+			     NULL, NULL, NULL, &err);
+		if (err) {
+			g_propagate_prefixed_error (error, err, "Error loading remote document: ");
 			g_object_unref (tmp_file);
 
 			return NULL;
@@ -138,7 +164,12 @@ evince_thumbnailer_get_document (GFile *file)
 		uri = g_file_get_uri (file);
 	}
 
-	document = ev_document_factory_get_document (uri, &error);
+	/* Only the first page is rendered */
+	ev_document_doc_mutex_lock ();
+	document = ev_document_factory_get_document_full (uri,
+							  EV_DOCUMENT_LOAD_FLAG_NO_CACHE,
+							  &err);
+	ev_document_doc_mutex_unlock ();
 	if (tmp_file) {
 		if (document) {
 			g_object_weak_ref (G_OBJECT (document),
@@ -150,23 +181,19 @@ evince_thumbnailer_get_document (GFile *file)
 		}
 	}
 	g_free (uri);
-	if (error) {
-		if (error->domain == EV_DOCUMENT_ERROR &&
-		    error->code == EV_DOCUMENT_ERROR_ENCRYPTED) {
-			/* FIXME: Create a thumb for cryp docs */
-			g_error_free (error);
-			return NULL;
-		}
-		g_printerr ("Error loading document: %s\n", error->message);
-		g_error_free (error);
+	if (err) {
+		/* Encrypted documents are returned too */
+		if (document)
+			g_object_unref (document);
+		g_propagate_prefixed_error (error, err, "Error loading document: ");
 		return NULL;
 	}
 
 	return document;
 }
 
-static gboolean
-evince_thumbnail_pngenc_get (EvDocument *document, const char *thumbnail, int size)
+static GdkPixbuf *
+evince_thumbnail_get_pixbuf (EvDocument *document, int size)
 {
 	EvRenderContext *rc;
 	double width, height;
@@ -181,7 +208,16 @@ evince_thumbnail_pngenc_get (EvDocument *document, const char *thumbnail, int si
 	pixbuf = ev_document_get_thumbnail (document, rc);
 	g_object_unref (rc);
 	g_object_unref (page);
-	
+
+	return pixbuf;
+}
+
+static gboolean
+evince_thumbnail_pngenc_get (EvDocument *document, const char *thumbnail, int size)
+{
+	GdkPixbuf *pixbuf;
+
+	pixbuf = evince_thumbnail_get_pixbuf (document, size);
 	if (pixbuf != NULL) {
 		if (gdk_pixbuf_save (pixbuf, thumbnail, "png", NULL, NULL)) {
 			g_object_unref  (pixbuf);
@@ -208,6 +244,233 @@ evince_thumbnail_pngenc_get_async (struct AsyncData *data)
 	return NULL;
 }
 
+static void
+append_json_string (GString     *json,
+		    const gchar *str)
+{
+	g_string_append_c (json, '"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			g_string_append_c (json, '\\');
+		if ((guchar)*str < 0x20)
+			g_string_append_printf (json, "\\u%04x", (guchar)*str);
+		else
+			g_string_append_c (json, *str);
+	}
+	g_string_append_c (json, '"');
+}
+
+static void
+batch_task_free (BatchTask *task)
+{
+	g_free (task->input);
+	g_free (task->output);
+	g_slice_free (BatchTask, task);
+}
+
+static void
+batch_report (BatchTask *task,
+	      GError    *error,
+	      gint64     start,
+	      gint64     loaded,
+	      gint64     rendered,
+	      gint64     end)
+{
+	GString *json;
+
+	json = g_string_new ("{\"input\":");
+	append_json_string (json, task->input);
+	g_string_append (json, ",\"output\":");
+	append_json_string (json, task->output ? task->output : "");
+	g_string_append_printf (json, ",\"success\":%s", error ? "false" : "true");
+	if (loaded > 0)
+		g_string_append_printf (json, ",\"load_ms\":%.3f", (loaded - start) / 1000.);
+	if (rendered > 0)
+		g_string_append_printf (json, ",\"render_ms\":%.3f", (rendered - loaded) / 1000.);
+	g_string_append_printf (json, ",\"total_ms\":%.3f", (end - start) / 1000.);
+	if (error) {
+		g_string_append (json, ",\"error\":");
+		append_json_string (json, error->message);
+	}
+	g_string_append (json, "}\n");
+
+	g_mutex_lock (&batch_mutex);
+	fputs (json->str, stdout);
+	fflush (stdout);
+	batch_n_files++;
+	if (error)
+		batch_n_failed++;
+	batch_pending--;
+	g_cond_signal (&batch_cond);
+	g_mutex_unlock (&batch_mutex);
+
+	g_string_free (json, TRUE);
+}
+
+static void
+batch_thumbnail (BatchTask *task,
+		 gpointer   user_data)
+{
+	EvDocument *document;
+	GdkPixbuf  *pixbuf = NULL;
+	GFile      *file;
+	GError     *error = NULL;
+	gint64      start, loaded = 0, rendered = 0;
+
+	start = g_get_monotonic_time ();
+
+	if (!task->output) {
+		g_set_error (&error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+			     "Missing output file");
+		batch_report (task, error, start, 0, 0, g_get_monotonic_time ());
+		g_error_free (error);
+		batch_task_free (task);
+
+		return;
+	}
+
+	file = g_file_new_for_commandline_arg (task->input);
+	document = evince_thumbnailer_get_document (file, &error);
+	g_object_unref (file);
+	loaded = g_get_monotonic_time ();
+
+	if (document) {
+		/* Backends are not thread safe, only the PNG
+		 * encoding runs in parallel
+		 */
+		ev_document_doc_mutex_lock ();
+		pixbuf = evince_thumbnail_get_pixbuf (document, size);
+		g_object_unref (document);
+		ev_document_doc_mutex_unlock ();
+		rendered = g_get_monotonic_time ();
+
+		if (!pixbuf) {
+			g_set_error (&error, EV_DOCUMENT_ERROR, EV_DOCUMENT_ERROR_INVALID,
+				     "Failed to render the thumbnail");
+		} else {
+			gdk_pixbuf_save (pixbuf, task->output, "png", &error, NULL);
+			g_object_unref (pixbuf);
+		}
+	}
+
+	batch_report (task, error, start, loaded, rendered, g_get_monotonic_time ());
+	if (error)
+		g_error_free (error);
+	batch_task_free (task);
+}
+
+/* Returns the next line of @stream without the line break, or %NULL */
+static gchar *
+batch_read_line (FILE *stream)
+{
+	GString *line;
+	gchar    buffer[1024];
+
+	line = g_string_new (NULL);
+	while (fgets (buffer, sizeof (buffer), stream)) {
+		g_string_append (line, buffer);
+		if (line->len > 0 && line->str[line->len - 1] == '\n')
+			break;
+	}
+
+	if (line->len == 0) {
+		g_string_free (line, TRUE);
+		return NULL;
+	}
+
+	while (line->len > 0 &&
+	       (line->str[line->len - 1] == '\n' || line->str[line->len - 1] == '\r'))
+		g_string_truncate (line, line->len - 1);
+
+	return g_string_free (line, FALSE);
+}
+
+static gint
+batch_get_n_jobs (void)
+{
+	if (n_jobs > 0)
+		return n_jobs;
+
+#if defined (G_OS_UNIX) && defined (_SC_NPROCESSORS_ONLN)
+	return MAX (sysconf (_SC_NPROCESSORS_ONLN), 1);
+#else
+	return DEFAULT_BATCH_JOBS;
+#endif
+}
+
+static gint
+batch_run (void)
+{
+	GThreadPool *pool;
+	FILE        *stream;
+	gchar       *line;
+	gint         max_threads;
+	gint64       start;
+	GError      *error = NULL;
+
+	if (manifest) {
+		stream = g_fopen (manifest, "r");
+		if (!stream) {
+			g_printerr ("Error opening manifest %s: %s\n", manifest, g_strerror (errno));
+			return -1;
+		}
+	} else {
+		stream = stdin;
+	}
+
+	start = g_get_monotonic_time ();
+	max_threads = batch_get_n_jobs ();
+	pool = g_thread_pool_new ((GFunc)batch_thumbnail, NULL,
+				  max_threads, TRUE, &error);
+	if (!pool) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		if (stream != stdin)
+			fclose (stream);
+		return -1;
+	}
+
+	while ((line = batch_read_line (stream))) {
+		BatchTask *task;
+		gchar     *separator;
+
+		if (line[0] == '\0' || line[0] == '#') {
+			g_free (line);
+			continue;
+		}
+
+		task = g_slice_new0 (BatchTask);
+		separator = strchr (line, '\t');
+		if (separator) {
+			task->input = g_strndup (line, separator - line);
+			task->output = g_strdup (separator + 1);
+		} else {
+			task->input = g_strdup (line);
+		}
+		g_free (line);
+
+		g_mutex_lock (&batch_mutex);
+		while (batch_pending >= (guint)max_threads * 2)
+			g_cond_wait (&batch_cond, &batch_mutex);
+		batch_pending++;
+		g_mutex_unlock (&batch_mutex);
+
+		g_thread_pool_push (pool, task, NULL);
+	}
+
+	if (stream != stdin)
+		fclose (stream);
+
+	/* Wait for the queued tasks */
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	g_print ("{\"files\":%u,\"failed\":%u,\"total_ms\":%.3f}\n",
+		 batch_n_files, batch_n_failed,
+		 (g_get_monotonic_time () - start) / 1000.);
+
+	return batch_n_failed > 0 ? -2 : 0;
+}
+
 static void
 print_usage (GOptionContext *context)
 {
@@ -240,6 +503,27 @@ main (int argc, char *argv[])
 		return -1;
 	}
 
+	if (batch || manifest) {
+		gint retval;
+
+		g_option_context_free (context);
+
+		if (size < 1) {
+			g_print ("Size cannot be smaller than 1 pixel\n");
+			return -1;
+		}
+
+		g_type_init ();
+
+		if (!ev_init ())
+			return -1;
+
+		retval = batch_run ();
+		ev_shutdown ();
+
+		return retval;
+	}
+
 	input = file_arguments ? file_arguments[0] : NULL;
 	output = input ? file_arguments[1] : NULL;
 	if (!input || !output) {
@@ -265,10 +549,14 @@ main (int argc, char *argv[])
                 return -1;
 
 	file = g_file_new_for_commandline_arg (input);
-	document = evince_thumbnailer_get_document (file);
+	document = evince_thumbnailer_get_document (file, &error);
 	g_object_unref (file);
 
 	if (!document) {
+		/* FIXME: Create a thumb for cryp docs */
+		if (!g_error_matches (error, EV_DOCUMENT_ERROR, EV_DOCUMENT_ERROR_ENCRYPTED))
+			g_printerr ("%s\n", error->message);
+		g_error_free (error);
 		ev_shutdown ();
 		return -2;
 	}